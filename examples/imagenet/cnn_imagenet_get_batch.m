@@ -20,17 +20,41 @@ fetch = numel(images) >= 1 && ischar(images{1}) ;
 % prefetch is used to load images in a separate thread
 prefetch = fetch & opts.prefetch ;
 
+% with a single augmentation per image, vl_imreadjpeg can crop, flip
+% and normalize the images in its reading threads, writing them
+% directly into the batch
+inReader = fetch && opts.numAugments == 1 && opts.keepAspect && ...
+           any(strcmp(opts.transformation, {'none', 'stretch'})) && ...
+           numel(opts.averageImage) <= 3 ;
+
+readerOpts = {'numThreads', opts.numThreads} ;
+if inReader
+  readerOpts = [readerOpts, getReaderAugmentation(opts), {'pack'}] ;
+end
+
 if prefetch
-  vl_imreadjpeg(images, 'numThreads', opts.numThreads, 'prefetch') ;
+  vl_imreadjpeg(images, readerOpts{:}, 'prefetch') ;
   imo = [] ;
   return ;
 end
 if fetch
-  im = vl_imreadjpeg(images,'numThreads', opts.numThreads) ;
+  im = vl_imreadjpeg(images, readerOpts{:}) ;
 else
   im = images ;
 end
 
+if inReader
+  % the images are packed in IMO; those that vl_imreadjpeg cannot read
+  % are left at zero and are read by IMREAD() instead
+  imo = im ;
+  failed = find(all(reshape(imo, [], numel(images)) == 0, 1)) ;
+  for i = failed
+    imt = single(imread(images{i})) ;
+    imo(:,:,:,i) = cnn_imagenet_get_batch({imt}, opts) ;
+  end
+  return ;
+end
+
 tfs = [] ;
 switch opts.transformation
   case 'none'
@@ -127,3 +151,26 @@ for i=1:numel(images)
     si = si + 1 ;
   end
 end
+
+% -------------------------------------------------------------------------
+function args = getReaderAugmentation(opts)
+% -------------------------------------------------------------------------
+% the crop is IMAGESIZE out of IMAGESIZE + BORDER pixels of the shorter
+% side of the image, as when resizing the image and then cropping it
+ratio = min(opts.imageSize(1:2) ./ (opts.imageSize(1:2) + opts.border)) ;
+args = {'resize', opts.imageSize(1:2)} ;
+switch opts.transformation
+  case 'none'
+    args = [args, {'cropSize', ratio}] ;
+  case 'stretch'
+    args = [args, {'cropSize', min(1, ratio * [.9 1.1]), ...
+                   'cropAnisotropy', [.9 1.1], ...
+                   'cropLocation', 'random', ...
+                   'flip'}] ;
+end
+if ~isempty(opts.averageImage)
+  args = [args, {'subtractAverage', double(opts.averageImage)}] ;
+end
+if ~isempty(opts.rgbVariance)
+  args = [args, {'brightness', double(opts.rgbVariance)}] ;
+end
@@ -153,6 +153,32 @@ map
 %%
 save([nnOpts.expDir 'resultsEpochFinalTest.mat'], 'nnOpts', 'stats', 'ap', 'conf');
 
+%%%%%%%%%%%%%
+%% Int8 inference on the CPU
+%%%%%%%%%%%%%
+% Calibrate the convolutional and fully connected layers on a sample of
+% training images and compare accuracy and speed against single precision.
+calvinn.nnOpts.gpus = [];
+calvinn.net.move('cpu');
+time = tic;
+statsFloat = calvinn.test();
+timeFloat = toc(time);
+
+calvinn.calibrateInt8('numImages', 500);
+time = tic;
+statsInt8 = calvinn.test();
+timeInt8 = toc(time);
+
+scoresFloat = cat(1, statsFloat.results.scores);
+scoresInt8 = cat(1, statsInt8.results.scores);
+mapFloat = MeanAveragePrecision(scoresFloat, testLabsAp);
+mapInt8 = MeanAveragePrecision(scoresInt8, testLabsAp);
+numTestIms = size(scoresFloat, 1);
+fprintf('CPU float: mAP %.2f%%, %.1f images/s\n', 100 * mapFloat, numTestIms / timeFloat);
+fprintf('CPU int8:  mAP %.2f%%, %.1f images/s (%.2fx)\n', 100 * mapInt8, numTestIms / timeInt8, timeFloat / timeInt8);
+fprintf('Max score difference: %g\n', max(abs(scoresFloat(:) - scoresInt8(:))));
+save([nnOpts.expDir 'resultsInt8.mat'], 'mapFloat', 'mapInt8', 'timeFloat', 'timeInt8');
+
 if USEGPU
     exit
 end
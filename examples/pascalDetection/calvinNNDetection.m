@@ -206,6 +206,45 @@ end
 %%
 save([nnOpts.expDir 'resultsEpochFinalTest.mat'], 'nnOpts', 'stats', 'ap', 'apRegressed');
 
+%%%%%%%%%%%%%
+%% Truncated SVD of the fully connected layers
+%%%%%%%%%%%%%
+% fc6 and fc7 are evaluated once per box and dominate test time. Compare
+% mAP and speed of the network against its compressed version (Fast R-CNN
+% uses ranks 1024 and 256 for VGG16).
+lowRankRanks = {'fc6', 1024, 'fc7', 256};
+headTime = sum([stats.results.headForwardTime]);
+forwardTime = sum([stats.results.forwardTime]);
+
+calvinn.nnOpts.testLowRank = lowRankRanks;
+statsLowRank = calvinn.test();
+headTimeLowRank = sum([statsLowRank.results.headForwardTime]);
+forwardTimeLowRank = sum([statsLowRank.results.forwardTime]);
+
+clear apLowRank
+for cI = 1:20
+    currBoxes = cell(length(testIms), 1);
+    currScores = cell(length(testIms), 1);
+    for i=1:length(testIms)
+        currBoxes{i} = statsLowRank.results(i).boxes{cI+1};
+        currScores{i} = statsLowRank.results(i).scores{cI+1};
+    end
+    [currBoxes, fileIdx] = Cell2Matrix(gather(currBoxes));
+    currScores = Cell2Matrix(gather(currScores));
+    currFilenames = testIms(fileIdx);
+    [~, sI] = sort(currScores, 'descend');
+    [~, ~, apLowRank(cI,1)] = ...
+        DetectionToPascalVOCFiles(testName, cI, currBoxes(sI,:), currFilenames(sI), currScores(sI), ...
+                                       'FastRcnnMatconvnet', 1, overlapNms);
+end
+
+fprintf('Full:     mAP %.2f%%, forward %.1fs (layers after ROI pooling %.1fs)\n', ...
+    100 * mean(ap), forwardTime, headTime);
+fprintf('Low rank: mAP %.2f%%, forward %.1fs (layers after ROI pooling %.1fs), %.2fx\n', ...
+    100 * mean(apLowRank), forwardTimeLowRank, headTimeLowRank, forwardTime / forwardTimeLowRank);
+save([nnOpts.expDir 'resultsLowRank.mat'], 'lowRankRanks', 'statsLowRank', 'apLowRank', ...
+    'forwardTime', 'headTime', 'forwardTimeLowRank', 'headTimeLowRank');
+
 if USEGPU
     exit
 end
@@ -130,11 +130,16 @@ classdef DagNN < handle
     setLayerOutput(obj, layer, outputs)
     setLayerParams(obj, layer, params)
     renameVar(obj, oldName, newName, varargin)
+    energy = factorizeConv(obj, name, rank)
+    density = sparsifyConv(obj, name, varargin)
+    folded = foldBatchNorm(obj, varargin)
+    fused = fuseBatchNormReLU(obj, varargin)
     rebuild(obj)
 
     % Process data with the DagNN
     initParams(obj)
     eval(obj, inputs, derOutputs)
+    calibrateInt8(obj, getBatch, numBatches, varargin)
 
     % Get information about the DagNN
     varSizes = getVarSizes(obj, inputSizes)
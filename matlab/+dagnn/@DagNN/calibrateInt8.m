@@ -0,0 +1,93 @@
+function calibrateInt8(obj, getBatch, numBatches, varargin)
+%CALIBRATEINT8  Calibrate the convolutional layers for int8 inference
+%   CALIBRATEINT8(OBJ, GETBATCH, NUMBATCHES) evaluates the DagNN OBJ
+%   in test mode on NUMBATCHES batches of data and sets up its
+%   dagnn.Conv layers (including the fully connected ones) to use the
+%   int8 quantized convolution of VL_NNCONV() at test time, on the CPU.
+%   GETBATCH(B) returns the B-th batch as a cell array of input names
+%   and values, as accepted by DagNN.eval(); inputs that are not
+%   variables of the network (e.g. labels) are ignored.
+%
+%   The input of each layer is quantized with a single scale, set from
+%   a high percentile of its absolute values (so that a few outliers do
+%   not use up the quantization range), averaged over the batches. The
+%   filters are quantized with one scale per output channel. The
+%   scales are stored in the `inputScale` and `filterScales`
+%   properties of the layers and saved with the network; set the
+%   `int8` property of a layer to false to use single precision again.
+%
+%   CALIBRATEINT8(..., 'OPT', VAL, ...) accepts the following options:
+%
+%   `Percentile`:: 99.99
+%     Percentile of the absolute values of the input of a layer that
+%     is mapped to the largest quantized value.
+%
+%   `Layers`:: all the dagnn.Conv layers without sparse filters
+%     Cell array with the names of the layers to calibrate.
+%
+%   `MaxNumSamples`:: 1e6
+%     Maximum number of values of each input used to compute the
+%     percentile for a batch.
+
+% Copyright (C) 2016 Andrea Vedaldi.
+% All rights reserved.
+%
+% This file is part of the VLFeat library and is made available under
+% the terms of the BSD license (see the COPYING file).
+
+opts.percentile = 99.99 ;
+opts.layers = {} ;
+opts.maxNumSamples = 1e6 ;
+opts = vl_argparse(opts, varargin) ;
+
+if isempty(opts.layers)
+  sel = find(arrayfun(@(l) isa(l.block, 'dagnn.Conv') && ...
+                   ~issparse(obj.params(l.paramIndexes(1)).value), obj.layers)) ;
+else
+  sel = obj.getLayerIndex(opts.layers) ;
+  if any(isnan(sel)), error('Unknown layer in LAYERS.') ; end
+end
+in = arrayfun(@(l) obj.layers(l).inputIndexes(1), sel) ;
+
+% evaluate the network in single precision, keeping the layer inputs
+for l = sel, obj.layers(l).block.int8 = false ; end
+mode = obj.mode ;
+precious = [obj.vars(in).precious] ;
+obj.mode = 'test' ;
+[obj.vars(in).precious] = deal(true) ;
+
+ranges = zeros(1, numel(sel)) ;
+for b = 1:numBatches
+  inputs = getBatch(b) ;
+  known = ~isnan(obj.getVarIndex(inputs(1:2:end))) ;
+  inputs = inputs(reshape([known ; known], 1, [])) ;
+  obj.eval(inputs) ;
+  for i = 1:numel(sel)
+    ranges(i) = ranges(i) + getRange(obj.vars(in(i)).value, opts) / numBatches ;
+  end
+end
+
+obj.mode = mode ;
+for i = 1:numel(in)
+  obj.vars(in(i)).precious = precious(i) ;
+end
+
+% set the scales
+for i = 1:numel(sel)
+  block = obj.layers(sel(i)).block ;
+  w = obj.params(obj.layers(sel(i)).paramIndexes(1)).value ;
+  w = gather(reshape(w, [], size(w,4))) ;
+  block.inputScale = ranges(i) / 127 ;
+  block.filterScales = single(max(abs(w), [], 1)' / 127) ;
+  block.int8 = true ;
+end
+
+% -------------------------------------------------------------------------
+function r = getRange(x, opts)
+% -------------------------------------------------------------------------
+x = abs(gather(x(:))) ;
+if numel(x) > opts.maxNumSamples
+  x = x(round(linspace(1, numel(x), opts.maxNumSamples))) ;
+end
+x = sort(x) ;
+r = double(x(max(1, round(numel(x) * opts.percentile / 100)))) ;
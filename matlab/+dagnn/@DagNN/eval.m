@@ -57,6 +57,13 @@ function eval(obj, inputs, derOutputs)
 %     `obj.conserveMemory` property of the DaG to `false`. It is also
 %     possible to preserve individual variables by setting the
 %     property `obj.vars(v).precious` to `true`.
+%
+%   * In `test` mode and when no derivatives are requested, a
+%     convolution followed by a ReLU whose output is used only by the
+%     latter is computed in a single call to VL_NNCONV() with the
+%     `ReLU` option. The intermediate variable is not computed in
+%     this case, unless it is precious or `obj.conserveMemory` is
+%     `false`.
 
 % Copyright (C) 2015 Karel Lenc and Andrea Vedaldi.
 % All rights reserved.
@@ -83,9 +90,20 @@ end
 inputs = [] ;
 
 obj.numPendingVarRefs = [obj.vars.fanout] ;
+if strcmp(obj.mode, 'test') && ~obj.computingDerivative
+  fusedReLU = findConvReLU(obj) ;
+else
+  fusedReLU = zeros(1, numel(obj.layers)) ;
+end
 for l = obj.executionOrder
   time = tic ;
-  obj.layers(l).block.forwardAdvanced(obj.layers(l)) ;
+  if fusedReLU(l) > 0
+    obj.layers(l).block.forwardAdvancedReLU(obj.layers(l), obj.layers(fusedReLU(l))) ;
+  elseif fusedReLU(l) < 0
+    % computed together with the preceding convolution
+  else
+    obj.layers(l).block.forwardAdvanced(obj.layers(l)) ;
+  end
   obj.layers(l).forwardTime = toc(time) ;
 end
 
@@ -107,3 +125,26 @@ for l = fliplr(obj.executionOrder)
   obj.layers(l).block.backwardAdvanced(obj.layers(l)) ;
   obj.layers(l).backwardTime = toc(time) ;
 end
+
+% -------------------------------------------------------------------------
+function fusedReLU = findConvReLU(obj)
+% -------------------------------------------------------------------------
+% FUSEDRELU(L) is the index of the ReLU layer merged into the Conv
+% layer L, or minus the index of the Conv layer if L is such a ReLU.
+
+fusedReLU = zeros(1, numel(obj.layers)) ;
+if ~obj.conserveMemory, return ; end
+consumer = zeros(1, numel(obj.vars)) ;
+for l = 1:numel(obj.layers)
+  consumer(obj.layers(l).inputIndexes) = l ;
+end
+for l = 1:numel(obj.layers)
+  if ~strcmp(class(obj.layers(l).block), 'dagnn.Conv'), continue ; end
+  v = obj.layers(l).outputIndexes ;
+  if numel(v) ~= 1 || obj.vars(v).fanout ~= 1 || obj.vars(v).precious, continue ; end
+  r = consumer(v) ;
+  if r == 0 || ~isa(obj.layers(r).block, 'dagnn.ReLU'), continue ; end
+  if obj.layers(r).block.leak ~= 0 || ~isempty(obj.layers(r).block.opts), continue ; end
+  fusedReLU(l) = r ;
+  fusedReLU(r) = -l ;
+end
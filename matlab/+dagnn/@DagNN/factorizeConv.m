@@ -0,0 +1,103 @@
+function energy = factorizeConv(obj, name, rank)
+%FACTORIZECONV  Replace a convolutional layer by a low-rank factorization
+%   ENERGY = FACTORIZECONV(OBJ, NAME, RANK) replaces the dagnn.Conv
+%   layer NAME of the DagNN OBJ with two layers computing a rank RANK
+%   approximation of it, obtained from the truncated SVD of its
+%   filter bank W, reshaped as a VOLUME x NUMFILTERS matrix:
+%
+%     W ~ U(:,1:RANK) * S(1:RANK,1:RANK) * V(:,1:RANK)'.
+%
+%   The first layer, NAME_L, has the same filter support, padding and
+%   stride as the original one, RANK filters U * S and no biases.
+%   The second layer, NAME_U, is a 1 x 1 convolution with filters V'
+%   and the biases of the original layer. The original output
+%   variable is preserved, so that the rest of the network is
+%   unaffected.
+%
+%   The cost of evaluating the layer becomes proportional to
+%   RANK * (VOLUME + NUMFILTERS) instead of VOLUME * NUMFILTERS. This
+%   is mostly useful for the fully connected layers of Fast R-CNN,
+%   which are evaluated once for each region proposal.
+%
+%   ENERGY is the fraction of the squared singular values retained by
+%   the approximation, which can be used to select RANK.
+%
+%   The new layers use single precision; if the original layer was
+%   set up for int8 inference, DagNN.calibrateInt8() must be run
+%   again.
+
+% Copyright (C) 2016 Andrea Vedaldi.
+% All rights reserved.
+%
+% This file is part of the VLFeat library and is made available under
+% the terms of the BSD license (see the COPYING file).
+
+l = obj.getLayerIndex(name) ;
+if isnan(l), error('There is no layer ''%s''.', name) ; end
+layer = obj.layers(l) ;
+block = layer.block ;
+if ~isa(block, 'dagnn.Conv')
+  error('Layer ''%s'' is not a dagnn.Conv layer.', name) ;
+end
+
+params = obj.params(layer.paramIndexes) ;
+w = params(1).value ;
+if issparse(w), w = reshape(single(full(w)), block.size) ; end
+sz = [size(w) 1 1 1] ;
+sz = sz(1:4) ;
+volume = prod(sz(1:3)) ;
+if rank < 1 || rank > min(volume, sz(4)) || rank ~= round(rank)
+  error('RANK must be an integer between 1 and %d.', min(volume, sz(4))) ;
+end
+
+% factorize the filter bank
+isGpu = isa(w, 'gpuArray') ;
+w = gather(w) ;
+dataType = class(w) ;
+[u,s,v] = svd(double(reshape(w, volume, sz(4))), 'econ') ;
+s = diag(s) ;
+energy = sum(s(1:rank).^2) / sum(s.^2) ;
+w1 = cast(reshape(bsxfun(@times, u(:,1:rank), s(1:rank)'), [sz(1:3) rank]), dataType) ;
+w2 = cast(reshape(v(:,1:rank)', [1 1 rank sz(4)]), dataType) ;
+if isGpu
+  w1 = gpuArray(w1) ;
+  w2 = gpuArray(w2) ;
+end
+
+% replace the layer
+nameL = [name '_L'] ;
+nameU = [name '_U'] ;
+obj.removeLayer(name) ;
+
+obj.addLayer(nameL, ...
+  dagnn.Conv('size', [sz(1:3) rank], 'hasBias', false, ...
+             'pad', block.pad, 'stride', block.stride, ...
+             'dilate', block.dilate, 'opts', block.opts), ...
+  layer.inputs, {nameL}, {[nameL 'f']}) ;
+
+paramsU = {[nameU 'f']} ;
+if block.hasBias && numel(params) > 1
+  paramsU{2} = [nameU 'b'] ;
+end
+obj.addLayer(nameU, ...
+  dagnn.Conv('size', [1 1 rank sz(4)], 'hasBias', numel(paramsU) > 1, ...
+             'opts', block.opts), ...
+  {nameL}, layer.outputs, paramsU) ;
+
+% set the parameters, inheriting the learning rates of the original ones
+p = obj.getParamIndex([nameL 'f']) ;
+obj.params(p).value = w1 ;
+obj.params(p).learningRate = params(1).learningRate ;
+obj.params(p).weightDecay = params(1).weightDecay ;
+
+p = obj.getParamIndex([nameU 'f']) ;
+obj.params(p).value = w2 ;
+obj.params(p).learningRate = params(1).learningRate ;
+obj.params(p).weightDecay = params(1).weightDecay ;
+
+if numel(paramsU) > 1
+  p = obj.getParamIndex(paramsU{2}) ;
+  obj.params(p).value = params(2).value ;
+  obj.params(p).learningRate = params(2).learningRate ;
+  obj.params(p).weightDecay = params(2).weightDecay ;
+end
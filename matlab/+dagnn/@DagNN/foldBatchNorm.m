@@ -0,0 +1,126 @@
+function folded = foldBatchNorm(obj, varargin)
+%FOLDBATCHNORM  Fold batch normalization layers into convolutions
+%   FOLDED = FOLDBATCHNORM(OBJ) removes the dagnn.BatchNorm layers of
+%   the DagNN OBJ that directly follow a dagnn.Conv layer, absorbing
+%   them into the filters and biases of the latter. FOLDED is a cell
+%   array with the names of the removed layers.
+%
+%   In test mode, batch normalization with multipliers G, biases B
+%   and moments [MU SIGMA] is the affine function
+%
+%     Y(:,:,K,:) = G(K) * (X(:,:,K,:) - MU(K)) / SIGMA(K) + B(K),
+%
+%   so that if X is the output of a convolution with filters W and
+%   biases C the two layers can be replaced by a single convolution
+%   with filters G(K)/SIGMA(K) * W(:,:,:,K) and biases
+%   G(K)/SIGMA(K) * (C(K) - MU(K)) + B(K). This saves a pass over the
+%   data of each layer. The output variable of the batch
+%   normalization layer is preserved, so that the rest of the network
+%   is unaffected.
+%
+%   A layer is folded only if the output of the convolution is not
+%   used by any other layer, is not precious, and the parameters of
+%   either layer are not shared with other layers. The folded network
+%   only computes the same function in test mode and should only be
+%   used for inference.
+%
+%   FOLDBATCHNORM(..., 'OPT', VAL, ...) accepts the following options:
+%
+%   `Layers`:: all the dagnn.BatchNorm layers
+%     Cell array with the names of the batch normalization layers to
+%     fold.
+
+% Copyright (C) 2016 Andrea Vedaldi.
+% All rights reserved.
+%
+% This file is part of the VLFeat library and is made available under
+% the terms of the BSD license (see the COPYING file).
+
+opts.layers = {} ;
+opts = vl_argparse(opts, varargin) ;
+
+if isempty(opts.layers)
+  sel = arrayfun(@(l) isa(l.block, 'dagnn.BatchNorm'), obj.layers) ;
+  opts.layers = {obj.layers(sel).name} ;
+end
+
+folded = {} ;
+for i = 1:numel(opts.layers)
+  name = opts.layers{i} ;
+  l = obj.getLayerIndex(name) ;
+  if isnan(l), error('There is no layer ''%s''.', name) ; end
+  bn = obj.layers(l) ;
+  if ~isa(bn.block, 'dagnn.BatchNorm')
+    error('Layer ''%s'' is not a dagnn.BatchNorm layer.', name) ;
+  end
+
+  % check that the layer can be folded
+  v = bn.inputIndexes(1) ;
+  if obj.vars(v).fanin ~= 1 || obj.vars(v).fanout ~= 1 || obj.vars(v).precious
+    continue ;
+  end
+  c = find(arrayfun(@(x) any(x.outputIndexes == v), obj.layers)) ;
+  conv = obj.layers(c) ;
+  if ~isa(conv.block, 'dagnn.Conv') || numel(conv.outputIndexes) ~= 1 || ...
+      numel(bn.paramIndexes) ~= 3 || ...
+      any([obj.params([conv.paramIndexes bn.paramIndexes]).fanout] > 1)
+    continue ;
+  end
+
+  % compute the folded filters and biases
+  w = obj.params(conv.paramIndexes(1)).value ;
+  isGpu = isa(w, 'gpuArray') ;
+  w = gather(w) ;
+  dataType = class(w) ;
+  if issparse(w)
+    % sparse filters are DOUBLE, but the biases are in the data class
+    dataType = class(gather(obj.params(bn.paramIndexes(2)).value)) ;
+  end
+  g = double(gather(obj.params(bn.paramIndexes(1)).value(:))) ;
+  b = double(gather(obj.params(bn.paramIndexes(2)).value(:))) ;
+  moments = double(gather(obj.params(bn.paramIndexes(3)).value)) ;
+  scale = g ./ moments(:,2) ;
+
+  hasBias = conv.block.hasBias && numel(conv.paramIndexes) > 1 ;
+  if hasBias
+    biasParam = conv.paramIndexes(2) ;
+    c0 = double(gather(obj.params(biasParam).value(:))) ;
+  else
+    biasParam = bn.paramIndexes(2) ;
+    c0 = zeros(size(scale)) ;
+  end
+  bias = scale .* (c0 - moments(:,1)) + b ;
+
+  if issparse(w)
+    % sparse filters are a VOLUME x NUMFILTERS matrix
+    w = w * spdiags(scale, 0, numel(scale), numel(scale)) ;
+  else
+    w = cast(bsxfun(@times, double(w), reshape(scale, 1, 1, 1, [])), dataType) ;
+  end
+  bias = cast(reshape(bias, size(obj.params(biasParam).value)), dataType) ;
+  if isGpu
+    w = gpuArray(w) ;
+    bias = gpuArray(bias) ;
+  end
+
+  % quantization scales of the filters scale as well
+  if ~isempty(conv.block.filterScales)
+    conv.block.filterScales = cast(conv.block.filterScales(:) .* abs(scale), ...
+                                   class(conv.block.filterScales)) ;
+  end
+
+  % update the parameters of the convolution, reusing the ones of the
+  % batch normalization for the biases if needed
+  obj.params(conv.paramIndexes(1)).value = w ;
+  obj.params(biasParam).value = bias ;
+  if ~hasBias
+    conv.block.hasBias = true ;
+    obj.setLayerParams(conv.name, {conv.params{1}, bn.params{2}}) ;
+  end
+
+  % remove the batch normalization layer and connect the convolution
+  % to its output
+  obj.removeLayer(name) ;
+  obj.renameVar(conv.outputs{1}, bn.outputs{1}, 'quiet', true) ;
+  folded{end+1} = name ;
+end
@@ -100,6 +100,9 @@ for l = 1:numel(net.layers)
           block.size = sz ;
           block.pad = net.layers{l}.pad ;
           block.stride = net.layers{l}.stride ;
+          if isfield(net.layers{l}, 'dilate')
+            block.dilate = net.layers{l}.dilate ;
+          end
         case 'convt'
           block = ConvTranspose() ;
           block.size = sz ;
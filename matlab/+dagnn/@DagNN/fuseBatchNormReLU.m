@@ -0,0 +1,68 @@
+function fused = fuseBatchNormReLU(obj, varargin)
+%FUSEBATCHNORMRELU  Merge ReLU layers into the preceding batch normalization
+%   FUSED = FUSEBATCHNORMRELU(OBJ) removes the dagnn.ReLU layers of the
+%   DagNN OBJ that directly follow a dagnn.BatchNorm layer, setting
+%   the `relu` property of the latter instead. FUSED is a cell array
+%   with the names of the removed layers.
+%
+%   The merged layer calls VL_NNBNORM() with the `ReLU` option, which
+%   rectifies the data in the same pass as batch normalization. In
+%   training on the CPU, the forward pass also returns a mask with one
+%   bit per output element that is used by the backward pass, so that
+%   the output of batch normalization before the ReLU is never stored.
+%   The output variable of the ReLU layer is preserved, so that the
+%   rest of the network is unaffected.
+%
+%   A layer is merged only if the output of the batch normalization
+%   is not used by any other layer and is not precious, and the ReLU
+%   has no leak.
+%
+%   FUSEBATCHNORMRELU(..., 'OPT', VAL, ...) accepts the following
+%   options:
+%
+%   `Layers`:: all the dagnn.ReLU layers
+%     Cell array with the names of the ReLU layers to merge.
+
+% Copyright (C) 2016 Andrea Vedaldi.
+% All rights reserved.
+%
+% This file is part of the VLFeat library and is made available under
+% the terms of the BSD license (see the COPYING file).
+
+opts.layers = {} ;
+opts = vl_argparse(opts, varargin) ;
+
+if isempty(opts.layers)
+  sel = arrayfun(@(l) isa(l.block, 'dagnn.ReLU'), obj.layers) ;
+  opts.layers = {obj.layers(sel).name} ;
+end
+
+fused = {} ;
+for i = 1:numel(opts.layers)
+  name = opts.layers{i} ;
+  l = obj.getLayerIndex(name) ;
+  if isnan(l), error('There is no layer ''%s''.', name) ; end
+  relu = obj.layers(l) ;
+  if ~isa(relu.block, 'dagnn.ReLU')
+    error('Layer ''%s'' is not a dagnn.ReLU layer.', name) ;
+  end
+
+  % check that the layer can be merged
+  if relu.block.leak ~= 0, continue ; end
+  v = relu.inputIndexes(1) ;
+  if obj.vars(v).fanin ~= 1 || obj.vars(v).fanout ~= 1 || obj.vars(v).precious
+    continue ;
+  end
+  b = find(arrayfun(@(x) any(x.outputIndexes == v), obj.layers)) ;
+  bn = obj.layers(b) ;
+  if ~isa(bn.block, 'dagnn.BatchNorm') || bn.block.relu
+    continue ;
+  end
+
+  % remove the ReLU layer and connect the batch normalization to its
+  % output
+  bn.block.relu = true ;
+  obj.removeLayer(name) ;
+  obj.renameVar(bn.outputs{1}, relu.outputs{1}, 'quiet', true) ;
+  fused{end+1} = name ;
+end
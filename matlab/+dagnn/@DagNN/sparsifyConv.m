@@ -0,0 +1,69 @@
+function density = sparsifyConv(obj, name, varargin)
+%SPARSIFYCONV  Store the filters of a fully connected layer as a sparse matrix
+%   DENSITY = SPARSIFYCONV(OBJ, NAME) replaces the filter bank W of the
+%   dagnn.Conv layer NAME of the DagNN OBJ with a sparse DOUBLE matrix
+%   SPARSE(RESHAPE(W, VOLUME, NUMFILTERS)), which VL_NNCONV() evaluates
+%   with a sparse matrix product. This only stores the zeros of W
+%   implicitly; use the options below to prune W by magnitude first.
+%   DENSITY is the fraction of nonzero weights left.
+%
+%   The layer must be fully connected, i.e. the filters must have the
+%   same size as the input and no padding, stride or dilation, and
+%   the network must be evaluated on the CPU in test mode, as sparse
+%   filters are not supported in the backward mode. The layer can no
+%   longer use int8 inference.
+%
+%   Since the weights are read once for each group of columns of the
+%   data (e.g. region proposals), this is faster than the dense
+%   product only if most of the weights are zero (density below
+%   10-20%). Enabling the `FilterCache` option of VL_NNCONV() halves
+%   the memory traffic by keeping the weights in a compact format.
+%
+%   SPARSIFYCONV(..., 'OPT', VAL, ...) accepts the following options:
+%
+%   `Threshold`:: 0
+%     Weights whose absolute value is not larger than this are set
+%     to zero.
+%
+%   `Sparsity`:: 0
+%     Fraction of the weights with the smallest absolute value set to
+%     zero.
+
+% Copyright (C) 2016 Andrea Vedaldi.
+% All rights reserved.
+%
+% This file is part of the VLFeat library and is made available under
+% the terms of the BSD license (see the COPYING file).
+
+opts.threshold = 0 ;
+opts.sparsity = 0 ;
+opts = vl_argparse(opts, varargin) ;
+
+l = obj.getLayerIndex(name) ;
+if isnan(l), error('There is no layer ''%s''.', name) ; end
+block = obj.layers(l).block ;
+if ~isa(block, 'dagnn.Conv')
+  error('Layer ''%s'' is not a dagnn.Conv layer.', name) ;
+end
+if any(block.pad ~= 0) || any(block.stride ~= 1) || any(block.dilate ~= 1)
+  error('Layer ''%s'' has padding, stride or dilation.', name) ;
+end
+
+p = obj.layers(l).paramIndexes(1) ;
+w = obj.params(p).value ;
+numFilters = block.size(4) ;
+w = double(reshape(gather(full(w)), [], numFilters)) ;
+
+% prune the smallest weights
+threshold = opts.threshold ;
+if opts.sparsity > 0
+  a = sort(abs(w(:))) ;
+  threshold = max(threshold, a(max(1, round(numel(a) * opts.sparsity)))) ;
+end
+if threshold > 0
+  w(abs(w) <= threshold) = 0 ;
+end
+
+obj.params(p).value = sparse(w) ;
+block.int8 = false ;
+density = nnz(w) / numel(w) ;
@@ -1,20 +1,45 @@
 classdef BatchNorm < dagnn.ElementWise
   properties
     numChannels
+    relu = false
+  end
+
+  properties (Transient)
+    mask = []
   end
 
   methods
     function outputs = forward(obj, inputs, params)
+      opts = {} ;
+      if obj.relu, opts = {'relu'} ; end
+      obj.mask = [] ;
       if strcmp(obj.net.mode, 'test')
-        outputs{1} = vl_nnbnorm(inputs{1}, params{1}, params{2}, 'moments', params{3}) ;
+        outputs{1} = vl_nnbnorm(inputs{1}, params{1}, params{2}, 'moments', params{3}, opts{:}) ;
+      elseif obj.relu && ~isa(inputs{1}, 'gpuArray')
+        % keep the ReLU mask for the backward pass
+        [outputs{1}, ~, obj.mask] = vl_nnbnorm(inputs{1}, params{1}, params{2}, opts{:}) ;
       else
-        outputs{1} = vl_nnbnorm(inputs{1}, params{1}, params{2}) ;
+        outputs{1} = vl_nnbnorm(inputs{1}, params{1}, params{2}, opts{:}) ;
       end
     end
 
     function [derInputs, derParams] = backward(obj, inputs, params, derOutputs)
+      derOutput = derOutputs{1} ;
+      opts = {} ;
+      if obj.relu
+        if isa(inputs{1}, 'gpuArray')
+          % the GPU code does not support the ReLU derivatives
+          y = vl_nnbnorm(inputs{1}, params{1}, params{2}) ;
+          derOutput = derOutput .* (y > 0) ;
+        elseif ~isempty(obj.mask)
+          opts = {'relu', 'mask', obj.mask} ;
+        else
+          opts = {'relu'} ;
+        end
+        obj.mask = [] ;
+      end
       [derInputs{1}, derParams{1}, derParams{2}, derParams{3}] = ...
-        vl_nnbnorm(inputs{1}, params{1}, params{2}, derOutputs{1}) ;
+        vl_nnbnorm(inputs{1}, params{1}, params{2}, derOutput, opts{:}) ;
       % multiply the moments update by the number of images in the batch
       % this is required to make the update additive for subbatches
       % and will eventually be normalized away
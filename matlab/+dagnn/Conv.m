@@ -2,16 +2,23 @@ classdef Conv < dagnn.Filter
   properties
     size = [0 0 0 0]
     hasBias = true
+    dilate = [1 1]
     opts = {'cuDNN'}
+    int8 = false
+    inputScale = []
+    filterScales = []
   end
 
   methods
     function outputs = forward(obj, inputs, params)
       if ~obj.hasBias, params{2} = [] ; end
+      int8Opts = obj.getInt8Options(inputs{1}) ;
       outputs{1} = vl_nnconv(...
         inputs{1}, params{1}, params{2}, ...
         'pad', obj.pad, ...
         'stride', obj.stride, ...
+        'dilate', obj.dilate, ...
+        int8Opts{:}, ...
         obj.opts{:}) ;
     end
 
@@ -21,11 +28,64 @@ classdef Conv < dagnn.Filter
         inputs{1}, params{1}, params{2}, derOutputs{1}, ...
         'pad', obj.pad, ...
         'stride', obj.stride, ...
+        'dilate', obj.dilate, ...
         obj.opts{:}) ;
     end
 
+    function forwardAdvancedReLU(obj, layer, reluLayer)
+    %FORWARDADVANCEDRELU  Forward step fused with the following ReLU
+    %  FORWARDADVANCEDRELU(OBJ, LAYER, RELULAYER) computes the output
+    %  of the ReLU layer RELULAYER, whose only input is the output of
+    %  LAYER, using the `ReLU` option of VL_NNCONV(). The output of
+    %  the convolution itself is not stored. DagNN.eval() uses this at
+    %  test time.
+
+      in = layer.inputIndexes ;
+      par = layer.paramIndexes ;
+      net = obj.net ;
+
+      x = net.vars(in).value ;
+      if isempty(x), return ; end
+
+      net.numPendingVarRefs(in) = net.numPendingVarRefs(in) - 1 ;
+      if net.numPendingVarRefs(in) == 0 & ~net.vars(in).precious
+        net.vars(in).value = [] ;
+      end
+      net.numPendingVarRefs(reluLayer.inputIndexes) = 0 ;
+
+      params = {net.params(par).value} ;
+      if ~obj.hasBias, params{2} = [] ; end
+      int8Opts = obj.getInt8Options(x) ;
+      net.vars(reluLayer.outputIndexes).value = vl_nnconv(...
+        x, params{1}, params{2}, ...
+        'pad', obj.pad, ...
+        'stride', obj.stride, ...
+        'dilate', obj.dilate, ...
+        'relu', ...
+        int8Opts{:}, ...
+        obj.opts{:}) ;
+    end
+
+    function opts = getInt8Options(obj, x)
+    %GETINT8OPTIONS  VL_NNCONV() options for int8 inference
+    %  The layer uses the int8 quantized convolution if `int8` is true,
+    %  the network is in test mode, and the data is a single precision
+    %  CPU array. `inputScale` and `filterScales` are set by
+    %  DagNN.calibrateInt8(); if empty, they are computed on the fly.
+      opts = {} ;
+      if obj.int8 && ~isempty(obj.net) && strcmp(obj.net.mode, 'test') && isa(x, 'single')
+        inputScale = obj.inputScale ;
+        if isempty(inputScale), inputScale = 0 ; end
+        opts = {'int8', 'inputScale', inputScale} ;
+        if ~isempty(obj.filterScales)
+          opts = [opts {'filterScales', obj.filterScales}] ;
+        end
+      end
+    end
+
     function kernelSize = getKernelSize(obj)
-      kernelSize = obj.size(1:2) ;
+      % a dilated filter spans a larger window than its size
+      kernelSize = (obj.size(1:2) - 1) .* obj.dilate + 1 ;
     end
 
     function outputSizes = getOutputSizes(obj, inputSizes)
@@ -47,6 +107,14 @@ classdef Conv < dagnn.Filter
       obj.size = ksize(1:4) ;
     end
 
+    function set.dilate(obj, dilate)
+      if numel(dilate) == 1
+        obj.dilate = [dilate dilate] ;
+      else
+        obj.dilate = dilate ;
+      end
+    end
+
     function obj = Conv(varargin)
       obj.load(varargin) ;
       % normalize field by implicitly calling setters defined in
@@ -54,6 +122,7 @@ classdef Conv < dagnn.Filter
       obj.size = obj.size ;
       obj.stride = obj.stride ;
       obj.pad = obj.pad ;
+      obj.dilate = obj.dilate ;
     end
   end
 end
@@ -2,12 +2,14 @@ classdef RoiPooling < dagnn.Layer
     % Region of interest pooling layer.
     %
     % inputs are: convIm, oriImSize, boxes
-    %   convIm:     height x width x channels x 1
+    %   convIm:     height x width x channels x 1, single or uint16 (half
+    %               precision, see vl_tohalf)
     %   oriImSize:  1 x 3
     %   boxes:      1 x 1 x 4 x boxCount [x1, y1, x2, y2]
     %
     % outputs are: rois, masks
-    %   rois:       poolSizeY x poolSizeX x channelCount x boxCount
+    %   rois:       poolSizeY x poolSizeX x channelCount x boxCount, same
+    %               class as convIm
     %   masks:      poolSizeY x poolSizeX x channelCount x boxCount
     %
     % Copyright by Holger Caesar, 2015
@@ -73,6 +75,14 @@ classdef RoiPooling < dagnn.Layer
                 dzdy = gather(dzdy);
             end;
             
+            % Return derivatives in the class of convIm (half precision
+            % derivatives are summed in single precision by the MEX file)
+            if isa(convIm, 'uint16') && ~isa(dzdy, 'uint16')
+                dzdy = vl_tohalf(dzdy);
+            elseif ~isa(convIm, 'uint16') && isa(dzdy, 'uint16')
+                dzdy = vl_fromhalf(dzdy);
+            end
+            
             % Backpropagate derivatives (only works on CPU)
             dzdx = roiPooling_backward(boxCount, convImSize, obj.poolSize, obj.mask, dzdy);
             
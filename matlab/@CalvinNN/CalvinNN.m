@@ -46,6 +46,9 @@ classdef CalvinNN < handle
         saveState(obj, fileName);
         train(obj);
         results = test(obj);
+        calibrateInt8(obj, varargin);
+        compressFullyConnected(obj, varargin);
+        sparsifyFullyConnected(obj, varargin);
     end
     
     methods (Access = protected)
@@ -0,0 +1,37 @@
+function calibrateInt8(obj, varargin)
+% calibrateInt8(obj, varargin)
+%
+% Calibrate the network for int8 inference on the CPU.
+% - Runs the network in test mode on a random sample of imdb images
+% - Stores the quantization scales in the convolutional and fully
+%   connected layers (see dagnn.DagNN.calibrateInt8), so that they are
+%   saved with the network
+% - Afterwards, test() uses int8 whenever the network runs on the CPU
+%
+% Options:
+% - numImages: number of images in the sample (default 500)
+% - datasetMode: part of the imdb to sample from (default 'train')
+% - percentile: see dagnn.DagNN.calibrateInt8 (default 99.99)
+%
+% Copyright by Holger Caesar, 2016
+
+opts.numImages = 500;
+opts.datasetMode = 'train';
+opts.percentile = 99.99;
+opts = vl_argparse(opts, varargin);
+
+% Sample the images
+prevDatasetMode = obj.imdb.datasetMode;
+obj.imdb.setDatasetMode(opts.datasetMode);
+allBatchInds = obj.imdb.getAllBatchInds();
+allBatchInds = allBatchInds(randperm(numel(allBatchInds), min(opts.numImages, numel(allBatchInds))));
+
+% Calibrate on batches of the usual size
+batchSize = obj.nnOpts.batchSize;
+numBatches = ceil(numel(allBatchInds) / batchSize);
+getBatch = @(b) obj.imdb.getBatch(allBatchInds((b-1)*batchSize+1 : min(b*batchSize, numel(allBatchInds))), obj.net, obj.nnOpts);
+obj.net.calibrateInt8(getBatch, numBatches, 'percentile', opts.percentile);
+
+if ~isempty(prevDatasetMode)
+    obj.imdb.setDatasetMode(prevDatasetMode);
+end
@@ -0,0 +1,27 @@
+function compressFullyConnected(obj, varargin)
+% compressFullyConnected(obj, varargin)
+%
+% Replace fully connected layers by a truncated SVD of their weights.
+% - Takes pairs of layer names and ranks, e.g. ('fc6', 1024, 'fc7', 256)
+% - Each layer is replaced by two layers <name>_L and <name>_U (see
+%   dagnn.DagNN.factorizeConv), which is the Fast R-CNN test time speed-up
+% - Layers that were already compressed are skipped
+% - Prints the fraction of the weight energy kept for each layer
+%
+% The layers of obj.net are replaced in place. The compressed network is
+% only meant for testing: test() calls this function with
+% nnOpts.testLowRank on a copy of obj.net, so the trained weights are kept.
+%
+% Copyright by Holger Caesar, 2016
+
+assert(mod(numel(varargin), 2) == 0, 'Error: Arguments must be pairs of layer names and ranks!');
+
+for i = 1 : 2 : numel(varargin)
+    layerName = varargin{i};
+    rank = varargin{i+1};
+    if isnan(obj.net.getLayerIndex(layerName)) && ~isnan(obj.net.getLayerIndex([layerName '_L']))
+        continue;
+    end
+    energy = obj.net.factorizeConv(layerName, rank);
+    fprintf('Compressed layer %s to rank %d (%.1f%% of the energy kept)\n', layerName, rank, 100 * energy);
+end
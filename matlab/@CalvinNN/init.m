@@ -22,6 +22,8 @@ defnnOpts.extractStatsFn = @CalvinNN.extractStats;
 defnnOpts.testFn = @(imdb, nnOpts, net, inputs, batchInds) error('Error: Test function not implemented'); % function used at test time to evaluate performance
 defnnOpts.misc = struct(); % fields used by custom layers are stored here
 defnnOpts.plotEval = true;
+defnnOpts.testSparsity = {}; % pairs of layer names and fractions of pruned weights, e.g. {'fc6', 0.9}: sparse weights at test time
+defnnOpts.testLowRank = {}; % pairs of layer names and ranks, e.g. {'fc6', 1024, 'fc7', 256}: truncated SVD of those layers at test time
 
 % Fast R-CNN options
 defnnOpts.convertToTrain = true;
@@ -0,0 +1,30 @@
+function sparsifyFullyConnected(obj, varargin)
+% sparsifyFullyConnected(obj, varargin)
+%
+% Prune fully connected layers and store their weights as sparse matrices.
+% - Takes pairs of layer names and sparsities, e.g. ('fc6', 0.9, 'fc7', 0.9)
+% - The given fraction of the weights with the smallest magnitude is set to
+%   zero and the rest is stored as a sparse matrix (see
+%   dagnn.DagNN.sparsifyConv), which vl_nnconv evaluates with a sparse
+%   matrix product
+% - Layers that are already sparse are skipped
+% - Prints the fraction of the weights that are kept for each layer
+%
+% The layers of obj.net are replaced in place. The sparse network is only
+% meant for testing on the CPU: test() calls this function with
+% nnOpts.testSparsity on a copy of obj.net, so the trained weights are kept.
+%
+% Copyright by Holger Caesar, 2016
+
+assert(mod(numel(varargin), 2) == 0, 'Error: Arguments must be pairs of layer names and sparsities!');
+
+for i = 1 : 2 : numel(varargin)
+    layerName = varargin{i};
+    sparsity = varargin{i+1};
+    layerIdx = obj.net.getLayerIndex(layerName);
+    if ~isnan(layerIdx) && issparse(obj.net.params(obj.net.layers(layerIdx).paramIndexes(1)).value)
+        continue;
+    end
+    density = obj.net.sparsifyConv(layerName, 'sparsity', sparsity);
+    fprintf('Pruned layer %s (%.1f%% of the weights kept)\n', layerName, 100 * density);
+end
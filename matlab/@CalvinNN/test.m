@@ -5,6 +5,10 @@ function results = test(obj)
 % - Does a single processing of an epoch for testing
 % - Uses the nnOpts.testFn function for the testing
 % - Automatically changes softmaxloss to softmax, removes hinge loss. Other losses are not yet supported
+% - Prunes the layers in nnOpts.testSparsity and stores them as sparse matrices
+% - Replaces the layers in nnOpts.testLowRank by their truncated SVD
+% - Pruning and SVD are applied to a copy of the network; obj.net keeps the
+%   original weights
 %
 % Copyright by Jasper Uijlings, 2015
 % Modified by Holger Caesar, 2016
@@ -34,15 +38,33 @@ if ~isnan(hingeLossIdx)
     obj.net.renameVar(finalLayerOutputName, 'scores');
 end
 
+% Compress fully connected layers of a copy of the network
+net = obj.net;
+testSparsity = isfield(obj.nnOpts, 'testSparsity') && ~isempty(obj.nnOpts.testSparsity);
+testLowRank = isfield(obj.nnOpts, 'testLowRank') && ~isempty(obj.nnOpts.testLowRank);
+if testSparsity || testLowRank
+    trainedNet = obj.net;
+    obj.net = dagnn.DagNN.loadobj(trainedNet.saveobj());
+    if testSparsity
+        obj.sparsifyFullyConnected(obj.nnOpts.testSparsity{:});
+    end
+    if testLowRank
+        obj.compressFullyConnected(obj.nnOpts.testLowRank{:});
+    end
+    net = obj.net;
+    obj.net = trainedNet;
+end
+
 % Set datasetMode in imdb
 datasetMode = 'test';
 obj.net.mode = datasetMode; % Disable dropout
+net.mode = datasetMode;
 obj.imdb.setDatasetMode(datasetMode);
 state.epoch = 1;
 state.allBatchInds = obj.imdb.getAllBatchInds();
 
 % Process the epoch
-obj.stats.(datasetMode) = obj.process_epoch(obj.net, state);
+obj.stats.(datasetMode) = obj.process_epoch(net, state);
 
 % The stats are the desired results
 results = obj.stats.(datasetMode);
\ No newline at end of file
@@ -5,6 +5,8 @@ function [results] = testDetection(imdb, nnOpts, net, inputs, ~)
 % Only gets top nnOpts.maxNumBoxesPerImTest boxes (default: 5000)
 % Only gets boxes with score higher than nnOpts.minDetectionScore (default: 0.01)
 % NMS threshold: nnOpts.nmsTTest (default: 0.3)
+% Also returns the forward time of the network (forwardTime) and of the
+% layers after ROI pooling, which run once per box (headForwardTime)
 
 % Variables which should probably be in imdb.nnOpts or something
 % Jasper: Probably need to do something more robust here
@@ -84,4 +86,14 @@ for cI = size(scores,2) : -1 : 1
         results.boxesRegressed{cI} = gather(currBoxesReg);
         results.scoresRegressed{cI} = gather(currScoresRegressed);
     end
-end
\ No newline at end of file
+end
+
+% Get forward times
+order = net.executionOrder;
+times = arrayfun(@(l) sum(net.layers(l).forwardTime), order);
+roiPoolPos = find(arrayfun(@(l) isa(net.layers(l).block, 'dagnn.RoiPooling'), order), 1);
+if isempty(roiPoolPos)
+    roiPoolPos = numel(order);
+end
+results.forwardTime = sum(times);
+results.headForwardTime = sum(times(roiPoolPos+1:end));
@@ -1,11 +1,16 @@
 #include <cmath>
+#include <vector>
 #include "mex.h"
 #include "matrix.h"
+#include "../src/bits/data.hpp"
 
 /*
  * dzdx = roiPooling_backward(boxCount, convImSize, roiPoolSize, masks, dzdy);
  *
  * Sum the gradients that are backpropagated through the ROI pooling layer.
+ * dzdy can also be a UINT16 array of half precision numbers (see vl_tohalf).
+ * The sums are then accumulated in single precision and dzdx is returned
+ * in half precision as well.
  *
  * Copyright by Holger Caesar, 2015
  */
@@ -42,8 +47,8 @@ void mexFunction(int nlhs, mxArray *out[], int nrhs, const mxArray *input[])
     if (!mxIsSingle(masksMx)){
         mexErrMsgTxt("Error: masks must be single!");
     }
-    if (!mxIsSingle(dzdyMx)) {
-        mexErrMsgTxt("Error: dzdy must be single!");
+    if (!mxIsSingle(dzdyMx) && !mxIsUint16(dzdyMx)) {
+        mexErrMsgTxt("Error: dzdy must be single or uint16 (half)!");
     }
     if (    mxGetNumberOfDimensions(masksMx) != mxGetNumberOfDimensions(dzdyMx) ||
             masksDims[0] != dzdyDims[0] ||
@@ -57,7 +62,8 @@ void mexFunction(int nlhs, mxArray *out[], int nrhs, const mxArray *input[])
     double* convImSize = (double*) mxGetData(convImSizeMx);
     double* roiPoolSize = (double*) mxGetData(roiPoolSizeMx);
     float* masks = (float*) mxGetData(masksMx);
-    float* dzdy = (float*) mxGetData(dzdyMx);
+    const bool isHalf = mxIsUint16(dzdyMx);
+    const void* dzdyData = mxGetData(dzdyMx);
     
     int roiPoolSizeY = roiPoolSize[0];
     int roiPoolSizeX = roiPoolSize[1];
@@ -71,8 +77,17 @@ void mexFunction(int nlhs, mxArray *out[], int nrhs, const mxArray *input[])
     dzdxSize[0] = convImSizeY;
     dzdxSize[1] = convImSizeX;
     dzdxSize[2] = channelCount;
-    out[0] = mxCreateNumericArray(3, dzdxSize, mxSINGLE_CLASS, mxREAL);
-    float* dzdx = (float*) mxGetData(out[0]);
+    out[0] = mxCreateNumericArray(3, dzdxSize, mxGetClassID(dzdyMx), mxREAL);
+    
+    // Half precision derivatives are summed in a single precision buffer
+    std::vector<float> dzdxBuffer;
+    float* dzdx;
+    if (isHalf) {
+        dzdxBuffer.resize(convImSizeY * convImSizeX * channelCount, 0);
+        dzdx = &dzdxBuffer[0];
+    } else {
+        dzdx = (float*) mxGetData(out[0]);
+    }
     
     for (int boxIdx = 0; boxIdx < boxCount; boxIdx++) {
         for (int regionIdxY = 0; regionIdxY < roiPoolSizeY; regionIdxY++) {
@@ -87,10 +102,18 @@ void mexFunction(int nlhs, mxArray *out[], int nrhs, const mxArray *input[])
                         // Sum over all RoIs that max-pooled x in the forward pass:
                         // dzdx(convImgY, convImgX, channelIdx) = dzdx(convImgY, convImgX, channelIdx) + dzdy(regionIdxY, regionIdxX, channelIdx, boxIdx);
                         int dzdxIdx = convImgIdxNoChannel + channelIdx * convImSizeY * convImSizeX;
-                        dzdx[dzdxIdx] = dzdx[dzdxIdx] + dzdy[masksIdx];
+                        float dzdyValue = isHalf ? vl::halfBitsToFloat(((const unsigned short*) dzdyData)[masksIdx]) : ((const float*) dzdyData)[masksIdx];
+                        dzdx[dzdxIdx] = dzdx[dzdxIdx] + dzdyValue;
                     }
                 }
             }
         }
     }
+    
+    if (isHalf) {
+        unsigned short* dzdxHalf = (unsigned short*) mxGetData(out[0]);
+        for (size_t i = 0; i < dzdxBuffer.size(); i++) {
+            dzdxHalf[i] = vl::floatToHalfBits(dzdxBuffer[i]);
+        }
+    }
 }
\ No newline at end of file
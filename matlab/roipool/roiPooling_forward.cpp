@@ -1,16 +1,29 @@
 #include <cmath>
 #include <algorithm>
 #include "mex.h"
+#include "../src/bits/data.hpp"
 
 /*
  * [rois, masks] = roiPooling_forward(convIm, oriImSize, boxes, poolSize);
  *
  * ROI pool a convolutional image into spatial bins for each box and channel.
+ * convIm can also be a UINT16 array of half precision numbers (see
+ * vl_tohalf). The maxima are then found in single precision and rois is
+ * returned in half precision as well.
  *
  * Copyright by Jasper Uijlings, 2015
  * Modified by Holger Caesar, 2015
  */
 
+// Read element index of a single or half precision (UINT16) array
+static inline float getValue(const void* data, bool isHalf, int index)
+{
+    if (isHalf) {
+        return vl::halfBitsToFloat(((const unsigned short*) data)[index]);
+    }
+    return ((const float*) data)[index];
+}
+
 void mexFunction(int nlhs, mxArray *out[], int nrhs, const mxArray *input[])
 {
     if (nlhs == 0) {
@@ -27,8 +40,8 @@ void mexFunction(int nlhs, mxArray *out[], int nrhs, const mxArray *input[])
     const mxArray* poolSizeMx = input[3];
     
     // Check inputs
-    if (!mxIsSingle(convImMx) || mxGetNumberOfDimensions(convImMx) != 3) {
-        mexErrMsgTxt("Error: convIm must be single with format height x width x channelCount!");
+    if (!(mxIsSingle(convImMx) || mxIsUint16(convImMx)) || mxGetNumberOfDimensions(convImMx) != 3) {
+        mexErrMsgTxt("Error: convIm must be single or uint16 (half) with format height x width x channelCount!");
     }
     if (!mxIsDouble(oriImSizeMx) || mxGetNumberOfDimensions(oriImSizeMx) != 2 || mxGetM(oriImSizeMx) != 1 || mxGetN(oriImSizeMx) != 3) {
         mexErrMsgTxt("Error: oriImSize must be double with format 1 x 3!");
@@ -41,7 +54,8 @@ void mexFunction(int nlhs, mxArray *out[], int nrhs, const mxArray *input[])
     }
     
     // Get arrays
-    float* convIm     = (float*)  mxGetData(convImMx);
+    const bool isHalf = mxIsUint16(convImMx);
+    const void* convIm = mxGetData(convImMx);
     double* oriImSize = (double*) mxGetData(oriImSizeMx);
     float* boxes      = (float*)  mxGetData(boxesMx);
     double* poolSize  = (double*) mxGetData(poolSizeMx);
@@ -66,8 +80,8 @@ void mexFunction(int nlhs, mxArray *out[], int nrhs, const mxArray *input[])
     roisSize[1] = poolSizeX;
     roisSize[2] = channelCount;
     roisSize[3] = boxCount;
-    out[0] = mxCreateNumericArray(4, roisSize, mxSINGLE_CLASS, mxREAL);
-    float* rois = (float*) mxGetData(out[0]);
+    out[0] = mxCreateNumericArray(4, roisSize, mxGetClassID(convImMx), mxREAL);
+    void* rois = mxGetData(out[0]);
     float* masks;
 
     if (nlhs >= 2) {
@@ -132,7 +146,8 @@ void mexFunction(int nlhs, mxArray *out[], int nrhs, const mxArray *input[])
                 for(int channelIdx = 0; channelIdx < channelCount; channelIdx++) {
                     roisIndex = poolIdxY + poolIdxX * poolSizeY + channelIdx * poolNumel + boxIdx * poolNumel * channelCount;
                     
-                    // Init maximum coordinate
+                    // Init maximum and its coordinate
+                    float maxValue = 0;
                     maxConvImIndexNoChannel = -1;
                     
                     // Find maximum
@@ -141,12 +156,18 @@ void mexFunction(int nlhs, mxArray *out[], int nrhs, const mxArray *input[])
                             convImIndexNoChannel = convImYIdx + convImXIdx * convImSizeY;
                             convImIndex = convImIndexNoChannel + channelIdx * convImSizeY * convImSizeX;
                             
-                            if (convIm[convImIndex] > rois[roisIndex]){
-                                rois[roisIndex] = convIm[convImIndex];
+                            float value = getValue(convIm, isHalf, convImIndex);
+                            if (value > maxValue){
+                                maxValue = value;
                                 maxConvImIndexNoChannel = convImIndexNoChannel;
                             }
                         }
                     }
+                    if (isHalf) {
+                        ((unsigned short*) rois)[roisIndex] = vl::floatToHalfBits(maxValue);
+                    } else {
+                        ((float*) rois)[roisIndex] = maxValue;
+                    }
                     
                     // Create the mask for backpropagation that tells us which value in each
                     // pooling region of the conv image was the highest.
@@ -0,0 +1,254 @@
+// @file convtuner.cpp
+// @brief CPU convolution algorithm selection
+// @author Andrea Vedaldi
+
+/*
+Copyright (C) 2016 Andrea Vedaldi.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#include "convtuner.hpp"
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+using namespace vl ;
+
+/* ---------------------------------------------------------------- */
+/*                                                          Helpers */
+/* ---------------------------------------------------------------- */
+
+static char const * algoNames [] = {
+  "im2row",
+  "direct1x1",
+  "auto"
+} ;
+
+char const *
+vl::getConvolutionAlgoName(ConvolutionAlgo algo)
+{
+  if (algo < vlConvolutionAlgoIm2row || algo > vlConvolutionAlgoAuto) {
+    return "unknown" ;
+  }
+  return algoNames[algo] ;
+}
+
+static bool
+getConvolutionAlgoByName(char const * name, ConvolutionAlgo & algo)
+{
+  for (int i = 0 ; i < vlConvolutionAlgoNum ; ++i) {
+    if (strcmp(name, algoNames[i]) == 0) {
+      algo = (ConvolutionAlgo)i ;
+      return true ;
+    }
+  }
+  return false ;
+}
+
+/* ---------------------------------------------------------------- */
+/*                                             ConvolutionSignature */
+/* ---------------------------------------------------------------- */
+
+vl::ConvolutionSignature::ConvolutionSignature()
+{
+  memset(fields, 0, sizeof(fields)) ;
+}
+
+vl::ConvolutionSignature::ConvolutionSignature(Tensor const & data,
+                                               Tensor const & filters,
+                                               int strideY, int strideX,
+                                               int dilateY, int dilateX,
+                                               int padTop, int padBottom,
+                                               int padLeft, int padRight,
+                                               int numThreads)
+{
+  size_t * f = fields ;
+  *f++ = data.getHeight() ;
+  *f++ = data.getWidth() ;
+  *f++ = data.getDepth() ;
+  *f++ = data.getSize() ;
+  *f++ = filters.getHeight() ;
+  *f++ = filters.getWidth() ;
+  *f++ = filters.getDepth() ;
+  *f++ = filters.getSize() ;
+  *f++ = strideY ;
+  *f++ = strideX ;
+  *f++ = dilateY ;
+  *f++ = dilateX ;
+  *f++ = padTop ;
+  *f++ = padBottom ;
+  *f++ = padLeft ;
+  *f++ = padRight ;
+  *f++ = numThreads ;
+  *f++ = data.getDataType() ;
+}
+
+std::string
+vl::ConvolutionSignature::toString() const
+{
+  std::ostringstream str ;
+  for (int i = 0 ; i < numFields ; ++i) {
+    if (i > 0) { str << ' ' ; }
+    str << fields[i] ;
+  }
+  return str.str() ;
+}
+
+bool
+vl::ConvolutionSignature::fromStream(std::istream & stream)
+{
+  for (int i = 0 ; i < numFields ; ++i) {
+    if (!(stream >> fields[i])) { return false ; }
+  }
+  return true ;
+}
+
+bool
+vl::operator < (ConvolutionSignature const & a, ConvolutionSignature const & b)
+{
+  for (int i = 0 ; i < ConvolutionSignature::numFields ; ++i) {
+    if (a.fields[i] != b.fields[i]) { return a.fields[i] < b.fields[i] ; }
+  }
+  return false ;
+}
+
+/* ---------------------------------------------------------------- */
+/*                                                 ConvolutionTuner */
+/* ---------------------------------------------------------------- */
+
+vl::ConvolutionTuner::ConvolutionTuner()
+: algo(vlConvolutionAlgoIm2row), cacheLoaded(false)
+{ }
+
+void
+vl::ConvolutionTuner::setAlgo(ConvolutionAlgo algo_)
+{
+  algo = algo_ ;
+}
+
+vl::ConvolutionAlgo
+vl::ConvolutionTuner::getAlgo() const
+{
+  return algo ;
+}
+
+void
+vl::ConvolutionTuner::setCachePath(std::string const & path)
+{
+  if (path != cachePath) {
+    cachePath = path ;
+    cacheLoaded = false ;
+  }
+}
+
+std::string const &
+vl::ConvolutionTuner::getCachePath() const
+{
+  return cachePath ;
+}
+
+size_t
+vl::ConvolutionTuner::getNumEntries() const
+{
+  return choices.size() ;
+}
+
+void
+vl::ConvolutionTuner::clear()
+{
+  choices.clear() ;
+  cacheLoaded = false ;
+}
+
+bool
+vl::ConvolutionTuner::lookup(ConvolutionSignature const & signature,
+                             ConvolutionAlgo & algo)
+{
+  if (!cacheLoaded) { load() ; }
+  Choices::const_iterator iter = choices.find(signature) ;
+  if (iter == choices.end()) { return false ; }
+  algo = iter->second ;
+  return true ;
+}
+
+void
+vl::ConvolutionTuner::store(ConvolutionSignature const & signature,
+                            ConvolutionAlgo algo)
+{
+  choices[signature] = algo ;
+  append(signature, algo) ;
+}
+
+/*
+ The cache file is a text file with one entry per line. Each entry
+ is the list of signature fields followed by the name of the
+ selected algorithm. Lines that cannot be parsed are skipped, so that
+ a file written by a version with different algorithms is harmless.
+ Failing to read or write the file is not an error: in this case
+ choices are simply not persistent.
+ */
+
+void
+vl::ConvolutionTuner::load()
+{
+  cacheLoaded = true ;
+  if (cachePath.empty()) { return ; }
+  FILE * fp = fopen(cachePath.c_str(), "r") ;
+  if (fp == NULL) { return ; }
+  char line [1024] ;
+  while (fgets(line, sizeof(line), fp)) {
+    if (line[0] == '#') { continue ; }
+    std::istringstream stream(line) ;
+    ConvolutionSignature signature ;
+    ConvolutionAlgo algo ;
+    std::string name ;
+    if (signature.fromStream(stream) &&
+        (stream >> name) &&
+        getConvolutionAlgoByName(name.c_str(), algo)) {
+      choices[signature] = algo ;
+    }
+  }
+  fclose(fp) ;
+}
+
+void
+vl::ConvolutionTuner::append(ConvolutionSignature const & signature,
+                             ConvolutionAlgo algo)
+{
+  if (cachePath.empty()) { return ; }
+  FILE * fp = fopen(cachePath.c_str(), "a") ;
+  if (fp == NULL) { return ; }
+  fprintf(fp, "%s %s\n",
+          signature.toString().c_str(),
+          getConvolutionAlgoName(algo)) ;
+  fclose(fp) ;
+}
+
+/* ---------------------------------------------------------------- */
+/*                                                            Timer */
+/* ---------------------------------------------------------------- */
+
+double
+vl::ConvolutionTuner::getTime()
+{
+#if defined(_WIN32)
+  LARGE_INTEGER frequency ;
+  LARGE_INTEGER counter ;
+  QueryPerformanceFrequency(&frequency) ;
+  QueryPerformanceCounter(&counter) ;
+  return (double)counter.QuadPart / (double)frequency.QuadPart ;
+#else
+  struct timeval time ;
+  gettimeofday(&time, NULL) ;
+  return time.tv_sec + 1e-6 * time.tv_usec ;
+#endif
+}
@@ -0,0 +1,96 @@
+// @file convtuner.hpp
+// @brief CPU convolution algorithm selection
+// @author Andrea Vedaldi
+
+/*
+Copyright (C) 2016 Andrea Vedaldi.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#ifndef __vl__convtuner__
+#define __vl__convtuner__
+
+#include "data.hpp"
+#include <istream>
+#include <map>
+#include <string>
+
+namespace vl {
+
+  enum ConvolutionAlgo {
+    vlConvolutionAlgoIm2row = 0, /* im2row + GEMM (always applicable) */
+    vlConvolutionAlgoDirect1x1,  /* GEMM on the input data, 1x1 filters */
+    vlConvolutionAlgoNum,
+    vlConvolutionAlgoAuto = vlConvolutionAlgoNum /* benchmark and select */
+  } ;
+
+  char const * getConvolutionAlgoName(ConvolutionAlgo algo) ;
+
+  /*
+   A ConvolutionSignature identifies a forward convolution problem for
+   the purpose of algorithm selection. Two problems with the same
+   signature are assumed to run equally fast with the same algorithm.
+   */
+
+  struct ConvolutionSignature
+  {
+    enum { numFields = 18 } ;
+    size_t fields [numFields] ;
+
+    ConvolutionSignature() ;
+    ConvolutionSignature(Tensor const & data,
+                         Tensor const & filters,
+                         int strideY, int strideX,
+                         int dilateY, int dilateX,
+                         int padTop, int padBottom,
+                         int padLeft, int padRight,
+                         int numThreads) ;
+    std::string toString() const ;
+    bool fromStream(std::istream & stream) ;
+  } ;
+
+  bool operator < (ConvolutionSignature const & a, ConvolutionSignature const & b) ;
+
+  /*
+   The ConvolutionTuner stores the CPU convolution algorithm
+   preference and, when this is set to vlConvolutionAlgoAuto, the
+   result of benchmarking the candidate algorithms for each problem
+   signature seen so far. This is the CPU analogue of the cuDNN
+   algorithm selection in CudaHelper. If a cache file is set, the
+   choices are loaded from it and new ones appended to it, so that
+   benchmarking is done only once per machine.
+   */
+
+  class ConvolutionTuner
+  {
+  public:
+    ConvolutionTuner() ;
+
+    void setAlgo(ConvolutionAlgo algo) ;
+    ConvolutionAlgo getAlgo() const ;
+    void setCachePath(std::string const & path) ;
+    std::string const & getCachePath() const ;
+
+    bool lookup(ConvolutionSignature const & signature, ConvolutionAlgo & algo) ;
+    void store(ConvolutionSignature const & signature, ConvolutionAlgo algo) ;
+    size_t getNumEntries() const ;
+    void clear() ;
+
+    static double getTime() ;
+
+  private:
+    void load() ;
+    void append(ConvolutionSignature const & signature, ConvolutionAlgo algo) ;
+
+    typedef std::map<ConvolutionSignature, ConvolutionAlgo> Choices ;
+    Choices choices ;
+    ConvolutionAlgo algo ;
+    std::string cachePath ;
+    bool cacheLoaded ;
+  } ;
+}
+
+#endif /* defined(__vl__convtuner__) */
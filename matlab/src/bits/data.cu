@@ -11,6 +11,8 @@ the terms of the BSD license (see the COPYING file).
 */
 
 #include "data.hpp"
+#include "convtuner.hpp"
+#include "filtercache.hpp"
 #include <cassert>
 #include <cstdlib>
 
@@ -54,6 +56,7 @@ getTypeSize(Type dataType)
     case vlTypeChar : return sizeof(char) ;
     case vlTypeFloat : return sizeof(float) ;
     case vlTypeDouble : return sizeof(double) ;
+    case vlTypeHalf : return sizeof(half_t) ;
     default: abort() ;
   }
   return 0 ;
@@ -152,7 +155,8 @@ vl::impl::Buffer::invalidateGpu()
 
 vl::Context::Context()
 :
-lastError(vl::vlSuccess), lastErrorMessage(), cudaHelper(NULL)
+lastError(vl::vlSuccess), lastErrorMessage(), cudaHelper(NULL),
+convolutionTuner(NULL), filterCache(NULL), numCpuThreads(1)
 { }
 
 vl::CudaHelper &
@@ -168,6 +172,36 @@ vl::Context::getCudaHelper()
   return *cudaHelper ;
 }
 
+vl::ConvolutionTuner &
+vl::Context::getConvolutionTuner()
+{
+  if (!convolutionTuner) {
+    convolutionTuner = new ConvolutionTuner() ;
+  }
+  return *convolutionTuner ;
+}
+
+vl::FilterCache &
+vl::Context::getFilterCache()
+{
+  if (!filterCache) {
+    filterCache = new FilterCache() ;
+  }
+  return *filterCache ;
+}
+
+void
+vl::Context::setNumCpuThreads(int numThreads)
+{
+  numCpuThreads = (numThreads >= 1) ? numThreads : 1 ;
+}
+
+int
+vl::Context::getNumCpuThreads() const
+{
+  return numCpuThreads ;
+}
+
 void vl::Context::clear()
 {
 #ifndef NDEBUG
@@ -175,6 +209,14 @@ void vl::Context::clear()
 #endif
   clearWorkspace(CPU) ;
   clearAllOnes(CPU) ;
+  if (convolutionTuner) {
+    delete convolutionTuner ;
+    convolutionTuner = NULL ;
+  }
+  if (filterCache) {
+    delete filterCache ;
+    filterCache = NULL ;
+  }
 #if ENABLE_GPU
   clearWorkspace(GPU) ;
   clearAllOnes(GPU) ;
@@ -35,18 +35,89 @@ namespace vl {
   enum Type {
     vlTypeChar,
     vlTypeFloat,
-    vlTypeDouble
+    vlTypeDouble,
+    vlTypeHalf
+  } ;
+
+  /* -----------------------------------------------------------------
+   * Half precision
+   * -------------------------------------------------------------- */
+
+  /*
+   IEEE 754 binary16 numbers, used only to store tensors in half the
+   memory. There is no half precision arithmetic: values are converted
+   to float when read, and the computations, including accumulations,
+   are carried out in float. In MATLAB, half precision tensors are
+   UINT16 arrays holding the bit patterns (see VL_TOHALF()).
+   */
+
+  inline float halfBitsToFloat(unsigned short h)
+  {
+    union { unsigned int u ; float f ; } o, magic ;
+    unsigned int const shiftedExp = 0x7c00u << 13 ;
+    magic.u = 113u << 23 ;
+    o.u = (h & 0x7fffu) << 13 ;
+    unsigned int exp = shiftedExp & o.u ;
+    o.u += (127u - 15u) << 23 ;
+    if (exp == shiftedExp) {
+      o.u += (128u - 16u) << 23 ; /* Inf or NaN */
+    } else if (exp == 0) {
+      o.u += 1u << 23 ; /* zero or denormal: renormalize */
+      o.f -= magic.f ;
+    }
+    o.u |= (h & 0x8000u) << 16 ;
+    return o.f ;
+  }
+
+  /* rounds to the nearest even, overflows to Inf */
+  inline unsigned short floatToHalfBits(float x)
+  {
+    union { unsigned int u ; float f ; } f, magic ;
+    unsigned int const f32Infinity = 255u << 23 ;
+    unsigned int const f16Max = (127u + 16u) << 23 ;
+    magic.u = ((127u - 15u) + (23u - 10u) + 1u) << 23 ;
+    f.f = x ;
+    unsigned int sign = f.u & 0x80000000u ;
+    unsigned short h ;
+    f.u ^= sign ;
+    if (f.u >= f16Max) {
+      h = (f.u > f32Infinity) ? 0x7e00 : 0x7c00 ;
+    } else if (f.u < (113u << 23)) {
+      /* denormal or zero: let the FPU round the mantissa */
+      f.f += magic.f ;
+      h = (unsigned short)(f.u - magic.u) ;
+    } else {
+      unsigned int mantissaOdd = (f.u >> 13) & 1 ;
+      f.u += ((unsigned int)(15 - 127) << 23) + 0xfff ;
+      f.u += mantissaOdd ;
+      h = (unsigned short)(f.u >> 13) ;
+    }
+    return h | (unsigned short)(sign >> 16) ;
+  }
+
+  struct half_t
+  {
+    half_t() { }
+    half_t(float x) : bits(floatToHalfBits(x)) { }
+    operator float() const { return halfBitsToFloat(bits) ; }
+    unsigned short bits ;
   } ;
 
   template <vl::Type id> struct DataTypeTraits { } ;
   template <> struct DataTypeTraits<vlTypeChar> { typedef char type ; } ;
   template <> struct DataTypeTraits<vlTypeFloat> { typedef float type ; } ;
   template <> struct DataTypeTraits<vlTypeDouble> { typedef double type ; } ;
+  template <> struct DataTypeTraits<vlTypeHalf> { typedef half_t type ; } ;
 
   template <typename type> struct BuiltinToDataType {} ;
   template <> struct BuiltinToDataType<char> { enum { dataType = vlTypeChar } ; } ;
   template <> struct BuiltinToDataType<float> { enum { dataType = vlTypeFloat } ; } ;
   template <> struct BuiltinToDataType<double> { enum { dataType = vlTypeDouble } ; } ;
+  template <> struct BuiltinToDataType<half_t> { enum { dataType = vlTypeHalf } ; } ;
+
+  /* type used to accumulate values of a given storage type */
+  template <typename T> struct AccumulatorTraits { typedef T type ; } ;
+  template <> struct AccumulatorTraits<half_t> { typedef float type ; } ;
 
   enum Error {
     vlSuccess = 0,
@@ -61,6 +132,8 @@ namespace vl {
   const char * getErrorMessage(Error error) ;
 
   class CudaHelper ;
+  class ConvolutionTuner ;
+  class FilterCache ;
 
   /* -----------------------------------------------------------------
    * Helpers
@@ -105,6 +178,12 @@ namespace vl {
     void * getAllOnes(Device device, Type type, size_t size) ;
     void clearAllOnes(Device device) ;
     CudaHelper& getCudaHelper() ;
+    ConvolutionTuner& getConvolutionTuner() ;
+    FilterCache& getFilterCache() ;
+
+    // number of threads the CPU code may use (MATLAB maxNumCompThreads)
+    void setNumCpuThreads(int numThreads) ;
+    int getNumCpuThreads() const ;
 
     void clear() ; // do a reset
     void invalidateGpu() ; // drop CUDA memory and handles
@@ -123,6 +202,9 @@ namespace vl {
     std::string lastErrorMessage ;
 
     CudaHelper * cudaHelper ;
+    ConvolutionTuner * convolutionTuner ;
+    FilterCache * filterCache ;
+    int numCpuThreads ;
   } ;
 
   /* -----------------------------------------------------------------
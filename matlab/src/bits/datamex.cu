@@ -11,6 +11,7 @@ the terms of the BSD license (see the COPYING file).
 */
 
 #include "datamex.hpp"
+#include "convtuner.hpp"
 #if ENABLE_GPU
 #include "datacu.hpp"
 #endif
@@ -34,6 +35,7 @@ vl::MexContext::MexContext()
 , gpuIsInitialized(false)
 , canary(NULL)
 #endif
+, numCpuThreadsUpdateTime(-1e10)
 { }
 
 vl::MexContext::~MexContext()
@@ -44,6 +46,33 @@ vl::MexContext::~MexContext()
 #endif
 }
 
+/* ---------------------------------------------------------------- */
+/*                                                      CPU threads */
+/* ---------------------------------------------------------------- */
+
+/*
+ The CPU code uses as many threads as MATLAB gives to BLAS. Asking
+ MATLAB goes through the interpreter and costs more than a small
+ layer, so the answer is reused for VL_MEX_NUM_CPU_THREADS_PERIOD
+ seconds; a change of maxNumCompThreads is picked up after at most
+ that long.
+ */
+
+#define VL_MEX_NUM_CPU_THREADS_PERIOD 1.0
+
+void
+vl::MexContext::updateNumCpuThreads()
+{
+  double time = ConvolutionTuner::getTime() ;
+  if (time - numCpuThreadsUpdateTime < VL_MEX_NUM_CPU_THREADS_PERIOD) { return ; }
+  mxArray * numThreads = NULL ;
+  if (mexCallMATLAB(1, &numThreads, 0, NULL, "maxNumCompThreads") == 0) {
+    setNumCpuThreads((int)mxGetScalar(numThreads)) ;
+    mxDestroyArray(numThreads) ;
+    numCpuThreadsUpdateTime = time ;
+  }
+}
+
 /* ---------------------------------------------------------------- */
 /*                                                   GPU management */
 /* ---------------------------------------------------------------- */
@@ -206,6 +235,10 @@ vl::MexTensor::initHelper(Device newDeviceType, Type newDataType,
       classID = mxDOUBLE_CLASS ;
       break ;
 #endif
+    case vlTypeHalf:
+      newMemorySize *= sizeof(DataTypeTraits<vlTypeHalf>::type) ;
+      classID = mxUINT16_CLASS ;
+      break ;
     default:
       abort() ;
   }
@@ -299,6 +332,7 @@ vl::MexTensor::initWithValue(Device newDeviceType,
 #ifdef ENABLE_DOUBLE
         case vlTypeDouble: error = operations<vl::CPU,double>::fill((double*)memory, n, (double)value) ; break ;
 #endif
+        case vlTypeHalf: error = operations<vl::CPU,half_t>::fill((half_t*)memory, n, (float)value) ; break ;
         default: abort() ;
       }
     }
@@ -399,6 +433,21 @@ vl::MexTensor::init(mxArray const * array_)
       break ;
 #endif
 
+    case mxUINT16_CLASS:
+      /* half precision values stored as UINT16 bit patterns */
+      if (newDeviceType != CPU) {
+#if ENABLE_GPU
+        if (newGpuArray) {
+          mxGPUDestroyGPUArray(newGpuArray) ;
+          newGpuArray = NULL ;
+        }
+#endif
+        mexErrMsgTxt("Half precision (UINT16) inputs are supported only on the CPU.") ;
+      }
+      newDataType = vlTypeHalf ;
+      newMemorySize *= sizeof(DataTypeTraits<vlTypeHalf>::type) ;
+      break ;
+
     default:
       if (isEmpty()) {
         newDataType = vlTypeFloat ;
@@ -406,9 +455,9 @@ vl::MexTensor::init(mxArray const * array_)
         break ;
       }
 #ifdef ENABLE_DOUBLE
-      mexErrMsgTxt("An input is neither SINGLE or DOUBLE nor it is empty.") ;
+      mexErrMsgTxt("An input is neither SINGLE, DOUBLE or UINT16 (half) nor it is empty.") ;
 #else
-      mexErrMsgTxt("An input is neither SINGLE nor empty.") ;
+      mexErrMsgTxt("An input is neither SINGLE or UINT16 (half) nor empty.") ;
 #endif
       break ;
   }
@@ -462,6 +511,7 @@ void vl::print(char const * str, vl::MexTensor const & tensor)
     case vl::vlTypeFloat: type = "float" ; break ;
     case vl::vlTypeDouble: type = "double" ; break ;
     case vl::vlTypeChar: type = "char" ; break ;
+    case vl::vlTypeHalf: type = "half" ; break ;
     default: type = "uknown type" ;
   }
   mexPrintf("%s[", str) ;
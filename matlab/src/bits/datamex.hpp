@@ -31,6 +31,9 @@ namespace vl {
     MexContext() ;
     ~MexContext() ;
 
+    // set the CPU threads from MATLAB maxNumCompThreads (cached)
+    void updateNumCpuThreads() ;
+
   protected:
 #if ENABLE_GPU
     vl::Error initGpu() ;
@@ -38,6 +41,7 @@ namespace vl {
     mxArray * canary ; // if it breathes, the GPU state is valid
     bool gpuIsInitialized ;
 #endif
+    double numCpuThreadsUpdateTime ;
 
     friend class MexTensor ;
   } ;
@@ -0,0 +1,183 @@
+// @file filtercache.cpp
+// @brief Cache of pre-packed filter banks
+// @author Andrea Vedaldi
+
+/*
+Copyright (C) 2016 Andrea Vedaldi.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#include "filtercache.hpp"
+#include <cstdlib>
+#include <cstring>
+
+using namespace vl ;
+
+#define VL_FILTER_CACHE_DEFAULT_MAX_SIZE (256 * 1024 * 1024)
+
+/* ---------------------------------------------------------------- */
+/*                                                          Helpers */
+/* ---------------------------------------------------------------- */
+
+static size_t
+getNumBytes(Tensor tensor)
+{
+  switch (tensor.getDataType()) {
+    case vlTypeFloat: return tensor.getNumElements() * sizeof(float) ;
+    case vlTypeDouble: return tensor.getNumElements() * sizeof(double) ;
+    case vlTypeHalf: return tensor.getNumElements() * sizeof(half_t) ;
+    default: return tensor.getNumElements() ;
+  }
+}
+
+/*
+ FNV-1a hash of the whole buffer, taken a word at a time. Each step is
+ invertible in the word being hashed, so any change to a single word
+ (for example, one filter edited in place) always changes the hash.
+ Reading the buffer once is still much cheaper than packing it.
+ */
+
+static size_t
+fingerprint(size_t hash, unsigned char const * memory, size_t numBytes)
+{
+  size_t const prime = (size_t)1099511628211ULL ;
+  size_t numWords = numBytes / sizeof(size_t) ;
+  for (size_t i = 0 ; i < numWords ; ++i) {
+    size_t word ;
+    memcpy(&word, memory + i * sizeof(size_t), sizeof(size_t)) ;
+    hash = (hash ^ word) * prime ;
+  }
+  for (size_t i = numWords * sizeof(size_t) ; i < numBytes ; ++i) {
+    hash = (hash ^ memory[i]) * prime ;
+  }
+  return hash ;
+}
+
+/* ---------------------------------------------------------------- */
+/*                                                      FilterCache */
+/* ---------------------------------------------------------------- */
+
+vl::FilterCache::FilterCache()
+: enabled(false), maxSize(VL_FILTER_CACHE_DEFAULT_MAX_SIZE), size(0)
+{ }
+
+vl::FilterCache::~FilterCache()
+{
+  clear() ;
+}
+
+void
+vl::FilterCache::setEnabled(bool enabled_)
+{
+  enabled = enabled_ ;
+  if (!enabled) { clear() ; }
+}
+
+bool
+vl::FilterCache::getEnabled() const
+{
+  return enabled ;
+}
+
+void
+vl::FilterCache::setMaxSize(size_t maxSize_)
+{
+  maxSize = maxSize_ ;
+}
+
+size_t
+vl::FilterCache::getMaxSize() const
+{
+  return maxSize ;
+}
+
+size_t
+vl::FilterCache::getSize() const
+{
+  return size ;
+}
+
+size_t
+vl::FilterCache::getNumEntries() const
+{
+  return entries.size() ;
+}
+
+void
+vl::FilterCache::clear()
+{
+  for (Entries::iterator iter = entries.begin() ; iter != entries.end() ; ++iter) {
+    free(iter->memory) ;
+  }
+  entries.clear() ;
+  size = 0 ;
+}
+
+/*
+ Returns a buffer of packedSize bytes for the filters and biases. If
+ needsPacking is true, the buffer is new or stale and the caller must
+ fill it before use. Returns NULL if the packed filters do not fit in
+ the budget (error is vlSuccess) or memory cannot be allocated.
+ */
+
+void *
+vl::FilterCache::get(vl::Error & error,
+                     bool & needsPacking,
+                     FilterPacking packing,
+                     Tensor filters, Tensor biases,
+                     size_t packedSize)
+{
+  error = vlSuccess ;
+  needsPacking = false ;
+  if (!enabled || packedSize > maxSize) { return NULL ; }
+
+  size_t hash = (size_t)14695981039346656037ULL ;
+  hash = fingerprint(hash, (unsigned char const*)filters.getMemory(), getNumBytes(filters)) ;
+  hash = fingerprint(hash, (unsigned char const*)biases.getMemory(), getNumBytes(biases)) ;
+
+  for (Entries::iterator iter = entries.begin() ; iter != entries.end() ; ++iter) {
+    if (iter->packing == packing &&
+        iter->filtersMemory == filters.getMemory() &&
+        iter->biasesMemory == biases.getMemory() &&
+        iter->filtersShape == filters.getShape() &&
+        iter->biasesShape == biases.getShape() &&
+        iter->dataType == filters.getDataType() &&
+        iter->size == packedSize) {
+      if (iter->fingerprint != hash) {
+        iter->fingerprint = hash ;
+        needsPacking = true ;
+      }
+      entries.splice(entries.begin(), entries, iter) ;
+      return entries.front().memory ;
+    }
+  }
+
+  // evict least recently used entries to make room
+  while (!entries.empty() && size + packedSize > maxSize) {
+    size -= entries.back().size ;
+    free(entries.back().memory) ;
+    entries.pop_back() ;
+  }
+
+  Entry entry ;
+  entry.packing = packing ;
+  entry.filtersMemory = filters.getMemory() ;
+  entry.biasesMemory = biases.getMemory() ;
+  entry.filtersShape = filters.getShape() ;
+  entry.biasesShape = biases.getShape() ;
+  entry.dataType = filters.getDataType() ;
+  entry.fingerprint = hash ;
+  entry.size = packedSize ;
+  entry.memory = malloc(packedSize) ;
+  if (entry.memory == NULL) {
+    error = vlErrorOutOfMemory ;
+    return NULL ;
+  }
+  entries.push_front(entry) ;
+  size += packedSize ;
+  needsPacking = true ;
+  return entry.memory ;
+}
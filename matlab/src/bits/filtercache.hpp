@@ -0,0 +1,82 @@
+// @file filtercache.hpp
+// @brief Cache of pre-packed filter banks
+// @author Andrea Vedaldi
+
+/*
+Copyright (C) 2016 Andrea Vedaldi.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#ifndef __vl__filtercache__
+#define __vl__filtercache__
+
+#include "data.hpp"
+#include <list>
+
+namespace vl {
+
+  enum FilterPacking {
+    vlFilterPackingInt8 = 0, /* quantized blocks per group, see nnconv_int8.hpp */
+    vlFilterPackingSparse /* compact sparse weights, see nnfullyconnected_sparse_cpu.cpp */
+  } ;
+
+  /*
+   A FilterCache holds filter banks transformed into a form that can
+   be reused as long as the filters do not change, which is the case
+   at inference time. It is used only for the int8 and sparse forms,
+   which are expensive to compute: the float filters are passed to
+   BLAS as they are, since BLAS packs its own panels at every call and
+   a cached copy would not save that work. An entry is identified by
+   the packing type, the memory address and shape of the filters and
+   biases and a hash of their values; the latter detects filters that
+   are updated in place or reallocated at the same address. The cache
+   is CPU-only, is disabled by default, and evicts the least recently
+   used entries to stay within a memory budget.
+   */
+
+  class FilterCache
+  {
+  public:
+    FilterCache() ;
+    ~FilterCache() ;
+
+    void setEnabled(bool enabled) ;
+    bool getEnabled() const ;
+    void setMaxSize(size_t maxSize) ;
+    size_t getMaxSize() const ;
+    size_t getSize() const ;
+    size_t getNumEntries() const ;
+    void clear() ;
+
+    void * get(vl::Error & error,
+               bool & needsPacking,
+               FilterPacking packing,
+               Tensor filters, Tensor biases,
+               size_t packedSize) ;
+
+  private:
+    struct Entry
+    {
+      FilterPacking packing ;
+      void const * filtersMemory ;
+      void const * biasesMemory ;
+      TensorShape filtersShape ;
+      TensorShape biasesShape ;
+      Type dataType ;
+      size_t fingerprint ;
+      size_t size ;
+      void * memory ;
+    } ;
+
+    typedef std::list<Entry> Entries ;
+    Entries entries ; // most recently used first
+    bool enabled ;
+    size_t maxSize ;
+    size_t size ;
+  } ;
+}
+
+#endif /* defined(__vl__filtercache__) */
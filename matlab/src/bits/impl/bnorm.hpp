@@ -15,9 +15,18 @@ the terms of the BSD license (see the COPYING file).
 
 #include "../data.hpp"
 #include <cstddef>
+#include <stdint.h>
 
 namespace vl { namespace impl {
 
+  /*
+   With rectify, the output is max(output, 0), and the backward
+   functions compute the derivatives of the rectified output. If mask
+   is not NULL, the forward functions set one bit for each positive
+   output (see nnbnorm_get_mask_size()), which the backward functions
+   use instead of recomputing them; this is only supported on the CPU.
+   */
+
   template<vl::Device dev, typename type>
   struct bnorm
   {
@@ -29,7 +38,9 @@ namespace vl { namespace impl {
             type const* multipliers,
             type const* biases,
             size_t height, size_t width, size_t depth, size_t size,
-            type epsilon) ;
+            type epsilon,
+            bool rectify,
+            uint8_t * mask) ;
 
     static vl::Error
     forward_given_moments(Context& context,
@@ -38,7 +49,9 @@ namespace vl { namespace impl {
                           type const* data,
                           type const* multipliers,
                           type const* biases,
-                          size_t height, size_t width, size_t depth, size_t size) ;
+                          size_t height, size_t width, size_t depth, size_t size,
+                          bool rectify,
+                          uint8_t * mask) ;
 
     static vl::Error
     backward(Context& context,
@@ -51,7 +64,9 @@ namespace vl { namespace impl {
              type const* biases,
              type const* derOutput,
              size_t height, size_t width, size_t depth, size_t size,
-             type epsilon) ;
+             type epsilon,
+             bool rectify,
+             uint8_t const * mask) ;
 
     static vl::Error
     backward_given_moments(Context& context,
@@ -64,7 +79,9 @@ namespace vl { namespace impl {
                            type const* biases,
                            type const* derOutput,
                            size_t height, size_t width, size_t depth, size_t size,
-                           type epsilon) ;
+                           type epsilon,
+                           bool rectify,
+                           uint8_t const * mask) ;
   } ;
 
 } }
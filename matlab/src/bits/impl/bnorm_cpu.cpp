@@ -20,134 +20,492 @@ the terms of the BSD license (see the COPYING file).
 #include <limits>
 #include <cassert>
 
+#ifndef _MSC_VER
+#pragma GCC optimize ("tree-vectorize")
+#endif
+
+/* after the pragma, so that the kernel runners are vectorized too */
+#include "cpufeatures.hpp"
+#include "tinythread.h"
+#include <stdint.h>
+#include <vector>
+
+/* Number of partial sums used in the reductions over WH */
+#define VL_BNORM_NUM_LANES 16
+
+/* Number of values accumulated in the partial sums before adding
+   them to the double precision totals */
+#define VL_BNORM_BLOCK_SIZE 1024
+
+/* Minimum number of data elements for starting one more thread */
+#define VL_BNORM_MIN_WORK_PER_THREAD (256*1024)
+
+/*
+ All the kernels below work on one channel at a time, which is made
+ of num planes of WH elements each. The channels are split among
+ threads, and each channel is normalized right after computing its
+ statistics, while its data is still in the cache.
+
+ The sums over a plane are computed with VL_BNORM_NUM_LANES partial
+ sums, which vectorizes over WH; the partial sums are added to double
+ precision totals every VL_BNORM_BLOCK_SIZE values, so that each of
+ them accumulates only a few values (pairwise summation). The data is
+ centered on its first value before accumulating the sum of squares,
+ so that the variance is obtained in a single pass without the
+ cancellation of E[x^2] - E[x]^2 when the mean is large.
+ */
+
 /* ---------------------------------------------------------------- */
-/*          compute_moments, compute_ders, compute_ders_and_moments	*/
+/*                                                      ReLU gating */
 /* ---------------------------------------------------------------- */
 
-// Compute moments (means and sigmas) from the batch data
-// WH is the product of the data width and height
-// moments is a 2 x depth array with means and sigmas
+/*
+ With rectification, the forward pass stores one bit per output
+ element, set if the output is positive. The bits of each channel
+ start at a new byte, so that channels can be processed in parallel
+ (see nnbnorm_get_mask_size()); within a channel, bit i corresponds to
+ the element wh + WH * element.
+
+ In the backward pass, the output derivatives are multiplied by these
+ bits. If the mask is not available, the bits are recomputed from the
+ data and the moments instead.
+ */
+
+template<typename T> struct ReluGate
+{
+  uint8_t const * mask ; // NULL to recompute the bits from the data
+  T coefficient ;
+  T mean ;
+  T bias ;
+
+  // buffer = dy .* (y > 0) for n values starting from bit firstBit
+  // of the channel
+  T const * apply(T * buffer, T const * derOutput, T const * data,
+                  size_t firstBit, int n) const
+  {
+    if (mask) {
+      int i = 0 ;
+      // bits up to the next byte boundary, then whole bytes
+      for ( ; i < n && ((firstBit + i) & 7) ; ++i) {
+        size_t b = firstBit + i ;
+        buffer[i] = ((mask[b >> 3] >> (b & 7)) & 1) ? derOutput[i] : (T)0 ;
+      }
+      uint8_t const * bytes = mask + ((firstBit + i) >> 3) ;
+      for ( ; i + 8 <= n ; i += 8) {
+        unsigned int m = *bytes++ ;
+        for (int k = 0 ; k < 8 ; ++k) {
+          buffer[i + k] = ((m >> k) & 1) ? derOutput[i + k] : (T)0 ;
+        }
+      }
+      for ( ; i < n ; ++i) {
+        size_t b = firstBit + i ;
+        buffer[i] = ((mask[b >> 3] >> (b & 7)) & 1) ? derOutput[i] : (T)0 ;
+      }
+    } else {
+      for (int i = 0 ; i < n ; ++i) {
+        T y = coefficient * (data[i] - mean) + bias ;
+        buffer[i] = (y > 0) ? derOutput[i] : (T)0 ;
+      }
+    }
+    return buffer ;
+  }
+} ;
 
+// set n bits of the mask starting from bit firstBit to output > 0
 template<typename T> inline void
-compute_moments(T * moments,
-                T const * data,
-                int WH,
-                int depth,
-                int num,
-                T epsilon)
+store_mask(uint8_t * mask, size_t firstBit, T const * output, int n)
 {
-  int mass = WH * num ;
-  for(int channel = 0; channel < depth; ++channel) {
-    for(int element = 0; element < num; ++element) {
-      for(int wh = 0; wh < WH; ++wh){
-        T x = data[wh + channel*WH + element*(depth*WH)] ;
-        moments[channel] += x ; // mean
-        moments[channel + depth] += x * x; // sigma
-      }
+  size_t b = firstBit ;
+  int i = 0 ;
+  // complete the current byte, then write whole bytes
+  if (b & 7) {
+    unsigned int byte = mask[b >> 3] ;
+    for ( ; i < n && (b & 7) ; ++i, ++b) {
+      byte |= (unsigned int)(output[i] > 0) << (b & 7) ;
     }
+    mask[(b - 1) >> 3] = (uint8_t)byte ;
   }
-  for(int i = 0; i < depth; ++i) {
-    moments[i] /= mass;
-    moments[i + depth] = sqrt(moments[i + depth]/mass
-                              - moments[i]*moments[i] + epsilon);
+  for ( ; i + 8 <= n ; i += 8, b += 8) {
+    unsigned int byte = 0 ;
+    for (int k = 0 ; k < 8 ; ++k) {
+      byte |= (unsigned int)(output[i + k] > 0) << k ;
+    }
+    mask[b >> 3] = (uint8_t)byte ;
+  }
+  if (i < n) {
+    unsigned int byte = 0 ;
+    for (int k = 0 ; i < n ; ++i, ++k) {
+      byte |= (unsigned int)(output[i] > 0) << k ;
+    }
+    mask[b >> 3] = (uint8_t)byte ;
   }
 }
 
-// this version assumes that moments is precomputed
+/* ---------------------------------------------------------------- */
+/*                                            per-plane reductions  */
+/* ---------------------------------------------------------------- */
+
+// sum and sumSq += sum (x - shift) and sum (x - shift)^2
 template<typename T> inline void
-compute_ders(T * derMultipliers,
-             T * derBiases,
-             T const * moments,
-             T const * data,
-             T const * derOutput,
-             int WH, int depth, int num,
-             T epsilon)
+plane_moments(double& sum, double& sumSq,
+              T const * data, int WH, T shift)
 {
-  memset(derMultipliers, 0, sizeof(T) * depth) ;
-  memset(derBiases, 0, sizeof(T) * depth) ;
-  for(int channel = 0; channel < depth; ++channel){
-    for(int element = 0; element < num; ++element ){
-      for(int wh = 0; wh < WH; ++wh){
-        int offset = wh + channel*WH + element * (WH*depth) ;
-        derMultipliers[channel] += derOutput[offset] * data[offset];
-        derBiases[channel] += derOutput[offset];
+  for (int begin = 0 ; begin < WH ; begin += VL_BNORM_BLOCK_SIZE) {
+    int end = std::min(begin + VL_BNORM_BLOCK_SIZE, WH) ;
+    T s [VL_BNORM_NUM_LANES] ;
+    T ss [VL_BNORM_NUM_LANES] ;
+    for (int t = 0 ; t < VL_BNORM_NUM_LANES ; ++t) { s[t] = 0 ; ss[t] = 0 ; }
+    int wh = begin ;
+    for ( ; wh + VL_BNORM_NUM_LANES <= end ; wh += VL_BNORM_NUM_LANES) {
+      for (int t = 0 ; t < VL_BNORM_NUM_LANES ; ++t) {
+        T x = data[wh + t] - shift ;
+        s[t] += x ;
+        ss[t] += x * x ;
+      }
+    }
+    for ( ; wh < end ; ++wh) {
+      T x = data[wh] - shift ;
+      s[0] += x ;
+      ss[0] += x * x ;
+    }
+    for (int t = 0 ; t < VL_BNORM_NUM_LANES ; ++t) {
+      sum += s[t] ;
+      sumSq += ss[t] ;
+    }
+  }
+}
+
+// sum += sum dy and sumProd += sum dy (x - shift), plus the moments
+// of x if computeMoments; dy is gated by gate if not NULL
+template<bool computeMoments, typename T> inline void
+plane_ders(double& sum, double& sumSq,
+           double& derSum, double& derSumProd,
+           T const * data, T const * derOutput, int WH, T shift,
+           ReluGate<T> const * gate, size_t firstBit)
+{
+  T buffer [VL_BNORM_BLOCK_SIZE] ;
+  for (int begin = 0 ; begin < WH ; begin += VL_BNORM_BLOCK_SIZE) {
+    int n = std::min(VL_BNORM_BLOCK_SIZE, WH - begin) ;
+    T const * x = data + begin ;
+    T const * dy = derOutput + begin ;
+    if (gate) { dy = gate->apply(buffer, dy, x, firstBit + begin, n) ; }
+    T s [VL_BNORM_NUM_LANES] ;
+    T ss [VL_BNORM_NUM_LANES] ;
+    T d [VL_BNORM_NUM_LANES] ;
+    T dp [VL_BNORM_NUM_LANES] ;
+    for (int t = 0 ; t < VL_BNORM_NUM_LANES ; ++t) {
+      s[t] = 0 ; ss[t] = 0 ; d[t] = 0 ; dp[t] = 0 ;
+    }
+    int i = 0 ;
+    for ( ; i + VL_BNORM_NUM_LANES <= n ; i += VL_BNORM_NUM_LANES) {
+      for (int t = 0 ; t < VL_BNORM_NUM_LANES ; ++t) {
+        T xc = x[i + t] - shift ;
+        if (computeMoments) {
+          s[t] += xc ;
+          ss[t] += xc * xc ;
+        }
+        d[t] += dy[i + t] ;
+        dp[t] += dy[i + t] * xc ;
+      }
+    }
+    for ( ; i < n ; ++i) {
+      T xc = x[i] - shift ;
+      if (computeMoments) {
+        s[0] += xc ;
+        ss[0] += xc * xc ;
+      }
+      d[0] += dy[i] ;
+      dp[0] += dy[i] * xc ;
+    }
+    for (int t = 0 ; t < VL_BNORM_NUM_LANES ; ++t) {
+      if (computeMoments) {
+        sum += s[t] ;
+        sumSq += ss[t] ;
       }
+      derSum += d[t] ;
+      derSumProd += dp[t] ;
     }
   }
+}
+
+/* ---------------------------------------------------------------- */
+/*          compute_moments, compute_ders, compute_ders_and_moments */
+/* ---------------------------------------------------------------- */
 
-  T mass = WH*num;
-  for(int i = 0; i < depth; ++i) {
-    T mean = moments[i] ;
-    T sigma = moments[i + depth] ;
-    derMultipliers[i] = (derMultipliers[i] - mean*derBiases[i]) / sigma;
+// Compute the moments (mean and sigma) of a channel
+// WH is the product of the data width and height, stride the
+// distance between two planes of the channel (WH * depth)
+
+template<typename T> inline void
+compute_moments(T& mean, T& sigma,
+                T const * data,
+                int WH, int stride, int num,
+                T epsilon)
+{
+  T shift = (WH * num > 0) ? data[0] : (T)0 ;
+  double sum = 0 ;
+  double sumSq = 0 ;
+  for (int element = 0 ; element < num ; ++element) {
+    plane_moments<T>(sum, sumSq, data + element * (ptrdiff_t)stride, WH, shift) ;
   }
+  double mass = (double)WH * num ;
+  double mu = sum / mass ;
+  double var = std::max(sumSq / mass - mu * mu, 0.0) ;
+  mean = (T)(mu + shift) ;
+  sigma = (T)sqrt(var + epsilon) ;
 }
 
+// this version assumes that the moments are precomputed
 template<typename T> inline void
-compute_ders_and_moments(T * derMultipliers,
-                         T * derBiases,
-                         T * moments,
+compute_ders(T& derMultiplier, T& derBias,
+             T mean, T sigma,
+             T const * data,
+             T const * derOutput,
+             int WH, int stride, int num,
+             ReluGate<T> const * gate)
+{
+  double sum = 0, sumSq = 0, derSum = 0, derSumProd = 0 ;
+  for (int element = 0 ; element < num ; ++element) {
+    ptrdiff_t offset = element * (ptrdiff_t)stride ;
+    plane_ders<false,T>(sum, sumSq, derSum, derSumProd,
+                        data + offset, derOutput + offset, WH, mean,
+                        gate, (size_t)element * WH) ;
+  }
+  derMultiplier = (T)(derSumProd / sigma) ;
+  derBias = (T)derSum ;
+}
+
+template<typename T> inline void
+compute_ders_and_moments(T& derMultiplier, T& derBias,
+                         T& mean, T& sigma,
                          T const * data,
                          T const * derOutput,
-                         int WH, int depth, int num,
-                         T epsilon)
+                         int WH, int stride, int num,
+                         T epsilon,
+                         ReluGate<T> const * gate)
 {
-  memset(derMultipliers, 0, sizeof(T) * depth) ;
-  memset(derBiases, 0, sizeof(T) * depth) ;
-  for(int channel = 0; channel < depth; ++channel){
-    for(int element = 0; element < num; ++element ){
-      for(int wh = 0; wh < WH; ++wh){
-        int offset = wh + channel*WH + element * (WH*depth) ;
-        moments[channel] += data[offset] ;
-        moments[channel + depth] += data[offset] * data[offset];
-        derMultipliers[channel] += derOutput[offset] * data[offset];
-        derBiases[channel] += derOutput[offset];
-      }
-    }
+  T shift = (WH * num > 0) ? data[0] : (T)0 ;
+  double sum = 0, sumSq = 0, derSum = 0, derSumProd = 0 ;
+  for (int element = 0 ; element < num ; ++element) {
+    ptrdiff_t offset = element * (ptrdiff_t)stride ;
+    plane_ders<true,T>(sum, sumSq, derSum, derSumProd,
+                       data + offset, derOutput + offset, WH, shift,
+                       gate, (size_t)element * WH) ;
   }
+  double mass = (double)WH * num ;
+  double mu = sum / mass ;
+  double var = std::max(sumSq / mass - mu * mu, 0.0) ;
+  mean = (T)(mu + shift) ;
+  sigma = (T)sqrt(var + epsilon) ;
+  // sum dy (x - mean) = sum dy (x - shift) - (mean - shift) sum dy
+  derMultiplier = (T)((derSumProd - mu * derSum) / sigma) ;
+  derBias = (T)derSum ;
+}
+
+/* ---------------------------------------------------------------- */
+/*                                          batch_normalize_forward */
+/* ---------------------------------------------------------------- */
 
-  T mass = WH*num;
-  for(int i = 0; i < depth; ++i) {
-    T mean = moments[i] /= mass ;
-    T sigma = sqrt(moments[i + depth]/mass - mean*mean + epsilon);
-    moments[i] = mean ;
-    moments[i + depth] = sigma ;
-    derMultipliers[i] = (derMultipliers[i] - mean*derBiases[i]) / sigma;
+template<bool rectify, typename T> inline void
+batch_normalize_forward(T * output,
+                        uint8_t * mask,
+                        T mean, T sigma,
+                        T const * data,
+                        T multiplier,
+                        T bias,
+                        int WH, int stride, int num)
+{
+  T coefficient = multiplier / sigma ;
+  for (int element = 0 ; element < num ; ++element) {
+    T * y = output + element * (ptrdiff_t)stride ;
+    T const * x = data + element * (ptrdiff_t)stride ;
+    for (int wh = 0 ; wh < WH ; ++wh) {
+      T z = coefficient * (x[wh] - mean) + bias ;
+      if (rectify) { z = (z > 0) ? z : (T)0 ; }
+      y[wh] = z ;
+    }
+    if (mask) { store_mask(mask, (size_t)element * WH, y, WH) ; }
   }
 }
 
 /* ---------------------------------------------------------------- */
-/*                                         batch_normalize_backward	*/
+/*                                         batch_normalize_backward */
 /* ---------------------------------------------------------------- */
 
 template<typename T> inline void
 batch_normalize_backward(T * derData,
-                         T const * moments,
+                         T mean, T sigma,
                          T const * data,
-                         T const * multipliers,
-                         T const * derMultipliers,
-                         T const * derBiases,
+                         T multiplier,
+                         T derMultiplier,
+                         T derBias,
                          T const * derOutput,
-                         int WH,
-                         int depth,
-                         int num)
+                         int WH, int stride, int num,
+                         ReluGate<T> const * gate)
+{
+  T mass = (T)WH * num ;
+  T muz = derBias / mass ;
+  T G1 = multiplier / sigma ;
+  T G2 = G1 * derMultiplier / (mass * sigma) ;
+  T buffer [VL_BNORM_BLOCK_SIZE] ;
+  for (int element = 0 ; element < num ; ++element) {
+    ptrdiff_t base = element * (ptrdiff_t)stride ;
+    for (int begin = 0 ; begin < WH ; begin += VL_BNORM_BLOCK_SIZE) {
+      int n = std::min(VL_BNORM_BLOCK_SIZE, WH - begin) ;
+      T * dx = derData + base + begin ;
+      T const * x = data + base + begin ;
+      T const * dy = derOutput + base + begin ;
+      if (gate) {
+        dy = gate->apply(buffer, dy, x, (size_t)element * WH + begin, n) ;
+      }
+      for (int i = 0 ; i < n ; ++i) {
+        dx[i] = G1 * (dy[i] - muz) - G2 * (x[i] - mean) ;
+      }
+    }
+  }
+}
+
+/* ---------------------------------------------------------------- */
+/*                                                         dispatch */
+/* ---------------------------------------------------------------- */
+
+// Function object running the kernels above on a range of channels,
+// with the best instruction set available (see cpufeatures.hpp)
+
+enum BnormMode {
+  bnormForward,
+  bnormForwardGivenMoments,
+  bnormBackward,
+  bnormBackwardGivenMoments
+} ;
+
+template<typename T> struct BnormTask
 {
-  T mass = WH*num;
-  for(int channel = 0; channel < depth; ++channel ) {
-    T mean = moments[channel] ;
-    T sigma = moments[channel + depth] ;
-
-    T muz = derBiases[channel]/mass;
-    T G1 = multipliers[channel]/sigma ;
-    T G2 = G1 * derMultipliers[channel]/(mass*sigma);
-
-    for(int element = 0; element < num; ++element){
-      for(int wh = 0; wh < WH; ++wh){
-        int offset = wh + channel*WH + element * (WH*depth) ;
-        derData[offset] = G1 * (derOutput[offset] - muz) - G2 * (data[offset]-mean) ;
+  BnormMode mode ;
+  T * output ;          // output or derData
+  T * moments ;         // 2 x depth
+  T * derMultipliers ;
+  T * derBiases ;
+  T const * data ;
+  T const * multipliers ;
+  T const * biases ;
+  T const * derOutput ;
+  int WH ; int depth ; int num ;
+  T epsilon ;
+  bool rectify ;
+  uint8_t * mask ;      // written forward, read backward; can be NULL
+  int firstChannel ;
+  int lastChannel ;
+
+  void operator()() const
+  {
+    int stride = WH * depth ;
+    size_t maskStride = ((size_t)WH * num + 7) / 8 ;
+    for (int channel = firstChannel ; channel < lastChannel ; ++channel) {
+      ptrdiff_t offset = channel * (ptrdiff_t)WH ;
+      T & mean = moments[channel] ;
+      T & sigma = moments[channel + depth] ;
+      uint8_t * channelMask = mask ? mask + channel * maskStride : NULL ;
+      ReluGate<T> gate = {channelMask, 0, 0, 0} ;
+      switch (mode) {
+        case bnormForward:
+          compute_moments<T>(mean, sigma, data + offset, WH, stride, num, epsilon) ;
+          /* fall through */
+        case bnormForwardGivenMoments:
+          if (rectify) {
+            batch_normalize_forward<true,T>(output + offset, channelMask,
+                                            mean, sigma, data + offset,
+                                            multipliers[channel], biases[channel],
+                                            WH, stride, num) ;
+          } else {
+            batch_normalize_forward<false,T>(output + offset, NULL,
+                                             mean, sigma, data + offset,
+                                             multipliers[channel], biases[channel],
+                                             WH, stride, num) ;
+          }
+          break ;
+
+        case bnormBackward:
+          if (rectify && !channelMask) {
+            // the moments are needed to recompute the mask
+            compute_moments<T>(mean, sigma, data + offset, WH, stride, num, epsilon) ;
+            gate.coefficient = multipliers[channel] / sigma ;
+            gate.mean = mean ;
+            gate.bias = biases[channel] ;
+            compute_ders<T>(derMultipliers[channel], derBiases[channel],
+                            mean, sigma,
+                            data + offset, derOutput + offset,
+                            WH, stride, num, &gate) ;
+          } else {
+            compute_ders_and_moments<T>(derMultipliers[channel], derBiases[channel],
+                                        mean, sigma,
+                                        data + offset, derOutput + offset,
+                                        WH, stride, num, epsilon,
+                                        rectify ? &gate : NULL) ;
+          }
+          batch_normalize_backward<T>(output + offset, mean, sigma, data + offset,
+                                      multipliers[channel],
+                                      derMultipliers[channel], derBiases[channel],
+                                      derOutput + offset,
+                                      WH, stride, num,
+                                      rectify ? &gate : NULL) ;
+          break ;
+
+        case bnormBackwardGivenMoments:
+          gate.coefficient = multipliers[channel] / sigma ;
+          gate.mean = mean ;
+          gate.bias = biases[channel] ;
+          compute_ders<T>(derMultipliers[channel], derBiases[channel],
+                          mean, sigma,
+                          data + offset, derOutput + offset,
+                          WH, stride, num,
+                          rectify ? &gate : NULL) ;
+          batch_normalize_backward<T>(output + offset, mean, sigma, data + offset,
+                                      multipliers[channel],
+                                      derMultipliers[channel], derBiases[channel],
+                                      derOutput + offset,
+                                      WH, stride, num,
+                                      rectify ? &gate : NULL) ;
+          break ;
       }
     }
   }
+} ;
+
+template<typename T> static void
+bnorm_thread(void * task)
+{
+  vl::impl::runCpuKernel(*(BnormTask<T> const*)task) ;
+}
+
+// Split the channels among threads
+template<typename T> static void
+run_bnorm(vl::Context& context, BnormTask<T> const& task)
+{
+  double work = (double)task.WH * task.depth * task.num ;
+  int numThreads = (int)std::min((double)context.getNumCpuThreads(),
+                                 1 + work / VL_BNORM_MIN_WORK_PER_THREAD) ;
+  numThreads = std::max(1, std::min(numThreads, task.depth)) ;
+
+  if (numThreads == 1) {
+    vl::impl::runCpuKernel(task) ;
+    return ;
+  }
+
+  std::vector<BnormTask<T> > tasks(numThreads, task) ;
+  std::vector<tthread::thread*> threads ;
+  for (int t = 0 ; t < numThreads ; ++t) {
+    tasks[t].firstChannel = (task.depth * t) / numThreads ;
+    tasks[t].lastChannel = (task.depth * (t + 1)) / numThreads ;
+  }
+  for (int t = 1 ; t < numThreads ; ++t) {
+    threads.push_back(new tthread::thread(bnorm_thread<T>, &tasks[t])) ;
+  }
+  vl::impl::runCpuKernel(tasks[0]) ;
+  for (int t = 0 ; t < threads.size() ; ++t) {
+    threads[t]->join() ;
+    delete threads[t] ;
+  }
 }
 
 /* ---------------------------------------------------------------- */
@@ -159,6 +517,21 @@ namespace vl { namespace impl {
   template<typename T>
   struct bnorm<vl::CPU,T>
   {
+    static BnormTask<T>
+    makeTask(BnormMode mode,
+             T* output, T* moments, T* derMultipliers, T* derBiases,
+             T const* data, T const* multipliers, T const* biases,
+             T const* derOutput,
+             size_t height, size_t width, size_t depth, size_t size,
+             T epsilon, bool rectify, uint8_t * mask)
+    {
+      BnormTask<T> task =
+      {mode, output, moments, derMultipliers, derBiases,
+        data, multipliers, biases, derOutput,
+        (int)(height*width), (int)depth, (int)size,
+        epsilon, rectify, mask, 0, (int)depth} ;
+      return task ;
+    }
 
     /* ------------------------------------------------------------ */
     /*                                                      forward */
@@ -171,22 +544,16 @@ namespace vl { namespace impl {
                           T const* data,
                           T const* multipliers,
                           T const* biases,
-                          size_t height, size_t width, size_t depth, size_t num)
+                          size_t height, size_t width, size_t depth, size_t size,
+                          bool rectify,
+                          uint8_t * mask)
     {
-      int WH = height * width ;
-      for(int channel = 0; channel < depth; ++channel) {
-        T mean = moments[channel] ;
-        T sigma = moments[channel + depth] ;
-        T bias = biases[channel];
-        T coefficient = multipliers[channel] / sigma ;
-
-        for(int element = 0; element < num; ++element) {
-          for(int wh = 0; wh < WH; ++wh){
-            int offset = wh + channel*WH + element * (depth*WH) ;
-            output[offset] = coefficient * (data[offset] - mean) + bias ;
-          }
-        }
-      }
+      // the moments are only read in this mode
+      run_bnorm(context, makeTask(bnormForwardGivenMoments,
+                                  output, (T*)moments, NULL, NULL,
+                                  data, multipliers, biases, NULL,
+                                  height, width, depth, size, 0,
+                                  rectify, mask)) ;
       return vlSuccess;
     }
 
@@ -198,35 +565,27 @@ namespace vl { namespace impl {
             T const* multipliers,
             T const* biases,
             size_t height, size_t width, size_t depth, size_t size,
-            T epsilon)
+            T epsilon,
+            bool rectify,
+            uint8_t * mask)
     {
-      vl::Error error = vlSuccess ;
       bool ownMoments = false ;
       if (moments == NULL) {
-        moments = (T*)calloc(sizeof(T),2*depth);
+        moments = (T*)malloc(sizeof(T)*2*depth);
         if (!moments) {
-          error = vlErrorOutOfMemory ;
-          goto done ;
+          return vlErrorOutOfMemory ;
         }
         ownMoments = true ;
-      } else {
-        memset(moments, 0, sizeof(T) * 2*depth) ;
       }
-      compute_moments<T>(moments,
-                         data, width*height, depth, size,
-                         epsilon) ;
-
-      error = bnorm<vl::CPU,T>::forward_given_moments
-      (context,
-       output,
-       moments, data,
-       multipliers, biases,
-       height, width, depth, size) ;
-
-      // Delete intermediate variable
-    done:
+
+      run_bnorm(context, makeTask(bnormForward,
+                                  output, moments, NULL, NULL,
+                                  data, multipliers, biases, NULL,
+                                  height, width, depth, size, epsilon,
+                                  rectify, mask)) ;
+
       if (ownMoments)  { free(moments) ; }
-      return error ;
+      return vlSuccess ;
     }
 
     /*------------------------------------------------------------- */
@@ -244,34 +603,17 @@ namespace vl { namespace impl {
                            T const* biases,
                            T const* derOutput,
                            size_t height, size_t width, size_t depth, size_t size,
-                           T epsilon)
+                           T epsilon,
+                           bool rectify,
+                           uint8_t const * mask)
     {
-      vl::Error error = vlSuccess ;
-      T * muz;
-      int WH = width * height;
-
-      // Allocate muz
-      muz = (T*)calloc(sizeof(T),depth);
-      if (!muz) {
-        error = vlErrorOutOfMemory ;
-        goto done ;
-      }
-
-      // Compute derMultipliers, derBiases, muz, and moments
-      compute_ders<T>(derMultipliers, derBiases,
-                      moments, data, derOutput,
-                      WH, depth, size,
-                      epsilon);
-
-      // Compute derData
-      batch_normalize_backward<T>(derData,
-                                  moments, data, muz,
-                                  multipliers, derMultipliers, derOutput,
-                                  WH, depth, size);
-
-    done:;
-      if (muz) { free(muz) ; }
-      return error ;
+      // the moments and the mask are only read in this mode
+      run_bnorm(context, makeTask(bnormBackwardGivenMoments,
+                                  derData, (T*)moments, derMultipliers, derBiases,
+                                  data, multipliers, biases, derOutput,
+                                  height, width, depth, size, epsilon,
+                                  rectify, (uint8_t*)mask)) ;
+      return vlSuccess ;
     }
 
     static vl::Error
@@ -285,42 +627,27 @@ namespace vl { namespace impl {
              T const* biases,
              T const* derOutput,
              size_t height, size_t width, size_t depth, size_t size,
-             T epsilon)
+             T epsilon,
+             bool rectify,
+             uint8_t const * mask)
     {
-      vl::Error error = vlSuccess ;
-      T* muz = NULL ;
       bool ownMoments = false ;
-      int WH = width * height;
-
-      // Allocate or reuse moments
       if (moments == NULL) {
-        moments = (T*)calloc(sizeof(T),2*depth);
+        moments = (T*)malloc(sizeof(T)*2*depth);
         if (!moments) {
-          error = vlErrorOutOfMemory ;
-          goto done ;
+          return vlErrorOutOfMemory ;
         }
         ownMoments = true ;
-      } else {
-        memset(moments, 0, sizeof(T) * 2*depth) ;
       }
 
-      // Compute derMultipliers, derBiases, and moments
-      compute_ders_and_moments<T>(derMultipliers, derBiases, moments,
-                                  data, derOutput,
-                                  WH, depth, size,
-                                  epsilon);
-
-      // Compute derData
-      batch_normalize_backward<T>(derData,
-                                  moments, data,
-                                  multipliers,
-                                  derMultipliers, derBiases, derOutput,
-                                  WH, depth, size);
-
-      // Delete intermediate variable
-    done:;
+      run_bnorm(context, makeTask(bnormBackward,
+                                  derData, moments, derMultipliers, derBiases,
+                                  data, multipliers, biases, derOutput,
+                                  height, width, depth, size, epsilon,
+                                  rectify, (uint8_t*)mask)) ;
+
       if (ownMoments) { free(moments) ; }
-      return error ;
+      return vlSuccess ;
     }
   } ;
 
@@ -12,6 +12,7 @@ the terms of the BSD license (see the COPYING file).
 */
 
 #include "bnorm.hpp"
+#include "copy.hpp"
 #include "../datacu.hpp"
 #include "blashelper.hpp"
 #include "sharedmem.cuh"
@@ -816,8 +817,12 @@ namespace vl { namespace impl {
             T const* multipliers,
             T const* biases,
             size_t height, size_t width, size_t depth, size_t size,
-            T epsilon)
+            T epsilon,
+            bool rectify,
+            uint8_t * mask)
     {
+      // the activation mask is only supported on the CPU
+      if (mask) { return vl::vlErrorUnsupported ; }
       cudaError_t status ;
       unsigned int planeArea = height * width ;
       unsigned int numPlanes = depth * size ;
@@ -956,7 +961,11 @@ namespace vl { namespace impl {
        depth) ;
 
       status = cudaPeekAtLastError() ;
-      return (status == cudaSuccess) ? vl::vlSuccess : vl::vlErrorCuda ;
+      if (status != cudaSuccess) { return vl::vlErrorCuda ; }
+      if (rectify) {
+        return vl::impl::operations<vl::GPU,T>::rectify(output, height*width*depth*size) ;
+      }
+      return vl::vlSuccess ;
     }
 
     /* ------------------------------------------------------------ */
@@ -970,8 +979,11 @@ namespace vl { namespace impl {
                           T const* data,
                           T const* multipliers,
                           T const* biases,
-                          size_t height, size_t width, size_t depth, size_t size)
+                          size_t height, size_t width, size_t depth, size_t size,
+                          bool rectify,
+                          uint8_t * mask)
     {
+      if (mask) { return vl::vlErrorUnsupported ; }
       cudaError_t status ;
       unsigned int planeArea = height * width ;
       unsigned int numPlanes = depth * size ;
@@ -998,7 +1010,11 @@ namespace vl { namespace impl {
        depth) ;
 
       status = cudaPeekAtLastError() ;
-      return (status == cudaSuccess) ? vl::vlSuccess : vl::vlErrorCuda ;
+      if (status != cudaSuccess) { return vl::vlErrorCuda ; }
+      if (rectify) {
+        return vl::impl::operations<vl::GPU,T>::rectify(output, height*width*depth*size) ;
+      }
+      return vl::vlSuccess ;
     }
 
     /* ------------------------------------------------------------ */
@@ -1016,8 +1032,12 @@ namespace vl { namespace impl {
              T const* biases,
              T const* derOutput,
              size_t height, size_t width, size_t depth, size_t size,
-             T epsilon)
+             T epsilon,
+             bool rectify,
+             uint8_t const * mask)
     {
+      // the fused ReLU backward is only supported on the CPU
+      if (rectify || mask) { return vl::vlErrorUnsupported ; }
       cudaError_t status = cudaSuccess;
       unsigned int planeArea = height * width ;
       unsigned int numPlanes = depth * size ;
@@ -1122,8 +1142,12 @@ namespace vl { namespace impl {
                            T const* biases,
                            T const* derOutput,
                            size_t height, size_t width, size_t depth, size_t size,
-                           T epsilon)
+                           T epsilon,
+                           bool rectify,
+                           uint8_t const * mask)
     {
+      // the fused ReLU backward is only supported on the CPU
+      if (rectify || mask) { return vl::vlErrorUnsupported ; }
       cudaError_t status;
       unsigned int planeArea = height * width ;
       unsigned int numPlanes = depth * size ;
@@ -23,6 +23,7 @@ namespace vl { namespace impl {
     typedef type data_type ;
     static vl::Error copy(data_type * dest, data_type const * src, size_t numElements) ;
     static vl::Error fill(data_type * dest, size_t numElements, data_type value) ;
+    static vl::Error rectify(data_type * dest, size_t numElements) ;
   } ;
 } }
 
@@ -39,11 +39,23 @@ namespace vl { namespace impl {
       }
       return vlSuccess ;
     }
+
+    static vl::Error
+    rectify(data_type * dest,
+            size_t numElements)
+    {
+      for (size_t k = 0 ; k < numElements ; ++k) {
+        data_type x = dest[k] ;
+        dest[k] = (x > 0) ? x : (data_type)0 ;
+      }
+      return vlSuccess ;
+    }
   } ;
 
 } }
 
 template struct vl::impl::operations<vl::CPU, float> ;
+template struct vl::impl::operations<vl::CPU, vl::half_t> ;
 
 #ifdef ENABLE_DOUBLE
 template struct vl::impl::operations<vl::CPU, double> ;
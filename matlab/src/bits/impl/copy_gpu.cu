@@ -21,6 +21,13 @@ fill_kernel (type * data, type value, size_t size)
   if (index < size) data[index] = value ;
 }
 
+template<typename type> __global__ void
+rectify_kernel (type * data, size_t size)
+{
+  int index = threadIdx.x + blockIdx.x * blockDim.x ;
+  if (index < size) { type x = data[index] ; data[index] = (x > 0) ? x : 0 ; }
+}
+
 namespace vl { namespace impl {
 
   template <typename type>
@@ -52,6 +59,21 @@ namespace vl { namespace impl {
       }
       return vlSuccess ;
     }
+
+    static vl::Error
+    rectify(data_type * dest,
+            size_t numElements)
+    {
+      rectify_kernel <data_type>
+      <<<divideUpwards(numElements, VL_CUDA_NUM_THREADS), VL_CUDA_NUM_THREADS>>>
+      (dest, numElements) ;
+
+      cudaError_t error = cudaGetLastError() ;
+      if (error != cudaSuccess) {
+        return vlErrorCuda ;
+      }
+      return vlSuccess ;
+    }
   } ;
 
 } }
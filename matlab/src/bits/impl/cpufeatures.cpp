@@ -0,0 +1,141 @@
+// @file cpufeatures.cpp
+// @brief Runtime selection of CPU instruction set variants
+// @author Andrea Vedaldi
+
+/*
+Copyright (C) 2016 Andrea Vedaldi.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#include "cpufeatures.hpp"
+
+#if VL_CPU_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#include <cstdlib>
+#include <cctype>
+#include <string>
+
+using namespace vl::impl ;
+
+#if VL_CPU_X86
+static void
+cpuid(unsigned int info [4], unsigned int leaf, unsigned int subleaf)
+{
+#if defined(_MSC_VER)
+  __cpuidex((int*)info, leaf, subleaf) ;
+#else
+  __cpuid_count(leaf, subleaf, info[0], info[1], info[2], info[3]) ;
+#endif
+}
+
+/* registers whose state the OS saves on context switches (XCR0) */
+static unsigned long long
+xgetbv0()
+{
+#if defined(_MSC_VER)
+  return _xgetbv(0) ;
+#else
+  unsigned int eax, edx ;
+  __asm__ __volatile__ ("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0)) ;
+  return ((unsigned long long)edx << 32) | eax ;
+#endif
+}
+#endif
+
+static bool detectedVnni = false ;
+
+static CpuIsa
+detectCpuIsa()
+{
+  CpuIsa isa = vlCpuIsaBase ;
+#if VL_CPU_X86
+  unsigned int info [4] ;
+  cpuid(info, 0, 0) ;
+  unsigned int maxLeaf = info[0] ;
+  if (maxLeaf < 1) { return isa ; }
+
+  cpuid(info, 1, 0) ;
+  bool ssse3 = (info[2] >> 9) & 1 ;
+  bool fma = (info[2] >> 12) & 1 ;
+  bool osxsave = (info[2] >> 27) & 1 ;
+  bool avx = (info[2] >> 28) & 1 ;
+  if (!ssse3) { return isa ; }
+  isa = vlCpuIsaSSSE3 ;
+
+  if (!(osxsave && avx && fma) || maxLeaf < 7) { return isa ; }
+  unsigned long long xcr0 = xgetbv0() ;
+  if ((xcr0 & 0x6) != 0x6) { return isa ; } /* XMM and YMM state */
+
+  cpuid(info, 7, 0) ;
+  bool avx2 = (info[1] >> 5) & 1 ;
+  bool avx512f = (info[1] >> 16) & 1 ;
+  bool avx512bw = (info[1] >> 30) & 1 ;
+  bool avx512vl = (info[1] >> 31) & 1 ;
+  bool avx512vnni = (info[2] >> 11) & 1 ;
+  if (!avx2) { return isa ; }
+  isa = vlCpuIsaAVX2 ;
+
+  if (avx512f && avx512bw && avx512vl &&
+      (xcr0 & 0xe0) == 0xe0) { /* opmask and ZMM state */
+    isa = vlCpuIsaAVX512 ;
+    detectedVnni = avx512vnni ;
+  }
+#endif
+  return isa ;
+}
+
+/*
+ The MATCONVNET_CPU_ISA environment variable (base, ssse3, avx2 or
+ avx512) caps the instruction set used by the kernels, for example to
+ compare the variants. Unknown values are ignored.
+ */
+
+static CpuIsa
+readCpuIsaLimit()
+{
+  char const * value = getenv("MATCONVNET_CPU_ISA") ;
+  if (value == NULL) { return vlCpuIsaAVX512 ; }
+  std::string name ;
+  for ( ; *value ; ++value) { name += (char)tolower(*value) ; }
+  if (name == "base") { return vlCpuIsaBase ; }
+  if (name == "ssse3") { return vlCpuIsaSSSE3 ; }
+  if (name == "avx2") { return vlCpuIsaAVX2 ; }
+  return vlCpuIsaAVX512 ;
+}
+
+/* detected once, when the library is loaded */
+static CpuIsa detectedIsa = detectCpuIsa() ;
+static CpuIsa isaLimit = readCpuIsaLimit() ;
+
+CpuIsa
+vl::impl::getCpuIsa()
+{
+  return (detectedIsa <= isaLimit) ? detectedIsa : isaLimit ;
+}
+
+bool
+vl::impl::getCpuHasVnni()
+{
+  return detectedVnni && getCpuIsa() == vlCpuIsaAVX512 ;
+}
+
+char const *
+vl::impl::getCpuIsaName(CpuIsa isa)
+{
+  switch (isa) {
+    case vlCpuIsaBase: return "base" ;
+    case vlCpuIsaSSSE3: return "SSSE3" ;
+    case vlCpuIsaAVX2: return "AVX2" ;
+    case vlCpuIsaAVX512: return "AVX-512" ;
+    default: return "unknown" ;
+  }
+}
@@ -0,0 +1,112 @@
+// @file cpufeatures.hpp
+// @brief Runtime selection of CPU instruction set variants
+// @author Andrea Vedaldi
+
+/*
+Copyright (C) 2016 Andrea Vedaldi.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#ifndef __vl__cpufeatures__
+#define __vl__cpufeatures__
+
+/*
+ The CPU kernels are compiled for the baseline instruction set given
+ to the compiler (SSE2 on x86-64) and, with GCC and Clang on x86, also
+ for AVX2 and AVX-512. The best variant supported by the processor and
+ the operating system is picked at run time, so that the same MEX
+ files run at full speed on different machines.
+
+ A kernel is wrapped in a function object and run by runCpuKernel():
+
+   struct MyKernel {
+     ... arguments ...
+     void operator()() const { my_kernel(...) ; }
+   } ;
+   runCpuKernel(MyKernel(...)) ;
+
+ The AVX2 and AVX-512 runners are compiled for the corresponding
+ target and inline (flatten) the whole call tree of the kernel, which
+ is therefore compiled for that instruction set. The runners use the
+ optimization options in effect where this header is included, so
+ files that enable vectorization with #pragma GCC optimize should
+ include it after the pragma. Code written with
+ intrinsics for a specific instruction set (e.g. SSSE3 pixel shuffles)
+ can instead check getCpuIsa() directly and use VL_CPU_TARGET_SSSE3,
+ VL_CPU_TARGET_AVX2 or VL_CPU_TARGET_AVX512. The AVX-512 integer dot
+ products (VNNI) are an optional extension, checked by getCpuHasVnni()
+ and used with VL_CPU_TARGET_AVX512VNNI.
+ */
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define VL_CPU_X86 1
+#else
+#define VL_CPU_X86 0
+#endif
+
+#if (defined(__GNUC__) || defined(__clang__)) && VL_CPU_X86 && !defined(__CUDACC__)
+#define VL_CPU_DISPATCH 1
+#define VL_CPU_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define VL_CPU_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define VL_CPU_TARGET_AVX512 __attribute__((target("avx512f,avx512bw,avx512vl,avx2,fma")))
+#define VL_CPU_TARGET_AVX512VNNI __attribute__((target("avx512vnni,avx512f,avx512bw,avx512vl,avx2,fma")))
+#define VL_CPU_RUNNER_ATTRIBUTES(isa) __attribute__((target(isa), flatten, noinline))
+#else
+#define VL_CPU_DISPATCH 0
+#define VL_CPU_TARGET_SSSE3
+#define VL_CPU_TARGET_AVX2
+#define VL_CPU_TARGET_AVX512
+#define VL_CPU_TARGET_AVX512VNNI
+#endif
+
+namespace vl { namespace impl {
+
+  enum CpuIsa {
+    vlCpuIsaBase = 0, /* whatever the code was compiled for */
+    vlCpuIsaSSSE3,
+    vlCpuIsaAVX2,     /* AVX2 + FMA */
+    vlCpuIsaAVX512    /* AVX-512 F, BW, VL */
+  } ;
+
+  /* Best instruction set usable on this machine, detected once and
+     capped by the MATCONVNET_CPU_ISA environment variable. */
+  CpuIsa getCpuIsa() ;
+
+  /* AVX-512 VNNI available (and AVX-512 not disabled by the limit). */
+  bool getCpuHasVnni() ;
+
+  char const * getCpuIsaName(CpuIsa isa) ;
+
+#if VL_CPU_DISPATCH
+  template<class Kernel> VL_CPU_RUNNER_ATTRIBUTES("avx2,fma") void
+  runCpuKernelAVX2(Kernel const & kernel)
+  {
+    kernel() ;
+  }
+
+  template<class Kernel> VL_CPU_RUNNER_ATTRIBUTES("avx512f,avx512bw,avx512vl,avx2,fma") void
+  runCpuKernelAVX512(Kernel const & kernel)
+  {
+    kernel() ;
+  }
+#endif
+
+  template<class Kernel> inline void
+  runCpuKernel(Kernel const & kernel)
+  {
+#if VL_CPU_DISPATCH
+    switch (getCpuIsa()) {
+      case vlCpuIsaAVX512: runCpuKernelAVX512(kernel) ; return ;
+      case vlCpuIsaAVX2: runCpuKernelAVX2(kernel) ; return ;
+      default: break ;
+    }
+#endif
+    kernel() ;
+  }
+
+} }
+
+#endif /* defined(__vl__cpufeatures__) */
@@ -0,0 +1,94 @@
+// @file half.hpp
+// @brief Half precision tensor helpers
+// @author Andrea Vedaldi
+
+/*
+Copyright (C) 2016 Andrea Vedaldi.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#ifndef __vl__half__
+#define __vl__half__
+
+#include "../data.hpp"
+#include <cstddef>
+
+namespace vl { namespace impl {
+
+  void convertHalfToFloat(float * dest, half_t const * src, size_t numElements) ;
+  void convertFloatToHalf(half_t * dest, float const * src, size_t numElements) ;
+
+  /*
+   FloatCopy is a single precision copy of a half precision CPU tensor,
+   used to run the blocks that have no half precision kernels (for
+   example, the BLAS-based convolution). The input tensors are
+   converted, the float code runs and accumulates in float, and the
+   output tensors are converted back by copyTo().
+
+   A copy of the whole tensor takes twice the memory of the tensor
+   itself. The blocks that work image by image copy the data one
+   image at a time instead, using initImage() and copyToImage(), so
+   that the float copies are never larger than an image.
+
+   A null tensor has a null copy.
+   */
+
+  class FloatCopy
+  {
+  public:
+    FloatCopy() ;
+    ~FloatCopy() ;
+
+    /* if convert is false, the copy is allocated but not filled */
+    vl::Error init(vl::Tensor tensor, bool convert = true) ;
+    void copyTo(vl::Tensor tensor) ;
+
+    /* the same for the image-th image of the tensor (the memory is
+       reused from one image to the next) */
+    vl::Error initImage(vl::Tensor tensor, size_t image, bool convert = true) ;
+    void copyToImage(vl::Tensor tensor, size_t image) ;
+
+    /* adds a copy with the same number of elements to this one */
+    void add(FloatCopy const & other) ;
+
+    operator vl::Tensor () const ;
+
+  private:
+    FloatCopy(FloatCopy const &) ;
+    FloatCopy & operator= (FloatCopy const &) ;
+    vl::Error assign(vl::TensorShape const & shape, half_t const * source,
+                     bool convert) ;
+    vl::Tensor tensor ;
+    float * memory ;
+    size_t capacity ;
+  } ;
+
+  /*
+   checkHalfDevice() reports an error to the context unless the tensor
+   is a CPU one (or null).
+   */
+
+  vl::Error checkHalfDevice(vl::Context & context, vl::Tensor tensor) ;
+
+  /*
+   initFloatCopies() initialises up to six float copies at once, as
+   needed by the blocks that wrap their float code for half tensors
+   (pass a null tensor for the unused slots). The first tensor must be
+   a CPU one. Errors are reported to the context as coming from
+   blockName.
+   */
+
+  vl::Error initFloatCopies(vl::Context & context, char const * blockName,
+                            FloatCopy & a, vl::Tensor ta, bool ca,
+                            FloatCopy & b, vl::Tensor tb, bool cb,
+                            FloatCopy & c, vl::Tensor tc, bool cc,
+                            FloatCopy & d, vl::Tensor td, bool cd,
+                            FloatCopy & e, vl::Tensor te, bool ce,
+                            FloatCopy & f, vl::Tensor tf, bool cf) ;
+
+} }
+
+#endif /* defined(__vl__half__) */
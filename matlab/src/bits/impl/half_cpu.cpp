@@ -0,0 +1,184 @@
+// @file half_cpu.cpp
+// @brief Half precision tensor helpers (CPU)
+// @author Andrea Vedaldi
+
+/*
+Copyright (C) 2016 Andrea Vedaldi.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#include "half.hpp"
+
+#ifndef _MSC_VER
+#pragma GCC optimize ("tree-vectorize")
+#endif
+
+#include "cpufeatures.hpp"
+#include <cstdlib>
+#include <cassert>
+
+using namespace vl ;
+using namespace vl::impl ;
+
+/* ---------------------------------------------------------------- */
+/*                                                      Conversions */
+/* ---------------------------------------------------------------- */
+
+struct HalfToFloat
+{
+  float * dest ; half_t const * src ; size_t numElements ;
+  void operator()() const {
+    for (size_t i = 0 ; i < numElements ; ++i) { dest[i] = src[i] ; }
+  }
+} ;
+
+struct FloatToHalf
+{
+  half_t * dest ; float const * src ; size_t numElements ;
+  void operator()() const {
+    for (size_t i = 0 ; i < numElements ; ++i) { dest[i] = src[i] ; }
+  }
+} ;
+
+void
+vl::impl::convertHalfToFloat(float * dest, half_t const * src, size_t numElements)
+{
+  HalfToFloat kernel = {dest, src, numElements} ;
+  runCpuKernel(kernel) ;
+}
+
+void
+vl::impl::convertFloatToHalf(half_t * dest, float const * src, size_t numElements)
+{
+  FloatToHalf kernel = {dest, src, numElements} ;
+  runCpuKernel(kernel) ;
+}
+
+/* ---------------------------------------------------------------- */
+/*                                                        FloatCopy */
+/* ---------------------------------------------------------------- */
+
+vl::impl::FloatCopy::FloatCopy()
+: memory(NULL), capacity(0)
+{ }
+
+vl::impl::FloatCopy::~FloatCopy()
+{
+  free(memory) ;
+}
+
+vl::Error
+vl::impl::FloatCopy::assign(vl::TensorShape const & shape,
+                            half_t const * source,
+                            bool convert)
+{
+  size_t numElements = shape.getNumElements() ;
+  float * target = NULL ;
+  if (source && numElements > 0) {
+    if (numElements > capacity) {
+      free(memory) ;
+      capacity = 0 ;
+      memory = (float*)malloc(sizeof(float) * numElements) ;
+      if (memory == NULL) { return vlErrorOutOfMemory ; }
+      capacity = numElements ;
+    }
+    target = memory ;
+    if (convert) {
+      convertHalfToFloat(target, source, numElements) ;
+    }
+  }
+  tensor = vl::Tensor(shape, vlTypeFloat, vl::CPU,
+                      target, sizeof(float) * numElements) ;
+  return vlSuccess ;
+}
+
+vl::Error
+vl::impl::FloatCopy::init(vl::Tensor source, bool convert)
+{
+  assert(!source || source.getDataType() == vlTypeHalf) ;
+  assert(!source || source.getDeviceType() == vl::CPU) ;
+  return assign(source.getShape(), (half_t const*)source.getMemory(), convert) ;
+}
+
+vl::Error
+vl::impl::FloatCopy::initImage(vl::Tensor source, size_t image, bool convert)
+{
+  assert(!source || source.getDataType() == vlTypeHalf) ;
+  assert(!source || source.getDeviceType() == vl::CPU) ;
+  vl::TensorShape shape = source.getShape() ;
+  size_t imageVolume = shape.getHeight() * shape.getWidth() * shape.getDepth() ;
+  half_t const * imageMemory = NULL ;
+  if (source) {
+    assert(image < shape.getSize()) ;
+    imageMemory = (half_t const*)source.getMemory() + imageVolume * image ;
+  }
+  shape.setSize(1) ;
+  return assign(shape, imageMemory, convert) ;
+}
+
+void
+vl::impl::FloatCopy::copyTo(vl::Tensor target)
+{
+  assert(target.getNumElements() == tensor.getNumElements()) ;
+  if (tensor) {
+    convertFloatToHalf((half_t*)target.getMemory(), memory, tensor.getNumElements()) ;
+  }
+}
+
+void
+vl::impl::FloatCopy::copyToImage(vl::Tensor target, size_t image)
+{
+  size_t imageVolume = target.getHeight() * target.getWidth() * target.getDepth() ;
+  if (tensor) {
+    assert(imageVolume == tensor.getNumElements()) ;
+    convertFloatToHalf((half_t*)target.getMemory() + imageVolume * image,
+                       memory, imageVolume) ;
+  }
+}
+
+void
+vl::impl::FloatCopy::add(FloatCopy const & other)
+{
+  size_t numElements = tensor.getNumElements() ;
+  assert(other.tensor.getNumElements() == numElements) ;
+  if (tensor && other.tensor) {
+    for (size_t i = 0 ; i < numElements ; ++i) { memory[i] += other.memory[i] ; }
+  }
+}
+
+vl::impl::FloatCopy::operator vl::Tensor () const
+{
+  return tensor ;
+}
+
+vl::Error
+vl::impl::checkHalfDevice(vl::Context & context, vl::Tensor tensor)
+{
+  if (tensor && tensor.getDeviceType() != vl::CPU) {
+    return context.setError(vlErrorUnsupported,
+                            "Half precision is supported only on the CPU.") ;
+  }
+  return vlSuccess ;
+}
+
+vl::Error
+vl::impl::initFloatCopies(vl::Context & context, char const * blockName,
+                          FloatCopy & a, vl::Tensor ta, bool ca,
+                          FloatCopy & b, vl::Tensor tb, bool cb,
+                          FloatCopy & c, vl::Tensor tc, bool cc,
+                          FloatCopy & d, vl::Tensor td, bool cd,
+                          FloatCopy & e, vl::Tensor te, bool ce,
+                          FloatCopy & f, vl::Tensor tf, bool cf)
+{
+  vl::Error error = checkHalfDevice(context, ta) ;
+  if (error == vlSuccess) { error = a.init(ta, ca) ; }
+  if (error == vlSuccess) { error = b.init(tb, cb) ; }
+  if (error == vlSuccess) { error = c.init(tc, cc) ; }
+  if (error == vlSuccess) { error = d.init(td, cd) ; }
+  if (error == vlSuccess) { error = e.init(te, ce) ; }
+  if (error == vlSuccess) { error = f.init(tf, cf) ; }
+  return context.passError(error, blockName) ;
+}
@@ -28,6 +28,7 @@ namespace vl { namespace impl {
             size_t height, size_t width, size_t depth,
             size_t windowHeight, size_t windowWidth,
             size_t strideY, size_t strideX,
+            size_t dilateY, size_t dilateX,
             size_t padTop, size_t padBottom, size_t padLeft, size_t padRight) ;
 
     static vl::Error
@@ -37,6 +38,7 @@ namespace vl { namespace impl {
              size_t height, size_t width, size_t depth,
              size_t windowHeight, size_t windowWidth,
              size_t strideY, size_t strideX,
+             size_t dilateY, size_t dilateX,
              size_t padTop, size_t padBottom, size_t padLeft, size_t padRight) ;
   } ;
 
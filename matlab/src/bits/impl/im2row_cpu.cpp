@@ -11,7 +11,14 @@ the terms of the BSD license (see the COPYING file).
 */
 
 #include "im2row.hpp"
+#include "cpufeatures.hpp"
+#include "tinythread.h"
 #include <string.h>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 using namespace vl ;
 using namespace vl::impl ;
@@ -38,6 +45,224 @@ static inline int static_min(int a, int b) {
   return (a<=b) ? a:b ;
 }
 
+/* ---------------------------------------------------------------- */
+/*                                          im2row fixed-size forward */
+/* ---------------------------------------------------------------- */
+
+/*
+ Most networks use square windows of size 1, 3, 5 or 7 with stride 1
+ or 2 and no dilation. For these, im2row_forward_fixed is instantiated
+ with the window size and stride known at compile time. The range of
+ patches whose pixels are all inside the image depends only on the
+ offset (u,v) and not on the channel, so it is computed once. Each
+ line of a stacked row is then filled by clearing the two borders
+ and copying the interior as a block (stride 1) or with a SIMD
+ deinterleave (stride 2).
+ */
+
+template<int stride, typename type> static inline void
+copy_strided(type* dest, type const* src, int n)
+{
+  for (int i = 0 ; i < n ; ++i) { dest[i] = src[stride * i] ; }
+}
+
+template<> inline void
+copy_strided<1,float>(float* dest, float const* src, int n)
+{
+  memcpy(dest, src, sizeof(float) * n) ;
+}
+
+template<> inline void
+copy_strided<1,double>(double* dest, double const* src, int n)
+{
+  memcpy(dest, src, sizeof(double) * n) ;
+}
+
+#ifdef __SSE2__
+/*
+ The last element of src read is src[2*(n-1)]; the vector loop stops
+ early enough not to read past it.
+ */
+template<> inline void
+copy_strided<2,float>(float* dest, float const* src, int n)
+{
+  int i = 0 ;
+  for ( ; i + 4 < n ; i += 4) {
+    __m128 a = _mm_loadu_ps(src + 2*i) ;
+    __m128 b = _mm_loadu_ps(src + 2*i + 4) ;
+    _mm_storeu_ps(dest + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0))) ;
+  }
+  for ( ; i < n ; ++i) { dest[i] = src[2*i] ; }
+}
+
+template<> inline void
+copy_strided<2,double>(double* dest, double const* src, int n)
+{
+  int i = 0 ;
+  for ( ; i + 2 < n ; i += 2) {
+    __m128d a = _mm_loadu_pd(src + 2*i) ;
+    __m128d b = _mm_loadu_pd(src + 2*i + 2) ;
+    _mm_storeu_pd(dest + i, _mm_shuffle_pd(a, b, 0)) ;
+  }
+  for ( ; i < n ; ++i) { dest[i] = src[2*i] ; }
+}
+#endif
+
+template<int window, int stride, typename type> static void
+im2row_forward_fixed(type* stacked,
+                     type const* data,
+                     int width, int height, int depth,
+                     int padLeft, int padRight,
+                     int padTop, int padBottom)
+{
+  const int numPatchesX = (width + (padLeft + padRight) - window)/stride + 1 ;
+  const int numPatchesY = (height + (padTop + padBottom) - window)/stride + 1 ;
+  int x0 [window] ;
+  int x1 [window] ;
+  int y0 [window] ;
+  int y1 [window] ;
+
+  /* see the comments in im2row<CPU>::forward; here the ranges are clamped */
+  for (int u = 0 ; u < window ; ++u) {
+    x0[u] = static_min(numPatchesX, static_max(0, ceil_divide(padLeft - u, stride))) ;
+    x1[u] = static_max(x0[u], static_min(numPatchesX, floor_divide(width-1 + padLeft - u, stride) + 1)) ;
+    y0[u] = static_min(numPatchesY, static_max(0, ceil_divide(padTop - u, stride))) ;
+    y1[u] = static_max(y0[u], static_min(numPatchesY, floor_divide(height-1 + padTop - u, stride) + 1)) ;
+  }
+
+  for (int z = 0 ; z < depth ; ++z) {
+    for (int v = 0 ; v < window ; ++v) {
+      for (int u = 0 ; u < window ; ++u) {
+        int xa = x0[u] ;
+        int xb = x1[u] ;
+        int ya = y0[v] ;
+        int yb = y1[v] ;
+        memset(stacked, 0, sizeof(type) * numPatchesX * ya) ;
+        if (stride == 1 && xa == 0 && xb == numPatchesX && numPatchesX == width) {
+          /* the lines are contiguous in the data too */
+          memcpy(stacked + numPatchesX * ya,
+                 data + (z * height + ya - padTop + v) * width + u - padLeft,
+                 sizeof(type) * numPatchesX * (yb - ya)) ;
+        } else {
+          for (int y = ya ; y < yb ; ++y) {
+            type* line = stacked + numPatchesX * y ;
+            int y_data = y * stride + v - padTop ;
+            int x_data = xa * stride + u - padLeft ;
+            memset(line, 0, sizeof(type) * xa) ;
+            copy_strided<stride>(line + xa, data + (z * height + y_data) * width + x_data, xb - xa) ;
+            memset(line + xb, 0, sizeof(type) * (numPatchesX - xb)) ;
+          }
+        }
+        memset(stacked + numPatchesX * yb, 0, sizeof(type) * numPatchesX * (numPatchesY - yb)) ;
+        stacked += numPatchesX * numPatchesY ;
+      }
+    }
+  }
+}
+
+/* Run with the best instruction set (see cpufeatures.hpp). */
+
+template<int window, int stride, typename type>
+struct Im2rowFixed
+{
+  type* stacked ; type const* data ;
+  int width ; int height ; int depth ;
+  int padLeft ; int padRight ; int padTop ; int padBottom ;
+  void operator()() const {
+    im2row_forward_fixed<window,stride>(stacked, data, width, height, depth,
+                                        padLeft, padRight, padTop, padBottom) ;
+  }
+} ;
+
+/* ---------------------------------------------------------------- */
+/*                                                           row2im */
+/* ---------------------------------------------------------------- */
+
+/*
+ row2im (im2row backward) accumulates each row of the stacked image back
+ into the data. Rows for different offsets (u,v) overlap in the data,
+ so the work is split instead by output location: each work item is a
+ band of input lines (y_data) of one feature channel z. Items write
+ disjoint parts of the data and can be processed in parallel. For each
+ item all the offsets (u,v) are visited in turn, so the band, which is
+ sized to stay in cache, receives all its contributions before the
+ next one is touched. Since the offsets are visited in the same order
+ as before, the result does not depend on the number of threads.
+ */
+
+#define VL_ROW2IM_BAND_SIZE (32*1024)
+#define VL_ROW2IM_MIN_WORK_PER_THREAD (64*1024)
+
+template<typename type>
+struct Row2imTask
+{
+  type* data ;
+  type const* stacked ;
+  int width ;
+  int height ;
+  int windowWidth ;
+  int windowHeight ;
+  int strideX ;
+  int strideY ;
+  int dilateX ;
+  int dilateY ;
+  int padLeft ;
+  int padTop ;
+  int numPatchesX ;
+  int numPatchesY ;
+  int bandHeight ;
+  int numBands ;
+  int firstItem ;
+  int lastItem ;
+  void operator()() const ;
+} ;
+
+template<typename type> static void
+row2im_items(Row2imTask<type> const & t)
+{
+  int numPatches = t.numPatchesX * t.numPatchesY ;
+  for (int item = t.firstItem ; item < t.lastItem ; ++item) {
+    int z = item / t.numBands ;
+    int h0 = (item % t.numBands) * t.bandHeight ;
+    int h1 = static_min(h0 + t.bandHeight, t.height) ;
+    for (int v = 0 ; v < t.windowHeight ; ++v) {
+      for (int u = 0 ; u < t.windowWidth ; ++u) {
+        int row = (z * t.windowHeight + v) * t.windowWidth + u ;
+        int ud = u * t.dilateX ;
+        int vd = v * t.dilateY ;
+        int x0 = static_max(0, ceil_divide(t.padLeft - ud, t.strideX)) ;
+        int x1 = static_min(t.numPatchesX, floor_divide(t.width-1 + t.padLeft - ud, t.strideX) + 1) ;
+        /* patches y such that h0 <= y_data(y) < h1 */
+        int y0 = static_max(0, ceil_divide(h0 + t.padTop - vd, t.strideY)) ;
+        int y1 = static_min(t.numPatchesY, floor_divide(h1-1 + t.padTop - vd, t.strideY) + 1) ;
+        type const* stacked = t.stacked + (ptrdiff_t)row * numPatches ;
+        for (int y = y0 ; y < y1 ; ++y) {
+          int y_data = y * t.strideY + vd - t.padTop ;
+          int x_data = x0 * t.strideX + ud - t.padLeft ;
+          type * b = t.data + ((ptrdiff_t)z * t.height + y_data) * t.width + x_data ;
+          type const* a = stacked + y * t.numPatchesX ;
+          for (int x = x0 ; x < x1 ; ++x) {
+            *b += a[x] ;
+            b += t.strideX ;
+          }
+        }
+      }
+    }
+  }
+}
+
+template<typename type> void
+Row2imTask<type>::operator()() const
+{
+  row2im_items(*this) ;
+}
+
+template<typename type> static void
+row2im_thread(void * task)
+{
+  vl::impl::runCpuKernel(*(Row2imTask<type> const*)task) ;
+}
+
 namespace vl { namespace impl {
 
 
@@ -60,13 +285,32 @@ namespace vl { namespace impl {
             size_t windowHeight,
             size_t strideX,
             size_t strideY,
+            size_t dilateX,
+            size_t dilateY,
             size_t padLeft,
             size_t padRight,
             size_t padTop,
             size_t padBottom)
     {
-      int numPatchesX = (width + (padLeft + padRight) - windowWidth)/strideX + 1 ;
-      int numPatchesY = (height + (padTop + padBottom) - windowHeight)/strideY + 1 ;
+      if (windowWidth == windowHeight && strideX == strideY &&
+          dilateX == 1 && dilateY == 1) {
+#define FIXED(window, stride) \
+        if (windowWidth == window && strideX == stride) { \
+          Im2rowFixed<window,stride,type> kernel = {stacked, data, \
+            (int)width, (int)height, (int)depth, \
+            (int)padLeft, (int)padRight, (int)padTop, (int)padBottom} ; \
+          runCpuKernel(kernel) ; \
+          return vl::vlSuccess ; \
+        }
+        FIXED(1,1) FIXED(3,1) FIXED(5,1) FIXED(7,1)
+        FIXED(1,2) FIXED(3,2) FIXED(5,2) FIXED(7,2)
+#undef FIXED
+      }
+
+      int windowExtentX = (windowWidth - 1) * dilateX + 1 ;
+      int windowExtentY = (windowHeight - 1) * dilateY + 1 ;
+      int numPatchesX = (width + (padLeft + padRight) - windowExtentX)/strideX + 1 ;
+      int numPatchesY = (height + (padTop + padBottom) - windowExtentY)/strideY + 1 ;
       int numRows = windowWidth * windowHeight * depth ;
 
       /*
@@ -88,6 +332,8 @@ namespace vl { namespace impl {
         int z = v / windowHeight ;
         u %= windowWidth ;
         v %= windowHeight ;
+        u *= dilateX ;
+        v *= dilateY ;
 
         /*
          Filling this row amounts to visiting all the pixels in the input
@@ -99,6 +345,9 @@ namespace vl { namespace impl {
          y_data(y) = y * strideY + v - padTop,   0 <= y < numPatchesY
          z_data(z) = z.
 
+         With dilation, the offsets (u,v) are multiplied by the dilation
+         factors, so that the filter taps are spread apart in the input.
+
          Here (x,y) are the spatial indexes of the output patches. Depending
          on the padding, some of these values will read pixels outised
          the input image, which should default to 0. In particular, x lands
@@ -166,50 +415,69 @@ namespace vl { namespace impl {
              size_t windowHeight,
              size_t strideX,
              size_t strideY,
+             size_t dilateX,
+             size_t dilateY,
              size_t padLeft,
              size_t padRight,
              size_t padTop,
              size_t padBottom)
     {
-      int numPatchesX = (width + (padLeft + padRight) - windowWidth)/strideX + 1 ;
-      int numPatchesY = (height + (padTop + padBottom) - windowHeight)/strideY + 1 ;
+      int windowExtentX = (windowWidth - 1) * dilateX + 1 ;
+      int windowExtentY = (windowHeight - 1) * dilateY + 1 ;
+      int numPatchesX = (width + (padLeft + padRight) - windowExtentX)/strideX + 1 ;
+      int numPatchesY = (height + (padTop + padBottom) - windowExtentY)/strideY + 1 ;
       int numRows = windowWidth * windowHeight * depth ;
 
       memset(data, 0, sizeof(type) * width * height * depth) ;
 
-      /*
-       Do the converse of im2col, still scanning rows of the stacked image.
-       See comments of im2col for an explanation of the algorithm.
-       */
-      for (int row = 0; row < numRows ; ++row) {
-        int u = row ;
-        int v = u / windowWidth ;
-        int z = v / windowHeight ;
-        u %= windowWidth ;
-        v %= windowHeight ;
-
-        int x0 = static_min(numPatchesX, ceil_divide(padLeft - u, strideX)) ;
-        int y0 = static_min(numPatchesY, ceil_divide(padTop - v, strideY)) ;
-        int x1 = static_min(numPatchesX, floor_divide(width-1 + padLeft - u, strideX) + 1) ;
-        int y1 = static_min(numPatchesY, floor_divide(height-1 + padTop - v, strideY) + 1) ;
-        int x ;
-        int y ;
-
-        y = static_max(0, y0) ;
-        stacked += numPatchesX * static_max(y, 0) ;
-        for ( ; y < y1 ; ++y) {
-          x = static_max(0, x0) ;
-          int y_data = y * strideY + v - padTop ;
-          int x_data = x * strideX + u - padLeft ;
-          type * b = data + (z * height + y_data) * width + x_data ;
-          stacked += x ;
-          for ( ; x < x1 ; ++x) {
-            *b += *stacked++ ;
-            b += strideX ;
-          }
-          stacked += numPatchesX - x ;
+      /* bands of whole lines of about VL_ROW2IM_BAND_SIZE bytes */
+      Row2imTask<type> task ;
+      task.data = data ;
+      task.stacked = stacked ;
+      task.width = width ;
+      task.height = height ;
+      task.windowWidth = windowWidth ;
+      task.windowHeight = windowHeight ;
+      task.strideX = strideX ;
+      task.strideY = strideY ;
+      task.dilateX = dilateX ;
+      task.dilateY = dilateY ;
+      task.padLeft = padLeft ;
+      task.padTop = padTop ;
+      task.numPatchesX = numPatchesX ;
+      task.numPatchesY = numPatchesY ;
+      task.bandHeight = static_max(1, VL_ROW2IM_BAND_SIZE / (sizeof(type) * width)) ;
+
+      /* use more, smaller bands if there are too few channels to go around */
+      int numThreads = static_min(context.getNumCpuThreads(),
+                                  1 + ((ptrdiff_t)numRows * numPatchesX * numPatchesY) / VL_ROW2IM_MIN_WORK_PER_THREAD) ;
+      task.numBands = static_max(divideUpwards(height, task.bandHeight),
+                                 divideUpwards(numThreads, depth)) ;
+      task.numBands = static_min(task.numBands, height) ;
+      task.bandHeight = divideUpwards(height, task.numBands) ;
+      task.numBands = divideUpwards(height, task.bandHeight) ;
+      int numItems = depth * task.numBands ;
+      numThreads = static_min(numThreads, numItems) ;
+
+      if (numThreads <= 1) {
+        task.firstItem = 0 ;
+        task.lastItem = numItems ;
+        runCpuKernel(task) ;
+      } else {
+        std::vector<Row2imTask<type> > tasks(numThreads, task) ;
+        std::vector<tthread::thread*> threads ;
+        for (int t = 0 ; t < numThreads ; ++t) {
+          tasks[t].firstItem = (numItems * t) / numThreads ;
+          tasks[t].lastItem = (numItems * (t + 1)) / numThreads ;
+        }
+        for (int t = 1 ; t < numThreads ; ++t) {
+          threads.push_back(new tthread::thread(row2im_thread<type>, &tasks[t])) ;
+        }
+        runCpuKernel(tasks[0]) ;
+        for (int t = 0 ; t < threads.size() ; ++t) {
+          threads[t]->join() ;
+          delete threads[t] ;
         }
-        stacked += numPatchesX * (numPatchesY - y) ;
       }
       return vl::vlSuccess ;
     }
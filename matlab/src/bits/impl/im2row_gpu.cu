@@ -32,6 +32,8 @@ im2row_forward_kernel(T* stacked,
                       const int windowHeight,
                       const int strideX,
                       const int strideY,
+                      const int dilateX,
+                      const int dilateY,
                       const int padLeft,
                       const int padTop)
 {
@@ -64,8 +66,8 @@ im2row_forward_kernel(T* stacked,
     /*
      copy the patch slice
      */
-    for (int v = 0 ; v < windowHeight ; ++v) {
-      for (int u = 0 ; u < windowWidth ; ++u) {
+    for (int v = 0 ; v < windowHeight * dilateY ; v += dilateY) {
+      for (int u = 0 ; u < windowWidth * dilateX ; u += dilateX) {
         if (y_data + v >= 0 &&
             y_data + v < height &&
             x_data + u >= 0 &&
@@ -196,6 +198,58 @@ im2row_backward_kernel(T* data,
   }
 }
 
+/*
+ With dilation, the closed-form expression of the stacked indexes
+ used above does not hold. Instead, each thread visits the filter
+ taps (u,v) and, for each, the only patch (x,y) that can read
+ (x_data,y_data) through that tap, if any.
+ */
+
+template <typename T> __global__ void
+im2row_backward_dilated_kernel(T* data,
+                               T const* stacked,
+                               const int numPatchesX,
+                               const int numPatchesY,
+                               const int dataVolume,
+                               const int width,
+                               const int height,
+                               const int depth,
+                               const int windowWidth,
+                               const int windowHeight,
+                               const int strideX,
+                               const int strideY,
+                               const int dilateX,
+                               const int dilateY,
+                               const int padLeft,
+                               const int padTop)
+{
+  int index = threadIdx.x + blockIdx.x * blockDim.x;
+  if (index < dataVolume)
+  {
+    T accumulator = 0 ;
+    int x_data = index ;
+    int y_data = x_data / width ;
+    int z = y_data / height ;
+    x_data %= width ;
+    y_data %= height ;
+
+    for (int v = 0 ; v < windowHeight ; ++v) {
+      int dy = y_data + padTop - v * dilateY ;
+      if (dy < 0 || dy % strideY) { continue ; }
+      int y = dy / strideY ;
+      if (y >= numPatchesY) { continue ; }
+      for (int u = 0 ; u < windowWidth ; ++u) {
+        int dx = x_data + padLeft - u * dilateX ;
+        if (dx < 0 || dx % strideX) { continue ; }
+        int x = dx / strideX ;
+        if (x >= numPatchesX) { continue ; }
+        accumulator += stacked[(((z * windowHeight + v) * windowWidth + u) * numPatchesY + y) * numPatchesX + x] ;
+      }
+    }
+    data[index] = accumulator;
+  }
+}
+
 namespace vl { namespace impl {
 
   template<typename type>
@@ -217,6 +271,8 @@ namespace vl { namespace impl {
             size_t windowHeight,
             size_t strideX,
             size_t strideY,
+            size_t dilateX,
+            size_t dilateY,
             size_t padLeft,
             size_t padRight,
             size_t padTop,
@@ -224,8 +280,10 @@ namespace vl { namespace impl {
     {
       /* Each kernel instance copies a feature dimension of a patch */
 
-      int numPatchesX = (width + (padLeft + padRight) - windowWidth)/strideX + 1 ;
-      int numPatchesY = (height + (padTop + padBottom) - windowHeight)/strideY + 1 ;
+      int windowExtentX = (windowWidth - 1) * dilateX + 1 ;
+      int windowExtentY = (windowHeight - 1) * dilateY + 1 ;
+      int numPatchesX = (width + (padLeft + padRight) - windowExtentX)/strideX + 1 ;
+      int numPatchesY = (height + (padTop + padBottom) - windowExtentY)/strideY + 1 ;
       int numPatchSlices = numPatchesX * numPatchesY * depth ;
 
       im2row_forward_kernel<type>
@@ -238,6 +296,7 @@ namespace vl { namespace impl {
        width, height,
        windowWidth, windowHeight,
        strideX, strideY,
+       dilateX, dilateY,
        padLeft, padTop) ;
 
       return context.setError(context.getCudaHelper().catchCudaError(__func__)) ;
@@ -258,6 +317,8 @@ namespace vl { namespace impl {
              size_t windowHeight,
              size_t strideX,
              size_t strideY,
+             size_t dilateX,
+             size_t dilateY,
              size_t padLeft,
              size_t padRight,
              size_t padTop,
@@ -268,10 +329,28 @@ namespace vl { namespace impl {
        of data.
        */
 
-      int numPatchesX = (width + (padLeft + padRight) - windowWidth)/strideX + 1 ;
-      int numPatchesY = (height + (padTop + padBottom) - windowHeight)/strideY + 1 ;
+      int windowExtentX = (windowWidth - 1) * dilateX + 1 ;
+      int windowExtentY = (windowHeight - 1) * dilateY + 1 ;
+      int numPatchesX = (width + (padLeft + padRight) - windowExtentX)/strideX + 1 ;
+      int numPatchesY = (height + (padTop + padBottom) - windowExtentY)/strideY + 1 ;
       int dataVolume = width * height * depth ;
 
+      if (dilateX != 1 || dilateY != 1) {
+        im2row_backward_dilated_kernel<type>
+        <<< divideUpwards(dataVolume, VL_CUDA_NUM_THREADS), VL_CUDA_NUM_THREADS >>>
+        (data,
+         stacked,
+         numPatchesX,
+         numPatchesY,
+         dataVolume,
+         width, height, depth,
+         windowWidth, windowHeight,
+         strideX, strideY,
+         dilateX, dilateY,
+         padLeft, padTop) ;
+        return context.setError(context.getCudaHelper().catchCudaError(__func__)) ;
+      }
+
       im2row_backward_kernel<type>
       <<< divideUpwards(dataVolume, VL_CUDA_NUM_THREADS), VL_CUDA_NUM_THREADS >>>
       (data,
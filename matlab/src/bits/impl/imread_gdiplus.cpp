@@ -195,6 +195,51 @@ vl::ImageReader::readShape(vl::ImageShape & shape, char const * filename)
   return impl->readShape(shape, filename) ;
 }
 
+vl::Error
+vl::ImageReader::readImage(vl::Image & image, char const * filename,
+                           vl::ImageAllocator allocator,
+                           vl::ImageShapeHint shapeHint, void * data,
+                           vl::Type dataType)
+{
+  /* the image is decoded in full anyway, so read the shape first;
+     decoding at a reduced size is not supported and shapeHint is
+     ignored */
+  if (dataType != vl::vlTypeFloat) {
+    snprintf(impl->lastErrorMessage, sizeof(impl->lastErrorMessage),
+             "reading UINT8 images requires the LibJPEG reader") ;
+    return vl::vlErrorUnsupported ;
+  }
+  vl::ImageShape shape ;
+  vl::Error error = readShape(shape, filename) ;
+  if (error != vl::vlSuccess) { return error ; }
+  float * memory ;
+  if (allocator) {
+    memory = (float*)allocator(shape, vl::vlTypeFloat, data) ;
+  } else {
+    memory = (float*)malloc(sizeof(float) * shape.getNumElements()) ;
+  }
+  if (memory == NULL) { return vl::vlErrorOutOfMemory ; }
+  error = readPixels(memory, filename) ;
+  if (error != vl::vlSuccess) {
+    if (!allocator) { free(memory) ; }
+    return error ;
+  }
+  image = vl::Image(shape, memory) ;
+  return vl::vlSuccess ;
+}
+
+vl::Error
+vl::ImageReader::readImageFromMemory(vl::Image & image,
+                                     void const * buffer, size_t size,
+                                     vl::ImageAllocator allocator,
+                                     vl::ImageShapeHint shapeHint, void * data,
+                                     vl::Type dataType)
+{
+  snprintf(impl->lastErrorMessage, sizeof(impl->lastErrorMessage),
+           "reading images from memory requires the LibJPEG reader") ;
+  return vl::vlErrorUnsupported ;
+}
+
 char const *
 vl::ImageReader::getLastErrorMessage() const
 {
@@ -10,12 +10,23 @@ This file is part of the VLFeat library and is made available under
 the terms of the BSD license (see the COPYING file).
 */
 
+#include "cpufeatures.hpp"
 #include <algorithm>
 #include <cassert>
 #include <cmath>
+#include <cstring>
 
-#ifdef __SSSE3__
+/*
+ The SSSE3 conversion routines are compiled if the compiler targets
+ SSSE3 or can generate code for it on demand; in the latter case,
+ they are used only if the CPU supports them.
+ */
+
+#if defined(__SSSE3__) || VL_CPU_DISPATCH
+#define VL_IMREAD_SSSE3 1
 #include <tmmintrin.h>
+#else
+#define VL_IMREAD_SSSE3 0
 #endif
 
 namespace vl { namespace impl {
@@ -29,15 +40,17 @@ namespace vl { namespace impl {
     pixelFormatBGRAasL
   };
 
-#ifndef __SSSE3__
+#if !VL_IMREAD_SSSE3
 #ifdef _MSC_VER
 #pragma message ( "SSSE3 instruction set not enabled. Using slower image conversion routines." )
 #else
 #warning "SSSE3 instruction set not enabled. Using slower image conversion routines."
+#endif
 #endif
 
-  template<int pixelFormat> void
-  imageFromPixels(vl::Image & image, char unsigned const * rgb, int rowStride)
+  /* T is float or, to keep the 8-bit values, char unsigned */
+  template<int pixelFormat, typename T> void
+  imageFromPixelsGeneric(vl::Image & image, char unsigned const * rgb, int rowStride)
   {
     vl::ImageShape const & shape = image.getShape() ;
     int blockSizeX ;
@@ -71,18 +84,18 @@ namespace vl { namespace impl {
     // will assume that the reference &image can be aliased
     // and recompute silly multiplications in the inner loop
 
-    float * const  __restrict imageMemory = image.getMemory() ;
+    T * const  __restrict imageMemory = (T*)image.getData() ;
     int const imageHeight = (int)shape.height ;
     int const imageWidth = (int)shape.width ;
 
     for (int x = 0 ; x < imageWidth ; x += blockSizeX) {
-      float * __restrict imageMemoryX = imageMemory + x * imageHeight ;
+      T * __restrict imageMemoryX = imageMemory + x * imageHeight ;
       int bsx = (std::min)(imageWidth - x, blockSizeX) ;
 
       for (int y = 0 ; y < imageHeight ; y += blockSizeY) {
         int bsy = (std::min)(imageHeight - y, blockSizeY) ;
-        float * __restrict r ;
-        float * rend ;
+        T * __restrict r ;
+        T * rend ;
         for (int dx = 0 ; dx < bsx ; ++dx) {
           char unsigned const * __restrict pixel = rgb + y * rowStride + (x + dx) * pixelStride ;
           r = imageMemoryX + y + dx * imageHeight ;
@@ -91,19 +104,19 @@ namespace vl { namespace impl {
             switch (pixelFormat) {
               case pixelFormatRGBA:
               case pixelFormatRGB:
-                r[0 * imagePlaneStride] = (float) pixel[0] ;
-                r[1 * imagePlaneStride] = (float) pixel[1] ;
-                r[2 * imagePlaneStride] = (float) pixel[2] ;
+                r[0 * imagePlaneStride] = (T) pixel[0] ;
+                r[1 * imagePlaneStride] = (T) pixel[1] ;
+                r[2 * imagePlaneStride] = (T) pixel[2] ;
                 break ;
               case pixelFormatBGR:
               case pixelFormatBGRA:
-                r[2 * imagePlaneStride] = (float) pixel[0] ;
-                r[1 * imagePlaneStride] = (float) pixel[1] ;
-                r[0 * imagePlaneStride] = (float) pixel[2] ;
+                r[2 * imagePlaneStride] = (T) pixel[0] ;
+                r[1 * imagePlaneStride] = (T) pixel[1] ;
+                r[0 * imagePlaneStride] = (T) pixel[2] ;
                 break;
               case pixelFormatBGRAasL:
               case pixelFormatL:
-                r[0] = (float) pixel[0] ;
+                r[0] = (T) pixel[0] ;
                 break ;
             }
             r += 1 ;
@@ -114,14 +127,11 @@ namespace vl { namespace impl {
     }
   }
 
-#else
-#ifdef _MSC_VER
-#pragma message ( "SSSE3 instruction set enabled." )
-#endif
+#if VL_IMREAD_SSSE3
   /* SSSE3 optimised version */
 
-  template<int pixelFormat> void
-  imageFromPixels(vl::Image & image, char unsigned const * rgb, int rowStride)
+  template<int pixelFormat> VL_CPU_TARGET_SSSE3 void
+  imageFromPixelsSSSE3(vl::Image & image, char unsigned const * rgb, int rowStride)
   {
     vl::ImageShape const & shape = image.getShape() ;
     int blockSizeX ;
@@ -181,7 +191,7 @@ namespace vl { namespace impl {
       case pixelFormatBGR:
         shuffleRgb = _mm_set_epi8(0xff,  9, 10, 11,
                                   0xff,  6,  7,  8,
-                                  0xff,  3,  4,  4,
+                                  0xff,  3,  4,  5,
                                   0xff,  0,  1,  2) ;
         break ;
 
@@ -390,8 +400,26 @@ namespace vl { namespace impl {
       }
     }
   }
+#endif
 
+  template<int pixelFormat> void
+  imageFromPixels(vl::Image & image, char unsigned const * rgb, int rowStride)
+  {
+    if (image.getDataType() == vl::vlTypeChar) {
+      imageFromPixelsGeneric<pixelFormat, char unsigned>(image, rgb, rowStride) ;
+      return ;
+    }
+#if VL_IMREAD_SSSE3
+#ifndef __SSSE3__
+    if (getCpuIsa() >= vlCpuIsaSSSE3)
 #endif
+    {
+      imageFromPixelsSSSE3<pixelFormat>(image, rgb, rowStride) ;
+      return ;
+    }
+#endif
+    imageFromPixelsGeneric<pixelFormat, float>(image, rgb, rowStride) ;
+  }
 
   struct ImageResizeFilter
   {
@@ -484,11 +512,22 @@ namespace vl { namespace impl {
     }
   } ;
 
-  inline void imageResizeVertical(float * output, float const * input, size_t outputHeight, size_t height, size_t width, size_t depth)
+  /* convert a filtered value to the type of the output image */
+  template<typename T> inline T castPixel(float z) ;
+  template<> inline float castPixel<float>(float z) { return z ; }
+  template<> inline char unsigned castPixel<char unsigned>(float z) {
+    return (char unsigned)(std::min)(255.0f, (std::max)(0.0f, z + 0.5f)) ;
+  }
+
+  template<typename TO, typename TI>
+  inline void imageResizeVertical(TO * output, TI const * input,
+                                  size_t outputHeight, size_t height, size_t width, size_t depth,
+                                  size_t inputColumnStride, size_t inputPlaneStride)
   {
     ImageResizeFilter filters(outputHeight, height) ;
     int filterSize = filters.filterSize ;
     for (int d = 0 ; d < (int)depth ; ++d) {
+      TI const * column = input + d * inputPlaneStride ;
       for (int x = 0 ; x < (int)width ; ++x) {
         for (int y = 0 ; y < (int)outputHeight ; ++y) {
           float z = 0 ;
@@ -497,26 +536,69 @@ namespace vl { namespace impl {
           for (int k = begin ; k < begin + filterSize ; ++k) {
             float w = *weights++ ;
             if ((0 <= k) & (k < (int)height)) {
-              z += input[k] * w ;
+              z += column[k] * w ;
             }
           }
-          output[x + y * width] = z ; // transpose
+          output[x + y * width] = castPixel<TO>(z) ; // transpose
         }
-        input += height ;
+        column += inputColumnStride ;
       }
       output += outputHeight * width ;
     }
   }
 
-  inline void resizeImage(vl::Image & output, vl::Image const & input)
+  template<typename TO, typename TI>
+  inline void imageResizeVertical(TO * output, TI const * input, size_t outputHeight, size_t height, size_t width, size_t depth)
+  {
+    imageResizeVertical(output, input, outputHeight, height, width, depth, height, height * width) ;
+  }
+
+  /* The first pass is always computed in single precision, so that
+     8-bit images are rounded only once. */
+  template<typename T>
+  inline void resizeImageWindow(vl::Image & output, vl::Image const & input,
+                                size_t y, size_t x, size_t height, size_t width)
   {
     vl::ImageShape const & inputShape = input.getShape() ;
     vl::ImageShape const & outputShape = output.getShape() ;
-    assert(outputShape.depth == inputShape.depth) ;
-    float * temp = (float*)malloc(sizeof(float) * outputShape.height * inputShape.width * inputShape.depth) ;
-    imageResizeVertical(temp, input.getMemory(), outputShape.height, inputShape.height, inputShape.width, inputShape.depth) ;
-    imageResizeVertical(output.getMemory(), temp, outputShape.width, inputShape.width, outputShape.height, inputShape.depth) ;
+    T const * window = (T const*)input.getData() + y + x * inputShape.height ;
+    if (outputShape.height == height && outputShape.width == width) {
+      T * pixels = (T*)output.getData() ;
+      for (size_t d = 0 ; d < inputShape.depth ; ++d) {
+        for (size_t u = 0 ; u < width ; ++u) {
+          memcpy(pixels, window + (u + d * inputShape.width) * inputShape.height, sizeof(T) * height) ;
+          pixels += height ;
+        }
+      }
+      return ;
+    }
+    float * temp = (float*)malloc(sizeof(float) * outputShape.height * width * inputShape.depth) ;
+    imageResizeVertical(temp, window, outputShape.height, height, width, inputShape.depth,
+                        inputShape.height, inputShape.height * inputShape.width) ;
+    imageResizeVertical((T*)output.getData(), (float const*)temp, outputShape.width, width, outputShape.height, inputShape.depth) ;
     free(temp) ;
   }
 
+  /* Resize the window of INPUT with top-left corner (Y,X) and size
+     HEIGHT x WIDTH to the shape of OUTPUT. The two images must have
+     the same depth and data type. */
+  inline void resizeImage(vl::Image & output, vl::Image const & input,
+                          size_t y, size_t x, size_t height, size_t width)
+  {
+    assert(output.getShape().depth == input.getShape().depth) ;
+    assert(output.getDataType() == input.getDataType()) ;
+    assert(y + height <= input.getShape().height && x + width <= input.getShape().width) ;
+    if (input.getDataType() == vl::vlTypeChar) {
+      resizeImageWindow<char unsigned>(output, input, y, x, height, width) ;
+    } else {
+      resizeImageWindow<float>(output, input, y, x, height, width) ;
+    }
+  }
+
+  inline void resizeImage(vl::Image & output, vl::Image const & input)
+  {
+    vl::ImageShape const & inputShape = input.getShape() ;
+    resizeImage(output, input, 0, 0, inputShape.height, inputShape.width) ;
+  }
+
 } }
@@ -20,6 +20,7 @@ the terms of the BSD license (see the COPYING file).
 #include <algorithm>
 extern "C" {
 #include <jpeglib.h>
+#include <jerror.h>
 #include <setjmp.h>
 }
 
@@ -40,8 +41,21 @@ public:
   char jpegLastErrorMsg [JMSG_LENGTH_MAX] ;
   char lastErrorMessage [ERR_MSG_MAX_LEN] ;
 
+  /* libjpeg refuses to switch the decompressor between its own file
+     and memory sources, so the latter is implemented here and the
+     former is saved and restored */
+  struct jpeg_source_mgr * fileSource ;
+  struct jpeg_source_mgr memorySource ;
+  void setFileSource(FILE * fp) ;
+  void setMemorySource(void const * buffer, size_t size) ;
+
   vl::Error readPixels(float * memory, char const * filename) ;
   vl::Error readShape(vl::ImageShape & shape, char const * filename) ;
+  vl::Error read(vl::Image & image, void * memory, vl::Type dataType,
+                 vl::ImageAllocator allocator,
+                 vl::ImageShapeHint shapeHint, void * data,
+                 char const * filename,
+                 void const * buffer = NULL, size_t bufferSize = 0) ;
 
   static void reader_jpeg_error (j_common_ptr cinfo)
   {
@@ -49,14 +63,45 @@ public:
     (*(cinfo->err->format_message)) (cinfo, self->jpegLastErrorMsg) ;
     longjmp(self->onJpegError, 1) ;
   }
+
+  static void memory_init_source(j_decompress_ptr cinfo) { }
+  static void memory_term_source(j_decompress_ptr cinfo) { }
+
+  static boolean memory_fill_input_buffer(j_decompress_ptr cinfo)
+  {
+    /* the data is over: insert a fake EOI marker as libjpeg does */
+    static JOCTET const eoi [2] = {0xFF, JPEG_EOI} ;
+    WARNMS(cinfo, JWRN_JPEG_EOF) ;
+    cinfo->src->next_input_byte = eoi ;
+    cinfo->src->bytes_in_buffer = 2 ;
+    return TRUE ;
+  }
+
+  static void memory_skip_input_data(j_decompress_ptr cinfo, long numBytes)
+  {
+    struct jpeg_source_mgr * src = cinfo->src ;
+    if (numBytes <= 0) { return ; }
+    if ((size_t)numBytes > src->bytes_in_buffer) {
+      memory_fill_input_buffer(cinfo) ;
+    } else {
+      src->next_input_byte += numBytes ;
+      src->bytes_in_buffer -= numBytes ;
+    }
+  }
 } ;
 
 vl::ImageReader::Impl::Impl()
+: fileSource(NULL)
 {
   lastErrorMessage[0] = 0 ;
   decompressor.err = jpeg_std_error(&jpegErrorManager) ;
   jpegErrorManager.error_exit = reader_jpeg_error ;
   jpeg_create_decompress(&decompressor) ;
+  memorySource.init_source = memory_init_source ;
+  memorySource.fill_input_buffer = memory_fill_input_buffer ;
+  memorySource.skip_input_data = memory_skip_input_data ;
+  memorySource.resync_to_restart = jpeg_resync_to_restart ;
+  memorySource.term_source = memory_term_source ;
 }
 
 vl::ImageReader::Impl::~Impl()
@@ -64,24 +109,61 @@ vl::ImageReader::Impl::~Impl()
   jpeg_destroy_decompress(&decompressor) ;
 }
 
+void
+vl::ImageReader::Impl::setFileSource(FILE * fp)
+{
+  decompressor.src = fileSource ;
+  jpeg_stdio_src(&decompressor, fp) ;
+  fileSource = decompressor.src ;
+}
+
+void
+vl::ImageReader::Impl::setMemorySource(void const * buffer, size_t size)
+{
+  memorySource.next_input_byte = (JOCTET const *)buffer ;
+  memorySource.bytes_in_buffer = size ;
+  decompressor.src = &memorySource ;
+}
+
+/*
+ Read the header and the pixels of an image opening the file once, or
+ from the bufferSize bytes at buffer if filename is NULL. If
+ memory is NULL, the image buffer is obtained from allocator once the
+ shape is known or, if that is NULL too, allocated with malloc(). If
+ shapeHint is not NULL, the image is decoded at the smallest scale
+ 1/2, 1/4 or 1/8 that is still at least as large as the shape it
+ returns. The pixels are stored as dataType (float or 8-bit). On
+ success, image is set to the shape and memory of the decoded image.
+ */
+
 vl::Error
-vl::ImageReader::Impl::readPixels(float * memory, char const * filename)
+vl::ImageReader::Impl::read(vl::Image & image, void * memory, vl::Type dataType,
+                            vl::ImageAllocator allocator,
+                            vl::ImageShapeHint shapeHint, void * data,
+                            char const * filename,
+                            void const * buffer, size_t bufferSize)
 {
   vl::Error error = vl::vlSuccess ;
   int row_stride ;
   const int blockSize = 32 ;
   char unsigned * pixels = NULL ;
   JSAMPARRAY scanlines = NULL ;
+  void * volatile allocatedMemory = NULL ;
   bool requiresAbort = false ;
 
   /* initialize the image as null */
   ImageShape shape ;
 
   /* open file */
-  FILE* fp = fopen(filename, "r") ;
-  if (fp == NULL) {
-    error = vl::vlErrorUnknown ;
-    return error ;
+  FILE* fp = NULL ;
+  if (filename) {
+    fp = fopen(filename, "r") ;
+    if (fp == NULL) {
+      error = vl::vlErrorUnknown ;
+      std::snprintf(lastErrorMessage, sizeof(lastErrorMessage),
+                    "could not open the file") ;
+      return error ;
+    }
   }
 
   /* handle LibJPEG errors */
@@ -92,8 +174,12 @@ vl::ImageReader::Impl::readPixels(float * memory, char const * filename)
     goto done ;
   }
 
-  /* set which file to read */
-  jpeg_stdio_src(&decompressor, fp);
+  /* set which file or buffer to read */
+  if (fp) {
+    setFileSource(fp) ;
+  } else {
+    setMemorySource(buffer, bufferSize) ;
+  }
 
   /* read image metadata */
   jpeg_read_header(&decompressor, TRUE) ;
@@ -109,13 +195,47 @@ vl::ImageReader::Impl::readPixels(float * memory, char const * filename)
     decompressor.out_color_space = JCS_RGB ;
   }
 
+  /* downscale in the DCT domain, which is much faster than decoding
+     the image at full resolution and resizing it afterwards */
+  decompressor.scale_num = 1 ;
+  decompressor.scale_denom = 1 ;
+  if (shapeHint) {
+    ImageShape target = shapeHint(ImageShape(decompressor.image_height,
+                                             decompressor.image_width,
+                                             shape.depth), data) ;
+    for (int denom = 8 ; denom > 1 ; denom /= 2) {
+      if ((decompressor.image_height + denom - 1) / denom >= target.height &&
+          (decompressor.image_width + denom - 1) / denom >= target.width) {
+        decompressor.scale_denom = denom ;
+        break ;
+      }
+    }
+  }
+
   /* get the output dimension */
   jpeg_calc_output_dimensions(&decompressor) ;
   shape.width = decompressor.output_width ;
   shape.height = decompressor.output_height ;
 
-  /* allocate scaline buffer */
-  pixels = (char unsigned*)malloc(sizeof(char) * shape.width * shape.height * shape.depth) ;
+  /* allocate the image buffer */
+  if (memory == NULL) {
+    if (allocator) {
+      memory = allocator(shape, dataType, data) ;
+    } else {
+      allocatedMemory = malloc(vl::getImageDataTypeSize(dataType) * shape.getNumElements()) ;
+      memory = allocatedMemory ;
+    }
+    if (memory == NULL) {
+      error = vl::vlErrorOutOfMemory ;
+      std::snprintf(lastErrorMessage, sizeof(lastErrorMessage),
+                    "could not allocate the image memory") ;
+      goto done ;
+    }
+  }
+
+  /* allocate scaline buffer (padded as the SSSE3 conversion routines
+     read the last pixels of a row in blocks of 16 bytes) */
+  pixels = (char unsigned*)malloc(sizeof(char) * shape.width * shape.height * shape.depth + 16) ;
   if (pixels == NULL) {
     error = vl::vlErrorUnknown ;
     goto done ;
@@ -137,7 +257,7 @@ vl::ImageReader::Impl::readPixels(float * memory, char const * filename)
                         shape.height - decompressor.output_scanline);
   }
   {
-    Image image(shape, memory) ;
+    Image image(shape, dataType, memory) ;
     switch (shape.depth) {
     case 3 : vl::impl::imageFromPixels<impl::pixelFormatRGB>(image, pixels, shape.width*3) ; break ;
     case 1 : vl::impl::imageFromPixels<impl::pixelFormatL>(image, pixels, shape.width*1) ; break ;
@@ -146,15 +266,24 @@ vl::ImageReader::Impl::readPixels(float * memory, char const * filename)
     jpeg_finish_decompress(&decompressor) ;
     requiresAbort = false ;
   }
+  image = vl::Image(shape, dataType, memory) ;
 
 done:
   if (requiresAbort) { jpeg_abort((j_common_ptr)&decompressor) ; }
   if (scanlines) free(scanlines) ;
   if (pixels) free(pixels) ;
-  fclose(fp) ;
+  if (error != vl::vlSuccess && allocatedMemory) free(allocatedMemory) ;
+  if (fp) fclose(fp) ;
   return error ;
 }
 
+vl::Error
+vl::ImageReader::Impl::readPixels(float * memory, char const * filename)
+{
+  vl::Image image ;
+  return read(image, memory, vl::vlTypeFloat, NULL, NULL, NULL, filename) ;
+}
+
 vl::Error
 vl::ImageReader::Impl::readShape(vl::ImageShape & shape, char const * filename)
 {
@@ -170,6 +299,8 @@ vl::ImageReader::Impl::readShape(vl::ImageShape & shape, char const * filename)
   FILE* fp = fopen(filename, "r") ;
   if (fp == NULL) {
     error = vl::vlErrorUnknown ;
+    std::snprintf(lastErrorMessage, sizeof(lastErrorMessage),
+                  "could not open the file") ;
     return error ;
   }
 
@@ -182,7 +313,7 @@ vl::ImageReader::Impl::readShape(vl::ImageShape & shape, char const * filename)
   }
 
   /* set which file to read */
-  jpeg_stdio_src(&decompressor, fp);
+  setFileSource(fp) ;
 
   /* read image metadata */
   jpeg_read_header(&decompressor, TRUE) ;
@@ -233,6 +364,25 @@ vl::ImageReader::readShape(vl::ImageShape & shape, char const * filename)
   return impl->readShape(shape, filename) ;
 }
 
+vl::Error
+vl::ImageReader::readImage(vl::Image & image, char const * filename,
+                           vl::ImageAllocator allocator,
+                           vl::ImageShapeHint shapeHint, void * data,
+                           vl::Type dataType)
+{
+  return impl->read(image, NULL, dataType, allocator, shapeHint, data, filename) ;
+}
+
+vl::Error
+vl::ImageReader::readImageFromMemory(vl::Image & image,
+                                     void const * buffer, size_t size,
+                                     vl::ImageAllocator allocator,
+                                     vl::ImageShapeHint shapeHint, void * data,
+                                     vl::Type dataType)
+{
+  return impl->read(image, NULL, dataType, allocator, shapeHint, data, NULL, buffer, size) ;
+}
+
 char const *
 vl::ImageReader::getLastErrorMessage() const
 {
@@ -15,7 +15,9 @@ the terms of the BSD license (see the COPYING file).
 
 #include "im2row.hpp"
 #include "blashelper.hpp"
+#include "copy.hpp"
 #include <assert.h>
+#include <algorithm>
 
 namespace vl { namespace impl {
 
@@ -26,8 +28,30 @@ namespace vl { namespace impl {
                       Tensor filters,
                       Tensor biases,
                       int strideY, int strideX,
+                      int dilateY, int dilateX,
                       int padTop, int padBottom,
-                      int padLeft, int padRight) ;
+                      int padLeft, int padRight,
+                      bool rectify = false) ;
+
+  template<vl::Device deviceType, vl::Type dataType> inline vl::Error
+  nnconv_forward_direct1x1_blas(Context& context,
+                                Tensor output, double outputMult,
+                                Tensor data, double dataMult,
+                                Tensor filters,
+                                Tensor biases,
+                                bool rectify = false) ;
+
+  template<vl::Device deviceType, vl::Type dataType> inline vl::Error
+  nnconv_gemm_bias_relu(Context& context,
+                        ptrdiff_t numOutputPixels,
+                        ptrdiff_t numFilters,
+                        ptrdiff_t volume,
+                        typename vl::DataTypeTraits<dataType>::type alpha,
+                        typename vl::DataTypeTraits<dataType>::type const * patches,
+                        typename vl::DataTypeTraits<dataType>::type const * filters,
+                        typename vl::DataTypeTraits<dataType>::type beta,
+                        typename vl::DataTypeTraits<dataType>::type * output,
+                        typename vl::DataTypeTraits<dataType>::type const * biases) ;
 
   template<vl::Device deviceType, vl::Type dataType> inline vl::Error
   nnconv_backward_blas(Context& context,
@@ -38,6 +62,7 @@ namespace vl { namespace impl {
                        Tensor filters,
                        Tensor derOutput,
                        int strideY, int strideX,
+                       int dilateY, int dilateX,
                        int padTop, int padBottom,
                        int padLeft, int padRight) ;
 
@@ -76,6 +101,74 @@ namespace vl { namespace impl {
 
  */
 
+/*
+ Fused bias and ReLU epilogue. The GEMM is split into blocks of output
+ pixels small enough that the corresponding block of the output, for
+ all the filters, stays in cache. Each block is biased and rectified
+ right after being computed, instead of making two further passes over
+ the whole output in memory. biases can be NULL.
+
+ With many filters the blocks become so thin that each GEMM re-reads
+ and repacks the whole filter bank for a few rows, which costs more
+ than the passes saved (about 25% slower with 512 filters and 64-row
+ blocks). If a block would be shorter than
+ VL_NNCONV_EPILOGUE_MIN_BLOCK_SIZE rows, a single GEMM is run instead,
+ followed by a single bias and ReLU pass.
+
+ patches is numOutputPixels x volume, filters is volume x numFilters,
+ and output is numOutputPixels x numFilters, all column-major with
+ leading dimensions numOutputPixels, volume, and numOutputPixels.
+ */
+
+#define VL_NNCONV_EPILOGUE_BLOCK_SIZE (128 * 1024)
+#define VL_NNCONV_EPILOGUE_MIN_BLOCK_SIZE 256
+
+template<vl::Device deviceType, vl::Type dataType> inline vl::Error
+vl::impl::nnconv_gemm_bias_relu(Context& context,
+                                ptrdiff_t numOutputPixels,
+                                ptrdiff_t numFilters,
+                                ptrdiff_t volume,
+                                typename vl::DataTypeTraits<dataType>::type alpha,
+                                typename vl::DataTypeTraits<dataType>::type const * patches,
+                                typename vl::DataTypeTraits<dataType>::type const * filters,
+                                typename vl::DataTypeTraits<dataType>::type beta,
+                                typename vl::DataTypeTraits<dataType>::type * output,
+                                typename vl::DataTypeTraits<dataType>::type const * biases)
+{
+  assert(deviceType == vl::CPU) ;
+  typedef typename vl::DataTypeTraits<dataType>::type type ;
+
+  ptrdiff_t blockSize = VL_NNCONV_EPILOGUE_BLOCK_SIZE / (numFilters * sizeof(type)) ;
+  blockSize &= ~(ptrdiff_t)15 ;
+  if (blockSize < VL_NNCONV_EPILOGUE_MIN_BLOCK_SIZE) {
+    blockSize = numOutputPixels ;
+  }
+
+  for (ptrdiff_t begin = 0 ; begin < numOutputPixels ; begin += blockSize) {
+    ptrdiff_t size = std::min(blockSize, numOutputPixels - begin) ;
+    vl::Error error = vl::impl::blas<deviceType,dataType>::gemm
+    (context,
+     'n', 'n',
+     size, numFilters, volume,
+     alpha,
+     patches + begin, numOutputPixels,
+     filters, volume,
+     beta,
+     output + begin, numOutputPixels) ;
+    if (error != vl::vlSuccess) { return error ; }
+
+    for (ptrdiff_t k = 0 ; k < numFilters ; ++k) {
+      type * y = output + begin + numOutputPixels * k ;
+      type b = biases ? biases[k] : (type)0 ;
+      for (ptrdiff_t i = 0 ; i < size ; ++i) {
+        type x = y[i] + b ;
+        y[i] = (x > 0) ? x : 0 ;
+      }
+    }
+  }
+  return vl::vlSuccess ;
+}
+
 template<vl::Device deviceType, vl::Type dataType> inline vl::Error
 vl::impl::nnconv_forward_blas(Context& context,
                               Tensor output, double outputMult,
@@ -83,8 +176,10 @@ vl::impl::nnconv_forward_blas(Context& context,
                               Tensor filters,
                               Tensor biases,
                               int strideY, int strideX,
+                              int dilateY, int dilateX,
                               int padTop, int padBottom,
-                              int padLeft, int padRight)
+                              int padLeft, int padRight,
+                              bool rectify)
 {
   assert(output) ;
   assert(data) ;
@@ -99,6 +194,9 @@ vl::impl::nnconv_forward_blas(Context& context,
   ptrdiff_t filtersVolume = filters.getHeight() * filters.getWidth() * filters.getDepth() ;
   ptrdiff_t tempVolume = numOutputPixels * filtersVolume * numGroups ;
 
+  /* on the CPU, bias and ReLU are applied by the GEMM epilogue */
+  bool fused = rectify && deviceType == vl::CPU ;
+
   type* tempMemory = (type*) context.getWorkspace(deviceType, tempVolume * sizeof(type)) ;
   type const* allOnesMemory = (type*) context.getAllOnes(deviceType,
                                                          dataType,
@@ -120,6 +218,7 @@ vl::impl::nnconv_forward_blas(Context& context,
      data.getHeight(), data.getWidth(), data.getDepth(),
      filters.getHeight(), filters.getWidth(),
      strideY, strideX,
+     dilateY, dilateX,
      padTop, padBottom, padLeft, padRight) ;
     if (error != vl::vlSuccess) { goto done ; }
 
@@ -129,6 +228,19 @@ vl::impl::nnconv_forward_blas(Context& context,
       ptrdiff_t outputGrpOffset = numOutputPixels * numFiltersPerGroup * g  ;
       type alpha = dataMult ;
       type beta = outputMult ;
+      if (fused) {
+        error = vl::impl::nnconv_gemm_bias_relu<deviceType,dataType>
+        (context,
+         numOutputPixels, numFiltersPerGroup, filtersVolume,
+         alpha,
+         tempMemory + tempGrpOffset,
+         (type*)filters.getMemory() + filterGrpOffset,
+         beta,
+         (type*)output.getMemory() + outputOffset + outputGrpOffset,
+         biases ? (type*)biases.getMemory() + numFiltersPerGroup * g : NULL) ;
+        if (error != vl::vlSuccess) { goto done ; }
+        continue ;
+      }
       error = vl::impl::blas<deviceType,dataType>::gemm
       (context,
        'n', 'n',
@@ -141,7 +253,108 @@ vl::impl::nnconv_forward_blas(Context& context,
       if (error != vl::vlSuccess) { goto done ; }
     }
 
-    if (biases) {
+    if (biases && !fused) {
+      type alpha = 1 ;
+      type beta = 1 ;
+      error = vl::impl::blas<deviceType,dataType>::gemm
+      (context,
+       'n', 'n',
+       numOutputPixels, biases.getNumElements(), 1,
+       alpha,
+       allOnesMemory, numOutputPixels,
+       (type*)biases.getMemory(), 1,
+       beta,
+       (type*)output.getMemory() + outputOffset, numOutputPixels) ;
+      if (error != vl::vlSuccess) { goto done ; }
+    }
+    if (rectify && !fused) {
+      error = vl::impl::operations<deviceType,type>::rectify
+      ((type*)output.getMemory() + outputOffset,
+       output.getHeight()*output.getWidth()*output.getDepth()) ;
+      if (error != vl::vlSuccess) { goto done ; }
+    }
+  }
+
+done:
+  return context.passError(error, __func__) ;
+}
+
+/*
+ With 1x1 filters, unit stride and no padding, the stacked image
+ computed by im2row is the input image itself. In this case the
+ GEMMs can read the data directly, skipping the im2row copy.
+ */
+
+template<vl::Device deviceType, vl::Type dataType> inline vl::Error
+vl::impl::nnconv_forward_direct1x1_blas(Context& context,
+                                        Tensor output, double outputMult,
+                                        Tensor data, double dataMult,
+                                        Tensor filters,
+                                        Tensor biases,
+                                        bool rectify)
+{
+  assert(output) ;
+  assert(data) ;
+  assert(filters) ;
+  assert(filters.getHeight() == 1 && filters.getWidth() == 1) ;
+
+  vl::Error error = vl::vlSuccess ;
+  typedef typename vl::DataTypeTraits<dataType>::type type ;
+
+  ptrdiff_t numGroups = data.getDepth() / filters.getDepth() ;
+  ptrdiff_t numFiltersPerGroup = filters.getSize() / numGroups ;
+  ptrdiff_t numOutputPixels = output.getHeight() * output.getWidth() ;
+  ptrdiff_t filtersVolume = filters.getDepth() ;
+  bool fused = rectify && deviceType == vl::CPU ;
+
+  type const* allOnesMemory = NULL ;
+  if (biases && !fused) {
+    allOnesMemory = (type*) context.getAllOnes(deviceType,
+                                               dataType,
+                                               numOutputPixels) ;
+    if (allOnesMemory == NULL) {
+      error = context.getLastError() ;
+      goto done ;
+    }
+  }
+
+  for (int image = 0 ; image < data.getSize() ; ++image) {
+
+    ptrdiff_t dataOffset = (data.getHeight()*data.getWidth()*data.getDepth()) * image ;
+    ptrdiff_t outputOffset = (output.getHeight()*output.getWidth()*output.getDepth()) * image ;
+
+    for (int g = 0 ; g < numGroups ; ++ g) {
+      ptrdiff_t filterGrpOffset = filtersVolume * numFiltersPerGroup * g ;
+      ptrdiff_t dataGrpOffset = numOutputPixels * filtersVolume * g ;
+      ptrdiff_t outputGrpOffset = numOutputPixels * numFiltersPerGroup * g  ;
+      type alpha = dataMult ;
+      type beta = outputMult ;
+      if (fused) {
+        error = vl::impl::nnconv_gemm_bias_relu<deviceType,dataType>
+        (context,
+         numOutputPixels, numFiltersPerGroup, filtersVolume,
+         alpha,
+         (type*)data.getMemory() + dataOffset + dataGrpOffset,
+         (type*)filters.getMemory() + filterGrpOffset,
+         beta,
+         (type*)output.getMemory() + outputOffset + outputGrpOffset,
+         biases ? (type*)biases.getMemory() + numFiltersPerGroup * g : NULL) ;
+        if (error != vl::vlSuccess) { goto done ; }
+        continue ;
+      }
+      error = vl::impl::blas<deviceType,dataType>::gemm
+      (context,
+       'n', 'n',
+       numOutputPixels, numFiltersPerGroup, filtersVolume,
+       alpha,
+       (type*)data.getMemory() + dataOffset + dataGrpOffset, numOutputPixels,
+       (type*)filters.getMemory() + filterGrpOffset, filtersVolume,
+       beta,
+       (type*)output.getMemory() + outputOffset + outputGrpOffset, numOutputPixels) ;
+      if (error != vl::vlSuccess) { goto done ; }
+    }
+
+    if (biases && !fused) {
       type alpha = 1 ;
       type beta = 1 ;
       error = vl::impl::blas<deviceType,dataType>::gemm
@@ -155,6 +368,12 @@ vl::impl::nnconv_forward_blas(Context& context,
        (type*)output.getMemory() + outputOffset, numOutputPixels) ;
       if (error != vl::vlSuccess) { goto done ; }
     }
+    if (rectify && !fused) {
+      error = vl::impl::operations<deviceType,type>::rectify
+      ((type*)output.getMemory() + outputOffset,
+       output.getHeight()*output.getWidth()*output.getDepth()) ;
+      if (error != vl::vlSuccess) { goto done ; }
+    }
   }
 
 done:
@@ -171,6 +390,7 @@ vl::impl::nnconv_backward_blas(Context& context,
                                Tensor filters,
                                Tensor derOutput,
                                int strideY, int strideX,
+                               int dilateY, int dilateX,
                                int padTop, int padBottom,
                                int padLeft, int padRight)
 {
@@ -272,6 +492,7 @@ vl::impl::nnconv_backward_blas(Context& context,
        derData.getHeight(), derData.getWidth(), derData.getDepth(),
        filters.getHeight(), filters.getWidth(),
        strideY, strideX,
+       dilateY, dilateX,
        padTop, padBottom, padLeft, padRight) ;
       if (error != vl::vlSuccess) { return error ; }
     }
@@ -287,6 +508,7 @@ vl::impl::nnconv_backward_blas(Context& context,
        data.getHeight(), data.getWidth(), data.getDepth(),
        derFilters.getHeight(), derFilters.getWidth(),
        strideY, strideX,
+       dilateY, dilateX,
        padTop, padBottom, padLeft, padRight) ;
       if (error != vl::vlSuccess) { return error ; }
       for (int g = 0 ; g < numGroups ; ++ g) {
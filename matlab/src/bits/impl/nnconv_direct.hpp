@@ -0,0 +1,68 @@
+// @file nnconv_direct.hpp
+// @brief Direct convolution for filters with few channels
+// @author Andrea Vedaldi
+
+/*
+Copyright (C) 2016 Andrea Vedaldi.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#ifndef __vl__nnconv_direct__
+#define __vl__nnconv_direct__
+
+#include "../data.hpp"
+#include <stddef.h>
+
+namespace vl { namespace impl {
+
+  /*
+   Direct (no im2row, no GEMM) convolution. This is meant for grouped
+   convolutions with shallow filters, and in particular depthwise
+   ones (one input channel per group), where the GEMM approach
+   degenerates into a large number of tiny matrix products. The work
+   is organised as multiply-accumulate operations between a filter
+   tap and a whole output column, which vectorise over the spatial
+   dimension. The arguments follow nnconv_forward and nnconv_backward:
+   data is height x width x depth x size, filters is filterHeight x
+   filterWidth x filterDepth x numFilters, and depth is a multiple of
+   filterDepth. Filter taps are spaced by the dilation factors.
+   derData, derFilters and derBiases can be NULL.
+   */
+
+  template<vl::Device dev, typename type>
+  struct nnconv_direct {
+
+    static vl::Error
+    forward(vl::Context& context,
+            type* output, double outputMult,
+            type const* data, double dataMult,
+            type const* filters,
+            type const* biases,
+            size_t height, size_t width, size_t depth, size_t size,
+            size_t filterHeight, size_t filterWidth, size_t filterDepth, size_t numFilters,
+            size_t strideY, size_t strideX,
+            size_t dilateY, size_t dilateX,
+            size_t padTop, size_t padBottom, size_t padLeft, size_t padRight,
+            bool rectify) ;
+
+    static vl::Error
+    backward(vl::Context& context,
+             type* derData,
+             type* derFilters,
+             type* derBiases,
+             type const* data,
+             type const* filters,
+             type const* derOutput,
+             size_t height, size_t width, size_t depth, size_t size,
+             size_t filterHeight, size_t filterWidth, size_t filterDepth, size_t numFilters,
+             size_t strideY, size_t strideX,
+             size_t dilateY, size_t dilateX,
+             size_t padTop, size_t padBottom, size_t padLeft, size_t padRight) ;
+  } ;
+
+} }
+
+#endif /* defined(__vl__nnconv_direct__) */
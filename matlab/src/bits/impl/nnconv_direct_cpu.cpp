@@ -0,0 +1,273 @@
+// @file nnconv_direct_cpu.cpp
+// @brief Direct convolution for filters with few channels (CPU)
+// @author Andrea Vedaldi
+
+/*
+Copyright (C) 2016 Andrea Vedaldi.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#include "nnconv_direct.hpp"
+#include <string.h>
+
+using namespace vl ;
+using namespace vl::impl ;
+
+/* ---------------------------------------------------------------- */
+/*                                                 Helper functions */
+/* ---------------------------------------------------------------- */
+
+static inline int floor_divide(int a, int b) {
+  if (a >= 0) return a/b;
+  else return (a - b + 1)/b;
+}
+
+static inline int ceil_divide(int a, int b) {
+  if (a >= 0) return (a + b - 1)/b ;
+  else return a/b ;
+}
+
+static inline int static_max(int a, int b) {
+  return (a>=b) ? a:b ;
+}
+
+static inline int static_min(int a, int b) {
+  return (a<=b) ? a:b ;
+}
+
+/*
+ Range [begin, end) of the output coordinates o such that the input
+ coordinate o * stride - pad + u read by the filter tap at offset u is in the
+ range [0, inputSize). Outside it the tap hits the zero padding.
+ */
+
+static inline void
+getValidRange(int & begin, int & end,
+              int outputSize, int inputSize,
+              int stride, int pad, int u)
+{
+  begin = static_max(0, ceil_divide(pad - u, stride)) ;
+  end = static_min(outputSize, floor_divide(inputSize - 1 + pad - u, stride) + 1) ;
+  if (end < begin) { end = begin ; }
+}
+
+namespace vl { namespace impl {
+
+  template<typename type>
+  struct nnconv_direct<vl::CPU, type>
+  {
+
+    /* ------------------------------------------------------------ */
+    /*                                                      forward */
+    /* ------------------------------------------------------------ */
+
+    static vl::Error
+    forward(vl::Context& context,
+            type* output, double outputMult,
+            type const* data, double dataMult,
+            type const* filters,
+            type const* biases,
+            size_t height, size_t width, size_t depth, size_t size,
+            size_t filterHeight, size_t filterWidth, size_t filterDepth, size_t numFilters,
+            size_t strideY, size_t strideX,
+            size_t dilateY, size_t dilateX,
+            size_t padTop, size_t padBottom, size_t padLeft, size_t padRight,
+            bool rectify)
+    {
+      int filterExtentY = (filterHeight - 1) * dilateY + 1 ;
+      int filterExtentX = (filterWidth - 1) * dilateX + 1 ;
+      int outputHeight = (height + (padTop + padBottom) - filterExtentY) / strideY + 1 ;
+      int outputWidth = (width + (padLeft + padRight) - filterExtentX) / strideX + 1 ;
+      int numGroups = depth / filterDepth ;
+      int numFiltersPerGroup = numFilters / numGroups ;
+      ptrdiff_t outputPlane = (ptrdiff_t)outputHeight * outputWidth ;
+      ptrdiff_t dataPlane = (ptrdiff_t)height * width ;
+      ptrdiff_t filterVolume = filterHeight * filterWidth * filterDepth ;
+
+      for (int image = 0 ; image < (int)size ; ++image) {
+        for (int k = 0 ; k < (int)numFilters ; ++k) {
+          int g = k / numFiltersPerGroup ;
+          type * y = output + outputPlane * (k + numFilters * image) ;
+          type const * x = data + dataPlane * (g * filterDepth + depth * image) ;
+          type const * w = filters + filterVolume * k ;
+
+          if (outputMult == 0) {
+            memset(y, 0, outputPlane * sizeof(type)) ;
+          } else if (outputMult != 1) {
+            type beta = outputMult ;
+            for (ptrdiff_t i = 0 ; i < outputPlane ; ++i) { y[i] *= beta ; }
+          }
+
+          for (int c = 0 ; c < (int)filterDepth ; ++c) {
+            for (int v = 0 ; v < (int)filterWidth ; ++v) {
+              int xbegin, xend ;
+              getValidRange(xbegin, xend, outputWidth, width, strideX, padLeft, v * dilateX) ;
+              for (int u = 0 ; u < (int)filterHeight ; ++u) {
+                int ybegin, yend ;
+                getValidRange(ybegin, yend, outputHeight, height, strideY, padTop, u * dilateY) ;
+                type weight = (type)dataMult * w[u + filterHeight * (v + filterWidth * c)] ;
+                for (int ox = xbegin ; ox < xend ; ++ox) {
+                  type * yc = y + (ptrdiff_t)ox * outputHeight ;
+                  ptrdiff_t base = dataPlane * c
+                  + (ptrdiff_t)(ox * (int)strideX - (int)padLeft + v * (int)dilateX) * height
+                  - (int)padTop + u * (int)dilateY ;
+                  if (strideY == 1) {
+                    for (int oy = ybegin ; oy < yend ; ++oy) {
+                      yc[oy] += weight * x[base + oy] ;
+                    }
+                  } else {
+                    for (int oy = ybegin ; oy < yend ; ++oy) {
+                      yc[oy] += weight * x[base + (ptrdiff_t)oy * strideY] ;
+                    }
+                  }
+                }
+              }
+            }
+          }
+
+          /* bias and ReLU while the output plane is in cache */
+          if (biases || rectify) {
+            type b = biases ? biases[k] : (type)0 ;
+            for (ptrdiff_t i = 0 ; i < outputPlane ; ++i) {
+              type z = y[i] + b ;
+              y[i] = (rectify && z < 0) ? (type)0 : z ;
+            }
+          }
+        }
+      }
+      return vlSuccess ;
+    }
+
+    /* ------------------------------------------------------------ */
+    /*                                                     backward */
+    /* ------------------------------------------------------------ */
+
+    static vl::Error
+    backward(vl::Context& context,
+             type* derData,
+             type* derFilters,
+             type* derBiases,
+             type const* data,
+             type const* filters,
+             type const* derOutput,
+             size_t height, size_t width, size_t depth, size_t size,
+             size_t filterHeight, size_t filterWidth, size_t filterDepth, size_t numFilters,
+             size_t strideY, size_t strideX,
+             size_t dilateY, size_t dilateX,
+             size_t padTop, size_t padBottom, size_t padLeft, size_t padRight)
+    {
+      int filterExtentY = (filterHeight - 1) * dilateY + 1 ;
+      int filterExtentX = (filterWidth - 1) * dilateX + 1 ;
+      int outputHeight = (height + (padTop + padBottom) - filterExtentY) / strideY + 1 ;
+      int outputWidth = (width + (padLeft + padRight) - filterExtentX) / strideX + 1 ;
+      int numGroups = depth / filterDepth ;
+      int numFiltersPerGroup = numFilters / numGroups ;
+      ptrdiff_t outputPlane = (ptrdiff_t)outputHeight * outputWidth ;
+      ptrdiff_t dataPlane = (ptrdiff_t)height * width ;
+      ptrdiff_t filterVolume = filterHeight * filterWidth * filterDepth ;
+
+      if (derBiases) {
+        memset(derBiases, 0, numFilters * sizeof(type)) ;
+      }
+      if (derFilters) {
+        memset(derFilters, 0, filterVolume * numFilters * sizeof(type)) ;
+      }
+
+      for (int image = 0 ; image < (int)size ; ++image) {
+
+        /* derData: scatter each output column back to the input */
+        if (derData) {
+          for (int g = 0 ; g < numGroups ; ++g) {
+            for (int c = 0 ; c < (int)filterDepth ; ++c) {
+              type * dx = derData + dataPlane * (g * filterDepth + c + depth * image) ;
+              memset(dx, 0, dataPlane * sizeof(type)) ;
+              for (int q = 0 ; q < numFiltersPerGroup ; ++q) {
+                int k = g * numFiltersPerGroup + q ;
+                type const * dy = derOutput + outputPlane * (k + numFilters * image) ;
+                type const * w = filters + filterVolume * k ;
+                for (int v = 0 ; v < (int)filterWidth ; ++v) {
+                  int xbegin, xend ;
+                  getValidRange(xbegin, xend, outputWidth, width, strideX, padLeft, v * dilateX) ;
+                  for (int u = 0 ; u < (int)filterHeight ; ++u) {
+                    int ybegin, yend ;
+                    getValidRange(ybegin, yend, outputHeight, height, strideY, padTop, u * dilateY) ;
+                    type weight = w[u + filterHeight * (v + filterWidth * c)] ;
+                    for (int ox = xbegin ; ox < xend ; ++ox) {
+                      type const * dyc = dy + (ptrdiff_t)ox * outputHeight ;
+                      ptrdiff_t base =
+                      (ptrdiff_t)(ox * (int)strideX - (int)padLeft + v * (int)dilateX) * height
+                      - (int)padTop + u * (int)dilateY ;
+                      if (strideY == 1) {
+                        for (int oy = ybegin ; oy < yend ; ++oy) {
+                          dx[base + oy] += weight * dyc[oy] ;
+                        }
+                      } else {
+                        for (int oy = ybegin ; oy < yend ; ++oy) {
+                          dx[base + (ptrdiff_t)oy * strideY] += weight * dyc[oy] ;
+                        }
+                      }
+                    }
+                  }
+                }
+              }
+            }
+          }
+        }
+
+        /* derFilters, derBiases: correlate output columns with input */
+        if (derFilters || derBiases) {
+          for (int k = 0 ; k < (int)numFilters ; ++k) {
+            int g = k / numFiltersPerGroup ;
+            type const * dy = derOutput + outputPlane * (k + numFilters * image) ;
+            if (derBiases) {
+              type acc = 0 ;
+              for (ptrdiff_t i = 0 ; i < outputPlane ; ++i) { acc += dy[i] ; }
+              derBiases[k] += acc ;
+            }
+            if (!derFilters) { continue ; }
+            type const * x = data + dataPlane * (g * filterDepth + depth * image) ;
+            type * dw = derFilters + filterVolume * k ;
+            for (int c = 0 ; c < (int)filterDepth ; ++c) {
+              for (int v = 0 ; v < (int)filterWidth ; ++v) {
+                int xbegin, xend ;
+                getValidRange(xbegin, xend, outputWidth, width, strideX, padLeft, v * dilateX) ;
+                for (int u = 0 ; u < (int)filterHeight ; ++u) {
+                  int ybegin, yend ;
+                  getValidRange(ybegin, yend, outputHeight, height, strideY, padTop, u * dilateY) ;
+                  type acc = 0 ;
+                  for (int ox = xbegin ; ox < xend ; ++ox) {
+                    type const * dyc = dy + (ptrdiff_t)ox * outputHeight ;
+                    ptrdiff_t base = dataPlane * c
+                    + (ptrdiff_t)(ox * (int)strideX - (int)padLeft + v * (int)dilateX) * height
+                    - (int)padTop + u * (int)dilateY ;
+                    if (strideY == 1) {
+                      for (int oy = ybegin ; oy < yend ; ++oy) {
+                        acc += dyc[oy] * x[base + oy] ;
+                      }
+                    } else {
+                      for (int oy = ybegin ; oy < yend ; ++oy) {
+                        acc += dyc[oy] * x[base + (ptrdiff_t)oy * strideY] ;
+                      }
+                    }
+                  }
+                  dw[u + filterHeight * (v + filterWidth * c)] += acc ;
+                }
+              }
+            }
+          }
+        }
+      }
+      return vlSuccess ;
+    }
+  } ;
+
+} }
+
+template struct vl::impl::nnconv_direct<vl::CPU, float> ;
+
+#ifdef ENABLE_DOUBLE
+template struct vl::impl::nnconv_direct<vl::CPU, double> ;
+#endif
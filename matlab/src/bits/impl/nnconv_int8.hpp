@@ -0,0 +1,108 @@
+// @file nnconv_int8.hpp
+// @brief Int8 quantized convolution and fully connected blocks (CPU)
+// @author Andrea Vedaldi
+
+/*
+Copyright (C) 2016 Andrea Vedaldi.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#ifndef __vl__nnconv_int8__
+#define __vl__nnconv_int8__
+
+#include "../data.hpp"
+#include <stddef.h>
+
+namespace vl { namespace impl {
+
+  /*
+   Int8 inference. The filters are quantized symmetrically with one
+   scale per output channel and the data with one scale per tensor:
+
+     w(v,k) ~ filterScales(k) * qw(v,k),   x(v) ~ inputScale * qx(v),
+
+   with qw and qx integers in [-127, 127]. The matrix products are
+   computed on the integers with 32-bit accumulators, and the GEMM
+   epilogue converts the result back to single precision, adding the
+   biases and applying the ReLU.
+
+   Both operands are stored as pairs of 16-bit integers so that the
+   kernels can use the multiply-add of 16-bit pairs (PMADDWD) of the
+   x86 vector instruction sets, which is exact for these values.
+   Filters are packed in blocks of VL_INT8_BLOCK_K output channels,
+   each block being volume/2 rows of VL_INT8_BLOCK_K pairs, preceded
+   by the VL_INT8_BLOCK_K scales.
+
+   filterScales can be NULL (an empty tensor), in which case they are
+   set to max_v |w(v,k)| / 127. inputScale can be zero, in which case
+   it is set to max |x| / 127 on each call (dynamic quantization).
+   Only single precision CPU tensors are supported, and there is no
+   backward mode.
+   */
+
+#define VL_INT8_BLOCK_K 16
+
+  size_t int8_packed_filters_size(size_t volume, size_t numFilters) ;
+
+  void int8_pack_filters(void * packed,
+                         float const * filters,
+                         float const * filterScales,
+                         size_t volume, size_t numFilters) ;
+
+  float int8_input_scale(float const * data, size_t numElements) ;
+
+  /*
+   output(k,n) = outputMult * output(k,n) + bias(k) +
+     inputScale * filterScale(k) * sum_v qw(v,k) qx(v,n)
+
+   The element (v,n) of the data is data[v * dataStrideV + n * dataStrideN]
+   and the element (k,n) of the output is
+   output[k * outputStrideK + n * outputStrideN]. biases can be NULL.
+   buffer holds the quantized data and must have at least
+   int8_gemm_buffer_size(volume, numColumns) bytes.
+   */
+
+  size_t int8_gemm_buffer_size(size_t volume, size_t numColumns) ;
+
+  vl::Error
+  int8_gemm(vl::Context& context,
+            float * output, ptrdiff_t outputStrideK, ptrdiff_t outputStrideN,
+            float outputMult,
+            void const * packedFilters, size_t volume, size_t numFilters,
+            float const * data, ptrdiff_t dataStrideV, ptrdiff_t dataStrideN,
+            size_t numColumns,
+            float inputScale,
+            float const * biases,
+            bool rectify,
+            void * buffer) ;
+
+  vl::Error
+  nnconv_forward_int8(vl::Context& context,
+                      vl::Tensor output,
+                      vl::Tensor data,
+                      vl::Tensor filters,
+                      vl::Tensor biases,
+                      float inputScale,
+                      vl::Tensor filterScales,
+                      int strideY, int strideX,
+                      int dilateY, int dilateX,
+                      int padTop, int padBottom,
+                      int padLeft, int padRight,
+                      bool rectify) ;
+
+  vl::Error
+  nnfullyconnected_forward_int8(vl::Context& context,
+                                vl::Tensor output,
+                                vl::Tensor data,
+                                vl::Tensor filters,
+                                vl::Tensor biases,
+                                float inputScale,
+                                vl::Tensor filterScales,
+                                bool rectify) ;
+
+} }
+
+#endif /* defined(__vl__nnconv_int8__) */
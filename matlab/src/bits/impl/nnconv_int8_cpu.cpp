@@ -0,0 +1,669 @@
+// @file nnconv_int8_cpu.cpp
+// @brief Int8 quantized convolution and fully connected blocks (CPU)
+// @author Andrea Vedaldi
+
+/*
+Copyright (C) 2016 Andrea Vedaldi.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#include "nnconv_int8.hpp"
+#include "im2row.hpp"
+#include "../filtercache.hpp"
+
+#ifndef _MSC_VER
+#pragma GCC optimize ("tree-vectorize")
+#endif
+
+#include "cpufeatures.hpp"
+#include "tinythread.h"
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <algorithm>
+#include <vector>
+
+#if VL_CPU_DISPATCH
+#include <immintrin.h>
+/* the VNNI intrinsics appeared in GCC 8 */
+#if defined(__clang__) || (__GNUC__ >= 8)
+#define VL_INT8_VNNI 1
+#else
+#define VL_INT8_VNNI 0
+#endif
+#endif
+
+using namespace vl ;
+using namespace vl::impl ;
+
+/* the widest kernel tile; the quantized data is padded to a multiple */
+#define VL_INT8_TILE_N 16
+#define VL_INT8_MIN_WORK_PER_THREAD (4*1024*1024)
+
+static inline size_t
+numPairs(size_t volume)
+{
+  return (volume + 1) / 2 ;
+}
+
+static inline size_t
+blockBytes(size_t volume)
+{
+  return VL_INT8_BLOCK_K * sizeof(float) +
+  numPairs(volume) * VL_INT8_BLOCK_K * 2 * sizeof(int16_t) ;
+}
+
+/* round to nearest and clamp to [-127, 127], without branches */
+static inline int
+quantize(float x, float invScale)
+{
+  float q = x * invScale + 128.5f ;
+  q = (q < 1.5f) ? 1.5f : q ;
+  q = (q > 255.5f) ? 255.5f : q ;
+  return (int)q - 128 ;
+}
+
+static inline uint32_t
+makePair(int a, int b)
+{
+  return (uint32_t)(uint16_t)(int16_t)a | ((uint32_t)(uint16_t)(int16_t)b << 16) ;
+}
+
+/* ---------------------------------------------------------------- */
+/*                                                  Filters packing */
+/* ---------------------------------------------------------------- */
+
+size_t
+vl::impl::int8_packed_filters_size(size_t volume, size_t numFilters)
+{
+  size_t numBlocks = (numFilters + VL_INT8_BLOCK_K - 1) / VL_INT8_BLOCK_K ;
+  return numBlocks * blockBytes(volume) ;
+}
+
+void
+vl::impl::int8_pack_filters(void * packed,
+                            float const * filters,
+                            float const * filterScales,
+                            size_t volume, size_t numFilters)
+{
+  size_t numBlocks = (numFilters + VL_INT8_BLOCK_K - 1) / VL_INT8_BLOCK_K ;
+  memset(packed, 0, int8_packed_filters_size(volume, numFilters)) ;
+  for (size_t b = 0 ; b < numBlocks ; ++b) {
+    char * block = (char*)packed + b * blockBytes(volume) ;
+    float * scales = (float*)block ;
+    int16_t * weights = (int16_t*)(block + VL_INT8_BLOCK_K * sizeof(float)) ;
+    for (size_t kk = 0 ; kk < VL_INT8_BLOCK_K ; ++kk) {
+      size_t k = b * VL_INT8_BLOCK_K + kk ;
+      if (k >= numFilters) { break ; }
+      float const * w = filters + k * volume ;
+      float scale ;
+      if (filterScales) {
+        scale = filterScales[k] ;
+      } else {
+        float maxAbs = 0 ;
+        for (size_t v = 0 ; v < volume ; ++v) {
+          maxAbs = std::max(maxAbs, std::abs(w[v])) ;
+        }
+        scale = maxAbs / 127.0f ;
+      }
+      float invScale = (scale > 0) ? 1.0f / scale : 0.0f ;
+      scales[kk] = scale ;
+      for (size_t v = 0 ; v < volume ; ++v) {
+        weights[((v / 2) * VL_INT8_BLOCK_K + kk) * 2 + (v % 2)] = (int16_t)quantize(w[v], invScale) ;
+      }
+    }
+  }
+}
+
+/* ---------------------------------------------------------------- */
+/*                                                Data quantization */
+/* ---------------------------------------------------------------- */
+
+struct MaxAbs
+{
+  float const * data ; size_t numElements ; float * result ;
+  void operator()() const {
+    float maxAbs = 0 ;
+    for (size_t i = 0 ; i < numElements ; ++i) {
+      maxAbs = std::max(maxAbs, std::abs(data[i])) ;
+    }
+    *result = maxAbs ;
+  }
+} ;
+
+float
+vl::impl::int8_input_scale(float const * data, size_t numElements)
+{
+  float maxAbs = 0 ;
+  MaxAbs kernel = {data, numElements, &maxAbs} ;
+  runCpuKernel(kernel) ;
+  return (maxAbs > 0) ? maxAbs / 127.0f : 1.0f ;
+}
+
+/*
+ Quantizes the columns [begin, end) of the data into pairs, zeroing the
+ columns [end, padEnd). begin and padEnd are multiples of
+ VL_INT8_TILE_N. The data is stored by tiles of VL_INT8_TILE_N columns,
+ each a contiguous array of numPairs(volume) rows of VL_INT8_TILE_N
+ pairs, so that a kernel streams through a tile.
+ */
+
+struct QuantizeColumns
+{
+  uint32_t * buffer ;
+  float const * data ;
+  ptrdiff_t strideV ;
+  ptrdiff_t strideN ;
+  size_t volume ;
+  size_t begin ;
+  size_t end ;
+  size_t padEnd ;
+  float invScale ;
+
+  void operator()() const {
+    size_t np = numPairs(volume) ;
+    size_t nv = volume / 2 ;
+    for (size_t p = 0 ; p < np ; ++p) {
+      float const * x0 = data + (2*p) * strideV ;
+      float const * x1 = x0 + strideV ;
+      bool odd = (p == nv) ;
+      for (size_t t = begin ; t < padEnd ; t += VL_INT8_TILE_N) {
+        uint32_t * q = buffer + t * np + p * VL_INT8_TILE_N ;
+        size_t m = (end > t) ? std::min((size_t)VL_INT8_TILE_N, end - t) : 0 ;
+        if (m == VL_INT8_TILE_N && !odd) {
+          for (size_t n = 0 ; n < VL_INT8_TILE_N ; ++n) {
+            q[n] = makePair(quantize(x0[(t + n) * strideN], invScale),
+                            quantize(x1[(t + n) * strideN], invScale)) ;
+          }
+        } else {
+          for (size_t n = 0 ; n < VL_INT8_TILE_N ; ++n) {
+            q[n] = (n < m) ? makePair(quantize(x0[(t + n) * strideN], invScale),
+                                      odd ? 0 : quantize(x1[(t + n) * strideN], invScale)) : 0 ;
+          }
+        }
+      }
+    }
+  }
+} ;
+
+/* ---------------------------------------------------------------- */
+/*                                                          Kernels */
+/* ---------------------------------------------------------------- */
+
+/*
+ A kernel computes a tile of VL_INT8_BLOCK_K output channels by
+ numColumns data columns: acc[n * VL_INT8_BLOCK_K + k] is the dot
+ product of the packed filter k of the block a and the column n of b,
+ whose pair p is b[p * VL_INT8_TILE_N + n].
+ */
+
+typedef void (*Int8Kernel)(int32_t * acc, int16_t const * a,
+                           uint32_t const * b,
+                           ptrdiff_t numPairs) ;
+
+static void
+int8_kernel_generic(int32_t * acc, int16_t const * a,
+                    uint32_t const * b,
+                    ptrdiff_t numPairs)
+{
+  int32_t sum [4 * VL_INT8_BLOCK_K] = {0} ;
+  for (ptrdiff_t p = 0 ; p < numPairs ; ++p) {
+    int16_t const * ap = a + p * 2 * VL_INT8_BLOCK_K ;
+    for (int n = 0 ; n < 4 ; ++n) {
+      uint32_t pair = b[p * VL_INT8_TILE_N + n] ;
+      int32_t b0 = (int16_t)(pair & 0xffff) ;
+      int32_t b1 = (int16_t)(pair >> 16) ;
+      for (int k = 0 ; k < VL_INT8_BLOCK_K ; ++k) {
+        sum[n * VL_INT8_BLOCK_K + k] += ap[2*k] * b0 + ap[2*k+1] * b1 ;
+      }
+    }
+  }
+  memcpy(acc, sum, sizeof(sum)) ;
+}
+
+#if VL_CPU_DISPATCH
+VL_CPU_TARGET_AVX2 static void
+int8_kernel_avx2(int32_t * acc, int16_t const * a,
+                 uint32_t const * b,
+                 ptrdiff_t numPairs)
+{
+  __m256i c00 = _mm256_setzero_si256(), c01 = _mm256_setzero_si256() ;
+  __m256i c10 = _mm256_setzero_si256(), c11 = _mm256_setzero_si256() ;
+  __m256i c20 = _mm256_setzero_si256(), c21 = _mm256_setzero_si256() ;
+  __m256i c30 = _mm256_setzero_si256(), c31 = _mm256_setzero_si256() ;
+  int const * bp = (int const*)b ;
+  for (ptrdiff_t p = 0 ; p < numPairs ; ++p, bp += VL_INT8_TILE_N) {
+    __m256i a0 = _mm256_loadu_si256((__m256i const*)(a + p * 32)) ;
+    __m256i a1 = _mm256_loadu_si256((__m256i const*)(a + p * 32 + 16)) ;
+    __m256i x ;
+    x = _mm256_set1_epi32(bp[0]) ;
+    c00 = _mm256_add_epi32(c00, _mm256_madd_epi16(a0, x)) ;
+    c01 = _mm256_add_epi32(c01, _mm256_madd_epi16(a1, x)) ;
+    x = _mm256_set1_epi32(bp[1]) ;
+    c10 = _mm256_add_epi32(c10, _mm256_madd_epi16(a0, x)) ;
+    c11 = _mm256_add_epi32(c11, _mm256_madd_epi16(a1, x)) ;
+    x = _mm256_set1_epi32(bp[2]) ;
+    c20 = _mm256_add_epi32(c20, _mm256_madd_epi16(a0, x)) ;
+    c21 = _mm256_add_epi32(c21, _mm256_madd_epi16(a1, x)) ;
+    x = _mm256_set1_epi32(bp[3]) ;
+    c30 = _mm256_add_epi32(c30, _mm256_madd_epi16(a0, x)) ;
+    c31 = _mm256_add_epi32(c31, _mm256_madd_epi16(a1, x)) ;
+  }
+  _mm256_storeu_si256((__m256i*)(acc +  0), c00) ;
+  _mm256_storeu_si256((__m256i*)(acc +  8), c01) ;
+  _mm256_storeu_si256((__m256i*)(acc + 16), c10) ;
+  _mm256_storeu_si256((__m256i*)(acc + 24), c11) ;
+  _mm256_storeu_si256((__m256i*)(acc + 32), c20) ;
+  _mm256_storeu_si256((__m256i*)(acc + 40), c21) ;
+  _mm256_storeu_si256((__m256i*)(acc + 48), c30) ;
+  _mm256_storeu_si256((__m256i*)(acc + 56), c31) ;
+}
+
+/*
+ The AVX-512 kernels compute 16 x 16 tiles. The accumulators are named
+ variables rather than an array, which the compiler would shuffle
+ between registers at each step.
+ */
+
+#define VL_INT8_AVX512_KERNEL(name, target, madd) \
+target static void \
+name(int32_t * acc, int16_t const * a, \
+     uint32_t const * b, \
+     ptrdiff_t numPairs) \
+{ \
+  __m512i c0 = _mm512_setzero_si512(), c1 = c0, c2 = c0, c3 = c0 ; \
+  __m512i c4 = c0, c5 = c0, c6 = c0, c7 = c0 ; \
+  __m512i c8 = c0, c9 = c0, c10 = c0, c11 = c0 ; \
+  __m512i c12 = c0, c13 = c0, c14 = c0, c15 = c0 ; \
+  int const * bp = (int const*)b ; \
+  for (ptrdiff_t p = 0 ; p < numPairs ; ++p, bp += VL_INT8_TILE_N) { \
+    __m512i x = _mm512_loadu_si512((void const*)(a + p * 32)) ; \
+    c0 = madd(c0, x, _mm512_set1_epi32(bp[0])) ; \
+    c1 = madd(c1, x, _mm512_set1_epi32(bp[1])) ; \
+    c2 = madd(c2, x, _mm512_set1_epi32(bp[2])) ; \
+    c3 = madd(c3, x, _mm512_set1_epi32(bp[3])) ; \
+    c4 = madd(c4, x, _mm512_set1_epi32(bp[4])) ; \
+    c5 = madd(c5, x, _mm512_set1_epi32(bp[5])) ; \
+    c6 = madd(c6, x, _mm512_set1_epi32(bp[6])) ; \
+    c7 = madd(c7, x, _mm512_set1_epi32(bp[7])) ; \
+    c8 = madd(c8, x, _mm512_set1_epi32(bp[8])) ; \
+    c9 = madd(c9, x, _mm512_set1_epi32(bp[9])) ; \
+    c10 = madd(c10, x, _mm512_set1_epi32(bp[10])) ; \
+    c11 = madd(c11, x, _mm512_set1_epi32(bp[11])) ; \
+    c12 = madd(c12, x, _mm512_set1_epi32(bp[12])) ; \
+    c13 = madd(c13, x, _mm512_set1_epi32(bp[13])) ; \
+    c14 = madd(c14, x, _mm512_set1_epi32(bp[14])) ; \
+    c15 = madd(c15, x, _mm512_set1_epi32(bp[15])) ; \
+  } \
+  _mm512_storeu_si512((void*)(acc + 16 * 0), c0) ; \
+  _mm512_storeu_si512((void*)(acc + 16 * 1), c1) ; \
+  _mm512_storeu_si512((void*)(acc + 16 * 2), c2) ; \
+  _mm512_storeu_si512((void*)(acc + 16 * 3), c3) ; \
+  _mm512_storeu_si512((void*)(acc + 16 * 4), c4) ; \
+  _mm512_storeu_si512((void*)(acc + 16 * 5), c5) ; \
+  _mm512_storeu_si512((void*)(acc + 16 * 6), c6) ; \
+  _mm512_storeu_si512((void*)(acc + 16 * 7), c7) ; \
+  _mm512_storeu_si512((void*)(acc + 16 * 8), c8) ; \
+  _mm512_storeu_si512((void*)(acc + 16 * 9), c9) ; \
+  _mm512_storeu_si512((void*)(acc + 16 * 10), c10) ; \
+  _mm512_storeu_si512((void*)(acc + 16 * 11), c11) ; \
+  _mm512_storeu_si512((void*)(acc + 16 * 12), c12) ; \
+  _mm512_storeu_si512((void*)(acc + 16 * 13), c13) ; \
+  _mm512_storeu_si512((void*)(acc + 16 * 14), c14) ; \
+  _mm512_storeu_si512((void*)(acc + 16 * 15), c15) ; \
+}
+
+#define VL_INT8_MADD(c, x, y) _mm512_add_epi32(c, _mm512_madd_epi16(x, y))
+VL_INT8_AVX512_KERNEL(int8_kernel_avx512, VL_CPU_TARGET_AVX512, VL_INT8_MADD)
+
+#if VL_INT8_VNNI
+/* VNNI fuses the multiply-add and the accumulation (VPDPWSSD) */
+VL_INT8_AVX512_KERNEL(int8_kernel_avx512vnni, VL_CPU_TARGET_AVX512VNNI, _mm512_dpwssd_epi32)
+#endif
+#endif
+
+/* ---------------------------------------------------------------- */
+/*                                                             GEMM */
+/* ---------------------------------------------------------------- */
+
+struct Int8GemmTask
+{
+  float * output ;
+  ptrdiff_t outputStrideK ;
+  ptrdiff_t outputStrideN ;
+  float outputMult ;
+  char const * packed ;
+  size_t volume ;
+  size_t numFilters ;
+  float const * data ;
+  ptrdiff_t dataStrideV ;
+  ptrdiff_t dataStrideN ;
+  size_t numColumns ;
+  size_t firstColumn ;
+  size_t lastColumn ;
+  float inputScale ;
+  float const * biases ;
+  bool rectify ;
+  uint32_t * buffer ;
+  Int8Kernel kernel ;
+  int tileWidth ;
+
+  void operator()() const ;
+  void computeTile(size_t blk, size_t n0) const ;
+} ;
+
+void
+Int8GemmTask::computeTile(size_t blk, size_t n0) const
+{
+  int32_t acc [VL_INT8_TILE_N * VL_INT8_BLOCK_K] ;
+  size_t np = numPairs(volume) ;
+  char const * block = packed + blk * blockBytes(volume) ;
+  float const * filterScales = (float const*)block ;
+  int16_t const * weights = (int16_t const*)(block + VL_INT8_BLOCK_K * sizeof(float)) ;
+  uint32_t const * tile = buffer + (n0 / VL_INT8_TILE_N) * VL_INT8_TILE_N * np ;
+  size_t k0 = blk * VL_INT8_BLOCK_K ;
+  size_t numK = std::min((size_t)VL_INT8_BLOCK_K, numFilters - k0) ;
+  size_t numN = std::min((size_t)tileWidth, numColumns - n0) ;
+
+  kernel(acc, weights, tile + n0 % VL_INT8_TILE_N, np) ;
+
+  /* epilogue: scale, bias, ReLU */
+  for (size_t n = 0 ; n < numN ; ++n) {
+    float * y = output + (n0 + n) * outputStrideN + k0 * outputStrideK ;
+    for (size_t k = 0 ; k < numK ; ++k) {
+      float z = acc[n * VL_INT8_BLOCK_K + k] * (inputScale * filterScales[k]) ;
+      if (biases) { z += biases[k0 + k] ; }
+      if (outputMult != 0) { z += outputMult * y[k * outputStrideK] ; }
+      if (rectify) { z = (z > 0) ? z : 0 ; }
+      y[k * outputStrideK] = z ;
+    }
+  }
+}
+
+/*
+ A task quantizes its columns in one pass and then computes the output
+ tile by tile, reusing each data tile for all the filter blocks. If
+ the filters are larger than the data, as in the fully connected
+ layers, the loops are swapped to stream the filters only once.
+ */
+
+void
+Int8GemmTask::operator()() const
+{
+  size_t numBlocks = (numFilters + VL_INT8_BLOCK_K - 1) / VL_INT8_BLOCK_K ;
+  size_t end = std::min(lastColumn, numColumns) ;
+
+  QuantizeColumns quantizer =
+  {buffer, data, dataStrideV, dataStrideN, volume,
+    firstColumn, end, lastColumn, 1.0f / inputScale} ;
+  runCpuKernel(quantizer) ;
+
+  if (numFilters > lastColumn - firstColumn) {
+    for (size_t blk = 0 ; blk < numBlocks ; ++blk) {
+      for (size_t n0 = firstColumn ; n0 < end ; n0 += tileWidth) {
+        computeTile(blk, n0) ;
+      }
+    }
+  } else {
+    for (size_t n0 = firstColumn ; n0 < end ; n0 += tileWidth) {
+      for (size_t blk = 0 ; blk < numBlocks ; ++blk) {
+        computeTile(blk, n0) ;
+      }
+    }
+  }
+}
+
+size_t
+vl::impl::int8_gemm_buffer_size(size_t volume, size_t numColumns)
+{
+  size_t numTiles = (numColumns + VL_INT8_TILE_N - 1) / VL_INT8_TILE_N ;
+  return sizeof(uint32_t) * numPairs(volume) * numTiles * VL_INT8_TILE_N ;
+}
+
+static void
+int8_gemm_thread(void * task)
+{
+  (*(Int8GemmTask const*)task)() ;
+}
+
+vl::Error
+vl::impl::int8_gemm(vl::Context& context,
+                    float * output, ptrdiff_t outputStrideK, ptrdiff_t outputStrideN,
+                    float outputMult,
+                    void const * packedFilters, size_t volume, size_t numFilters,
+                    float const * data, ptrdiff_t dataStrideV, ptrdiff_t dataStrideN,
+                    size_t numColumns,
+                    float inputScale,
+                    float const * biases,
+                    bool rectify,
+                    void * buffer)
+{
+  Int8GemmTask task ;
+  task.output = output ;
+  task.outputStrideK = outputStrideK ;
+  task.outputStrideN = outputStrideN ;
+  task.outputMult = outputMult ;
+  task.packed = (char const*)packedFilters ;
+  task.volume = volume ;
+  task.numFilters = numFilters ;
+  task.data = data ;
+  task.dataStrideV = dataStrideV ;
+  task.dataStrideN = dataStrideN ;
+  task.numColumns = numColumns ;
+  task.inputScale = inputScale ;
+  task.biases = biases ;
+  task.rectify = rectify ;
+  task.kernel = int8_kernel_generic ;
+  task.tileWidth = 4 ;
+#if VL_CPU_DISPATCH
+  switch (getCpuIsa()) {
+    case vlCpuIsaAVX512:
+      task.kernel = int8_kernel_avx512 ;
+#if VL_INT8_VNNI
+      if (getCpuHasVnni()) { task.kernel = int8_kernel_avx512vnni ; }
+#endif
+      task.tileWidth = 16 ;
+      break ;
+    case vlCpuIsaAVX2: task.kernel = int8_kernel_avx2 ; task.tileWidth = 4 ; break ;
+    default: break ;
+  }
+#endif
+
+  /* the quantized data, padded to whole tiles */
+  size_t numTiles = (numColumns + VL_INT8_TILE_N - 1) / VL_INT8_TILE_N ;
+  task.buffer = (uint32_t*)buffer ;
+
+  double work = (double)numColumns * volume * numFilters ;
+  int numThreads = (int)std::min((double)context.getNumCpuThreads(),
+                                 1 + work / VL_INT8_MIN_WORK_PER_THREAD) ;
+  numThreads = (int)std::min((size_t)numThreads, numTiles) ;
+  numThreads = std::max(numThreads, 1) ;
+
+  if (numThreads == 1) {
+    task.firstColumn = 0 ;
+    task.lastColumn = numTiles * VL_INT8_TILE_N ;
+    task() ;
+  } else {
+    std::vector<Int8GemmTask> tasks(numThreads, task) ;
+    std::vector<tthread::thread*> threads ;
+    for (int t = 0 ; t < numThreads ; ++t) {
+      tasks[t].firstColumn = ((numTiles * t) / numThreads) * VL_INT8_TILE_N ;
+      tasks[t].lastColumn = ((numTiles * (t + 1)) / numThreads) * VL_INT8_TILE_N ;
+    }
+    for (int t = 1 ; t < numThreads ; ++t) {
+      threads.push_back(new tthread::thread(int8_gemm_thread, &tasks[t])) ;
+    }
+    tasks[0]() ;
+    for (int t = 0 ; t < threads.size() ; ++t) {
+      threads[t]->join() ;
+      delete threads[t] ;
+    }
+  }
+  return vlSuccess ;
+}
+
+/* ---------------------------------------------------------------- */
+/*                                                   Packed filters */
+/* ---------------------------------------------------------------- */
+
+/*
+ Returns the filters packed for int8_gemm, one bank per group, from
+ the filter cache if enabled or in a temporary buffer otherwise. The
+ filter scales take the place of the biases in the cache key.
+ */
+
+class PackedFilters
+{
+public:
+  PackedFilters() : memory(NULL), owned(NULL) { }
+  ~PackedFilters() { free(owned) ; }
+
+  vl::Error init(vl::Context& context, Tensor filters, Tensor filterScales, size_t numGroups)
+  {
+    size_t volume = filters.getHeight() * filters.getWidth() * filters.getDepth() ;
+    size_t numFiltersPerGroup = filters.getSize() / numGroups ;
+    groupBytes = int8_packed_filters_size(volume, numFiltersPerGroup) ;
+    size_t size = groupBytes * numGroups ;
+    bool needsPacking = false ;
+    vl::Error error ;
+    memory = (char*)context.getFilterCache().get
+    (error, needsPacking, vl::vlFilterPackingInt8, filters, filterScales, size) ;
+    if (error != vlSuccess) { return error ; }
+    if (memory == NULL) {
+      memory = owned = (char*)malloc(size) ;
+      if (memory == NULL) { return vlErrorOutOfMemory ; }
+      needsPacking = true ;
+    }
+    if (needsPacking) {
+      for (size_t g = 0 ; g < numGroups ; ++g) {
+        int8_pack_filters(memory + groupBytes * g,
+                          (float const*)filters.getMemory() + volume * numFiltersPerGroup * g,
+                          filterScales ? (float const*)filterScales.getMemory() + numFiltersPerGroup * g : NULL,
+                          volume, numFiltersPerGroup) ;
+      }
+    }
+    return vlSuccess ;
+  }
+
+  void const * getGroup(size_t g) const { return memory + groupBytes * g ; }
+
+private:
+  PackedFilters(PackedFilters const &) ;
+  PackedFilters & operator= (PackedFilters const &) ;
+  char * memory ;
+  char * owned ;
+  size_t groupBytes ;
+} ;
+
+/* ---------------------------------------------------------------- */
+/*                                                           Blocks */
+/* ---------------------------------------------------------------- */
+
+vl::Error
+vl::impl::nnconv_forward_int8(vl::Context& context,
+                              vl::Tensor output,
+                              vl::Tensor data,
+                              vl::Tensor filters,
+                              vl::Tensor biases,
+                              float inputScale,
+                              vl::Tensor filterScales,
+                              int strideY, int strideX,
+                              int dilateY, int dilateX,
+                              int padTop, int padBottom,
+                              int padLeft, int padRight,
+                              bool rectify)
+{
+  vl::Error error ;
+  ptrdiff_t numGroups = data.getDepth() / filters.getDepth() ;
+  ptrdiff_t numFiltersPerGroup = filters.getSize() / numGroups ;
+  ptrdiff_t numOutputPixels = output.getHeight() * output.getWidth() ;
+  ptrdiff_t filtersVolume = filters.getHeight() * filters.getWidth() * filters.getDepth() ;
+  ptrdiff_t tempVolume = numOutputPixels * filtersVolume * numGroups ;
+
+  PackedFilters packed ;
+  error = packed.init(context, filters, filterScales, numGroups) ;
+  if (error != vlSuccess) { return error ; }
+
+  if (inputScale <= 0) {
+    inputScale = int8_input_scale((float const*)data.getMemory(), data.getNumElements()) ;
+  }
+
+  /* the workspace holds the patches followed by their quantized version */
+  size_t tempSize = (tempVolume * sizeof(float) + 63) & ~(size_t)63 ;
+  size_t bufferSize = int8_gemm_buffer_size(filtersVolume, numOutputPixels) ;
+  float * temp = (float*)context.getWorkspace(vl::CPU, tempSize + bufferSize) ;
+  if (temp == NULL) { return context.getLastError() ; }
+  void * buffer = (char*)temp + tempSize ;
+
+  for (int image = 0 ; image < data.getSize() ; ++image) {
+    ptrdiff_t dataOffset = (data.getHeight()*data.getWidth()*data.getDepth()) * image ;
+    ptrdiff_t outputOffset = (output.getHeight()*output.getWidth()*output.getDepth()) * image ;
+
+    error = vl::impl::im2row<vl::CPU,float>::forward
+    (context,
+     temp,
+     (float const*)data.getMemory() + dataOffset,
+     data.getHeight(), data.getWidth(), data.getDepth(),
+     filters.getHeight(), filters.getWidth(),
+     strideY, strideX,
+     dilateY, dilateX,
+     padTop, padBottom, padLeft, padRight) ;
+    if (error != vlSuccess) { break ; }
+
+    for (int g = 0 ; g < numGroups ; ++g) {
+      error = int8_gemm
+      (context,
+       (float*)output.getMemory() + outputOffset + numOutputPixels * numFiltersPerGroup * g,
+       numOutputPixels, 1, 0,
+       packed.getGroup(g), filtersVolume, numFiltersPerGroup,
+       temp + numOutputPixels * filtersVolume * g, numOutputPixels, 1,
+       numOutputPixels,
+       inputScale,
+       biases ? (float const*)biases.getMemory() + numFiltersPerGroup * g : NULL,
+       rectify, buffer) ;
+      if (error != vlSuccess) { break ; }
+    }
+    if (error != vlSuccess) { break ; }
+  }
+  return error ;
+}
+
+vl::Error
+vl::impl::nnfullyconnected_forward_int8(vl::Context& context,
+                                        vl::Tensor output,
+                                        vl::Tensor data,
+                                        vl::Tensor filters,
+                                        vl::Tensor biases,
+                                        float inputScale,
+                                        vl::Tensor filterScales,
+                                        bool rectify)
+{
+  ptrdiff_t filtersVolume = filters.getHeight() * filters.getWidth() * filters.getDepth() ;
+  ptrdiff_t numFilters = filters.getSize() ;
+
+  PackedFilters packed ;
+  vl::Error error = packed.init(context, filters, filterScales, 1) ;
+  if (error != vlSuccess) { return error ; }
+
+  if (inputScale <= 0) {
+    inputScale = int8_input_scale((float const*)data.getMemory(), data.getNumElements()) ;
+  }
+
+  void * buffer = context.getWorkspace
+  (vl::CPU, int8_gemm_buffer_size(filtersVolume, data.getSize())) ;
+  if (buffer == NULL) { return context.getLastError() ; }
+
+  return int8_gemm
+  (context,
+   (float*)output.getMemory(), 1, numFilters, 0,
+   packed.getGroup(0), filtersVolume, numFilters,
+   (float const*)data.getMemory(), 1, filtersVolume,
+   data.getSize(),
+   inputScale,
+   biases ? (float const*)biases.getMemory() : NULL,
+   rectify, buffer) ;
+}
@@ -0,0 +1,38 @@
+// @file nnfullyconnected_sparse.hpp
+// @brief Fully connected block with sparse filters (CPU)
+// @author Andrea Vedaldi
+
+/*
+Copyright (C) 2016 Andrea Vedaldi.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#ifndef __vl__nnfullyconnected_sparse__
+#define __vl__nnfullyconnected_sparse__
+
+#include "../nnfullyconnected.hpp"
+
+namespace vl { namespace impl {
+
+  /*
+   output(k,n) = bias(k) + sum_v filters(v,k) data(v,n), with the
+   filters in the format of vl::SparseFilters. data is a
+   volume x numColumns and output a numFilters x numColumns matrix.
+   biases can be NULL.
+   */
+
+  template<typename type> vl::Error
+  nnfullyconnected_forward_sparse(vl::Context& context,
+                                  type * output,
+                                  type const * data,
+                                  size_t numColumns,
+                                  vl::SparseFilters const & filters,
+                                  type const * biases,
+                                  bool rectify) ;
+
+} }
+
+#endif /* defined(__vl__nnfullyconnected_sparse__) */
@@ -0,0 +1,293 @@
+// @file nnfullyconnected_sparse_cpu.cpp
+// @brief Fully connected block with sparse filters (CPU)
+// @author Andrea Vedaldi
+
+/*
+Copyright (C) 2016 Andrea Vedaldi.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#include "nnfullyconnected_sparse.hpp"
+#include "../filtercache.hpp"
+
+#ifndef _MSC_VER
+#pragma GCC optimize ("tree-vectorize")
+#endif
+
+#include "cpufeatures.hpp"
+#include "tinythread.h"
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+using namespace vl ;
+using namespace vl::impl ;
+
+/* Minimum number of multiply-adds for starting one more thread */
+#define VL_SPARSE_MIN_WORK_PER_THREAD (1024*1024)
+
+/* Maximum size of a transposed data tile */
+#define VL_SPARSE_TILE_BYTES (2*1024*1024)
+
+/* ---------------------------------------------------------------- */
+/*                                                           Kernel */
+/* ---------------------------------------------------------------- */
+
+/*
+ The product is computed on tiles of W columns of the data (e.g. the
+ region proposals of a Fast R-CNN batch). A tile is first transposed
+ so that the W values of an input element are contiguous; then each
+ nonzero weight of a filter scales one such row and adds it to W
+ accumulators, which vectorizes over the columns irrespective of the
+ sparsity pattern. The transposed tile is reused by all the filters.
+
+ The work is split among threads by columns if there are enough of
+ them, and by filters otherwise (a single image).
+ */
+
+template<typename type, int W, typename value_type, typename index_type>
+struct SparseFcTask
+{
+  type * output ;
+  type const * data ;
+  size_t volume ;
+  size_t numFilters ;
+  size_t const * offsets ;
+  index_type const * rows ;
+  value_type const * values ;
+  type const * biases ;
+  bool rectify ;
+  size_t firstColumn ;
+  size_t lastColumn ;
+  size_t firstFilter ;
+  size_t lastFilter ;
+  type * buffer ;
+
+  void operator()() const
+  {
+    for (size_t n0 = firstColumn ; n0 < lastColumn ; n0 += W) {
+      size_t numN = std::min((size_t)W, lastColumn - n0) ;
+
+      /* transpose the tile, padding it with zeros */
+      for (size_t n = 0 ; n < numN ; ++n) {
+        type const * x = data + (n0 + n) * volume ;
+        for (size_t v = 0 ; v < volume ; ++v) {
+          buffer[v * W + n] = x[v] ;
+        }
+      }
+      for (size_t n = numN ; n < W ; ++n) {
+        for (size_t v = 0 ; v < volume ; ++v) {
+          buffer[v * W + n] = 0 ;
+        }
+      }
+
+      for (size_t k = firstFilter ; k < lastFilter ; ++k) {
+        type acc [W] ;
+        for (int t = 0 ; t < W ; ++t) { acc[t] = 0 ; }
+        size_t end = offsets[k+1] ;
+        for (size_t j = offsets[k] ; j < end ; ++j) {
+          type w = (type)values[j] ;
+          type const * x = buffer + (size_t)rows[j] * W ;
+          for (int t = 0 ; t < W ; ++t) { acc[t] += w * x[t] ; }
+        }
+        type b = biases ? biases[k] : (type)0 ;
+        for (size_t n = 0 ; n < numN ; ++n) {
+          type z = acc[n] + b ;
+          if (rectify) { z = (z > 0) ? z : (type)0 ; }
+          output[k + (n0 + n) * numFilters] = z ;
+        }
+      }
+    }
+  }
+} ;
+
+template<class Task> static void
+sparse_fc_thread(void * task)
+{
+  runCpuKernel(*(Task const*)task) ;
+}
+
+template<typename type, int W, typename value_type, typename index_type> static vl::Error
+sparse_fc(vl::Context& context,
+          type * output,
+          type const * data,
+          size_t numColumns,
+          SparseFilters const & filters,
+          value_type const * values,
+          index_type const * rows,
+          type const * biases,
+          bool rectify)
+{
+  typedef SparseFcTask<type,W,value_type,index_type> Task ;
+  size_t numTiles = (numColumns + W - 1) / W ;
+  size_t nnz = filters.columnOffsets[filters.numFilters] ;
+  double work = (double)nnz * numColumns ;
+  int numThreads = (int)std::min((double)context.getNumCpuThreads(),
+                                 1 + work / VL_SPARSE_MIN_WORK_PER_THREAD) ;
+  bool splitColumns = (numTiles >= (size_t)numThreads) ;
+  if (!splitColumns) {
+    numThreads = (int)std::min((size_t)numThreads, filters.numFilters) ;
+  }
+  numThreads = std::max(numThreads, 1) ;
+
+  size_t bufferSize = filters.volume * W ;
+  type * buffer = (type*)context.getWorkspace
+  (vl::CPU, sizeof(type) * bufferSize * numThreads) ;
+  if (buffer == NULL) { return context.getLastError() ; }
+
+  Task task ;
+  task.output = output ;
+  task.data = data ;
+  task.volume = filters.volume ;
+  task.numFilters = filters.numFilters ;
+  task.offsets = filters.columnOffsets ;
+  task.rows = rows ;
+  task.values = values ;
+  task.biases = biases ;
+  task.rectify = rectify ;
+  task.firstColumn = 0 ;
+  task.lastColumn = numColumns ;
+  task.firstFilter = 0 ;
+  task.lastFilter = filters.numFilters ;
+  task.buffer = buffer ;
+
+  if (numThreads == 1) {
+    runCpuKernel(task) ;
+    return vlSuccess ;
+  }
+
+  std::vector<Task> tasks(numThreads, task) ;
+  std::vector<tthread::thread*> threads ;
+  for (int t = 0 ; t < numThreads ; ++t) {
+    if (splitColumns) {
+      tasks[t].firstColumn = std::min(((numTiles * t) / numThreads) * W, numColumns) ;
+      tasks[t].lastColumn = std::min(((numTiles * (t + 1)) / numThreads) * W, numColumns) ;
+    } else {
+      tasks[t].firstFilter = (filters.numFilters * t) / numThreads ;
+      tasks[t].lastFilter = (filters.numFilters * (t + 1)) / numThreads ;
+    }
+    tasks[t].buffer = buffer + bufferSize * t ;
+  }
+  for (int t = 1 ; t < numThreads ; ++t) {
+    threads.push_back(new tthread::thread(sparse_fc_thread<Task>, &tasks[t])) ;
+  }
+  runCpuKernel(tasks[0]) ;
+  for (int t = 0 ; t < threads.size() ; ++t) {
+    threads[t]->join() ;
+    delete threads[t] ;
+  }
+  return vlSuccess ;
+}
+
+/* ---------------------------------------------------------------- */
+/*                                                           Driver */
+/* ---------------------------------------------------------------- */
+
+/*
+ The weights are read once per tile, so the tiles are as wide as
+ possible: up to 256 bytes (four AVX-512 registers of accumulators),
+ as long as the transposed tile fits in the L2 cache. Narrower tiles
+ are used for a few columns to avoid computing on the padding.
+ */
+
+template<typename type, typename value_type, typename index_type> static vl::Error
+sparse_fc_any_width(vl::Context& context,
+                    type * output,
+                    type const * data,
+                    size_t numColumns,
+                    SparseFilters const & filters,
+                    value_type const * values,
+                    index_type const * rows,
+                    type const * biases,
+                    bool rectify)
+{
+  enum {
+    wide = 256 / sizeof(type),
+    medium = 128 / sizeof(type),
+    narrow = 64 / sizeof(type)
+  } ;
+  size_t maxWidth = VL_SPARSE_TILE_BYTES / (sizeof(type) * std::max(filters.volume, (size_t)1)) ;
+  if (numColumns == 1) {
+    return sparse_fc<type,1>(context, output, data, numColumns, filters, values, rows, biases, rectify) ;
+  }
+  if (numColumns >= wide && maxWidth >= wide) {
+    return sparse_fc<type,wide>(context, output, data, numColumns, filters, values, rows, biases, rectify) ;
+  }
+  if (numColumns >= medium && maxWidth >= medium) {
+    return sparse_fc<type,medium>(context, output, data, numColumns, filters, values, rows, biases, rectify) ;
+  }
+  return sparse_fc<type,narrow>(context, output, data, numColumns, filters, values, rows, biases, rectify) ;
+}
+
+/*
+ The weights are streamed from memory once per data tile, so if the
+ filter cache is enabled they are repacked in a compact form: values
+ in the data type and 32-bit row indices, i.e. 8 bytes per nonzero in
+ single precision instead of the 16 of a MATLAB sparse matrix (the
+ column offsets are used as they are). Otherwise, the weights are used
+ as they are rather than repacked at every call.
+ */
+
+template<typename type> vl::Error
+vl::impl::nnfullyconnected_forward_sparse(vl::Context& context,
+                                          type * output,
+                                          type const * data,
+                                          size_t numColumns,
+                                          SparseFilters const & filters,
+                                          type const * biases,
+                                          bool rectify)
+{
+  if (numColumns == 0) { return vlSuccess ; }
+
+  size_t nnz = filters.columnOffsets[filters.numFilters] ;
+  size_t packedSize = nnz * (sizeof(type) + sizeof(uint32_t)) ;
+  bool needsPacking = false ;
+  vl::Error error = vlSuccess ;
+  char * packed = (char*)context.getFilterCache().get
+  (error, needsPacking, vl::vlFilterPackingSparse,
+   vl::Tensor(vl::TensorShape(nnz,1,1,1), vlTypeDouble, vl::CPU,
+              (void*)filters.values, nnz * sizeof(double)),
+   vl::Tensor(vl::TensorShape(nnz,1,1,1), vlTypeDouble, vl::CPU,
+              (void*)filters.rowIndices, nnz * sizeof(size_t)),
+   packedSize) ;
+  if (error != vlSuccess) { return error ; }
+
+  if (packed == NULL) {
+    return sparse_fc_any_width(context, output, data, numColumns, filters,
+                               filters.values, filters.rowIndices,
+                               biases, rectify) ;
+  }
+
+  type * values = (type*)packed ;
+  uint32_t * rows = (uint32_t*)(packed + nnz * sizeof(type)) ;
+  if (needsPacking) {
+    for (size_t j = 0 ; j < nnz ; ++j) {
+      values[j] = (type)filters.values[j] ;
+      rows[j] = (uint32_t)filters.rowIndices[j] ;
+    }
+  }
+  return sparse_fc_any_width(context, output, data, numColumns, filters,
+                             (type const*)values, (uint32_t const*)rows,
+                             biases, rectify) ;
+}
+
+template vl::Error
+vl::impl::nnfullyconnected_forward_sparse<float>(vl::Context& context,
+                                                 float * output,
+                                                 float const * data,
+                                                 size_t numColumns,
+                                                 SparseFilters const & filters,
+                                                 float const * biases,
+                                                 bool rectify) ;
+
+template vl::Error
+vl::impl::nnfullyconnected_forward_sparse<double>(vl::Context& context,
+                                                  double * output,
+                                                  double const * data,
+                                                  size_t numColumns,
+                                                  SparseFilters const & filters,
+                                                  double const * biases,
+                                                  bool rectify) ;
@@ -22,14 +22,16 @@ namespace vl { namespace impl {
   struct lrn
   {
     static vl::Error
-    forward(type* output,
+    forward(Context& context,
+            type* output,
             type const* data,
             size_t height, size_t width, size_t depth, size_t size,
             size_t normDetph,
             type  kappa, type  alpha, type  beta) ;
 
     static vl::Error
-    backward(type* derData,
+    backward(Context& context,
+             type* derData,
              type const* data,
              type const* derOutput,
              size_t height, size_t width, size_t depth, size_t size,
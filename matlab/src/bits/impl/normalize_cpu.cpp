@@ -14,6 +14,10 @@ the terms of the BSD license (see the COPYING file).
 #include "../data.hpp"
 #include <math.h>
 #include <memory.h>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
 
 /* ---------------------------------------------------------------- */
 /*                             Fast approximated numerical routines */
@@ -26,357 +30,370 @@ the terms of the BSD license (see the COPYING file).
 //#pragma GCC target ("veclibabi=svml")
 //#pragma GCC target "sse4"
 #endif
+
+/* after the pragmas, so that the kernel runners are vectorized too */
+#include "cpufeatures.hpp"
+#include "tinythread.h"
 #define restrict __restrict
 
 #define VL_NNNORMALIZE_FAST
-#define max(a,b) (((a)>=(b))?a:b)
-#define xat(t) x[(t) * offset]
-#define yat(t) y[(t) * offset]
-#define zat(t) z[(t) * offset]
+
+/* Minimum number of data elements for starting one more thread */
+#define VL_LRN_MIN_WORK_PER_THREAD (256*1024)
 
 #ifndef VL_NNNORMALIZE_FAST
 inline double fast_pow(double a, double b) { return pow(a,b) ; }
 inline float fast_pow(float a, float b) { return powf(a,b) ; }
 #else
-//#define VERY_FAST
-#ifndef VERY_FAST
+/*
+ fast_pow(x,y) computes 2^(y log2(x)) for x > 0, approximating log2
+ and 2^ by cubic polynomials of the mantissa. The bits are moved with
+ memcpy() and floor() is computed by integer conversion, so that the
+ loops calling this function are vectorized (with AVX2 and AVX-512
+ in the kernel runners).
+ */
+
 inline double fast_pow(double x, double y)
 {
-  double z ;
   double const plog3 = 0.164042561333445 ;
   double const plog2 = -0.606737602222409 ;
   double const plog1 = 1.442695040888963 ;
   double const pexp3 = 0.079441541679836 ;
   double const pexp2 = 0.227411277760219 ;
   double const pexp1 = 0.693147180559945 ;
-  typedef long long int int_t;
-  const int_t offset = 1023LL << 52 ;
-
-  int_t ix = *(int_t*)&x - offset ;
-  int_t imx = (ix & ((1LL<<52)-1LL)) + offset;
-  double fx = (double)(ix >> 52) ;
-  double mx = *((double*)&imx) - 1 ;
-  double mx2 = mx*mx ;
-  double mx3 = mx2*mx ;
-  double t = y * (fx + mx*plog1 + mx2*plog2 + mx3*plog3) ;
-  //  double t = y * (fx + mx) ;
-
-  double fz = floor(t) ;
-  double rz = t - fz ;
-  double rz2 = rz*rz ;
-  double rz3 = rz2*rz ;
-  double tz = fz + rz*pexp1 + rz2*pexp2 + rz3*pexp3 ;
-  // double tz = fz + rz ;
-
-  //  mexPrintf("%g %g -- ix %ld imx %ld fx %g mx %g t %g\n", x,y, ix,imx, fx, mx, t) ;
-  *((int_t*)&z) = (int_t)(tz * (1LL<<52)) + offset ;
-  //z = exp(t * log(2.0)) ;
-  return z ;
-}
-#else
-inline double fast_pow(double a, double b)
-{
-  double z ;
-  typedef long long int int_t;
-  const int_t offset = 1023L << 52 ;
-  int_t ai = *((int_t*)&a) ;
-  *((int_t*)&z) = (int_t)(b * (ai - offset)) + offset ;
-  return z ;
+
+  /* x = 2^fx (1 + mx) */
+  int64_t ix ; memcpy(&ix, &x, sizeof(ix)) ;
+  int64_t imx = (ix & ((1LL << 52) - 1)) | (1023LL << 52) ;
+  double fx = (double)((int32_t)(ix >> 52) - 1023) ;
+  double mx ; memcpy(&mx, &imx, sizeof(mx)) ; mx -= 1 ;
+  double t = y * (fx + mx*(plog1 + mx*(plog2 + mx*plog3))) ;
+
+  /* z = 2^fz (1 + p(rz)), fz = floor(t) */
+  t = (t > -1022.0) ? t : -1022.0 ;
+  int32_t fz = (int32_t)t ;
+  fz -= (t < (double)fz) ;
+  double rz = t - (double)fz ;
+  int64_t iz = (int64_t)(fz + 1023) << 52 ;
+  double z ; memcpy(&z, &iz, sizeof(z)) ;
+  return z * (1.0 + rz*(pexp1 + rz*(pexp2 + rz*pexp3))) ;
 }
-#endif
 
-#ifndef VERY_FAST
 inline float fast_pow(float x, float y)
 {
-  float z ;
   float const plog3 = 0.164042561333445F ;
   float const plog2 = -0.606737602222409F ;
   float const plog1 = 1.442695040888963F ;
   float const pexp3 = 0.079441541679836F ;
   float const pexp2 = 0.227411277760219F ;
   float const pexp1 = 0.693147180559945F ;
-  typedef int int_t;
-  const int_t offset = 127 << 23 ;
-
-  int_t ix = *(int_t*)&x - offset ;
-  int_t imx = (ix & ((1<<23)-1)) + offset;
-  float fx = (float)(ix >> 23) ;
-  float mx = *((float*)&imx) - 1 ;
-  float mx2 = mx*mx ;
-  float mx3 = mx2*mx ;
-  float t = y * (fx + mx*plog1 + mx2*plog2 + mx3*plog3) ;
-
-  float fz = floor(t) ;
-  float rz = t - fz ;
-  float rz2 = rz*rz ;
-  float rz3 = rz2*rz ;
-  float tz = fz + rz*pexp1 + rz2*pexp2 + rz3*pexp3 ;
-
-  *((int_t*)&z) = (int_t)(tz * (1<<23)) + offset ;
-  return z ;
+
+  /* x = 2^fx (1 + mx) */
+  int32_t ix ; memcpy(&ix, &x, sizeof(ix)) ;
+  int32_t imx = (ix & ((1 << 23) - 1)) | (127 << 23) ;
+  float fx = (float)((ix >> 23) - 127) ;
+  float mx ; memcpy(&mx, &imx, sizeof(mx)) ; mx -= 1 ;
+  float t = y * (fx + mx*(plog1 + mx*(plog2 + mx*plog3))) ;
+
+  /* z = 2^fz (1 + p(rz)), fz = floor(t) */
+  t = (t > -126.0F) ? t : -126.0F ;
+  int32_t fz = (int32_t)t ;
+  fz -= (t < (float)fz) ;
+  float rz = t - (float)fz ;
+  int32_t iz = (fz + 127) << 23 ;
+  float z ; memcpy(&z, &iz, sizeof(z)) ;
+  return z * (1.0F + rz*(pexp1 + rz*(pexp2 + rz*pexp3))) ;
 }
-#else
-inline float fast_pow(float a, float b)
+#endif
+
+/* ---------------------------------------------------------------- */
+/*                                                          Kernels */
+/* ---------------------------------------------------------------- */
+
+/*
+ The kernels process a band of n consecutive pixels of an image,
+ going through the feature channels (planes) in order. The sum of the
+ squares of the data in the normalization window is updated
+ incrementally in acc, which has n elements.
+ */
+
+template<typename type> static inline void
+update_window(type * restrict acc,
+              type const* restrict data,
+              int n, int offset, int depth, int m1, int m2, int t)
 {
-  float z ;
-  typedef int int_t;
-  const int_t offset = 127 << 23 ;
-  int_t ai = *((int_t*)&a) ;
-  *((int_t*)&z) = (int_t)(b * (ai - offset)) + offset ;
-  return z ;
+  int const tm = t - m1 - 1 ;
+  int const tp = t + m2 ;
+  type const* restrict datam_ = data + offset * tm ;
+  type const* restrict datap_ = data + offset * tp ;
+  if (0 <= tm && tp < depth) {
+    for (int i = 0 ; i < n ; ++i) {
+      type am = datam_[i] ;
+      type ap = datap_[i] ;
+      acc[i] += ap*ap - am*am ;
+    }
+  } else if (0 > tm && tp < depth) {
+    for (int i = 0 ; i < n ; ++i) {
+      type ap = datap_[i] ;
+      acc[i] += ap*ap ;
+    }
+  } else if (0 <= tm && tp >= depth) {
+    for (int i = 0 ; i < n ; ++i) {
+      type am = datam_[i] ;
+      acc[i] -= am*am ;
+    }
+  }
+}
+
+template<typename type> static void
+forward_band(type * restrict output,
+             type const* restrict data,
+             type * restrict acc,
+             int n, int offset, int depth, int normDepth,
+             type kappa, type alpha, type beta)
+{
+  int m1 = (normDepth-1)/2 ;
+  int m2 = normDepth - m1 - 1 ;
+  memset(acc, 0, sizeof(type) * n) ;
+  for (int t = -m2 ; t < depth ; ++t) {
+    update_window(acc, data, n, offset, depth, m1, m2, t) ;
+    if (0 <= t) {
+      type const* restrict data_ = data + offset * t ;
+      type * restrict output_ = output + offset * t ;
+      for (int i = 0 ; i < n ; ++i) {
+        output_[i] = data_[i] * fast_pow(kappa + alpha * acc[i], -beta) ;
+      }
+    }
+  }
+}
+
+/*
+ The backward kernel also needs a buffer acc2 of n * depth elements.
+ */
+
+template<typename type> static void
+backward_band(type * restrict output,
+              type const* restrict data,
+              type const* restrict derOutput,
+              type * restrict acc,
+              type * restrict acc2,
+              int n, int offset, int depth, int normDepth,
+              type kappa, type alpha, type beta)
+{
+  int m1 = (normDepth-1)/2 ;
+  int m2 = normDepth - m1 - 1 ;
+  type ab2 = 2*alpha*beta ;
+  memset(acc, 0, sizeof(type) * n) ;
+  for (int t = -m2 ; t < depth ; ++t) {
+    update_window(acc, data, n, offset, depth, m1, m2, t) ;
+
+    /*
+     Compute the arguments of the summation in the derivative
+     expression, storing them into acc2.
+     */
+    if (0 <= t) {
+      type const* restrict data_ = data + offset * t ;
+      type const* restrict derOutput_ = derOutput + offset * t ;
+      type * restrict output_ = output + offset * t ;
+      type * restrict acc2_ = acc2 + n * t ;
+      for (int i = 0 ; i < n ; ++i) {
+        type L = kappa + alpha * acc[i] ;
+        type Lbeta = fast_pow(L, -beta) ;
+        type temp1 = derOutput_[i] * Lbeta ;
+        output_[i] = temp1 ;
+        acc2_[i] = data_[i] * ab2 * temp1 / L ;
+      }
+    }
+  }
+
+  /*
+   Integrate along feature channels in acc2, summing plane t-1 to
+   plane t.
+   */
+  for (int t = 1 ; t < depth ; ++t) {
+    type * restrict acc2_ = acc2 + n * t ;
+    type const* restrict src_ = acc2_ - n ;
+    for (int i = 0 ; i < n ; ++i) {
+      acc2_[i] += src_[i] ;
+    }
+  }
+
+  /*
+   Compute summation in the derivative expression from the integral
+   just obtained.
+   */
+  for (int t = 0 ; t < depth ; ++t) {
+    int q1 = t - m2 - 1 ;
+    int q2 = ((t + m1) <= (depth - 1)) ? t + m1 : depth - 1 ;
+    type const* restrict acc22_ = acc2 + n * q2 ;
+    type const* restrict acc21_ = acc2 + n * q1 ;
+    type const* restrict data_  = data + offset * t ;
+    type * restrict output_ = output + offset * t ;
+    if (q1 >= 0) {
+      for (int i = 0 ; i < n ; ++i) {
+        output_[i] -= (acc22_[i] - acc21_[i]) * data_[i] ;
+      }
+    } else {
+      for (int i = 0 ; i < n ; ++i) {
+        output_[i] -= acc22_[i] * data_[i] ;
+      }
+    }
+  }
+}
+
+/* ---------------------------------------------------------------- */
+/*                                                        Threading */
+/* ---------------------------------------------------------------- */
+
+/*
+ The work is split in units, each a band of up to bandSize pixels of
+ one image, and the units are divided evenly among the threads. A
+ unit is a whole image unless the batch is smaller than the number of
+ threads. Each thread has its own accumulators, taken from the CPU
+ workspace instead of being allocated at each call.
+ */
+
+template<typename type>
+struct LrnTask
+{
+  bool backward ;
+  type * output ;
+  type const* data ;
+  type const* derOutput ;
+  int WH ;
+  int depth ;
+  int normDepth ;
+  type kappa ;
+  type alpha ;
+  type beta ;
+  int bandSize ;
+  int numBands ;
+  type * workspace ;
+  int firstUnit ;
+  int lastUnit ;
+
+  void operator()() const
+  {
+    type * acc = workspace ;
+    type * acc2 = workspace + bandSize ;
+    for (int unit = firstUnit ; unit < lastUnit ; ++unit) {
+      int image = unit / numBands ;
+      int begin = (unit % numBands) * bandSize ;
+      int n = std::min(bandSize, WH - begin) ;
+      ptrdiff_t start = (ptrdiff_t)WH * depth * image + begin ;
+      if (backward) {
+        backward_band(output + start, data + start, derOutput + start,
+                      acc, acc2,
+                      n, WH, depth, normDepth, kappa, alpha, beta) ;
+      } else {
+        forward_band(output + start, data + start,
+                     acc,
+                     n, WH, depth, normDepth, kappa, alpha, beta) ;
+      }
+    }
+  }
+} ;
+
+template<typename type> static void
+lrn_thread(void * task)
+{
+  vl::impl::runCpuKernel(*(LrnTask<type> const*)task) ;
 }
-#endif
-#endif
 
+template<typename type> static vl::Error
+run_lrn(vl::Context& context, LrnTask<type> task, int num)
+{
+  double work = (double)task.WH * task.depth * num ;
+  if (work == 0) { return vl::vlSuccess ; }
+  int numThreads = (int)std::min((double)context.getNumCpuThreads(),
+                                 1 + work / VL_LRN_MIN_WORK_PER_THREAD) ;
+  numThreads = std::max(1, numThreads) ;
+
+  /* split the images in bands only if there are fewer than threads */
+  int numBands = std::min((numThreads + num - 1) / num, (task.WH + 15) / 16) ;
+  numBands = std::max(1, numBands) ;
+  int bandSize = (task.WH + numBands - 1) / numBands ;
+  if (numBands > 1) {
+    bandSize = (bandSize + 15) & ~15 ;
+    numBands = (task.WH + bandSize - 1) / bandSize ;
+  }
+  task.bandSize = bandSize ;
+  task.numBands = numBands ;
+
+  int numUnits = numBands * num ;
+  numThreads = std::min(numThreads, numUnits) ;
+
+  size_t workspaceSize = (size_t)bandSize * (task.backward ? (1 + task.depth) : 1) ;
+  workspaceSize = (workspaceSize + 15) & ~(size_t)15 ;
+  type * workspace = (type*)context.getWorkspace
+  (vl::CPU, sizeof(type) * workspaceSize * numThreads) ;
+  if (workspace == NULL) { return context.getLastError() ; }
+
+  std::vector<LrnTask<type> > tasks(numThreads, task) ;
+  std::vector<tthread::thread*> threads ;
+  for (int t = 0 ; t < numThreads ; ++t) {
+    tasks[t].workspace = workspace + workspaceSize * t ;
+    tasks[t].firstUnit = (int)(((ptrdiff_t)numUnits * t) / numThreads) ;
+    tasks[t].lastUnit = (int)(((ptrdiff_t)numUnits * (t + 1)) / numThreads) ;
+  }
+  for (int t = 1 ; t < numThreads ; ++t) {
+    threads.push_back(new tthread::thread(lrn_thread<type>, &tasks[t])) ;
+  }
+  vl::impl::runCpuKernel(tasks[0]) ;
+  for (int t = 0 ; t < threads.size() ; ++t) {
+    threads[t]->join() ;
+    delete threads[t] ;
+  }
+  return vl::vlSuccess ;
+}
+
+/* ---------------------------------------------------------------- */
+/*                                                           driver */
+/* ---------------------------------------------------------------- */
 
 namespace vl { namespace impl {
 
   template<typename type>
   struct lrn<vl::CPU, type>
   {
-    /* ------------------------------------------------------------ */
-    /*                                                      forward */
-    /* ------------------------------------------------------------ */
-
     static vl::Error
-    forward(type* output,
+    forward(Context& context,
+            type* output,
             type const* data,
-            size_t width,
             size_t height,
+            size_t width,
             size_t depth,
             size_t num,
             size_t normDepth,
             type kappa, type alpha, type beta)
     {
-      int t ;
-      int m1 = ((signed)normDepth-1)/2 ;
-      int m2 = (int)normDepth - m1 - 1 ;
-      int offset = (int)width*(int)height ;
-#ifndef VL_NNNORMALIZE_FAST
-      for (int k = 0 ; k < num ; ++k) {
-        for (int h = 0 ; h < height ; ++h) {
-          for (int w = 0 ; w < width ; ++w) {
-            type const* x = data + w + h * width ;
-            T* y = output + w + h * width ;
-            type acc = 0 ;
-            for (t = -m2 ; t < (signed)depth ; ++t) {
-              type ap = 0 ;
-              type am = 0 ;
-              if (t-m1-1 >= 0) { am = xat(t-m1-1) ; }
-              if (t+m2 < depth) { ap = xat(t+m2) ; }
-              acc += ap*ap - am*am ;
-              if (0 <= t && t < depth) {
-                yat(t) = xat(t) * fast_pow(kappa + alpha * acc, -beta) ;
-              }
-            }
-          }
-        }
-        data += width*height*depth ;
-        output += width*height*depth ;
-      }
-#else
-      type * acc = (type*) calloc(sizeof(type), width*height) ;
-      for (int k = 0 ; k < num ; ++k) {
-        memset(acc, 0, sizeof(type) * width*height) ;
-        for (t = -m2 ; t < (signed)depth ; ++t) {
-          int tm = t - m1 - 1 ;
-          int tp = t + m2 ;
-          type const* xam = data + offset * (t-m1-1) ;
-          type const* xap = data + offset * (t+m2) ;
-          type *end = acc + width*height ;
-          if (0 <= tm && tp < depth) {
-            for(type *xacc = acc ; xacc != end ; ++xacc, ++xam, ++xap) {
-              type am = *xam ;
-              type ap = *xap ;
-              *xacc += ap*ap - am*am ;
-            }
-          } else if (0 > tm && tp < depth) {
-            for(type *xacc = acc ; xacc != end ; ++xacc, ++xap) {
-              type ap = *xap ;
-              *xacc += ap*ap ;
-            }
-          } else if (0 <= tm && tp >= depth) {
-            for(type *xacc = acc ; xacc != end ; ++xacc, ++xam) {
-              type am = *xam ;
-              *xacc -= am*am ;
-            }
-          }
-          if (0 <= t && t < depth) {
-            type const* xx = data + offset * t ;
-            type * xy = output + offset * t ;
-            for(type *xacc = acc ; xacc != end ; ++xacc, ++xx, ++xy) {
-              (*xy) = (*xx) * fast_pow(kappa + alpha * (*xacc), -beta) ;
-            }
-          }
-        }
-        data += width*height*depth ;
-        output += width*height*depth ;
-      }
-      free(acc) ;
-#endif
-      return vl::vlSuccess ;
+      LrnTask<type> task =
+      {false, output, data, NULL,
+        (int)(height*width), (int)depth, (int)normDepth,
+        kappa, alpha, beta,
+        0, 0, NULL, 0, 0} ;
+      return run_lrn(context, task, (int)num) ;
     }
 
-    /* ------------------------------------------------------------ */
-    /*                                                     backward */
-    /* ------------------------------------------------------------ */
-
     static vl::Error
-    backward(type * output,
+    backward(Context& context,
+             type * output,
              type const* data,
              type const* derOutput,
-             size_t width,
              size_t height,
+             size_t width,
              size_t depth,
              size_t num,
              size_t normDepth,
              type kappa, type alpha, type beta)
     {
-      int m1 = ((signed)normDepth-1)/2 ;
-      int m2 = (int)normDepth - m1 - 1 ;
-      int offset = (int)width*(int)height ;
-      type ab2 = 2*alpha*beta ;
-      int t, q ;
-
-#ifndef VL_NNNORMALIZE_FAST
-      for (int k = 0 ; k < num ; ++k) {
-        for (int h = 0 ; h < height ; ++h) {
-          for (int w = 0 ; w < width ; ++w) {
-            type const* x = data + w + h * width ;
-            T* y = output + w + h * width ;
-            type const* z = derOutput + w + h * width ;
-            type acc = 0 ;
-            for (t = 0 ; t < (signed)depth ; ++t) {
-              yat(t) = 0 ;
-            }
-            for (t = -m2 ; t < (signed)depth ; ++t) {
-              int q1 = t-m1 ;
-              int q2 = t+m2 ;
-              type ap = 0 ;
-              type am = 0 ;
-              if (t-m1-1 >= 0) { am = xat(t-m1-1) ; } else { q1 = 0 ; }
-              if (t+m2 < depth) { ap = xat(t+m2) ; } else { q2 = depth - 1 ; }
-              acc += ap*ap - am*am ;
-              type L = kappa + alpha * acc ;
-              type Lbeta = fast_pow(L, -beta) ;
-              type Lbeta1 = Lbeta / L ;
-
-              if (0 <= t && t < depth) {
-                yat(t) += zat(t) * Lbeta ;
-                for (q = q1 ; q <= q2 ; ++ q) {
-                  yat(q) -= zat(t) * xat(t) * xat(q) * ab2 * Lbeta1 ;
-                }
-              }
-            }
-          }
-        }
-        data += width*height*depth ;
-        output += width*height*depth ;
-        derOutput += width*height*depth ;
-      }
-#else
-      type * restrict acc = (type*) malloc(sizeof(type) * width*height) ;
-      type * restrict acc2 = (type*) malloc(sizeof(type) * width*height*depth) ;
-      for (int k = 0 ; k < num ; ++k) {
-        memset(acc, 0, sizeof(type) * width*height) ;
-        for (t = -m2 ; t < (signed)depth ; ++t) {
-          /*
-           Compue the square of the input data x.^2 summed in the normalization window. This is done
-           incrementally, by updating the previous normalization window sum.
-           */
-          {
-            int const tm = t - m1 - 1 ;
-            int const tp = t + m2 ;
-            type const* restrict datam_ = data + offset * tm ;
-            type const* restrict datap_ = data + offset * tp ;
-            type *end = acc + width*height ;
-
-            if (0 <= tm && tp < depth) {
-              for(type * restrict acc_ = acc ; acc_ != end ; ++acc_, ++datap_, ++datam_) {
-                type am = *datam_ ;
-                type ap = *datap_ ;
-                *acc_ += ap*ap - am*am ;
-              }
-            } else if (0 > tm && tp < depth) {
-              for(type * restrict acc_ = acc ; acc_ != end ; ++acc_, ++datap_) {
-                type ap = *datap_ ;
-                *acc_ += ap*ap ;
-              }
-            } else if (0 <= tm && tp >= depth) {
-              for(type * restrict acc_ = acc ; acc_ != end ; ++acc_, ++datam_) {
-                type am = *datam_ ;
-                *acc_ -= am*am ;
-              }
-            }
-          }
-
-          /*
-           Compute the arguments of the summation in the derivative
-           expression, storing them into acc2.
-           */
-          if (0 <= t && t < depth) {
-            type const* restrict data_ = data + offset * t ;
-            type const* restrict derOutput_ = derOutput + offset * t ;
-            type * restrict output_ = output + offset * t ;
-            type * restrict acc2_ = acc2 + offset * t ;
-            type * end = acc + width*height ;
-            for(type * restrict acc_ = acc ; acc_ != end ;
-                ++acc_, ++acc2_, ++data_, ++derOutput_, ++output_) {
-              type L = kappa + alpha * (*acc_) ;
-              type Lbeta = fast_pow(L, -beta) ;
-              type temp1 = (*derOutput_) * Lbeta ;
-              type temp2 = (*data_) * ab2 * temp1 / L ;
-              *output_ = temp1 ;
-              *acc2_ = temp2 ;
-            }
-          }
-        }
-
-        /*
-         Integrate along feature channels in acc2, summing plane t-1 to
-         plane t.
-         */
-        for (t = 1 ; t < (signed)depth ; ++t) {
-          type * restrict acc2_ = acc2 + t * offset ;
-          type const* restrict src_ = acc2_ - offset ;
-          type const* end = acc2_ + offset ;
-          for( ; acc2_ != end ; ++acc2_, ++src_) {
-            *acc2_ += *src_ ;
-          }
-        }
-
-        /*
-         Compute summation in the derivative expression from the integral
-         just obtained.
-         */
-        for (t = 0 ; t < (signed)depth ; ++t) {
-          int q1 = t - m2 - 1 ;
-          int q2 = ((t + m1) <= (depth - 1)) ? t + m1 : depth - 1 ;
-          type const* restrict acc22_ = acc2 + offset * q2 ;
-          type const* restrict acc21_ = acc2 + offset * q1 ;
-          type const* restrict data_  = data + offset * t ;
-          type const* restrict end = data_  + width*height ;
-          type * restrict output_ = output + offset * t ;
-          if (q1 >= 0) {
-            for( ; data_ != end ; ++data_, ++acc22_, ++acc21_, ++output_) {
-              *output_ -= (*acc22_ - *acc21_) * (*data_) ;
-            }
-          } else {
-            for( ; data_ != end ; ++data_, ++acc22_, ++output_) {
-              *output_ -= (*acc22_) * (*data_) ;
-            }
-          }
-        }
-        data += width*height*depth ;
-        output += width*height*depth ;
-        derOutput += width*height*depth ;
-      }
-      free(acc) ;
-      free(acc2) ;
-#endif
-      return vl::vlSuccess ;
+      LrnTask<type> task =
+      {true, output, data, derOutput,
+        (int)(height*width), (int)depth, (int)normDepth,
+        kappa, alpha, beta,
+        0, 0, NULL, 0, 0} ;
+      return run_lrn(context, task, (int)num) ;
     }
-
   } ;
 
 } }
@@ -141,7 +141,8 @@ namespace vl { namespace impl {
     /* ------------------------------------------------------------ */
 
     static vl::Error
-    forward(type * output,
+    forward(Context& context,
+            type * output,
             type  const* data,
             size_t width,
             size_t height,
@@ -164,7 +165,8 @@ namespace vl { namespace impl {
     /* ------------------------------------------------------------ */
 
     static vl::Error
-    backward(type * derData,
+    backward(Context& context,
+             type * derData,
              type  const* data,
              type  const* derOutput,
              size_t width,
@@ -12,14 +12,22 @@ the terms of the BSD license (see the COPYING file).
 */
 
 #include "pooling.hpp"
+#include "cpufeatures.hpp"
+#include "half.hpp"
 #include "../data.hpp"
 #include <algorithm>
 #include <limits>
+#include <cstdlib>
 
 /* ---------------------------------------------------------------- */
 /*                                               Max pooling helper */
 /* ---------------------------------------------------------------- */
 
+/*
+ The pooling helpers accumulate in their own type, which is float for
+ half precision data (see AccumulatorTraits).
+ */
+
 template <typename type>
 struct acc_max
 {
@@ -34,7 +42,8 @@ struct acc_max
     value = std::max(value, x) ;
   }
 
-  inline void accumulate_backward(type const* data, type* derDataPt) {
+  template <typename data_type>
+  inline void accumulate_backward(data_type const* data, type* derDataPt) {
     type x = *data ;
     if (x > value) {
       value = x ;
@@ -50,6 +59,7 @@ struct acc_max
     if (derDataActivePt) { *derDataActivePt += derOutput ; }
   }
 
+  typedef type acc_type ;
   type value ;
   type derOutput ;
   type* derDataActivePt ;
@@ -74,7 +84,8 @@ struct acc_sum
   }
 
   /* note: data is unused */
-  inline void accumulate_backward(type const* data, type* derDataPt) {
+  template <typename data_type>
+  inline void accumulate_backward(data_type const* data, type* derDataPt) {
     *derDataPt += derOutput * scale ;
   }
 
@@ -84,6 +95,7 @@ struct acc_sum
 
   inline void done_backward() const { }
 
+  typedef type acc_type ;
   type value ;
   type derOutput ;
   type scale ;
@@ -164,7 +176,7 @@ pooling_forward_cpu(type* pooled,
 /* Todo: transpose */
 
 template<typename type, typename Accumulator> static inline void
-pooling_backward_cpu(type* derData,
+pooling_backward_cpu(typename Accumulator::acc_type* derData,
                      type const* data,
                      type const* derPooled,
                      size_t width, size_t height, size_t depth,
@@ -199,6 +211,108 @@ pooling_backward_cpu(type* derData,
   }
 }
 
+/* ---------------------------------------------------------------- */
+/*                                                         Dispatch */
+/* ---------------------------------------------------------------- */
+
+/* Run the kernels with the best instruction set (see cpufeatures.hpp). */
+
+template<typename type, typename Accumulator>
+struct PoolingForward
+{
+  type* pooled ; type const* data ;
+  size_t width ; size_t height ; size_t depth ;
+  size_t windowWidth ; size_t windowHeight ;
+  size_t strideX ; size_t strideY ;
+  size_t padLeft ; size_t padRight ; size_t padTop ; size_t padBottom ;
+  void operator()() const {
+    pooling_forward_cpu<type, Accumulator>(pooled, data, width, height, depth,
+                                           windowWidth, windowHeight, strideX, strideY,
+                                           padLeft, padRight, padTop, padBottom) ;
+  }
+} ;
+
+template<typename type, typename Accumulator>
+struct PoolingBackward
+{
+  typename Accumulator::acc_type* derData ; type const* data ; type const* derPooled ;
+  size_t width ; size_t height ; size_t depth ;
+  size_t windowWidth ; size_t windowHeight ;
+  size_t strideX ; size_t strideY ;
+  size_t padLeft ; size_t padRight ; size_t padTop ; size_t padBottom ;
+  void operator()() const {
+    pooling_backward_cpu<type, Accumulator>(derData, data, derPooled, width, height, depth,
+                                            windowWidth, windowHeight, strideX, strideY,
+                                            padLeft, padRight, padTop, padBottom) ;
+  }
+} ;
+
+template<typename type, typename Accumulator> static inline void
+pooling_forward_run(type* pooled,
+                    type const* data,
+                    size_t width, size_t height, size_t depth,
+                    size_t windowWidth, size_t windowHeight,
+                    size_t strideX, size_t strideY,
+                    size_t padLeft, size_t padRight, size_t padTop, size_t padBottom)
+{
+  PoolingForward<type, Accumulator> kernel =
+  {pooled, data, width, height, depth, windowWidth, windowHeight,
+    strideX, strideY, padLeft, padRight, padTop, padBottom} ;
+  vl::impl::runCpuKernel(kernel) ;
+}
+
+/*
+ DerivativeBuffer gives the backward kernels a derivative array of the
+ accumulator type. For half precision this is a float copy, converted
+ back by finish().
+ */
+
+template<typename type>
+struct DerivativeBuffer
+{
+  DerivativeBuffer(type* derData, size_t numElements) : memory(derData) { }
+  void finish() { }
+  type* memory ;
+} ;
+
+template<>
+struct DerivativeBuffer<vl::half_t>
+{
+  DerivativeBuffer(vl::half_t* derData, size_t numElements)
+  : derData(derData), numElements(numElements),
+  memory((float*)malloc(sizeof(float) * numElements))
+  {
+    if (memory) { vl::impl::convertHalfToFloat(memory, derData, numElements) ; }
+  }
+  ~DerivativeBuffer() { free(memory) ; }
+  void finish() { vl::impl::convertFloatToHalf(derData, memory, numElements) ; }
+  vl::half_t* derData ;
+  size_t numElements ;
+  float* memory ;
+private:
+  DerivativeBuffer(DerivativeBuffer const &) ;
+  DerivativeBuffer & operator= (DerivativeBuffer const &) ;
+} ;
+
+template<typename type, typename Accumulator> static inline vl::Error
+pooling_backward_run(type* derData,
+                     type const* data,
+                     type const* derPooled,
+                     size_t width, size_t height, size_t depth,
+                     size_t windowWidth, size_t windowHeight,
+                     size_t strideX, size_t strideY,
+                     size_t padLeft, size_t padRight, size_t padTop, size_t padBottom)
+{
+  DerivativeBuffer<type> buffer(derData, width*height*depth) ;
+  if (buffer.memory == NULL) { return vl::vlErrorOutOfMemory ; }
+  PoolingBackward<type, Accumulator> kernel =
+  {buffer.memory, data, derPooled, width, height, depth, windowWidth, windowHeight,
+    strideX, strideY, padLeft, padRight, padTop, padBottom} ;
+  vl::impl::runCpuKernel(kernel) ;
+  buffer.finish() ;
+  return vl::vlSuccess ;
+}
+
 /* ---------------------------------------------------------------- */
 /*                                                        Interface */
 /* ---------------------------------------------------------------- */
@@ -208,6 +322,8 @@ namespace vl { namespace impl {
   template <typename type>
   struct pooling_max<vl::CPU, type>
   {
+    typedef acc_max<typename AccumulatorTraits<type>::type> accumulator ;
+
     static vl::Error
     forward(type* pooled,
             type const* data,
@@ -216,12 +332,12 @@ namespace vl { namespace impl {
             size_t strideY, size_t strideX,
             size_t padTop, size_t padBottom, size_t padLeft, size_t padRight)
     {
-      pooling_forward_cpu<type, acc_max<type> > (pooled,
-                                                 data,
-                                                 height, width, depth,
-                                                 poolHeight, poolWidth,
-                                                 strideY, strideX,
-                                                 padTop, padBottom, padLeft, padRight) ;
+      pooling_forward_run<type, accumulator> (pooled,
+                                              data,
+                                              height, width, depth,
+                                              poolHeight, poolWidth,
+                                              strideY, strideX,
+                                              padTop, padBottom, padLeft, padRight) ;
       return vlSuccess ;
     }
 
@@ -235,19 +351,19 @@ namespace vl { namespace impl {
              size_t padTop, size_t padBottom,
              size_t padLeft, size_t padRight)
     {
-      pooling_backward_cpu<type, acc_max<type> > (derData,
-                                                  data, derOutput,
-                                                  height, width, depth,
-                                                  poolHeight, poolWidth,
-                                                  strideY, strideX,
-                                                  padTop, padBottom, padLeft, padRight) ;
-      return vlSuccess ;
+      return pooling_backward_run<type, accumulator> (derData,
+                                                      data, derOutput,
+                                                      height, width, depth,
+                                                      poolHeight, poolWidth,
+                                                      strideY, strideX,
+                                                      padTop, padBottom, padLeft, padRight) ;
     }
   } ; // pooling_max
 
   template <typename type>
   struct pooling_average<vl::CPU, type>
   {
+    typedef acc_sum<typename AccumulatorTraits<type>::type> accumulator ;
 
     static vl::Error
     forward(type* pooled,
@@ -257,12 +373,12 @@ namespace vl { namespace impl {
             size_t strideY, size_t strideX,
             size_t padTop, size_t padBottom, size_t padLeft, size_t padRight)
     {
-      pooling_forward_cpu<type, acc_sum<type> > (pooled,
-                                                 data,
-                                                 height, width, depth,
-                                                 poolHeight, poolWidth,
-                                                 strideY, strideX,
-                                                 padTop, padBottom, padLeft, padRight) ;
+      pooling_forward_run<type, accumulator> (pooled,
+                                              data,
+                                              height, width, depth,
+                                              poolHeight, poolWidth,
+                                              strideY, strideX,
+                                              padTop, padBottom, padLeft, padRight) ;
       return vlSuccess ;
     }
 
@@ -275,13 +391,12 @@ namespace vl { namespace impl {
              size_t padTop, size_t padBottom,
              size_t padLeft, size_t padRight)
     {
-      pooling_backward_cpu<type, acc_sum<type> > (derData,
-                                                  NULL, derPooled,
-                                                  height, width, depth,
-                                                  poolHeight, poolWidth,
-                                                  strideY, strideX,
-                                                  padTop, padBottom, padLeft, padRight) ;
-      return vlSuccess ;
+      return pooling_backward_run<type, accumulator> (derData,
+                                                      NULL, derPooled,
+                                                      height, width, depth,
+                                                      poolHeight, poolWidth,
+                                                      strideY, strideX,
+                                                      padTop, padBottom, padLeft, padRight) ;
     }
   } ; // pooling_average
 
@@ -290,6 +405,8 @@ namespace vl { namespace impl {
 // Instantiations
 template struct vl::impl::pooling_max<vl::CPU, float> ;
 template struct vl::impl::pooling_average<vl::CPU, float> ;
+template struct vl::impl::pooling_max<vl::CPU, vl::half_t> ;
+template struct vl::impl::pooling_average<vl::CPU, vl::half_t> ;
 
 #ifdef ENABLE_DOUBLE
 template struct vl::impl::pooling_max<vl::CPU, double> ;
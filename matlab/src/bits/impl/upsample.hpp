@@ -0,0 +1,81 @@
+// @file upsample.hpp
+// @brief Separable upsampling block implementation
+// @author Andrea Vedaldi
+
+/*
+Copyright (C) 2016 Andrea Vedaldi.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#ifndef VL_NNUPSAMPLE_H
+#define VL_NNUPSAMPLE_H
+
+#include "../data.hpp"
+#include <stddef.h>
+
+namespace vl { namespace impl {
+
+  /*
+   Convolution transpose of each feature channel with its own separable
+   filter F(:,:,c) = factorsY(:,c) * factorsX(:,c)', as used for
+   bilinear interpolation in FCN-style networks. When the filter is not
+   taller than twice upsampleY and not wider than twice upsampleX, each
+   output pixel receives contributions from at most 2 x 2 input pixels,
+   so that the cost is linear in the number of output pixels.
+
+   factorize() splits a bank of numChannels filters of size
+   filterHeight x filterWidth into factors, stored as numChannels
+   columns of filterHeight elements followed by numChannels columns of
+   filterWidth elements; the buffer must have room for one more
+   element, used as scratch. If check is true, isSeparable is set to
+   false if any filter is not (numerically) of rank one; otherwise the
+   filters are assumed to be separable and only the factors are
+   computed.
+
+   The data has size height x width x depth, where depth counts
+   feature channels and images together (channel = plane % numChannels).
+   The output has size outputHeight x outputWidth x depth.
+   */
+
+  template<vl::Device dev, typename type>
+  struct upsample {
+
+    static vl::Error
+    factorize(vl::Context& context,
+              bool & isSeparable,
+              type* factors,
+              type const* filters,
+              size_t filterHeight, size_t filterWidth, size_t numChannels,
+              bool check) ;
+
+    static vl::Error
+    forward(vl::Context& context,
+            type* output,
+            type const* data,
+            type const* factors,
+            size_t height, size_t width, size_t depth,
+            size_t numChannels,
+            size_t outputHeight, size_t outputWidth,
+            size_t filterHeight, size_t filterWidth,
+            size_t upsampleY, size_t upsampleX,
+            size_t cropTop, size_t cropLeft) ;
+
+    static vl::Error
+    backward(vl::Context& context,
+             type* derData,
+             type const* derOutput,
+             type const* factors,
+             size_t height, size_t width, size_t depth,
+             size_t numChannels,
+             size_t outputHeight, size_t outputWidth,
+             size_t filterHeight, size_t filterWidth,
+             size_t upsampleY, size_t upsampleX,
+             size_t cropTop, size_t cropLeft) ;
+  } ;
+
+} }
+
+#endif /* defined(VL_NNUPSAMPLE_H) */
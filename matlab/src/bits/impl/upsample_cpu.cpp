@@ -0,0 +1,240 @@
+// @file upsample_cpu.cpp
+// @brief Separable upsampling block implementation (CPU)
+// @author Andrea Vedaldi
+
+/*
+Copyright (C) 2016 Andrea Vedaldi.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#include "upsample.hpp"
+#include <vector>
+#include <limits>
+#include <string.h>
+#include <math.h>
+
+using namespace vl ;
+using namespace vl::impl ;
+
+/* ---------------------------------------------------------------- */
+/*                                                 Helper functions */
+/* ---------------------------------------------------------------- */
+
+/*
+ Output coordinate o receives input coordinate i through the filter
+ tap o + crop - i * upsample, provided that the latter is in the range
+ [0, filterSize). If filterSize <= 2 * upsample, there are at most two
+ such input coordinates, the last one being floor((o + crop) /
+ upsample). A tap with offset -1 is unused.
+ */
+
+struct Taps
+{
+  int index [2] ;
+  int offset [2] ;
+} ;
+
+static void
+getTaps(std::vector<Taps> & taps,
+        int outputSize, int inputSize,
+        int filterSize, int upsample, int crop)
+{
+  taps.resize(outputSize) ;
+  for (int o = 0 ; o < outputSize ; ++o) {
+    int oc = o + crop ;
+    int last = oc / upsample ;
+    for (int t = 0 ; t < 2 ; ++t) {
+      int i = last - t ;
+      int u = oc - i * upsample ;
+      if (i >= 0 && i < inputSize && u < filterSize) {
+        taps[o].index[t] = i ;
+        taps[o].offset[t] = u ;
+      } else {
+        taps[o].index[t] = 0 ;
+        taps[o].offset[t] = -1 ;
+      }
+    }
+  }
+}
+
+template<typename type> static inline type
+getWeight(Taps const & taps, int t, type const* factors)
+{
+  return (taps.offset[t] >= 0) ? factors[taps.offset[t]] : (type)0 ;
+}
+
+namespace vl { namespace impl {
+
+  template<typename type>
+  struct upsample<vl::CPU, type>
+  {
+
+    /* ------------------------------------------------------------ */
+    /*                                                    factorize */
+    /* ------------------------------------------------------------ */
+
+    static vl::Error
+    factorize(vl::Context& context,
+              bool & isSeparable,
+              type* factors,
+              type const* filters,
+              size_t filterHeight, size_t filterWidth, size_t numChannels,
+              bool check)
+    {
+      type tolerance = 16 * std::numeric_limits<type>::epsilon() ;
+      isSeparable = true ;
+      for (int c = 0 ; c < numChannels ; ++c) {
+        type const* f = filters + c * filterHeight * filterWidth ;
+        type* factorsY = factors + c * filterHeight ;
+        type* factorsX = factors + numChannels * filterHeight + c * filterWidth ;
+
+        /* use the largest element as pivot */
+        int pivot = 0 ;
+        for (int k = 1 ; k < filterHeight * filterWidth ; ++k) {
+          if (fabs(f[k]) > fabs(f[pivot])) { pivot = k ; }
+        }
+        int py = pivot % filterHeight ;
+        int px = pivot / filterHeight ;
+        type scale = f[pivot] ;
+        for (int y = 0 ; y < filterHeight ; ++y) {
+          factorsY[y] = f[y + px * filterHeight] ;
+        }
+        for (int x = 0 ; x < filterWidth ; ++x) {
+          factorsX[x] = (scale != 0) ? f[py + x * filterHeight] / scale : 0 ;
+        }
+        if (check && isSeparable) {
+          type maxError = tolerance * fabs(scale) ;
+          for (int x = 0 ; x < filterWidth && isSeparable ; ++x) {
+            for (int y = 0 ; y < filterHeight ; ++y) {
+              if (fabs(factorsY[y] * factorsX[x] - f[y + x * filterHeight]) > maxError) {
+                isSeparable = false ;
+                break ;
+              }
+            }
+          }
+        }
+      }
+      return vlSuccess ;
+    }
+
+    /* ------------------------------------------------------------ */
+    /*                                                      forward */
+    /* ------------------------------------------------------------ */
+
+    /*
+     For each output column, first blend the (at most) two input
+     columns that contribute to it, then interpolate vertically.
+     */
+
+    static vl::Error
+    forward(vl::Context& context,
+            type* output,
+            type const* data,
+            type const* factors,
+            size_t height, size_t width, size_t depth,
+            size_t numChannels,
+            size_t outputHeight, size_t outputWidth,
+            size_t filterHeight, size_t filterWidth,
+            size_t upsampleY, size_t upsampleX,
+            size_t cropTop, size_t cropLeft)
+    {
+      std::vector<Taps> tapsY, tapsX ;
+      std::vector<type> weightsY(2 * outputHeight) ;
+      std::vector<type> column(height) ;
+      getTaps(tapsY, outputHeight, height, filterHeight, upsampleY, cropTop) ;
+      getTaps(tapsX, outputWidth, width, filterWidth, upsampleX, cropLeft) ;
+
+      for (int z = 0 ; z < depth ; ++z) {
+        int c = z % numChannels ;
+        type const* factorsY = factors + c * filterHeight ;
+        type const* factorsX = factors + numChannels * filterHeight + c * filterWidth ;
+        for (int y = 0 ; y < outputHeight ; ++y) {
+          weightsY[2*y+0] = getWeight(tapsY[y], 0, factorsY) ;
+          weightsY[2*y+1] = getWeight(tapsY[y], 1, factorsY) ;
+        }
+        for (int x = 0 ; x < outputWidth ; ++x) {
+          type wx0 = getWeight(tapsX[x], 0, factorsX) ;
+          type wx1 = getWeight(tapsX[x], 1, factorsX) ;
+          type const* a = data + tapsX[x].index[0] * height ;
+          type const* b = data + tapsX[x].index[1] * height ;
+          for (int i = 0 ; i < height ; ++i) {
+            column[i] = wx0 * a[i] + wx1 * b[i] ;
+          }
+          for (int y = 0 ; y < outputHeight ; ++y) {
+            output[y] =
+            weightsY[2*y+0] * column[tapsY[y].index[0]] +
+            weightsY[2*y+1] * column[tapsY[y].index[1]] ;
+          }
+          output += outputHeight ;
+        }
+        data += height * width ;
+      }
+      return vlSuccess ;
+    }
+
+    /* ------------------------------------------------------------ */
+    /*                                                     backward */
+    /* ------------------------------------------------------------ */
+
+    /* Transpose of forward(), step by step. */
+
+    static vl::Error
+    backward(vl::Context& context,
+             type* derData,
+             type const* derOutput,
+             type const* factors,
+             size_t height, size_t width, size_t depth,
+             size_t numChannels,
+             size_t outputHeight, size_t outputWidth,
+             size_t filterHeight, size_t filterWidth,
+             size_t upsampleY, size_t upsampleX,
+             size_t cropTop, size_t cropLeft)
+    {
+      std::vector<Taps> tapsY, tapsX ;
+      std::vector<type> weightsY(2 * outputHeight) ;
+      std::vector<type> column(height) ;
+      getTaps(tapsY, outputHeight, height, filterHeight, upsampleY, cropTop) ;
+      getTaps(tapsX, outputWidth, width, filterWidth, upsampleX, cropLeft) ;
+
+      memset(derData, 0, sizeof(type) * height * width * depth) ;
+      for (int z = 0 ; z < depth ; ++z) {
+        int c = z % numChannels ;
+        type const* factorsY = factors + c * filterHeight ;
+        type const* factorsX = factors + numChannels * filterHeight + c * filterWidth ;
+        for (int y = 0 ; y < outputHeight ; ++y) {
+          weightsY[2*y+0] = getWeight(tapsY[y], 0, factorsY) ;
+          weightsY[2*y+1] = getWeight(tapsY[y], 1, factorsY) ;
+        }
+        for (int x = 0 ; x < outputWidth ; ++x) {
+          type wx0 = getWeight(tapsX[x], 0, factorsX) ;
+          type wx1 = getWeight(tapsX[x], 1, factorsX) ;
+          type* a = derData + tapsX[x].index[0] * height ;
+          type* b = derData + tapsX[x].index[1] * height ;
+          memset(&column[0], 0, sizeof(type) * height) ;
+          for (int y = 0 ; y < outputHeight ; ++y) {
+            column[tapsY[y].index[0]] += weightsY[2*y+0] * derOutput[y] ;
+            column[tapsY[y].index[1]] += weightsY[2*y+1] * derOutput[y] ;
+          }
+          for (int i = 0 ; i < height ; ++i) {
+            a[i] += wx0 * column[i] ;
+            b[i] += wx1 * column[i] ;
+          }
+          derOutput += outputHeight ;
+        }
+        derData += height * width ;
+      }
+      return vlSuccess ;
+    }
+  } ;
+
+} }
+
+// Instantiations
+template struct vl::impl::upsample<vl::CPU, float> ;
+
+#ifdef ENABLE_DOUBLE
+template struct vl::impl::upsample<vl::CPU, double> ;
+#endif
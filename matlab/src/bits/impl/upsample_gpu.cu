@@ -0,0 +1,274 @@
+// @file upsample_gpu.cu
+// @brief Separable upsampling block implementation (GPU)
+// @author Andrea Vedaldi
+
+/*
+Copyright (C) 2016 Andrea Vedaldi.
+All rights reserved.
+
+This file is part of the VLFeat library and is made available under
+the terms of the BSD license (see the COPYING file).
+*/
+
+#include "upsample.hpp"
+#include "../datacu.hpp"
+#include <assert.h>
+#include <float.h>
+
+#ifndef ENABLE_GPU
+#error "upsample_gpu.cu cannot be compiled without GPU support"
+#endif
+
+using namespace vl ;
+
+/* ---------------------------------------------------------------- */
+/*                                                 factorize kernel */
+/* ---------------------------------------------------------------- */
+
+template<typename T> __global__ void
+upsample_factorize_kernel
+(T* factors,
+ int* numNonSeparable,
+ const T* filters,
+ const int filterHeight,
+ const int filterWidth,
+ const int numChannels,
+ const T tolerance)
+{
+  int c = threadIdx.x + blockIdx.x * blockDim.x;
+  if (c < numChannels) {
+    const T* f = filters + c * filterHeight * filterWidth ;
+    T* factorsY = factors + c * filterHeight ;
+    T* factorsX = factors + numChannels * filterHeight + c * filterWidth ;
+    int pivot = 0 ;
+    for (int k = 1 ; k < filterHeight * filterWidth ; ++k) {
+      if (fabs(f[k]) > fabs(f[pivot])) { pivot = k ; }
+    }
+    int py = pivot % filterHeight ;
+    int px = pivot / filterHeight ;
+    T scale = f[pivot] ;
+    for (int y = 0 ; y < filterHeight ; ++y) {
+      factorsY[y] = f[y + px * filterHeight] ;
+    }
+    for (int x = 0 ; x < filterWidth ; ++x) {
+      factorsX[x] = (scale != 0) ? f[py + x * filterHeight] / scale : 0 ;
+    }
+    if (numNonSeparable) {
+      T maxError = tolerance * fabs(scale) ;
+      for (int x = 0 ; x < filterWidth ; ++x) {
+        for (int y = 0 ; y < filterHeight ; ++y) {
+          if (fabs(factorsY[y] * factorsX[x] - f[y + x * filterHeight]) > maxError) {
+            atomicAdd(numNonSeparable, 1) ;
+            return ;
+          }
+        }
+      }
+    }
+  }
+}
+
+/* ---------------------------------------------------------------- */
+/*                                          upsample forward kernel */
+/* ---------------------------------------------------------------- */
+
+template<typename T> __global__ void
+upsample_forward_kernel
+(T* output,
+ const T* data,
+ const T* factors,
+ const int outputHeight,
+ const int outputWidth,
+ const int outputVolume,
+ const int height,
+ const int width,
+ const int numChannels,
+ const int filterHeight,
+ const int filterWidth,
+ const int upsampleY,
+ const int upsampleX,
+ const int cropTop,
+ const int cropLeft)
+{
+  int outputIndex = threadIdx.x + blockIdx.x * blockDim.x;
+  if (outputIndex < outputVolume) {
+    int py = outputIndex ;
+    int px = py / outputHeight ;
+    int z = px / outputWidth ;
+    px %= outputWidth ;
+    py %= outputHeight ;
+    int c = z % numChannels ;
+    const T* factorsY = factors + c * filterHeight ;
+    const T* factorsX = factors + numChannels * filterHeight + c * filterWidth ;
+    data += z * (width*height) ;
+
+    /* at most two taps in each direction, ending at the last input pixel */
+    int oy = py + cropTop ;
+    int ox = px + cropLeft ;
+    int lastY = oy / upsampleY ;
+    int lastX = ox / upsampleX ;
+    T value = 0 ;
+    for (int tx = 0 ; tx < 2 ; ++tx) {
+      int x = lastX - tx ;
+      int u = ox - x * upsampleX ;
+      if (x < 0 || x >= width || u >= filterWidth) continue ;
+      T column = 0 ;
+      for (int ty = 0 ; ty < 2 ; ++ty) {
+        int y = lastY - ty ;
+        int v = oy - y * upsampleY ;
+        if (y < 0 || y >= height || v >= filterHeight) continue ;
+        column += factorsY[v] * data[x * height + y] ;
+      }
+      value += factorsX[u] * column ;
+    }
+    output[outputIndex] = value ;
+  }
+}
+
+/* ---------------------------------------------------------------- */
+/*                                         upsample backward kernel */
+/* ---------------------------------------------------------------- */
+
+template<typename T> __global__ void
+upsample_backward_kernel
+(T* derData,
+ const T* derOutput,
+ const T* factors,
+ const int outputHeight,
+ const int outputWidth,
+ const int dataVolume,
+ const int height,
+ const int width,
+ const int numChannels,
+ const int filterHeight,
+ const int filterWidth,
+ const int upsampleY,
+ const int upsampleX,
+ const int cropTop,
+ const int cropLeft)
+{
+  int index = threadIdx.x + blockIdx.x * blockDim.x;
+  if (index < dataVolume) {
+    int y = index ;
+    int x = y / height ;
+    int z = x / width ;
+    x %= width ;
+    y %= height ;
+    int c = z % numChannels ;
+    const T* factorsY = factors + c * filterHeight ;
+    const T* factorsX = factors + numChannels * filterHeight + c * filterWidth ;
+    derOutput += z * outputHeight * outputWidth ;
+
+    /* input pixel (x,y) feeds the output window starting at (x,y) * upsample - crop */
+    int y1 = y * upsampleY - cropTop ;
+    int x1 = x * upsampleX - cropLeft ;
+    int y2 = min(y1 + filterHeight, outputHeight) ;
+    int x2 = min(x1 + filterWidth, outputWidth) ;
+    int y1c = max(y1, 0) ;
+    int x1c = max(x1, 0) ;
+    T value = 0 ;
+    for (int px = x1c ; px < x2 ; ++px) {
+      T column = 0 ;
+      for (int py = y1c ; py < y2 ; ++py) {
+        column += factorsY[py - y1] * derOutput[px * outputHeight + py] ;
+      }
+      value += factorsX[px - x1] * column ;
+    }
+    derData[index] = value ;
+  }
+}
+
+/* ---------------------------------------------------------------- */
+/*                                                          drivers */
+/* ---------------------------------------------------------------- */
+
+namespace vl { namespace impl {
+
+  template <typename type>
+  struct upsample<vl::GPU, type>
+  {
+
+    static vl::Error
+    factorize(vl::Context& context,
+              bool & isSeparable,
+              type* factors,
+              type const* filters,
+              size_t filterHeight, size_t filterWidth, size_t numChannels,
+              bool check)
+    {
+      /* the extra element after the factors holds the counter */
+      int* numNonSeparable = NULL ;
+      if (check) {
+        numNonSeparable = (int*)(factors + numChannels * (filterHeight + filterWidth)) ;
+        cudaMemset(numNonSeparable, 0, sizeof(int)) ;
+      }
+      upsample_factorize_kernel<type>
+      <<< divideUpwards(numChannels, VL_CUDA_NUM_THREADS), VL_CUDA_NUM_THREADS >>>
+      (factors, numNonSeparable, filters,
+       filterHeight, filterWidth, numChannels,
+       16 * ((sizeof(type) == sizeof(float)) ? FLT_EPSILON : DBL_EPSILON)) ;
+      isSeparable = true ;
+      if (check) {
+        int count = 0 ;
+        cudaMemcpy(&count, numNonSeparable, sizeof(int), cudaMemcpyDeviceToHost) ;
+        isSeparable = (count == 0) ;
+      }
+      return context.setError(context.getCudaHelper().catchCudaError(__func__)) ;
+    }
+
+    static vl::Error
+    forward(vl::Context& context,
+            type* output,
+            type const* data,
+            type const* factors,
+            size_t height, size_t width, size_t depth,
+            size_t numChannels,
+            size_t outputHeight, size_t outputWidth,
+            size_t filterHeight, size_t filterWidth,
+            size_t upsampleY, size_t upsampleX,
+            size_t cropTop, size_t cropLeft)
+    {
+      int outputVolume = outputWidth * outputHeight * depth ;
+      upsample_forward_kernel<type>
+      <<< divideUpwards(outputVolume, VL_CUDA_NUM_THREADS), VL_CUDA_NUM_THREADS >>>
+      (output, data, factors,
+       outputHeight, outputWidth, outputVolume,
+       height, width, numChannels,
+       filterHeight, filterWidth,
+       upsampleY, upsampleX,
+       cropTop, cropLeft) ;
+      return context.setError(context.getCudaHelper().catchCudaError(__func__)) ;
+    }
+
+    static vl::Error
+    backward(vl::Context& context,
+             type* derData,
+             type const* derOutput,
+             type const* factors,
+             size_t height, size_t width, size_t depth,
+             size_t numChannels,
+             size_t outputHeight, size_t outputWidth,
+             size_t filterHeight, size_t filterWidth,
+             size_t upsampleY, size_t upsampleX,
+             size_t cropTop, size_t cropLeft)
+    {
+      int dataVolume = width * height * depth ;
+      upsample_backward_kernel<type>
+      <<< divideUpwards(dataVolume, VL_CUDA_NUM_THREADS), VL_CUDA_NUM_THREADS >>>
+      (derData, derOutput, factors,
+       outputHeight, outputWidth, dataVolume,
+       height, width, numChannels,
+       filterHeight, filterWidth,
+       upsampleY, upsampleX,
+       cropTop, cropLeft) ;
+      return context.setError(context.getCudaHelper().catchCudaError(__func__)) ;
+    }
+  } ;
+
+} }
+
+// Instantiations
+template struct vl::impl::upsample<vl::GPU, float> ;
+
+#ifdef ENABLE_DOUBLE
+template struct vl::impl::upsample<vl::GPU, double> ;
+#endif
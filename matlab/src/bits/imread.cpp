@@ -12,6 +12,17 @@ the terms of the BSD license (see the COPYING file).
 
 #include "imread.hpp"
 #include <cstring>
+#include <cassert>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 vl::ImageShape::ImageShape()
 : height(0), width(0), depth(0)
@@ -54,22 +65,179 @@ void vl::ImageShape::clear()
 }
 
 vl::Image::Image()
-: shape(), memory(NULL)
+: shape(), dataType(vl::vlTypeFloat), memory(NULL)
 { }
 
 vl::Image::Image(Image const & im)
-: shape(im.shape), memory(im.memory)
+: shape(im.shape), dataType(im.dataType), memory(im.memory)
 { }
 
 vl::Image::Image(vl::ImageShape const & shape, float * memory)
-: shape(shape), memory(memory)
+: shape(shape), dataType(vl::vlTypeFloat), memory(memory)
+{ }
+
+vl::Image::Image(vl::ImageShape const & shape, vl::Type dataType, void * memory)
+: shape(shape), dataType(dataType), memory(memory)
 { }
 
 vl::ImageShape const & vl::Image::getShape() const { return shape ; }
-float * vl::Image::getMemory() const { return memory ; }
+vl::Type vl::Image::getDataType() const { return dataType ; }
+void * vl::Image::getData() const { return memory ; }
+
+float * vl::Image::getMemory() const
+{
+  assert(dataType == vl::vlTypeFloat) ;
+  return (float*)memory ;
+}
 
 void vl::Image::clear()
 {
   shape.clear() ;
+  dataType = vl::vlTypeFloat ;
   memory = 0 ;
 }
+
+size_t vl::getImageDataTypeSize(vl::Type dataType)
+{
+  return (dataType == vl::vlTypeChar) ? sizeof(char unsigned) : sizeof(float) ;
+}
+
+/* ---------------------------------------------------------------- */
+/*                                                      Image shard */
+/* ---------------------------------------------------------------- */
+
+#define VL_IMAGE_SHARD_MAGIC "VLIMSHRD"
+
+static size_t readUInt64(unsigned char const * bytes)
+{
+  unsigned long long x = 0 ;
+  for (int k = 7 ; k >= 0 ; --k) { x = (x << 8) | bytes[k] ; }
+  return (size_t)x ;
+}
+
+vl::ImageShard::ImageShard()
+: mapping(NULL), mappingSize(0), numImages(0)
+#ifdef _WIN32
+, fileHandle(INVALID_HANDLE_VALUE), mappingHandle(NULL)
+#endif
+{
+  lastErrorMessage[0] = 0 ;
+}
+
+vl::ImageShard::~ImageShard()
+{
+  close() ;
+}
+
+void
+vl::ImageShard::close()
+{
+#ifdef _WIN32
+  if (mapping) { UnmapViewOfFile(mapping) ; }
+  if (mappingHandle) { CloseHandle(mappingHandle) ; }
+  if (fileHandle != INVALID_HANDLE_VALUE) { CloseHandle(fileHandle) ; }
+  mappingHandle = NULL ;
+  fileHandle = INVALID_HANDLE_VALUE ;
+#else
+  if (mapping) { munmap((void*)mapping, mappingSize) ; }
+#endif
+  mapping = NULL ;
+  mappingSize = 0 ;
+  numImages = 0 ;
+}
+
+vl::Error
+vl::ImageShard::open(char const * fileName)
+{
+  size_t headerSize ;
+  close() ;
+
+#ifdef _WIN32
+  LARGE_INTEGER fileSize ;
+  fileHandle = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL,
+                           OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL) ;
+  if (fileHandle == INVALID_HANDLE_VALUE) {
+    snprintf(lastErrorMessage, sizeof(lastErrorMessage), "could not open the shard") ;
+    return vl::vlErrorUnknown ;
+  }
+  if (!GetFileSizeEx(fileHandle, &fileSize)) { goto fail_map ; }
+  mappingSize = (size_t)fileSize.QuadPart ;
+  if (mappingSize > 0) {
+    mappingHandle = CreateFileMapping(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL) ;
+    if (mappingHandle == NULL) { goto fail_map ; }
+    mapping = (unsigned char const*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0) ;
+    if (mapping == NULL) { goto fail_map ; }
+  }
+#else
+  struct stat info ;
+  int fd = ::open(fileName, O_RDONLY) ;
+  if (fd < 0) {
+    snprintf(lastErrorMessage, sizeof(lastErrorMessage), "could not open the shard") ;
+    return vl::vlErrorUnknown ;
+  }
+  if (fstat(fd, &info) != 0) {
+    ::close(fd) ;
+    goto fail_map ;
+  }
+  mappingSize = (size_t)info.st_size ;
+  if (mappingSize > 0) {
+    void * address = mmap(NULL, mappingSize, PROT_READ, MAP_SHARED, fd, 0) ;
+    if (address == MAP_FAILED) {
+      ::close(fd) ;
+      goto fail_map ;
+    }
+    mapping = (unsigned char const*)address ;
+  }
+  /* the mapping stays valid after closing the file */
+  ::close(fd) ;
+#endif
+
+  /* check the header */
+  if (mappingSize < 16 ||
+      memcmp(mapping, VL_IMAGE_SHARD_MAGIC, 8) != 0) {
+    close() ;
+    snprintf(lastErrorMessage, sizeof(lastErrorMessage), "the file is not an image shard") ;
+    return vl::vlErrorUnknown ;
+  }
+  numImages = readUInt64(mapping + 8) ;
+  headerSize = 16 + 8 * (numImages + 1) ;
+  if (numImages > mappingSize / 8 || headerSize > mappingSize) {
+    close() ;
+    snprintf(lastErrorMessage, sizeof(lastErrorMessage), "the shard is truncated") ;
+    return vl::vlErrorUnknown ;
+  }
+  return vl::vlSuccess ;
+
+fail_map:
+  close() ;
+  snprintf(lastErrorMessage, sizeof(lastErrorMessage), "could not map the shard in memory") ;
+  return vl::vlErrorUnknown ;
+}
+
+size_t
+vl::ImageShard::getNumImages() const
+{
+  return numImages ;
+}
+
+vl::Error
+vl::ImageShard::getImage(void const ** buffer, size_t * size, size_t index) const
+{
+  if (index >= numImages) {
+    return vl::vlErrorUnknown ;
+  }
+  size_t begin = readUInt64(mapping + 16 + 8 * index) ;
+  size_t end = readUInt64(mapping + 16 + 8 * (index + 1)) ;
+  if (begin > end || end > mappingSize) {
+    return vl::vlErrorUnknown ;
+  }
+  *buffer = mapping + begin ;
+  *size = end - begin ;
+  return vl::vlSuccess ;
+}
+
+char const *
+vl::ImageShard::getLastErrorMessage() const
+{
+  return lastErrorMessage ;
+}
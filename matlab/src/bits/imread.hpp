@@ -35,21 +35,41 @@ namespace vl {
     void clear() ;
   } ;
 
+  /* The pixels of an image are stored in MATLAB order (column major,
+     one plane per channel), either as floats (vlTypeFloat) or as
+     8-bit unsigned integers (vlTypeChar). getMemory() can only be
+     used with the former. */
   class Image
   {
   public:
     Image() ;
     Image(Image const & im) ;
     Image(ImageShape const & shape, float * memory = NULL) ;
+    Image(ImageShape const & shape, vl::Type dataType, void * memory) ;
     ImageShape const & getShape() const ;
+    vl::Type getDataType() const ;
     float * getMemory() const ;
+    void * getData() const ;
     void clear() ;
 
   protected:
     ImageShape shape ;
-    float * memory ;
+    vl::Type dataType ;
+    void * memory ;
   } ;
 
+  size_t getImageDataTypeSize(vl::Type dataType) ;
+
+  /* Function used by ImageReader::readImage() to obtain the memory of
+     an image once its shape and data type are known. It returns NULL
+     on failure. */
+  typedef void * (*ImageAllocator)(ImageShape const & shape, vl::Type dataType, void * data) ;
+
+  /* Function used by ImageReader::readImage() to obtain, given the
+     shape of an image, the smallest shape at which it can be decoded,
+     e.g. because the image is to be shrunk to it anyway. */
+  typedef ImageShape (*ImageShapeHint)(ImageShape const & shape, void * data) ;
+
   class ImageReader
   {
   public:
@@ -57,12 +77,67 @@ namespace vl {
     ~ImageReader() ;
     vl::Error readShape(ImageShape & image, char const * fileName) ;
     vl::Error readPixels(float * memory, char const * fileName) ;
+
+    /* Read the shape and the pixels of an image at once. The memory
+       of the image is obtained from allocator, which keeps its
+       ownership also on error, or, if this is NULL, with malloc(), in
+       which case the caller must free() it on success. If shapeHint
+       is not NULL, the image may be decoded at a reduced size, no
+       smaller than the shape it returns. data is passed to both
+       functions. The pixels are stored as dataType, which can be
+       vlTypeChar only with the LibJPEG reader. */
+    vl::Error readImage(Image & image, char const * fileName,
+                        ImageAllocator allocator = NULL,
+                        ImageShapeHint shapeHint = NULL,
+                        void * data = NULL,
+                        vl::Type dataType = vl::vlTypeFloat) ;
+
+    /* Same as readImage(), but decode the image from the size bytes
+       at buffer, e.g. an image in an ImageShard. */
+    vl::Error readImageFromMemory(Image & image,
+                                  void const * buffer, size_t size,
+                                  ImageAllocator allocator = NULL,
+                                  ImageShapeHint shapeHint = NULL,
+                                  void * data = NULL,
+                                  vl::Type dataType = vl::vlTypeFloat) ;
     char const * getLastErrorMessage() const ;
 
   private:
     class Impl ;
     Impl * impl ;
   } ;
+
+  /* A shard packs many images in a single file (see vl_imshard.m),
+     which is memory mapped so that the encoded images can be decoded
+     directly from it with ImageReader::readImageFromMemory(). The
+     file starts with the 8 characters VLIMSHRD, followed by the
+     number N of images and by N+1 byte offsets, all 64-bit little
+     endian integers. Image i occupies the bytes from offset i to
+     offset i+1 (excluded). */
+  class ImageShard
+  {
+  public:
+    ImageShard() ;
+    ~ImageShard() ;
+    vl::Error open(char const * fileName) ;
+    void close() ;
+    size_t getNumImages() const ;
+    vl::Error getImage(void const ** buffer, size_t * size, size_t index) const ;
+    char const * getLastErrorMessage() const ;
+
+  private:
+    ImageShard(ImageShard const &) ;
+    ImageShard & operator = (ImageShard const &) ;
+
+    unsigned char const * mapping ;
+    size_t mappingSize ;
+    size_t numImages ;
+#ifdef _WIN32
+    void * fileHandle ;
+    void * mappingHandle ;
+#endif
+    char lastErrorMessage [VL_IMAGE_ERROR_MSG_MAX_LENGTH] ;
+  } ;
 }
 
 #endif
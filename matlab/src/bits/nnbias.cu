@@ -12,6 +12,7 @@ the terms of the BSD license (see the COPYING file).
 
 #include "nnbias.hpp"
 #include "impl/nnbias_blas.hpp"
+#include "impl/half.hpp"
 #if ENABLE_CUDNN
 #include "impl/nnbias_cudnn.hpp"
 #endif
@@ -19,6 +20,57 @@ the terms of the BSD license (see the COPYING file).
 
 using namespace vl ;
 
+/* ---------------------------------------------------------------- */
+/* Half precision                                                   */
+/* ---------------------------------------------------------------- */
+
+/*
+ Half tensors (CPU only) are processed in float, see impl/half.hpp.
+ The data is converted one image at a time and the bias derivatives
+ are summed over the images in float.
+ */
+
+static vl::Error
+nnbias_forward_half(vl::Context& context,
+                    vl::Tensor output, double outputMult,
+                    vl::Tensor data, double dataMult,
+                    vl::Tensor biases, double biasesMult)
+{
+  vl::impl::FloatCopy output_, data_, biases_ ;
+  vl::Error status = biases_.init(biases) ;
+  for (size_t image = 0 ; image < output.getSize() && status == vlSuccess ; ++image) {
+    status = output_.initImage(output, image, outputMult != 0) ;
+    if (status == vlSuccess) { status = data_.initImage(data, image) ; }
+    if (status != vlSuccess) { break ; }
+    status = vl::impl::nnbias_forward_blas<vl::CPU,vlTypeFloat>
+    (context, output_, outputMult, data_, dataMult, biases_, biasesMult) ;
+    if (status == vlSuccess) { output_.copyToImage(output, image) ; }
+  }
+  return context.passError(status, __func__) ;
+}
+
+static vl::Error
+nnbias_backward_half(vl::Context& context,
+                     vl::Tensor derData, double derDataMult,
+                     vl::Tensor derBiases, double derBiasesMult,
+                     vl::Tensor derOutput, double derOutputMult)
+{
+  vl::impl::FloatCopy derData_, derBiases_, derOutput_ ;
+  vl::Error status = derBiases_.init(derBiases, derBiasesMult != 0) ;
+  for (size_t image = 0 ; image < derOutput.getSize() && status == vlSuccess ; ++image) {
+    status = derOutput_.initImage(derOutput, image) ;
+    if (status == vlSuccess) { status = derData_.initImage(derData, image, derDataMult != 0) ; }
+    if (status != vlSuccess) { break ; }
+    status = vl::impl::nnbias_backward_blas<vl::CPU,vlTypeFloat>
+    (context, derData_, derDataMult,
+     derBiases_, image ? 1 : derBiasesMult,
+     derOutput_, derOutputMult) ;
+    if (status == vlSuccess) { derData_.copyToImage(derData, image) ; }
+  }
+  if (status == vlSuccess) { derBiases_.copyTo(derBiases) ; }
+  return context.passError(status, __func__) ;
+}
+
 /* ---------------------------------------------------------------- */
 /* Forward                                                          */
 /* ---------------------------------------------------------------- */
@@ -61,6 +113,11 @@ vl::nnbias_forward(vl::Context& context,
       break ;
 
     case vl::CPU:
+      if (dataType == vlTypeHalf) {
+        status = nnbias_forward_half(context, output, outputMult,
+                                     data, dataMult, biases, biasesMult) ;
+        break ;
+      }
       DISPATCH2(vl::CPU) ;
       break ;
 
@@ -114,6 +171,12 @@ vl::nnbias_backward(vl::Context& context,
       break ;
 
     case vl::CPU:
+      if (dataType == vlTypeHalf) {
+        status = nnbias_backward_half(context, derData, derDataMult,
+                                      derBiases, derBiasesMult,
+                                      derOutput, derOutputMult) ;
+        break ;
+      }
       DISPATCH2(vl::CPU) ;
       break ;
 
@@ -35,12 +35,15 @@ error = vl::impl::bnorm<deviceType,type>::forward \
  (type*)multipliers.getMemory(), \
  (type*)biases.getMemory(), \
  data.getHeight(), data.getWidth(), data.getDepth(), data.getSize(), \
- epsilon);
+ epsilon, rectify, mask);
 
 #define DISPATCH2(deviceType) \
 switch (dataType) { \
 case vlTypeFloat : DISPATCH(deviceType, float) ; break ; \
 IF_DOUBLE(case vlTypeDouble : DISPATCH(deviceType, double) ; break ;) \
+case vlTypeHalf : \
+  return context.setError(vlErrorUnsupported, \
+                          "Batch normalization does not support half precision arrays.") ; \
 default: assert(false) ; return vlErrorUnknown ; \
 }
 
@@ -51,7 +54,9 @@ vl::nnbnorm_forward(vl::Context& context,
                     vl::Tensor data,
                     vl::Tensor multipliers,
                     vl::Tensor biases,
-                    double epsilon)
+                    double epsilon,
+                    bool rectify,
+                    uint8_t * mask)
 {
   vl::Error error = vlSuccess ;
   vl::Type dataType = output.getDataType() ;
@@ -69,6 +74,10 @@ vl::nnbnorm_forward(vl::Context& context,
 #if ENABLE_GPU
     case vl::GPU:
       DISPATCH2(vl::GPU) ;
+      if (error == vlErrorUnsupported) {
+        error = context.setError
+        (error, "The ReLU mask and derivatives are only supported on the CPU.") ;
+      }
       if (error == vlErrorCuda) {
         context.setError(context.getCudaHelper().catchCudaError("GPU")) ;
       }
@@ -87,7 +96,8 @@ error = vl::impl::bnorm<deviceType,type>::forward_given_moments \
 (type const*)data.getMemory(), \
 (type*)multipliers.getMemory(), \
 (type*)biases.getMemory(), \
-data.getHeight(), data.getWidth(), data.getDepth(), data.getSize()) ;
+data.getHeight(), data.getWidth(), data.getDepth(), data.getSize(), \
+rectify, mask) ;
 
 vl::Error
 vl::nnbnorm_forward_given_moments(vl::Context& context,
@@ -95,7 +105,9 @@ vl::nnbnorm_forward_given_moments(vl::Context& context,
                                   vl::Tensor moments,
                                   vl::Tensor data,
                                   vl::Tensor multipliers,
-                                  vl::Tensor biases)
+                                  vl::Tensor biases,
+                                  bool rectify,
+                                  uint8_t * mask)
 {
   vl::Error error = vlSuccess ;
   vl::Type dataType = output.getDataType() ;
@@ -113,6 +125,10 @@ vl::nnbnorm_forward_given_moments(vl::Context& context,
 #if ENABLE_GPU
     case vl::GPU:
       DISPATCH2(vl::GPU) ;
+      if (error == vlErrorUnsupported) {
+        error = context.setError
+        (error, "The ReLU mask and derivatives are only supported on the CPU.") ;
+      }
       if (error == vlErrorCuda) {
         context.setError(context.getCudaHelper().catchCudaError("nnbnorm_*_forward")) ;
       }
@@ -139,7 +155,7 @@ error = vl::impl::bnorm<deviceType,type>::backward \
  (type const*)biases.getMemory(), \
  (type const*)derOutput.getMemory(), \
  data.getHeight(), data.getWidth(), data.getDepth(), data.getSize(), \
- epsilon);
+ epsilon, rectify, mask);
 
 vl::Error
 vl::nnbnorm_backward(Context& context,
@@ -151,7 +167,9 @@ vl::nnbnorm_backward(Context& context,
                      vl::Tensor multipliers,
                      vl::Tensor biases,
                      vl::Tensor derOutput,
-                     double epsilon)
+                     double epsilon,
+                     bool rectify,
+                     uint8_t const * mask)
 {
   vl::Error error = vl::vlSuccess ;
   vl::Type dataType = derOutput.getDataType() ;
@@ -169,6 +187,10 @@ vl::nnbnorm_backward(Context& context,
 #if ENABLE_GPU
     case vl::GPU:
       DISPATCH2(vl::GPU) ;
+      if (error == vlErrorUnsupported) {
+        error = context.setError
+        (error, "The ReLU mask and derivatives are only supported on the CPU.") ;
+      }
       if (error == vlErrorCuda) {
         context.setError(context.getCudaHelper().catchCudaError("GPU")) ;
       }
@@ -191,7 +213,7 @@ error = vl::impl::bnorm<deviceType,type>::backward_given_moments \
 (type const*)biases.getMemory(), \
 (type const*)derOutput.getMemory(), \
 data.getHeight(), data.getWidth(), data.getDepth(), data.getSize(), \
-epsilon);
+epsilon, rectify, mask);
 
 vl::Error
 vl::nnbnorm_backward_given_moments(Context& context,
@@ -203,7 +225,9 @@ vl::nnbnorm_backward_given_moments(Context& context,
                                    vl::Tensor multipliers,
                                    vl::Tensor biases,
                                    vl::Tensor derOutput,
-                                   double epsilon)
+                                   double epsilon,
+                                   bool rectify,
+                                   uint8_t const * mask)
 {
   vl::Error error = vl::vlSuccess ;
   vl::Type dataType = derOutput.getDataType() ;
@@ -221,6 +245,10 @@ vl::nnbnorm_backward_given_moments(Context& context,
 #if ENABLE_GPU
     case vl::GPU:
       DISPATCH2(vl::GPU) ;
+      if (error == vlErrorUnsupported) {
+        error = context.setError
+        (error, "The ReLU mask and derivatives are only supported on the CPU.") ;
+      }
       if (error == vlErrorCuda) {
         context.setError(context.getCudaHelper().catchCudaError("GPU")) ;
       }
@@ -16,9 +16,28 @@ the terms of the BSD license (see the COPYING file).
 
 #include "data.hpp"
 #include <stdio.h>
+#include <stdint.h>
 
 namespace vl {
 
+  /*
+   With rectify, the functions below compute batch normalization
+   followed by a ReLU, and its derivatives. The forward functions can
+   also store a mask with one bit for each positive output, which the
+   backward functions use instead of recomputing the moments first;
+   the mask is only supported on the CPU.
+
+   The bits of each channel start at a new byte, so the mask size is
+   the value returned by nnbnorm_get_mask_size().
+   */
+
+  inline size_t
+  nnbnorm_get_mask_size(vl::TensorShape const & shape)
+  {
+    size_t numBits = shape.getHeight() * shape.getWidth() * shape.getSize() ;
+    return shape.getDepth() * ((numBits + 7) / 8) ;
+  }
+
   // This version computes mean and sigma
   vl::Error
   nnbnorm_forward(vl::Context& context,
@@ -27,7 +46,9 @@ namespace vl {
                   vl::Tensor data,
                   vl::Tensor filters,
                   vl::Tensor biases,
-                  double epsilon) ;
+                  double epsilon,
+                  bool rectify = false,
+                  uint8_t * mask = NULL) ;
 
   // This version uses the mean and sigma specified
   vl::Error
@@ -36,7 +57,9 @@ namespace vl {
                                 vl::Tensor moments, // input
                                 vl::Tensor data,
                                 vl::Tensor filters,
-                                vl::Tensor biases) ;
+                                vl::Tensor biases,
+                                bool rectify = false,
+                                uint8_t * mask = NULL) ;
 
   vl::Error
   nnbnorm_backward(vl::Context& context,
@@ -48,7 +71,9 @@ namespace vl {
                    vl::Tensor filters,
                    vl::Tensor biases,
                    vl::Tensor derOutput,
-                   double epsilon) ;
+                   double epsilon,
+                   bool rectify = false,
+                   uint8_t const * mask = NULL) ;
 
   vl::Error
   nnbnorm_backward_given_moments(vl::Context& context,
@@ -60,7 +85,9 @@ namespace vl {
                                  vl::Tensor filters,
                                  vl::Tensor biases,
                                  vl::Tensor derOutput,
-                                 double epsilon) ;
+                                 double epsilon,
+                                 bool rectify = false,
+                                 uint8_t const * mask = NULL) ;
 }
 
 #endif /* defined(__vl__nnbnorm__) */
@@ -15,7 +15,12 @@ the terms of the BSD license (see the COPYING file).
 
 #include "nnconv.hpp"
 #include "nnbias.hpp"
+#include "convtuner.hpp"
 #include "impl/nnconv_blas.hpp"
+#include "impl/nnconv_direct.hpp"
+#include "impl/upsample.hpp"
+#include "impl/half.hpp"
+#include "impl/nnconv_int8.hpp"
 #if ENABLE_CUDNN
 #include "impl/nnconv_cudnn.hpp"
 #endif
@@ -23,6 +28,22 @@ the terms of the BSD license (see the COPYING file).
 
 using namespace vl ;
 
+/* ---------------------------------------------------------------- */
+/*                                                   Half precision */
+/* ---------------------------------------------------------------- */
+
+/*
+ There are no half precision convolution kernels. The filters and
+ biases are converted to float once, while the data and the outputs
+ are converted one image at a time (see impl::FloatCopy::initImage()).
+ The float code runs on each image (accumulating in float, as BLAS
+ does), and the results are converted back. In this way, the float
+ copies take no more memory than the im2row buffer of an image.
+
+ The filter and bias derivatives are summed over the images in float
+ and converted back at the end.
+ */
+
 /* ---------------------------------------------------------------- */
 /*                                                   nnconv_forward */
 /* ---------------------------------------------------------------- */
@@ -39,8 +60,10 @@ output, outputMult, \
 data, dataMult, \
 filters, biases, \
 strideY, strideX, \
+dilateY, dilateX, \
 padTop, padBottom, \
-padLeft, padRight) ;
+padLeft, padRight, \
+rectify) ;
 
 #define DISPATCH2(deviceType) \
 switch (dataType) { \
@@ -66,6 +89,204 @@ IF_DOUBLE(case vlTypeDouble : DISPATCHCUDNN(vlTypeDouble) ; break ;) \
 default: assert(false) ; return vlErrorUnknown ; \
 }
 
+/*
+ On the CPU, there can be several algorithms to compute the same
+ convolution. The one to use is stored in the context ConvolutionTuner
+ and can be a fixed choice or vlConvolutionAlgoAuto. In the latter case,
+ the first time a problem signature is seen all the applicable
+ algorithms are timed and the fastest is remembered for later calls.
+ */
+
+static bool
+isApplicable(vl::ConvolutionAlgo algo,
+             Tensor filters,
+             int strideY, int strideX,
+             int padTop, int padBottom,
+             int padLeft, int padRight)
+{
+  switch (algo) {
+    case vlConvolutionAlgoIm2row:
+      return true ;
+    case vlConvolutionAlgoDirect1x1:
+      return
+      filters.getHeight() == 1 && filters.getWidth() == 1 &&
+      strideY == 1 && strideX == 1 &&
+      padTop == 0 && padBottom == 0 && padLeft == 0 && padRight == 0 ;
+    default:
+      return false ;
+  }
+}
+
+/*
+ Grouped convolutions with shallow filters, and depthwise ones in
+ particular, would run a tiny GEMM per group. These are computed by
+ a direct kernel instead, forward and backward, whatever the
+ selected algorithm.
+ */
+
+#define VL_NNCONV_DIRECT_MAX_FILTER_DEPTH 4
+
+static bool
+useDirectGrouped(TensorShape const & data, TensorShape const & filters)
+{
+  return
+  filters.getDepth() < data.getDepth() &&
+  filters.getDepth() <= VL_NNCONV_DIRECT_MAX_FILTER_DEPTH ;
+}
+
+template<vl::Type dataType> static vl::Error
+nnconv_forward_cpu(Context& context,
+                   vl::ConvolutionAlgo algo,
+                   Tensor output, double outputMult,
+                   Tensor data, double dataMult,
+                   Tensor filters,
+                   Tensor biases,
+                   int strideY, int strideX,
+                   int dilateY, int dilateX,
+                   int padTop, int padBottom,
+                   int padLeft, int padRight,
+                   bool rectify)
+{
+  typedef typename vl::DataTypeTraits<dataType>::type type ;
+
+  if (useDirectGrouped(data, filters)) {
+    vl::Error error = vl::impl::nnconv_direct<vl::CPU,type>::forward
+    (context,
+     (type*)output.getMemory(), outputMult,
+     (type const*)data.getMemory(), dataMult,
+     (type const*)filters.getMemory(),
+     (type const*)biases.getMemory(),
+     data.getHeight(), data.getWidth(), data.getDepth(), data.getSize(),
+     filters.getHeight(), filters.getWidth(), filters.getDepth(), filters.getSize(),
+     strideY, strideX,
+     dilateY, dilateX,
+     padTop, padBottom,
+     padLeft, padRight,
+     rectify) ;
+    return context.passError(error, "nnconv_forward") ;
+  }
+
+  switch (algo) {
+    case vlConvolutionAlgoDirect1x1:
+      return vl::impl::nnconv_forward_direct1x1_blas<vl::CPU, dataType>
+      (context,
+       output, outputMult,
+       data, dataMult,
+       filters, biases,
+       rectify) ;
+    default:
+      return vl::impl::nnconv_forward_blas<vl::CPU, dataType>
+      (context,
+       output, outputMult,
+       data, dataMult,
+       filters, biases,
+       strideY, strideX,
+       dilateY, dilateX,
+       padTop, padBottom,
+       padLeft, padRight,
+       rectify) ;
+  }
+}
+
+template<vl::Type dataType> static vl::Error
+nnconv_forward_cpu_tuned(Context& context,
+                         Tensor output, double outputMult,
+                         Tensor data, double dataMult,
+                         Tensor filters,
+                         Tensor biases,
+                         int strideY, int strideX,
+                         int dilateY, int dilateX,
+                         int padTop, int padBottom,
+                         int padLeft, int padRight,
+                         bool rectify)
+{
+  vl::ConvolutionTuner & tuner = context.getConvolutionTuner() ;
+  vl::ConvolutionAlgo algo = tuner.getAlgo() ;
+  vl::Error error = vlSuccess ;
+
+#define RUN(algo) \
+nnconv_forward_cpu<dataType>(context, algo, \
+output, outputMult, data, dataMult, filters, biases, \
+strideY, strideX, dilateY, dilateX, padTop, padBottom, padLeft, padRight, rectify)
+
+#define APPLICABLE(algo) \
+isApplicable(algo, filters, strideY, strideX, padTop, padBottom, padLeft, padRight)
+
+  if (algo != vlConvolutionAlgoAuto) {
+    if (!APPLICABLE(algo)) { algo = vlConvolutionAlgoIm2row ; }
+    return RUN(algo) ;
+  }
+
+  /* benchmarking overwrites the output, so it is possible only if
+     the latter is not accumulated into */
+  if (outputMult != 0) {
+    return RUN(vlConvolutionAlgoIm2row) ;
+  }
+
+  vl::ConvolutionSignature signature(data, filters,
+                                     strideY, strideX,
+                                     dilateY, dilateX,
+                                     padTop, padBottom,
+                                     padLeft, padRight,
+                                     context.getNumCpuThreads()) ;
+  if (tuner.lookup(signature, algo) && APPLICABLE(algo)) {
+    return RUN(algo) ;
+  }
+
+  /* time each applicable algorithm; the first run of each is a
+     warm-up and the output is left by the last one */
+  double bestTime = -1 ;
+  vl::ConvolutionAlgo bestAlgo = vlConvolutionAlgoIm2row ;
+  for (int candidate = 0 ; candidate < vlConvolutionAlgoNum ; ++candidate) {
+    if (!APPLICABLE((vl::ConvolutionAlgo)candidate)) { continue ; }
+    double time = 0 ;
+    for (int trial = 0 ; trial < 2 ; ++trial) {
+      time = vl::ConvolutionTuner::getTime() ;
+      error = RUN((vl::ConvolutionAlgo)candidate) ;
+      if (error != vlSuccess) { return error ; }
+      time = vl::ConvolutionTuner::getTime() - time ;
+    }
+    if (bestTime < 0 || time < bestTime) {
+      bestTime = time ;
+      bestAlgo = (vl::ConvolutionAlgo)candidate ;
+    }
+  }
+  tuner.store(signature, bestAlgo) ;
+  return error ;
+
+#undef RUN
+#undef APPLICABLE
+}
+
+#define DISPATCHCPU(dataType) \
+error = nnconv_forward_cpu_tuned<dataType> \
+(context, \
+ output, outputMult, \
+ data, dataMult, \
+ filters, biases, \
+ strideY, strideX, \
+ dilateY, dilateX, \
+ padTop, padBottom, \
+ padLeft, padRight, \
+ rectify) ;
+
+#define DISPATCHCPU2() \
+switch (dataType) { \
+case vlTypeFloat : DISPATCHCPU(vlTypeFloat) ; break ; \
+IF_DOUBLE(case vlTypeDouble : DISPATCHCPU(vlTypeDouble) ; break ;) \
+default: assert(false) ; return vlErrorUnknown ; \
+}
+
+#if ENABLE_CUDNN
+template<vl::Type dataType> static vl::Error
+rectify_gpu(Tensor output)
+{
+  typedef typename vl::DataTypeTraits<dataType>::type type ;
+  return vl::impl::operations<vl::GPU,type>::rectify
+  ((type*)output.getMemory(), output.getNumElements()) ;
+}
+#endif
+
 vl::Error
 vl::nnconv_forward(Context& context,
                    Tensor output, double outputMult,
@@ -73,12 +294,37 @@ vl::nnconv_forward(Context& context,
                    Tensor filters,
                    Tensor biases,
                    int strideY, int strideX,
+                   int dilateY, int dilateX,
                    int padTop, int padBottom,
-                   int padLeft, int padRight)
+                   int padLeft, int padRight,
+                   bool rectify)
 {
   vl::Error error = vlSuccess ;
   vl::Type dataType = output.getDataType() ;
 
+  if (dataType == vlTypeHalf) {
+    impl::FloatCopy output_, data_, filters_, biases_ ;
+    error = impl::checkHalfDevice(context, output) ;
+    if (error == vlSuccess) { error = filters_.init(filters) ; }
+    if (error == vlSuccess) { error = biases_.init(biases) ; }
+    for (size_t image = 0 ; image < output.getSize() && error == vlSuccess ; ++image) {
+      error = output_.initImage(output, image, outputMult != 0) ;
+      if (error == vlSuccess) { error = data_.initImage(data, image) ; }
+      if (error != vlSuccess) { break ; }
+      error = nnconv_forward(context,
+                             output_, outputMult,
+                             data_, dataMult,
+                             filters_, biases_,
+                             strideY, strideX,
+                             dilateY, dilateX,
+                             padTop, padBottom,
+                             padLeft, padRight,
+                             rectify) ;
+      if (error == vlSuccess) { output_.copyToImage(output, image) ; }
+    }
+    return context.passError(error, "nnconv (half)") ;
+  }
+
   switch (output.getDeviceType()) {
     default:
       assert(false) ;
@@ -86,15 +332,27 @@ vl::nnconv_forward(Context& context,
       break ;
 
     case vl::CPU:
-      DISPATCH2(vl::CPU) ;
+      DISPATCHCPU2() ;
       break ;
 
 #if ENABLE_GPU
     case vl::GPU:
 #if ENABLE_CUDNN
-      if (context.getCudaHelper().getCudnnEnabled()) {
+      /* this version of the cuDNN wrapper does not handle dilation */
+      if (context.getCudaHelper().getCudnnEnabled() &&
+          dilateY == 1 && dilateX == 1) {
         DISPATCHCUDNN2() ;
-        if (error == vl::vlSuccess) { return error ; }
+        if (error == vl::vlSuccess) {
+          if (rectify) {
+            /* cuDNN has no fused ReLU for this call, apply it afterwards */
+            switch (dataType) {
+              case vlTypeFloat : error = rectify_gpu<vlTypeFloat>(output) ; break ;
+              IF_DOUBLE(case vlTypeDouble : error = rectify_gpu<vlTypeDouble>(output) ; break ;)
+              default: assert(false) ; return vlErrorUnknown ;
+            }
+          }
+          return error ;
+        }
         if (error != vl::vlErrorUnsupported) { goto done ; }
         /* this case was not supported by CUDNN -- fallback */
       }
@@ -109,6 +367,35 @@ done:
   return error ;
 }
 
+/* ---------------------------------------------------------------- */
+/*                                              nnconv_forward_int8 */
+/* ---------------------------------------------------------------- */
+
+vl::Error
+vl::nnconv_forward_int8(Context& context,
+                        Tensor output,
+                        Tensor data,
+                        Tensor filters,
+                        Tensor biases,
+                        float inputScale,
+                        Tensor filterScales,
+                        int strideY, int strideX,
+                        int dilateY, int dilateX,
+                        int padTop, int padBottom,
+                        int padLeft, int padRight,
+                        bool rectify)
+{
+  if (output.getDeviceType() != vl::CPU || output.getDataType() != vlTypeFloat) {
+    return context.setError(vlErrorUnsupported,
+                            "Int8 convolution is supported only for single precision CPU arrays.") ;
+  }
+  vl::Error error = vl::impl::nnconv_forward_int8
+  (context, output, data, filters, biases, inputScale, filterScales,
+   strideY, strideX, dilateY, dilateX,
+   padTop, padBottom, padLeft, padRight, rectify) ;
+  return context.passError(error, __func__) ;
+}
+
 /* ---------------------------------------------------------------- */
 /*                                                  nnconv_backward */
 /* ---------------------------------------------------------------- */
@@ -127,6 +414,7 @@ error = vl::impl::nnconv_backward_blas<deviceType, dataType> \
  derData, derFilters, derBiases, \
  data, filters, derOutput, \
  strideY, strideX, \
+ dilateY, dilateX, \
  padTop, padBottom, \
  padLeft, padRight) ;
 
@@ -140,6 +428,62 @@ error = vl::impl::nnconv_cudnn<dataType>::backward \
  padTop, padBottom, \
  padLeft, padRight) ;
 
+template<vl::Type dataType> static vl::Error
+nnconv_backward_cpu(Context& context,
+                    Tensor derData,
+                    Tensor derFilters,
+                    Tensor derBiases,
+                    Tensor data,
+                    Tensor filters,
+                    Tensor derOutput,
+                    int strideY, int strideX,
+                    int dilateY, int dilateX,
+                    int padTop, int padBottom,
+                    int padLeft, int padRight)
+{
+  typedef typename vl::DataTypeTraits<dataType>::type type ;
+  TensorShape dataShape = derData ? derData.getShape() : data.getShape() ;
+  TensorShape filtersShape = filters ? filters.getShape() : derFilters.getShape() ;
+
+  if ((derData || derFilters) && useDirectGrouped(dataShape, filtersShape)) {
+    vl::Error error = vl::impl::nnconv_direct<vl::CPU,type>::backward
+    (context,
+     (type*)derData.getMemory(),
+     (type*)derFilters.getMemory(),
+     (type*)derBiases.getMemory(),
+     (type const*)data.getMemory(),
+     (type const*)filters.getMemory(),
+     (type const*)derOutput.getMemory(),
+     dataShape.getHeight(), dataShape.getWidth(), dataShape.getDepth(), dataShape.getSize(),
+     filtersShape.getHeight(), filtersShape.getWidth(), filtersShape.getDepth(), filtersShape.getSize(),
+     strideY, strideX,
+     dilateY, dilateX,
+     padTop, padBottom,
+     padLeft, padRight) ;
+    return context.passError(error, "nnconv_backward") ;
+  }
+
+  return vl::impl::nnconv_backward_blas<vl::CPU, dataType>
+  (context,
+   derData, derFilters, derBiases,
+   data, filters, derOutput,
+   strideY, strideX,
+   dilateY, dilateX,
+   padTop, padBottom,
+   padLeft, padRight) ;
+}
+
+#undef DISPATCHCPU
+#define DISPATCHCPU(dataType) \
+error = nnconv_backward_cpu<dataType> \
+(context, \
+ derData, derFilters, derBiases, \
+ data, filters, derOutput, \
+ strideY, strideX, \
+ dilateY, dilateX, \
+ padTop, padBottom, \
+ padLeft, padRight) ;
+
 vl::Error
 vl::nnconv_backward(Context& context,
                     Tensor derData,
@@ -149,12 +493,53 @@ vl::nnconv_backward(Context& context,
                     Tensor filters,
                     Tensor derOutput,
                     int strideY, int strideX,
+                    int dilateY, int dilateX,
                     int padTop, int padBottom,
                     int padLeft, int padRight)
 {
   vl::Error error = vl::vlSuccess ;
   vl::Type dataType = derOutput.getDataType() ;
 
+  if (dataType == vlTypeHalf) {
+    impl::FloatCopy derData_, derFilters_, derBiases_, data_, filters_, derOutput_ ;
+    impl::FloatCopy imageDerFilters_, imageDerBiases_ ;
+    size_t numImages = derOutput.getSize() ;
+    error = impl::checkHalfDevice(context, derOutput) ;
+    if (error == vlSuccess) { error = filters_.init(filters) ; }
+    if (error == vlSuccess) { error = derFilters_.init(derFilters, false) ; }
+    if (error == vlSuccess) { error = derBiases_.init(derBiases, false) ; }
+    if (numImages > 1) {
+      if (error == vlSuccess) { error = imageDerFilters_.init(derFilters, false) ; }
+      if (error == vlSuccess) { error = imageDerBiases_.init(derBiases, false) ; }
+    }
+    for (size_t image = 0 ; image < numImages && error == vlSuccess ; ++image) {
+      error = derOutput_.initImage(derOutput, image) ;
+      if (error == vlSuccess) { error = data_.initImage(data, image) ; }
+      if (error == vlSuccess) { error = derData_.initImage(derData, image, false) ; }
+      if (error != vlSuccess) { break ; }
+      error = nnconv_backward(context,
+                              derData_,
+                              image ? imageDerFilters_ : derFilters_,
+                              image ? imageDerBiases_ : derBiases_,
+                              data_, filters_, derOutput_,
+                              strideY, strideX,
+                              dilateY, dilateX,
+                              padTop, padBottom,
+                              padLeft, padRight) ;
+      if (error != vlSuccess) { break ; }
+      derData_.copyToImage(derData, image) ;
+      if (image) {
+        derFilters_.add(imageDerFilters_) ;
+        derBiases_.add(imageDerBiases_) ;
+      }
+    }
+    if (error == vlSuccess) {
+      derFilters_.copyTo(derFilters) ;
+      derBiases_.copyTo(derBiases) ;
+    }
+    return context.passError(error, "nnconv (half)") ;
+  }
+
   switch (derOutput.getDeviceType()) {
     default:
       assert(false) ;
@@ -162,13 +547,15 @@ vl::nnconv_backward(Context& context,
       break ;
 
     case vl::CPU:
-      DISPATCH2(vl::CPU) ;
+      DISPATCHCPU2() ;
       break ;
 
 #if ENABLE_GPU
     case vl::GPU:
 #if ENABLE_CUDNN
-      if (context.getCudaHelper().getCudnnEnabled()) {
+      /* this version of the cuDNN wrapper does not handle dilation */
+      if (context.getCudaHelper().getCudnnEnabled() &&
+          dilateY == 1 && dilateX == 1) {
         DISPATCHCUDNN2() ;
         if (error == vl::vlSuccess) { return error ; }
         if (error != vl::vlErrorUnsupported) { goto done ; }
@@ -186,6 +573,141 @@ done:
 }
 
 
+/* ---------------------------------------------------------------- */
+/*                                      nnconvt separable upsampling */
+/* ---------------------------------------------------------------- */
+
+/*
+ Bilinear upsampling layers, as found in FCN-style networks, use one
+ separable filter per feature channel (NUMGROUPS equal to the number
+ of channels) no larger than twice the upsampling factor. These are
+ computed by vl::impl::upsample, whose cost is linear in the number of
+ output pixels, instead of a GEMM and row2im for each image.
+ */
+
+static bool
+useSeparableUpsampling(TensorShape const & data,
+                       TensorShape const & output,
+                       TensorShape const & filters,
+                       int upsampleY, int upsampleX)
+{
+  return
+  filters.getDepth() == 1 &&
+  filters.getSize() == data.getDepth() &&
+  output.getDepth() == data.getDepth() &&
+  filters.getHeight() <= 2 * upsampleY &&
+  filters.getWidth() <= 2 * upsampleX ;
+}
+
+/*
+ Forward: result is the output and input the data.
+ Backward: result is derData and input is derOutput.
+ applied is false if the filters turn out not to be separable.
+ */
+
+template<vl::Device deviceType, typename type> static vl::Error
+nnconvt_separable(Context& context,
+                  bool & applied,
+                  Tensor result,
+                  Tensor input,
+                  Tensor filters,
+                  int upsampleY, int upsampleX,
+                  int cropTop, int cropLeft,
+                  bool check, bool backward)
+{
+  TensorShape data = backward ? result : input ;
+  TensorShape output = backward ? input : result ;
+  size_t numChannels = filters.getSize() ;
+  size_t filterHeight = filters.getHeight() ;
+  size_t filterWidth = filters.getWidth() ;
+  bool isSeparable = false ;
+  vl::Error error ;
+
+  applied = false ;
+  type* factors = (type*)context.getWorkspace
+  (deviceType, (numChannels * (filterHeight + filterWidth) + 1) * sizeof(type)) ;
+  if (factors == NULL) {
+    return context.getLastError() ;
+  }
+  error = vl::impl::upsample<deviceType,type>::factorize
+  (context, isSeparable, factors,
+   (type const*)filters.getMemory(),
+   filterHeight, filterWidth, numChannels,
+   check) ;
+  if (error != vlSuccess || !isSeparable) {
+    return context.passError(error, "nnconvt_separable") ;
+  }
+  if (backward) {
+    error = vl::impl::upsample<deviceType,type>::backward
+    (context,
+     (type*)result.getMemory(), (type const*)input.getMemory(), factors,
+     data.getHeight(), data.getWidth(), data.getDepth() * data.getSize(),
+     numChannels,
+     output.getHeight(), output.getWidth(),
+     filterHeight, filterWidth,
+     upsampleY, upsampleX,
+     cropTop, cropLeft) ;
+  } else {
+    error = vl::impl::upsample<deviceType,type>::forward
+    (context,
+     (type*)result.getMemory(), (type const*)input.getMemory(), factors,
+     data.getHeight(), data.getWidth(), data.getDepth() * data.getSize(),
+     numChannels,
+     output.getHeight(), output.getWidth(),
+     filterHeight, filterWidth,
+     upsampleY, upsampleX,
+     cropTop, cropLeft) ;
+  }
+  applied = (error == vlSuccess) ;
+  return context.passError(error, "nnconvt_separable") ;
+}
+
+#define DISPATCHSEPARABLE(deviceType, type) \
+error = nnconvt_separable<deviceType, type> \
+(context, applied, \
+ result, input, filters, \
+ upsampleY, upsampleX, \
+ cropTop, cropLeft, \
+ method == vlConvTransposeAuto, backward) ;
+
+#define DISPATCHSEPARABLE2(deviceType) \
+switch (input.getDataType()) { \
+case vlTypeFloat : DISPATCHSEPARABLE(deviceType, float) ; break ; \
+IF_DOUBLE(case vlTypeDouble : DISPATCHSEPARABLE(deviceType, double) ; break ;) \
+default: assert(false) ; return vlErrorUnknown ; \
+}
+
+static vl::Error
+nnconvt_try_separable(Context& context,
+                      bool & applied,
+                      Tensor result,
+                      Tensor input,
+                      Tensor filters,
+                      int upsampleY, int upsampleX,
+                      int cropTop, int cropLeft,
+                      vl::ConvTransposeMethod method,
+                      bool backward)
+{
+  vl::Error error = vlSuccess ;
+  applied = false ;
+  switch (input.getDeviceType()) {
+    default:
+      assert(false) ;
+      return vl::vlErrorUnknown ;
+
+    case vl::CPU:
+      DISPATCHSEPARABLE2(vl::CPU) ;
+      break ;
+
+#if ENABLE_GPU
+    case vl::GPU:
+      DISPATCHSEPARABLE2(vl::GPU) ;
+      break ;
+#endif
+  }
+  return error ;
+}
+
 /* ---------------------------------------------------------------- */
 /*                                                  nnconvt_forward */
 /* ---------------------------------------------------------------- */
@@ -198,15 +720,48 @@ vl::nnconvt_forward(Context& context,
                     Tensor biases,
                     int upsampleY, int upsampleX,
                     int cropTop, int cropBottom,
-                    int cropLeft, int cropRight)
+                    int cropLeft, int cropRight,
+                    ConvTransposeMethod method)
 {
   vl::Error error = vlSuccess ;
   size_t dataOffset = data.getHeight()*data.getWidth()*data.getDepth() ;
   size_t outputOffset = output.getHeight()*output.getWidth()*output.getDepth() ;
+  bool separable = false ;
+
+  if (data.getDataType() == vlTypeHalf) {
+    /* as for nnconv, the data is converted one image at a time */
+    impl::FloatCopy output_, data_, filters_, biases_ ;
+    error = impl::checkHalfDevice(context, data) ;
+    if (error == vlSuccess) { error = filters_.init(filters) ; }
+    if (error == vlSuccess) { error = biases_.init(biases) ; }
+    for (size_t image = 0 ; image < data.getSize() && error == vlSuccess ; ++image) {
+      error = data_.initImage(data, image) ;
+      if (error == vlSuccess) { error = output_.initImage(output, image, false) ; }
+      if (error != vlSuccess) { break ; }
+      error = nnconvt_forward(context,
+                              output_, data_, filters_, biases_,
+                              upsampleY, upsampleX,
+                              cropTop, cropBottom,
+                              cropLeft, cropRight,
+                              method) ;
+      if (error == vlSuccess) { output_.copyToImage(output, image) ; }
+    }
+    return context.passError(error, "nnconvt (half)") ;
+  }
+
+  if (method != vlConvTransposeGeneric &&
+      useSeparableUpsampling(data, output, filters, upsampleY, upsampleX)) {
+    error = nnconvt_try_separable(context, separable,
+                                  output, data, filters,
+                                  upsampleY, upsampleX,
+                                  cropTop, cropLeft,
+                                  method, false) ;
+    if (error != vlSuccess) { goto done ; }
+  }
 
   // we need to process this down per image as nnconv_backward would otherwise
   // accumulate everything into a single feature field in the output
-  for (int image = 0 ; image < data.getSize() ; ++image) {
+  for (int image = 0 ; image < data.getSize() && !separable ; ++image) {
     Tensor dataSlice(data) ;
     Tensor outputSlice(output) ;
 
@@ -229,6 +784,7 @@ vl::nnconvt_forward(Context& context,
                                 outputSlice, Tensor(), Tensor(),
                                 Tensor(), filters, dataSlice,
                                 upsampleY, upsampleX,
+                                1, 1,
                                 cropTop, cropBottom,
                                 cropLeft, cropRight) ;
     if (error != vlSuccess) { goto done ; }
@@ -257,16 +813,71 @@ vl::nnconvt_backward(Context& context,
                      Tensor derOutput,
                      int upsampleY, int upsampleX,
                      int cropTop, int cropBottom,
-                     int cropLeft, int cropRight)
+                     int cropLeft, int cropRight,
+                     ConvTransposeMethod method)
 {
   vl::Error error = vl::vlSuccess ;
+  bool separable = false ;
+
+  if (derOutput.getDataType() == vlTypeHalf) {
+    /* as for nnconv, the data is converted one image at a time */
+    impl::FloatCopy derData_, derFilters_, derBiases_, data_, filters_, derOutput_ ;
+    impl::FloatCopy imageDerFilters_, imageDerBiases_ ;
+    size_t numImages = derOutput.getSize() ;
+    error = impl::checkHalfDevice(context, derOutput) ;
+    if (error == vlSuccess) { error = filters_.init(filters) ; }
+    if (error == vlSuccess) { error = derFilters_.init(derFilters, false) ; }
+    if (error == vlSuccess) { error = derBiases_.init(derBiases, false) ; }
+    if (numImages > 1) {
+      if (error == vlSuccess) { error = imageDerFilters_.init(derFilters, false) ; }
+      if (error == vlSuccess) { error = imageDerBiases_.init(derBiases, false) ; }
+    }
+    for (size_t image = 0 ; image < numImages && error == vlSuccess ; ++image) {
+      error = derOutput_.initImage(derOutput, image) ;
+      if (error == vlSuccess) { error = data_.initImage(data, image) ; }
+      if (error == vlSuccess) { error = derData_.initImage(derData, image, false) ; }
+      if (error != vlSuccess) { break ; }
+      error = nnconvt_backward(context,
+                               derData_,
+                               image ? imageDerFilters_ : derFilters_,
+                               image ? imageDerBiases_ : derBiases_,
+                               data_, filters_, derOutput_,
+                               upsampleY, upsampleX,
+                               cropTop, cropBottom,
+                               cropLeft, cropRight,
+                               method) ;
+      if (error != vlSuccess) { break ; }
+      derData_.copyToImage(derData, image) ;
+      if (image) {
+        derFilters_.add(imageDerFilters_) ;
+        derBiases_.add(imageDerBiases_) ;
+      }
+    }
+    if (error == vlSuccess) {
+      derFilters_.copyTo(derFilters) ;
+      derBiases_.copyTo(derBiases) ;
+    }
+    return context.passError(error, "nnconvt (half)") ;
+  }
+
+  if (derData &&
+      method != vlConvTransposeGeneric &&
+      useSeparableUpsampling(derData, derOutput, filters, upsampleY, upsampleX)) {
+    error = nnconvt_try_separable(context, separable,
+                                  derData, derOutput, filters,
+                                  upsampleY, upsampleX,
+                                  cropTop, cropLeft,
+                                  method, true) ;
+    if (error != vlSuccess) { goto done ; }
+  }
 
-  if (derData) {
+  if (derData && !separable) {
     error = vl::nnconv_forward(context,
                                 derData, 0,
                                 derOutput, 1,
                                 filters, Tensor(),
                                 upsampleY, upsampleX,
+                                1, 1,
                                 cropTop, cropBottom,
                                 cropLeft, cropRight) ;
     if (error != vlSuccess) { goto done ; }
@@ -277,6 +888,7 @@ vl::nnconvt_backward(Context& context,
                                  Tensor(), derFilters, Tensor(),
                                  derOutput, Tensor(), data,
                                  upsampleY, upsampleX,
+                                 1, 1,
                                  cropTop, cropBottom,
                                  cropLeft, cropRight) ;
     if (error != vlSuccess) { goto done ; }
@@ -27,8 +27,10 @@ namespace vl {
                  vl::Tensor filters,
                  vl::Tensor biases,
                  int strideY, int strideX,
+                 int dilateY, int dilateX,
                  int padTop, int padBottom,
-                 int padLeft, int padRight) ;
+                 int padLeft, int padRight,
+                 bool rectify = false) ;
 
   vl::Error
   nnconv_backward(vl::Context& context,
@@ -39,9 +41,46 @@ namespace vl {
                   vl::Tensor filters,
                   vl::Tensor derOutput,
                   int strideY, int strideX,
+                  int dilateY, int dilateX,
                   int padTop, int padBottom,
                   int padLeft, int padRight) ;
 
+  /*
+   Forward convolution with int8 quantized filters and data (see
+   impl/nnconv_int8.hpp), for inference with single precision CPU
+   tensors. An inputScale of zero quantizes the data dynamically and
+   an empty filterScales uses the range of each filter.
+   */
+
+  vl::Error
+  nnconv_forward_int8(vl::Context& context,
+                      vl::Tensor output,
+                      vl::Tensor data,
+                      vl::Tensor filters,
+                      vl::Tensor biases,
+                      float inputScale,
+                      vl::Tensor filterScales,
+                      int strideY, int strideX,
+                      int dilateY, int dilateX,
+                      int padTop, int padBottom,
+                      int padLeft, int padRight,
+                      bool rectify = false) ;
+
+  /*
+   Convolution transpose with depthwise filters that are separable and
+   at most twice as large as the upsampling factor, such as bilinear
+   interpolation filters, can be computed in time linear in the number
+   of output pixels. By default this is used when the filters are found
+   to be separable; vlConvTransposeSeparable skips the check and
+   vlConvTransposeGeneric disables it.
+   */
+
+  enum ConvTransposeMethod {
+    vlConvTransposeAuto = 0,
+    vlConvTransposeGeneric,
+    vlConvTransposeSeparable
+  } ;
+
   vl::Error
   nnconvt_forward(vl::Context& context,
                   vl::Tensor output,
@@ -50,7 +89,8 @@ namespace vl {
                   vl::Tensor biases,
                   int upsampleY, int upsampleX,
                   int cropTop, int cropBottom,
-                  int cropLeft, int cropRight) ;
+                  int cropLeft, int cropRight,
+                  ConvTransposeMethod method = vlConvTransposeAuto) ;
 
   vl::Error
   nnconvt_backward(vl::Context& context,
@@ -62,7 +102,8 @@ namespace vl {
                    vl::Tensor derOutput,
                    int upsampleY, int upsampleX,
                    int cropTop, int cropBottom,
-                   int cropLeft, int cropRight) ;
+                   int cropLeft, int cropRight,
+                   ConvTransposeMethod method = vlConvTransposeAuto) ;
 }
 
 
@@ -13,6 +13,9 @@ the terms of the BSD license (see the COPYING file).
 #include "nnfullyconnected.hpp"
 #include "impl/blashelper.hpp"
 #include "impl/copy.hpp"
+#include "impl/half.hpp"
+#include "impl/nnconv_int8.hpp"
+#include "impl/nnfullyconnected_sparse.hpp"
 #include <assert.h>
 
 using namespace vl ;
@@ -26,7 +29,8 @@ nnfullyconnected_forward_impl(Context& context,
                               Tensor output,
                               Tensor data,
                               Tensor filters,
-                              Tensor biases)
+                              Tensor biases,
+                              bool rectify)
 {
   vl::Error error ;
   typedef typename vl::DataTypeTraits<dataType>::type type ;
@@ -86,6 +90,11 @@ nnfullyconnected_forward_impl(Context& context,
      (type*)output.getMemory(), biases.getNumElements()) ;
     if (error != vl::vlSuccess) { goto done ; }
   }
+
+  if (rectify) {
+    error = vl::impl::operations<deviceType,type>::rectify
+    ((type*)output.getMemory(), output.getNumElements()) ;
+  }
 done:
   return context.passError(error, __func__) ;
 }
@@ -174,7 +183,7 @@ done:
 
 #define DISPATCH(deviceType, dataType) \
 error = nnfullyconnected_forward_impl<deviceType,dataType> \
-(context, output, data, filters, biases) ;
+(context, output, data, filters, biases, rectify) ;
 
 #define DISPATCH2(deviceType) \
 switch (dataType) { \
@@ -188,11 +197,29 @@ vl::nnfullyconnected_forward(Context& context,
                              Tensor output,
                              Tensor data,
                              Tensor filters,
-                             Tensor biases)
+                             Tensor biases,
+                             bool rectify)
 {
   vl::Error error = vl::vlSuccess ;
   vl::Type dataType = data.getDataType() ;
 
+  if (dataType == vlTypeHalf) {
+    impl::FloatCopy output_, data_, filters_, biases_, unused1, unused2 ;
+    error = impl::initFloatCopies(context, "nnfullyconnected (half)",
+                                  data_, data, true,
+                                  output_, output, false,
+                                  filters_, filters, true,
+                                  biases_, biases, true,
+                                  unused1, Tensor(), false,
+                                  unused2, Tensor(), false) ;
+    if (error != vlSuccess) { return error ; }
+    error = nnfullyconnected_forward(context,
+                                     output_, data_, filters_, biases_,
+                                     rectify) ;
+    if (error == vlSuccess) { output_.copyTo(output) ; }
+    return error ;
+  }
+
   switch (data.getDeviceType()) {
     default:
       assert(false) ;
@@ -212,6 +239,70 @@ vl::nnfullyconnected_forward(Context& context,
   return context.passError(error, __func__) ;
 }
 
+/* ---------------------------------------------------------------- */
+/* nnfullyconnected_forward_int8                                    */
+/* ---------------------------------------------------------------- */
+
+vl::Error
+vl::nnfullyconnected_forward_int8(Context& context,
+                                  Tensor output,
+                                  Tensor data,
+                                  Tensor filters,
+                                  Tensor biases,
+                                  float inputScale,
+                                  Tensor filterScales,
+                                  bool rectify)
+{
+  if (output.getDeviceType() != vl::CPU || output.getDataType() != vlTypeFloat) {
+    return context.setError(vlErrorUnsupported,
+                            "Int8 fully connected layers are supported only for single precision CPU arrays.") ;
+  }
+  vl::Error error = vl::impl::nnfullyconnected_forward_int8
+  (context, output, data, filters, biases, inputScale, filterScales, rectify) ;
+  return context.passError(error, __func__) ;
+}
+
+/* ---------------------------------------------------------------- */
+/* nnfullyconnected_forward_sparse                                  */
+/* ---------------------------------------------------------------- */
+
+vl::Error
+vl::nnfullyconnected_forward_sparse(Context& context,
+                                    Tensor output,
+                                    Tensor data,
+                                    SparseFilters const & filters,
+                                    Tensor biases,
+                                    bool rectify)
+{
+  vl::Error error = vl::vlSuccess ;
+  if (output.getDeviceType() != vl::CPU) {
+    return context.setError(vlErrorUnsupported,
+                            "Sparse fully connected layers are supported only for CPU arrays.") ;
+  }
+  assert(data.getHeight() * data.getWidth() * data.getDepth() == filters.volume) ;
+
+  switch (data.getDataType()) {
+    case vlTypeFloat :
+      error = vl::impl::nnfullyconnected_forward_sparse<float>
+      (context, (float*)output.getMemory(), (float const*)data.getMemory(),
+       data.getSize(), filters,
+       biases ? (float const*)biases.getMemory() : NULL, rectify) ;
+      break ;
+#if ENABLE_DOUBLE
+    case vlTypeDouble :
+      error = vl::impl::nnfullyconnected_forward_sparse<double>
+      (context, (double*)output.getMemory(), (double const*)data.getMemory(),
+       data.getSize(), filters,
+       biases ? (double const*)biases.getMemory() : NULL, rectify) ;
+      break ;
+#endif
+    default:
+      return context.setError(vlErrorUnsupported,
+                              "Sparse fully connected layers are supported only for single and double precision arrays.") ;
+  }
+  return context.passError(error, __func__) ;
+}
+
 /* ---------------------------------------------------------------- */
 /* nnfullyconnected_backward                                        */
 /* ---------------------------------------------------------------- */
@@ -233,6 +324,27 @@ vl::nnfullyconnected_backward(vl::Context& context,
   vl::Error error = vl::vlSuccess ;
   vl::Type dataType = data.getDataType() ;
 
+  if (dataType == vlTypeHalf) {
+    impl::FloatCopy derData_, derFilters_, derBiases_, data_, filters_, derOutput_ ;
+    error = impl::initFloatCopies(context, "nnfullyconnected (half)",
+                                  derOutput_, derOutput, true,
+                                  derData_, derData, false,
+                                  derFilters_, derFilters, false,
+                                  derBiases_, derBiases, false,
+                                  data_, data, true,
+                                  filters_, filters, true) ;
+    if (error != vlSuccess) { return error ; }
+    error = nnfullyconnected_backward(context,
+                                      derData_, derFilters_, derBiases_,
+                                      data_, filters_, derOutput_) ;
+    if (error == vlSuccess) {
+      derData_.copyTo(derData) ;
+      derFilters_.copyTo(derFilters) ;
+      derBiases_.copyTo(derBiases) ;
+    }
+    return error ;
+  }
+
   switch (derOutput.getDeviceType()) {
     default:
       assert(false) ;
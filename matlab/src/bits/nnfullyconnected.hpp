@@ -23,7 +23,45 @@ namespace vl {
                            vl::Tensor output,
                            vl::Tensor data,
                            vl::Tensor filters,
-                           vl::Tensor biases) ;
+                           vl::Tensor biases,
+                           bool rectify = false) ;
+
+  /* int8 quantized version of nnfullyconnected_forward, see nnconv_forward_int8 */
+  vl::Error
+  nnfullyconnected_forward_int8(vl::Context& context,
+                                vl::Tensor output,
+                                vl::Tensor data,
+                                vl::Tensor filters,
+                                vl::Tensor biases,
+                                float inputScale,
+                                vl::Tensor filterScales,
+                                bool rectify = false) ;
+
+  /*
+   Sparse filter bank, stored as a volume x numFilters matrix in
+   compressed sparse column format (the format of MATLAB sparse
+   matrices). This is the compressed sparse row format of the
+   transposed matrix: the nonzero weights of filter k are values[j]
+   for the input elements rowIndices[j], with
+   columnOffsets[k] <= j < columnOffsets[k+1].
+   */
+  struct SparseFilters
+  {
+    size_t volume ;
+    size_t numFilters ;
+    size_t const * columnOffsets ;
+    size_t const * rowIndices ;
+    double const * values ;
+  } ;
+
+  /* nnfullyconnected_forward with sparse filters (CPU only) */
+  vl::Error
+  nnfullyconnected_forward_sparse(vl::Context& context,
+                                  vl::Tensor output,
+                                  vl::Tensor data,
+                                  SparseFilters const & filters,
+                                  vl::Tensor biases,
+                                  bool rectify = false) ;
 
   vl::Error
   nnfullyconnected_backward(vl::Context& context,
@@ -30,7 +30,7 @@ using namespace vl ;
 
 #define DISPATCH(deviceType, type) \
 error = vl::impl::lrn<deviceType,type>::forward \
-((type*)output.getMemory(), (type const*)data.getMemory(), \
+(context, (type*)output.getMemory(), (type const*)data.getMemory(), \
 data.getHeight(), data.getWidth(), data.getDepth(), data.getSize(), \
 normDetph, kappa, alpha, beta) ;
 
@@ -38,6 +38,9 @@ normDetph, kappa, alpha, beta) ;
 switch (dataType) { \
 case vlTypeFloat : DISPATCH(deviceType, float) ; break ; \
 IF_DOUBLE(case vlTypeDouble : DISPATCH(deviceType, double) ; break ;) \
+case vlTypeHalf : \
+  return context.setError(vlErrorUnsupported, \
+                          "LRN does not support half precision arrays.") ; \
 default: assert(false) ; return vlErrorUnknown ; \
 }
 
@@ -94,7 +97,7 @@ vl::nnlrn_forward(vl::Context& context,
 
 #define DISPATCH(deviceType, type) \
 error = vl::impl::lrn<deviceType,type>::backward \
-((type*)derData.getMemory(), (type const*)data.getMemory(), (type const*)derOutput.getMemory(), \
+(context, (type*)derData.getMemory(), (type const*)data.getMemory(), (type const*)derOutput.getMemory(), \
 data.getHeight(), data.getWidth(), data.getDepth(), data.getSize(), \
 normDetph, kappa, alpha, beta) ;
 
@@ -51,6 +51,17 @@ case vlPoolingMax : DISPATCH2(deviceType, pooling_max) ; break ; \
 default: assert(false) ; return vlErrorUnknown ; \
 }
 
+/* half precision is supported only on the CPU */
+#define DISPATCH2HALF(op) \
+DISPATCH(vl::CPU, op, vl::half_t)
+
+#define DISPATCH3HALF() \
+switch (method) { \
+case vlPoolingAverage : DISPATCH2HALF(pooling_average) ; break ; \
+case vlPoolingMax : DISPATCH2HALF(pooling_max) ; break ; \
+default: assert(false) ; return vlErrorUnknown ; \
+}
+
 #define DISPATCHCUDNN(dataType) \
 status = vl::impl::nnpooling_cudnn<dataType>::forward \
 (context, output, data, \
@@ -87,6 +98,10 @@ vl::nnpooling_forward(vl::Context& context,
       return vl::vlErrorUnknown ;
 
     case vl::CPU:
+      if (dataType == vlTypeHalf) {
+        DISPATCH3HALF() ;
+        break ;
+      }
       DISPATCH3(vl::CPU) ;
       break ;
 
@@ -116,6 +131,7 @@ vl::nnpooling_forward(vl::Context& context,
 
 #undef DISPATCH
 #undef DISPATCH2
+#undef DISPATCH2HALF
 
 // backward max and average want slightly differet argument lists
 
@@ -144,6 +160,9 @@ IF_DOUBLE(case vlTypeDouble : DISPATCH_ ## op (deviceType, double) ; break ;) \
 default: assert(false) ; return vlErrorUnknown ; \
 }
 
+#define DISPATCH2HALF(op) \
+DISPATCH_ ## op (vl::CPU, vl::half_t)
+
 vl::Error
 vl::nnpooling_backward(Context& context,
                        Tensor derData,
@@ -165,6 +184,10 @@ vl::nnpooling_backward(Context& context,
       return vl::vlErrorUnknown ;
 
     case vl::CPU:
+      if (dataType == vlTypeHalf) {
+        DISPATCH3HALF() ;
+        break ;
+      }
       DISPATCH3(vl::CPU) ;
       break ;
 
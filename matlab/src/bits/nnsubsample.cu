@@ -13,6 +13,7 @@ the terms of the BSD license (see the COPYING file).
 #include "nnsubsample.hpp"
 #include "impl/subsample.hpp"
 #include "impl/blashelper.hpp"
+#include "impl/half.hpp"
 #include <assert.h>
 
 using namespace vl ;
@@ -163,6 +164,25 @@ vl::nnsubsample_forward(Context& context,
   vl::Device deviceType = output.getDeviceType() ;
   vl::Type dataType = output.getDataType() ;
 
+  if (dataType == vlTypeHalf) {
+    impl::FloatCopy output_, data_, biases_, unused1, unused2, unused3 ;
+    error = impl::initFloatCopies(context, "nnsubsample (half)",
+                                  data_, data, true,
+                                  output_, output, false,
+                                  biases_, biases, true,
+                                  unused1, Tensor(), false,
+                                  unused2, Tensor(), false,
+                                  unused3, Tensor(), false) ;
+    if (error != vlSuccess) { return error ; }
+    error = nnsubsample_forward(context,
+                                output_, data_, biases_,
+                                strideY, strideX,
+                                padTop, padBottom,
+                                padLeft, padRight) ;
+    if (error == vlSuccess) { output_.copyTo(output) ; }
+    return error ;
+  }
+
   switch (deviceType) {
     default:
       assert(false) ;
@@ -206,6 +226,28 @@ vl::nnsubsample_backward(vl::Context& context,
   vl::Device deviceType = derOutput.getDeviceType() ;
   vl::Type dataType = derOutput.getDataType() ;
 
+  if (dataType == vlTypeHalf) {
+    impl::FloatCopy derData_, derBiases_, derOutput_, unused1, unused2, unused3 ;
+    error = impl::initFloatCopies(context, "nnsubsample (half)",
+                                  derOutput_, derOutput, true,
+                                  derData_, derData, false,
+                                  derBiases_, derBiases, false,
+                                  unused1, Tensor(), false,
+                                  unused2, Tensor(), false,
+                                  unused3, Tensor(), false) ;
+    if (error != vlSuccess) { return error ; }
+    error = nnsubsample_backward(context,
+                                 derData_, derBiases_, derOutput_,
+                                 strideY, strideX,
+                                 padTop, padBottom,
+                                 padLeft, padRight) ;
+    if (error == vlSuccess) {
+      derData_.copyTo(derData) ;
+      derBiases_.copyTo(derBiases) ;
+    }
+    return error ;
+  }
+
   switch (deviceType) {
     default:
       assert(false) ;
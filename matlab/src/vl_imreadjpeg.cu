@@ -17,7 +17,12 @@ the terms of the BSD license (see the COPYING file).
 
 #include <vector>
 #include <string>
+#include <map>
+#include <list>
+#include <cstring>
 #include <algorithm>
+#include <cmath>
+#include <stdint.h>
 
 #include "bits/data.hpp"
 #include "bits/mexutils.h"
@@ -28,6 +33,20 @@ enum {
   opt_prefetch,
   opt_resize,
   opt_verbose,
+  opt_crop_size,
+  opt_crop_anisotropy,
+  opt_crop_location,
+  opt_flip,
+  opt_brightness,
+  opt_contrast,
+  opt_saturation,
+  opt_subtract_average,
+  opt_divide_std,
+  opt_seed,
+  opt_pack,
+  opt_uint8,
+  opt_cache_size,
+  opt_max_prefetch_size,
 } ;
 
 /* options */
@@ -36,6 +55,20 @@ vlmxOption  options [] = {
   {"Prefetch",         0,   opt_prefetch           },
   {"Verbose",          0,   opt_verbose            },
   {"Resize",           1,   opt_resize             },
+  {"CropSize",         1,   opt_crop_size          },
+  {"CropAnisotropy",   1,   opt_crop_anisotropy    },
+  {"CropLocation",     1,   opt_crop_location      },
+  {"Flip",             0,   opt_flip               },
+  {"Brightness",       1,   opt_brightness         },
+  {"Contrast",         1,   opt_contrast           },
+  {"Saturation",       1,   opt_saturation         },
+  {"SubtractAverage",  1,   opt_subtract_average   },
+  {"DivideStd",        1,   opt_divide_std         },
+  {"Seed",             1,   opt_seed               },
+  {"Pack",             0,   opt_pack               },
+  {"Uint8",            0,   opt_uint8              },
+  {"CacheSize",        1,   opt_cache_size         },
+  {"MaxPrefetchSize",  1,   opt_max_prefetch_size  },
   {0,                  0,   0                      }
 } ;
 
@@ -44,7 +77,7 @@ enum {
 } ;
 
 enum {
-  OUT_IMAGES = 0, OUT_END
+  OUT_IMAGES = 0, OUT_CACHE_STATS, OUT_END
 } ;
 
 enum ResizeMode
@@ -54,6 +87,104 @@ enum ResizeMode
   kResizeIsotropic,
 } ;
 
+enum CropLocation
+{
+  kCropCenter,
+  kCropRandom,
+} ;
+
+/* Augmentation applied by the readers to each image, after decoding
+   and before returning it. */
+struct Augmentation
+{
+  bool crop ;
+  CropLocation cropLocation ;
+  float minCropSize ;
+  float maxCropSize ;
+  float minCropAnisotropy ;
+  float maxCropAnisotropy ;
+  bool flip ;
+  float brightness [9] ; // 3x3 matrix, column major
+  float contrast ;
+  float saturation ;
+  float average [3] ;
+  float std [3] ;
+
+  Augmentation()
+  : crop(false), cropLocation(kCropCenter),
+    minCropSize(1), maxCropSize(1),
+    minCropAnisotropy(1), maxCropAnisotropy(1),
+    flip(false), contrast(0), saturation(0)
+  {
+    for (int i = 0 ; i < 9 ; ++i) { brightness[i] = 0 ; }
+    for (int i = 0 ; i < 3 ; ++i) { average[i] = 0 ; std[i] = 1 ; }
+  }
+
+  bool hasBrightness() const {
+    for (int i = 0 ; i < 9 ; ++i) { if (brightness[i] != 0) return true ; }
+    return false ;
+  }
+
+  bool hasNormalization() const {
+    for (int i = 0 ; i < 3 ; ++i) { if (average[i] != 0 || std[i] != 1) return true ; }
+    return false ;
+  }
+
+  bool hasColorTransform() const {
+    return hasBrightness() || contrast > 0 || saturation > 0 || hasNormalization() ;
+  }
+
+  bool isCropRandom() const {
+    return crop && (cropLocation == kCropRandom ||
+                    minCropSize != maxCropSize ||
+                    minCropAnisotropy != maxCropAnisotropy) ;
+  }
+
+  bool isRandom() const {
+    return isCropRandom() ||
+    flip || hasBrightness() || contrast > 0 || saturation > 0 ;
+  }
+} ;
+
+/*
+ Each image has its own random generator (SplitMix64), seeded from the
+ image index in the call, so that its augmentation does not depend on
+ which reader processes it nor on the timing of the readers.
+ */
+
+class Random
+{
+public:
+  Random() : state(0) { }
+  void seed(uint64_t seed_) { state = seed_ ; }
+
+  uint64_t next() {
+    uint64_t z = (state += 0x9e3779b97f4a7c15ULL) ;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL ;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL ;
+    return z ^ (z >> 31) ;
+  }
+
+  // uniform in [0,1)
+  double uniform() {
+    return (double)(next() >> 11) * (1.0 / 9007199254740992.0) ;
+  }
+
+  double uniform(double a, double b) {
+    return a + (b - a) * uniform() ;
+  }
+
+  // standard normal (Box-Muller)
+  double normal() {
+    double u = 1.0 - uniform() ;
+    double v = uniform() ;
+    return sqrt(-2.0 * log(u)) * cos(6.283185307179586 * v) ;
+  }
+
+private:
+  uint64_t state ;
+} ;
+
 /* ---------------------------------------------------------------- */
 /*                                                           Caches */
 /* ---------------------------------------------------------------- */
@@ -97,47 +228,229 @@ public:
     vl::Image::clear() ;
   }
 
-  float * relinquishMemory()
+  void * relinquishMemory()
   {
-    float * memory_ = memory ;
+    void * memory_ = memory ;
     isMemoryOwner = false ;
     clear() ;
     return memory_ ;
   }
 
-  vl::Error init(vl::ImageShape const & shape_, bool matlab_)
+  vl::Error init(vl::ImageShape const & shape_, vl::Type dataType_, bool matlab_)
   {
     clear() ;
     shape = shape_ ;
+    dataType = dataType_ ;
     isMemoryOwner = true ;
+    size_t numBytes = vl::getImageDataTypeSize(dataType) * shape.getNumElements() ;
     if (matlab_) {
-      memory = (float*)mxMalloc(sizeof(float)*shape.getNumElements()) ;
+      memory = mxMalloc(numBytes) ;
       mexMakeMemoryPersistent(memory) ;
       hasMatlabMemory = true ;
     } else {
-      memory = (float*)malloc(sizeof(float)*shape.getNumElements()) ;
+      memory = malloc(numBytes) ;
       hasMatlabMemory = false ;
     }
-    return vl::vlSuccess ;
+    return memory ? vl::vlSuccess : vl::vlErrorOutOfMemory ;
+  }
+
+  // take ownership of an image allocated by malloc()
+  void adopt(vl::Image const & image)
+  {
+    clear() ;
+    vl::Image::operator=(image) ;
+    isMemoryOwner = true ;
+  }
+
+  // use memory owned by somebody else
+  void wrap(vl::ImageShape const & shape_, vl::Type dataType_, void * memory_)
+  {
+    clear() ;
+    shape = shape_ ;
+    dataType = dataType_ ;
+    memory = memory_ ;
   }
 
   bool hasMatlabMemory ;
   bool isMemoryOwner ;
 } ;
 
+/*
+ The decoded images are kept across calls in a cache with a budget in
+ bytes, evicting the least recently used ones. An entry is pinned by
+ the readers using it, and its memory is freed only when it is both
+ evicted and unpinned. The cached image is the one before the random
+ part of the augmentation, so that it can be reused in every epoch.
+ */
+
+struct CachedImage
+{
+  std::string key ;
+  vl::Image image ; // allocated by malloc()
+  vl::ImageShape fullShape ;
+  int numUsers ;
+  bool evicted ;
+} ;
+
+class ImageCache
+{
+public:
+  ImageCache()
+  : capacity(0), size(0), numHits(0), numMisses(0), numEvictions(0)
+  { }
+
+  ~ImageCache()
+  {
+    setCapacity(0) ;
+  }
+
+  size_t getCapacity()
+  {
+    tthread::lock_guard<tthread::mutex> lock(mutex) ;
+    return capacity ;
+  }
+
+  void setCapacity(size_t capacity_)
+  {
+    tthread::lock_guard<tthread::mutex> lock(mutex) ;
+    capacity = capacity_ ;
+    evict(capacity) ;
+  }
+
+  // get and pin the entry, if any
+  CachedImage * get(std::string const & key)
+  {
+    tthread::lock_guard<tthread::mutex> lock(mutex) ;
+    index_t::iterator iter = index.find(key) ;
+    if (iter == index.end()) {
+      numMisses ++ ;
+      return NULL ;
+    }
+    numHits ++ ;
+    entries.splice(entries.begin(), entries, iter->second) ;
+    CachedImage * entry = *iter->second ;
+    entry->numUsers ++ ;
+    return entry ;
+  }
+
+  // take ownership of the image memory and return the pinned entry,
+  // or NULL, leaving the memory to the caller, if it cannot be stored
+  CachedImage * insert(std::string const & key, vl::Image const & image,
+                       vl::ImageShape const & fullShape)
+  {
+    tthread::lock_guard<tthread::mutex> lock(mutex) ;
+    size_t numBytes = getNumBytes(image) ;
+    if (numBytes > capacity || index.find(key) != index.end()) {
+      return NULL ;
+    }
+    evict(capacity - numBytes) ;
+    CachedImage * entry = new CachedImage() ;
+    entry->key = key ;
+    entry->image = image ;
+    entry->fullShape = fullShape ;
+    entry->numUsers = 1 ;
+    entry->evicted = false ;
+    entries.push_front(entry) ;
+    index[key] = entries.begin() ;
+    size += numBytes ;
+    return entry ;
+  }
+
+  void release(CachedImage * entry)
+  {
+    tthread::lock_guard<tthread::mutex> lock(mutex) ;
+    entry->numUsers -- ;
+    if (entry->evicted && entry->numUsers == 0) {
+      free(entry->image.getData()) ;
+      delete entry ;
+    }
+  }
+
+  void getStats(size_t & numImages_, size_t & size_, size_t & capacity_,
+                size_t & numHits_, size_t & numMisses_, size_t & numEvictions_)
+  {
+    tthread::lock_guard<tthread::mutex> lock(mutex) ;
+    numImages_ = entries.size() ;
+    size_ = size ;
+    capacity_ = capacity ;
+    numHits_ = numHits ;
+    numMisses_ = numMisses ;
+    numEvictions_ = numEvictions ;
+  }
+
+private:
+  typedef std::list<CachedImage*> entries_t ;
+  typedef std::map<std::string,entries_t::iterator> index_t ;
+  entries_t entries ; // most recently used first
+  index_t index ;
+  tthread::mutex mutex ;
+  size_t capacity ;
+  size_t size ;
+  size_t numHits ;
+  size_t numMisses ;
+  size_t numEvictions ;
+
+  static size_t getNumBytes(vl::Image const & image) {
+    return vl::getImageDataTypeSize(image.getDataType()) * image.getShape().getNumElements() ;
+  }
+
+  // called with the mutex locked
+  void evict(size_t maxSize)
+  {
+    while (size > maxSize) {
+      CachedImage * entry = entries.back() ;
+      entries.pop_back() ;
+      index.erase(entry->key) ;
+      size -= getNumBytes(entry->image) ;
+      numEvictions ++ ;
+      if (entry->numUsers == 0) {
+        free(entry->image.getData()) ;
+        delete entry ;
+      } else {
+        entry->evicted = true ;
+      }
+    }
+  }
+} ;
+
+ImageCache imageCache ;
+
 #define TASK_ERROR_MSG_MAX_LEN 1024
 
+struct Batch ;
+
 struct Task
 {
   std::string name ;
+  Batch * batch ;
   bool done ;
   ImageBuffer resizedImage ;
   ImageBuffer inputImage ;
   vl::Error error ;
-  bool requireResize ;
+  ResizeMode resizeMode ;
+  int resizeHeight ;
+  int resizeWidth ;
+  vl::ImageShape resizedShape ;
+  Augmentation augmentation ;
+  uint64_t seed ;
+  Random random ;
+  vl::ImageShape fullShape ; // before the DCT downscaling
+  vl::ImageShape cropShape ; // of the crop window in the full image
+  size_t cropY ;
+  size_t cropX ;
+  vl::Type dataType ;
+  bool pack ;
+  void * packedMemory ;
+  std::string cacheKey ; // empty if not caching
+  bool cacheDecoded ; // cache the image before cropping it
+  bool requestedMemory ;
+  vl::ImageShape requestedShape ;
   char errorMessage [TASK_ERROR_MSG_MAX_LEN] ;
 
-  Task() { }
+  Task()
+  : batch(NULL), seed(0), cropY(0), cropX(0), dataType(vl::vlTypeFloat),
+    pack(false), packedMemory(NULL), cacheDecoded(false), requestedMemory(false)
+  { errorMessage[0] = 0 ; }
 
 private:
   Task(Task const &) ;
@@ -145,12 +458,60 @@ private:
 } ;
 
 typedef std::vector<Task*> Tasks ;
-Tasks tasks ;
+
+/*
+ A batch holds the tasks created by a call, and is identified by the
+ handle returned when prefetching it. The readers process the batches
+ in the order in which they are created, except for the one being
+ collected by the MATLAB thread, which comes first.
+ */
+
+struct Batch
+{
+  int handle ;
+  Tasks tasks ;
+  int nextTaskIndex ;
+  int numTasksCompleted ;
+  bool collecting ;
+  bool cancelled ;
+  size_t numBytes ; // of the prefetched images
+  void * packedMemory ;
+  bool pack ;
+  vl::Type dataType ;
+  int resizeHeight ;
+  int resizeWidth ;
+  std::vector<mwSize> dimensions ; // of the FILES cell array
+
+  Batch()
+  : handle(0), nextTaskIndex(0), numTasksCompleted(0),
+    collecting(false), cancelled(false), numBytes(0), packedMemory(NULL),
+    pack(false), dataType(vl::vlTypeFloat), resizeHeight(1), resizeWidth(1)
+  { }
+
+  ~Batch()
+  {
+    for (int t = 0 ; t < (int)tasks.size() ; ++t) {
+      delete tasks[t] ;
+    }
+    if (packedMemory) {
+      mxFree(packedMemory) ;
+    }
+  }
+
+private:
+  Batch(Batch const &) ;
+  Batch & operator= (Batch const &) ;
+} ;
+
+typedef std::list<Batch*> Batches ;
+Batches batches ;
+int nextBatchHandle = 1 ;
+size_t maxPrefetchSize = 0 ;
 tthread::mutex tasksMutex ;
 tthread::condition_variable tasksCondition ;
 tthread::condition_variable completedCondition ;
-int nextTaskIndex = 0 ;
-int numTasksCompleted = 0 ;
+tthread::condition_variable allocatedCondition ;
+int numRequestedMemory = 0 ;
 
 typedef std::pair<tthread::thread*,vl::ImageReader*> reader_t ;
 typedef std::vector<reader_t> readers_t ;
@@ -161,39 +522,586 @@ bool terminateReaders = true ;
 /*                                                Tasks and readers */
 /* ---------------------------------------------------------------- */
 
+/*
+ The images are returned in memory allocated by mxMalloc(), which can
+ only be called from the MATLAB thread. While the latter waits for the
+ images, a reader that knows the shape of an image asks it for the
+ memory, so that the image is decoded or resized directly into it.
+ Otherwise, as when prefetching, the memory is allocated by malloc()
+ and the image is copied when it is returned.
+
+ When the images are packed, the MATLAB thread allocates the whole
+ batch when it creates the tasks, even when prefetching, and a reader
+ writes each image directly into its slot.
+ */
+
+vl::Error allocate_image(Task & task, vl::ImageShape const & shape)
+{
+  tasksMutex.lock() ;
+  if (task.packedMemory) {
+    task.resizedImage.wrap(shape, task.dataType, task.packedMemory) ;
+    tasksMutex.unlock() ;
+    return vl::vlSuccess ;
+  }
+  if (task.batch->collecting) {
+    task.requestedShape = shape ;
+    task.requestedMemory = true ;
+    numRequestedMemory ++ ;
+    completedCondition.notify_all() ;
+    while (task.requestedMemory) {
+      allocatedCondition.wait(tasksMutex) ;
+    }
+    tasksMutex.unlock() ;
+    return vl::vlSuccess ;
+  }
+  tasksMutex.unlock() ;
+  return task.resizedImage.init(shape, task.dataType, false) ;
+}
+
+void * allocate_image_callback(vl::ImageShape const & shape, vl::Type dataType, void * task_)
+{
+  Task & task = *(Task*)task_ ;
+  if (allocate_image(task, shape) != vl::vlSuccess) {
+    return NULL ;
+  }
+  return task.resizedImage.getData() ;
+}
+
+/* Called by the MATLAB thread with tasksMutex locked. */
+void serve_memory_requests(Batch & batch)
+{
+  if (numRequestedMemory == 0) {
+    return ;
+  }
+  for (int t = 0 ; t < (int)batch.tasks.size() ; ++t) {
+    Task & task = *batch.tasks[t] ;
+    if (task.requestedMemory) {
+      task.resizedImage.init(task.requestedShape, task.dataType, true) ;
+      task.requestedMemory = false ;
+    }
+  }
+  numRequestedMemory = 0 ;
+  allocatedCondition.notify_all() ;
+}
+
+vl::ImageShape getResizedShape(Task const & task, vl::ImageShape const & shape)
+{
+  vl::ImageShape resizedShape = shape ;
+  switch (task.resizeMode) {
+    case kResizeAnisotropic:
+      resizedShape.height = task.resizeHeight ;
+      resizedShape.width = task.resizeWidth ;
+      break ;
+    case kResizeIsotropic:
+    {
+      float scale = (std::max)((float)task.resizeWidth / shape.width,
+                               (float)task.resizeHeight / shape.height);
+      resizedShape.height = roundf(resizedShape.height * scale) ;
+      resizedShape.width = roundf(resizedShape.width * scale) ;
+      break ;
+    }
+    default:
+      break ;
+  }
+  return resizedShape ;
+}
+
+/*
+ The crop window is drawn in the coordinates of the full resolution
+ image, before decoding it, so that it does not depend on the DCT
+ downscaling. It has the aspect ratio of the target shape (or of the
+ image if there is none), perturbed by the anisotropy, and it is the
+ largest such window that fits in the image, scaled by the crop size.
+ */
+
+vl::ImageShape get_crop_shape(Task const & task, vl::ImageShape const & shape,
+                              double anisotropy, double scale)
+{
+  double aspect = (task.resizeMode == kResizeAnisotropic) ?
+    (double)task.resizeWidth / task.resizeHeight :
+    (double)shape.width / shape.height ;
+  aspect *= anisotropy ;
+  double height = shape.height ;
+  double width = shape.width ;
+  if (width > aspect * height) {
+    width = aspect * height ;
+  } else {
+    height = width / aspect ;
+  }
+  return vl::ImageShape((std::min)(shape.height, (size_t)(std::max)(1.0, round(scale * height))),
+                        (std::min)(shape.width, (size_t)(std::max)(1.0, round(scale * width))),
+                        shape.depth) ;
+}
+
+void set_geometry(Task & task, vl::ImageShape const & shape)
+{
+  Augmentation const & aug = task.augmentation ;
+  task.fullShape = shape ;
+  task.cropShape = shape ;
+  task.cropY = 0 ;
+  task.cropX = 0 ;
+  if (aug.crop) {
+    double anisotropy = task.random.uniform(aug.minCropAnisotropy, aug.maxCropAnisotropy) ;
+    double scale = task.random.uniform(aug.minCropSize, aug.maxCropSize) ;
+    task.cropShape = get_crop_shape(task, shape, anisotropy, scale) ;
+    size_t dy = shape.height - task.cropShape.height ;
+    size_t dx = shape.width - task.cropShape.width ;
+    if (aug.cropLocation == kCropRandom) {
+      task.cropY = (std::min)(dy, (size_t)(task.random.uniform() * (dy + 1))) ;
+      task.cropX = (std::min)(dx, (size_t)(task.random.uniform() * (dx + 1))) ;
+    } else {
+      task.cropY = dy / 2 ;
+      task.cropX = dx / 2 ;
+    }
+  }
+  task.resizedShape = getResizedShape(task, task.cropShape) ;
+}
+
+vl::ImageShape resized_shape_callback(vl::ImageShape const & shape, void * task_)
+{
+  Task & task = *(Task*)task_ ;
+  set_geometry(task, shape) ;
+  if (!task.augmentation.crop) {
+    return task.resizedShape ;
+  }
+  if (task.resizeMode == kResizeNone) {
+    return shape ;
+  }
+  // the crop must be decoded at least as large as the target; an
+  // image decoded for the cache must be so for any crop, and the
+  // smallest crops are obtained for the extreme anisotropies
+  vl::ImageShape cropShape = task.cropShape ;
+  if (task.cacheDecoded) {
+    Augmentation const & aug = task.augmentation ;
+    vl::ImageShape crop1 = get_crop_shape(task, shape, aug.minCropAnisotropy, aug.minCropSize) ;
+    vl::ImageShape crop2 = get_crop_shape(task, shape, aug.maxCropAnisotropy, aug.minCropSize) ;
+    cropShape.height = (std::min)(crop1.height, crop2.height) ;
+    cropShape.width = (std::min)(crop1.width, crop2.width) ;
+  }
+  return vl::ImageShape((size_t)ceil((double)shape.height * task.resizedShape.height / cropShape.height),
+                        (size_t)ceil((double)shape.width * task.resizedShape.width / cropShape.width),
+                        shape.depth) ;
+}
+
+/*
+ A name of the form SHARD#ID refers to the ID-th image (one-based) in
+ the shard file SHARD (see vl_imshard.m). A shard is opened by the
+ first reader that needs it and stays mapped in memory until the MEX
+ file is cleared.
+ */
+
+typedef std::map<std::string,vl::ImageShard*> shards_t ;
+shards_t shards ;
+tthread::mutex shardsMutex ;
+
+bool parse_shard_reference(std::string const & name, std::string & shardName, size_t & index)
+{
+  size_t sep = name.rfind('#') ;
+  if (sep == std::string::npos || sep == 0 || sep + 1 == name.size()) {
+    return false ;
+  }
+  index = 0 ;
+  for (size_t i = sep + 1 ; i < name.size() ; ++i) {
+    if (name[i] < '0' || name[i] > '9') { return false ; }
+    index = 10 * index + (name[i] - '0') ;
+  }
+  shardName = name.substr(0, sep) ;
+  return true ;
+}
+
+vl::Error get_shard_image(void const ** buffer, size_t * size, Task & task,
+                          std::string const & shardName, size_t index)
+{
+  vl::Error error = vl::vlSuccess ;
+  vl::ImageShard * shard ;
+
+  shardsMutex.lock() ;
+  shards_t::iterator iter = shards.find(shardName) ;
+  if (iter != shards.end()) {
+    shard = iter->second ;
+  } else {
+    shard = new vl::ImageShard() ;
+    error = shard->open(shardName.c_str()) ;
+    if (error == vl::vlSuccess) {
+      shards[shardName] = shard ;
+    } else {
+      snprintf(task.errorMessage, TASK_ERROR_MSG_MAX_LEN,
+               "%s", shard->getLastErrorMessage()) ;
+      delete shard ;
+    }
+  }
+  shardsMutex.unlock() ;
+  if (error != vl::vlSuccess) {
+    return error ;
+  }
+
+  if (index < 1 || shard->getImage(buffer, size, index - 1) != vl::vlSuccess) {
+    snprintf(task.errorMessage, TASK_ERROR_MSG_MAX_LEN,
+             "the shard does not contain image %d (it has %d)",
+             (int)index, (int)shard->getNumImages()) ;
+    return vl::vlErrorUnknown ;
+  }
+  return vl::vlSuccess ;
+}
+
+void delete_shards()
+{
+  for (shards_t::iterator iter = shards.begin() ; iter != shards.end() ; ++iter) {
+    delete iter->second ;
+  }
+  shards.clear() ;
+}
+
+/*
+ The flip and the colour transformations are applied in place to the
+ returned image. The latter are combined into a single affine map of
+ the colour of each pixel:
+
+   x -> S (k x + (1 - k) m) + B n
+
+ where k is the contrast factor, m the average colour of the image, S
+ blends the colour with its gray level by the saturation factor and
+ B n is the brightness offset, n being standard normal. The result is
+ then normalized as (x - average) / std. For grayscale images, the
+ three components of the colour offsets and of the average and
+ standard deviation are averaged. They are only available for SINGLE
+ images, while a UINT8 image can only be flipped.
+ */
+
+template<typename T>
+void flip_image(vl::Image & image)
+{
+  vl::ImageShape const & shape = image.getShape() ;
+  for (size_t d = 0 ; d < shape.depth ; ++d) {
+    T * plane = (T*)image.getData() + d * shape.height * shape.width ;
+    for (size_t x = 0 ; x < shape.width / 2 ; ++x) {
+      T * left = plane + x * shape.height ;
+      T * right = plane + (shape.width - 1 - x) * shape.height ;
+      std::swap_ranges(left, left + shape.height, right) ;
+    }
+  }
+}
+
+void transform_colors(vl::Image & image, Augmentation const & aug, Random & random)
+{
+  vl::ImageShape const & shape = image.getShape() ;
+  size_t n = shape.height * shape.width ;
+  float * pixels = image.getMemory() ;
+  double offset [3] = {0, 0, 0} ;
+  double mean [3] = {0, 0, 0} ;
+  double k = 1 ;
+  double w = 1 ;
+
+  if (aug.hasBrightness()) {
+    double z [3] ;
+    for (int j = 0 ; j < 3 ; ++j) { z[j] = random.normal() ; }
+    for (int i = 0 ; i < 3 ; ++i) {
+      for (int j = 0 ; j < 3 ; ++j) { offset[i] += aug.brightness[i + 3*j] * z[j] ; }
+    }
+  }
+  if (aug.contrast > 0) {
+    k = random.uniform(1 - aug.contrast, 1 + aug.contrast) ;
+    for (size_t d = 0 ; d < shape.depth && d < 3 && n > 0 ; ++d) {
+      float const * plane = pixels + d * n ;
+      for (size_t i = 0 ; i < n ; ++i) { mean[d] += plane[i] ; }
+      mean[d] /= n ;
+    }
+  }
+  if (aug.saturation > 0) {
+    w = random.uniform(1 - aug.saturation, 1 + aug.saturation) ;
+  }
+
+  if (shape.depth == 3) {
+    double const gray [3] = {0.299, 0.587, 0.114} ;
+    double A [9] ;
+    double b [3] ;
+    double grayMean = 0 ;
+    for (int j = 0 ; j < 3 ; ++j) { grayMean += gray[j] * mean[j] ; }
+    for (int i = 0 ; i < 3 ; ++i) {
+      // S = w I + (1 - w) 1 gray', A = k S, b = (1 - k) S m + B n
+      for (int j = 0 ; j < 3 ; ++j) {
+        A[i + 3*j] = k * ((i == j) * w + (1 - w) * gray[j]) ;
+      }
+      b[i] = (1 - k) * (w * mean[i] + (1 - w) * grayMean) + offset[i] ;
+      // normalization
+      for (int j = 0 ; j < 3 ; ++j) { A[i + 3*j] /= aug.std[i] ; }
+      b[i] = (b[i] - aug.average[i]) / aug.std[i] ;
+    }
+    float A_ [9] ;
+    float b_ [3] ;
+    for (int i = 0 ; i < 9 ; ++i) { A_[i] = (float)A[i] ; }
+    for (int i = 0 ; i < 3 ; ++i) { b_[i] = (float)b[i] ; }
+    float * r = pixels ;
+    float * g = pixels + n ;
+    float * bl = pixels + 2*n ;
+    for (size_t i = 0 ; i < n ; ++i) {
+      float x0 = r[i], x1 = g[i], x2 = bl[i] ;
+      r[i] = A_[0] * x0 + A_[3] * x1 + A_[6] * x2 + b_[0] ;
+      g[i] = A_[1] * x0 + A_[4] * x1 + A_[7] * x2 + b_[1] ;
+      bl[i] = A_[2] * x0 + A_[5] * x1 + A_[8] * x2 + b_[2] ;
+    }
+  } else {
+    double average = (aug.average[0] + aug.average[1] + aug.average[2]) / 3 ;
+    double std = (aug.std[0] + aug.std[1] + aug.std[2]) / 3 ;
+    double b = (1 - k) * mean[0] + (offset[0] + offset[1] + offset[2]) / 3 ;
+    float a_ = (float)(k / std) ;
+    float b_ = (float)((b - average) / std) ;
+    for (size_t d = 0 ; d < shape.depth ; ++d) {
+      float * plane = pixels + d * n ;
+      for (size_t i = 0 ; i < n ; ++i) { plane[i] = a_ * plane[i] + b_ ; }
+    }
+  }
+}
+
+void augment_image(Task & task)
+{
+  if (task.augmentation.flip && task.random.uniform() < 0.5) {
+    if (task.dataType == vl::vlTypeChar) {
+      flip_image<char unsigned>(task.resizedImage) ;
+    } else {
+      flip_image<float>(task.resizedImage) ;
+    }
+  }
+  if (task.augmentation.hasColorTransform()) {
+    transform_colors(task.resizedImage, task.augmentation, task.random) ;
+  }
+}
+
+/*
+ A reader opens each file once, getting the image shape, allocating
+ its memory and decoding the pixels in a single pass, and then crops
+ and resizes the image if needed. The MATLAB thread only enqueues the
+ file names. The result is always stored in task.resizedImage, where
+ it is finally flipped and colour transformed.
+
+ When resizing, the reader is told the target shape, computed from
+ the full resolution one, and may decode a smaller image (down to the
+ target) to save time and memory.
+
+ With the cache, the image is stored after resizing it if the crop is
+ deterministic, and otherwise after decoding it, and is then cropped
+ and resized in each call.
+ */
+
+std::string get_cache_key(Task const & task)
+{
+  Augmentation const & aug = task.augmentation ;
+  char buffer [256] ;
+  snprintf(buffer, sizeof(buffer), "%d %d %d %d %d %d %d %g %g %g %g:",
+           (int)task.dataType, (int)task.pack,
+           (int)task.resizeMode, task.resizeHeight, task.resizeWidth,
+           (int)aug.crop, (int)aug.cropLocation,
+           aug.minCropSize, aug.maxCropSize,
+           aug.minCropAnisotropy, aug.maxCropAnisotropy) ;
+  return std::string(buffer) + task.name ;
+}
+
+/* Crop and resize input to task.resizedImage. */
+void resize_image(Task & task, vl::Image const & input)
+{
+  // map the crop window to the input image
+  vl::ImageShape const & shape = input.getShape() ;
+  double sy = (double)shape.height / task.fullShape.height ;
+  double sx = (double)shape.width / task.fullShape.width ;
+  size_t cropHeight = (std::min)(shape.height, (size_t)(std::max)(1.0, round(sy * task.cropShape.height))) ;
+  size_t cropWidth = (std::min)(shape.width, (size_t)(std::max)(1.0, round(sx * task.cropShape.width))) ;
+  size_t cropY = (std::min)(shape.height - cropHeight, (size_t)(sy * task.cropY)) ;
+  size_t cropX = (std::min)(shape.width - cropWidth, (size_t)(sx * task.cropX)) ;
+
+  // packed images are always colour images
+  vl::ImageShape resizedShape = task.resizedShape ;
+  resizedShape.depth = shape.depth ;
+  if (task.pack) {
+    if (shape.depth != 1 && shape.depth != 3) {
+      snprintf(task.errorMessage, TASK_ERROR_MSG_MAX_LEN,
+               "cannot pack an image with %d channels", (int)shape.depth) ;
+      task.error = vl::vlErrorUnsupported ;
+      return ;
+    }
+    resizedShape.depth = 3 ;
+  }
+  task.error = allocate_image(task, resizedShape) ;
+  if (task.error != vl::vlSuccess) {
+    snprintf(task.errorMessage, TASK_ERROR_MSG_MAX_LEN,
+             "could not allocate the image memory") ;
+    return ;
+  }
+  vl::ImageShape outputShape = resizedShape ;
+  outputShape.depth = shape.depth ;
+  vl::Image output(outputShape, task.dataType, task.resizedImage.getData()) ;
+  vl::impl::resizeImage(output, input,
+                        cropY, cropX, cropHeight, cropWidth) ;
+  size_t planeSize = vl::getImageDataTypeSize(task.dataType) * outputShape.getNumElements() ;
+  for (size_t d = outputShape.depth ; d < resizedShape.depth ; ++d) {
+    memcpy((char*)output.getData() + d * planeSize, output.getData(), planeSize) ;
+  }
+}
+
+/* Store a copy of task.resizedImage in the cache. */
+void cache_resized_image(Task & task)
+{
+  vl::Image const & image = task.resizedImage ;
+  size_t numBytes = vl::getImageDataTypeSize(image.getDataType()) * image.getShape().getNumElements() ;
+  if (numBytes > imageCache.getCapacity()) {
+    return ;
+  }
+  void * memory = malloc(numBytes) ;
+  if (memory == NULL) {
+    return ;
+  }
+  memcpy(memory, image.getData(), numBytes) ;
+  CachedImage * entry = imageCache.insert(task.cacheKey,
+                                          vl::Image(image.getShape(), image.getDataType(), memory),
+                                          task.fullShape) ;
+  if (entry) {
+    imageCache.release(entry) ;
+  } else {
+    free(memory) ;
+  }
+}
+
+void read_cached_image(Task & task, CachedImage const & cached)
+{
+  // draw the crop as when decoding the image
+  set_geometry(task, cached.fullShape) ;
+  if (!task.cacheDecoded) {
+    // the image was cached after cropping and resizing it
+    task.fullShape = cached.image.getShape() ;
+    task.cropShape = task.fullShape ;
+    task.resizedShape = task.fullShape ;
+    task.cropY = 0 ;
+    task.cropX = 0 ;
+  }
+  resize_image(task, cached.image) ;
+  if (task.error == vl::vlSuccess) {
+    augment_image(task) ;
+  }
+}
+
+void read_image(vl::ImageReader * reader, Task & task)
+{
+  vl::Image image ;
+  vl::ImageAllocator allocator = NULL ;
+  vl::ImageShapeHint shapeHint = NULL ;
+  std::string shardName ;
+  size_t shardIndex ;
+  bool geometric = (task.resizeMode != kResizeNone) || task.augmentation.crop ;
+  CachedImage * cached = NULL ;
+
+  task.random.seed(task.seed) ;
+  task.fullShape.clear() ;
+  task.cacheKey.clear() ;
+  task.cacheDecoded = false ;
+  if (imageCache.getCapacity() > 0) {
+    task.cacheKey = get_cache_key(task) ;
+    task.cacheDecoded = geometric && task.augmentation.isCropRandom() ;
+    cached = imageCache.get(task.cacheKey) ;
+    if (cached) {
+      read_cached_image(task, *cached) ;
+      imageCache.release(cached) ;
+      return ;
+    }
+  }
+  if (geometric) {
+    shapeHint = resized_shape_callback ;
+  } else {
+    allocator = allocate_image_callback ;
+  }
+
+  if (parse_shard_reference(task.name, shardName, shardIndex)) {
+    void const * buffer ;
+    size_t size ;
+    task.error = get_shard_image(&buffer, &size, task, shardName, shardIndex) ;
+    if (task.error != vl::vlSuccess) {
+      return ;
+    }
+    task.error = reader->readImageFromMemory(image, buffer, size,
+                                             allocator, shapeHint, &task,
+                                             task.dataType) ;
+  } else {
+    task.error = reader->readImage(image, task.name.c_str(),
+                                   allocator, shapeHint, &task,
+                                   task.dataType) ;
+  }
+  if (task.error != vl::vlSuccess) {
+    strncpy(task.errorMessage, reader->getLastErrorMessage(), TASK_ERROR_MSG_MAX_LEN) ;
+    task.errorMessage[TASK_ERROR_MSG_MAX_LEN - 1] = 0 ;
+    return ;
+  }
+  if (task.fullShape.getNumElements() == 0) {
+    // the reader did not ask for the shape hint
+    set_geometry(task, image.getShape()) ;
+  }
+  if (geometric) {
+    if (task.cacheDecoded) {
+      cached = imageCache.insert(task.cacheKey, image, task.fullShape) ;
+    }
+    if (cached) {
+      resize_image(task, cached->image) ;
+      imageCache.release(cached) ;
+    } else {
+      task.inputImage.adopt(image) ;
+      resize_image(task, task.inputImage) ;
+      task.inputImage.clear() ;
+    }
+    if (task.error != vl::vlSuccess) {
+      return ;
+    }
+  }
+  if (!task.cacheKey.empty() && !task.cacheDecoded) {
+    cache_resized_image(task) ;
+  }
+  augment_image(task) ;
+}
+
+/* Called with tasksMutex locked. */
+Task * get_next_task()
+{
+  Batch * next = NULL ;
+  for (Batches::iterator iter = batches.begin() ; iter != batches.end() ; ++iter) {
+    Batch * batch = *iter ;
+    if (batch->cancelled || batch->nextTaskIndex >= (int)batch->tasks.size()) {
+      continue ;
+    }
+    if (batch->collecting) {
+      next = batch ;
+      break ;
+    }
+    if (next == NULL) {
+      next = batch ;
+    }
+  }
+  if (next == NULL) {
+    return NULL ;
+  }
+  return next->tasks[next->nextTaskIndex++] ;
+}
+
 void reader_function(void* reader_)
 {
   vl::ImageReader* reader = (vl::ImageReader*) reader_ ;
-  int taskIndex ;
+  Task * task = NULL ;
 
   tasksMutex.lock() ;
   while (true) {
     // wait for next task
-    while ((nextTaskIndex >= tasks.size()) && ! terminateReaders) {
+    while (! terminateReaders && (task = get_next_task()) == NULL) {
       tasksCondition.wait(tasksMutex);
     }
     if (terminateReaders) {
       break ;
     }
-    taskIndex = nextTaskIndex++ ;
-    Task & thisTask = *tasks[taskIndex] ;
 
     tasksMutex.unlock() ;
-    if (thisTask.error == vl::vlSuccess) {
-      // the memory has been pre-allocated
-      thisTask.error = reader->readPixels(thisTask.inputImage.getMemory(), thisTask.name.c_str()) ;
-      if (thisTask.error != vl::vlSuccess) {
-        strncpy(thisTask.errorMessage, reader->getLastErrorMessage(), TASK_ERROR_MSG_MAX_LEN) ;
-      }
-    }
-
-    if ((thisTask.error == vl::vlSuccess) && thisTask.requireResize) {
-      vl::impl::resizeImage(thisTask.resizedImage, thisTask.inputImage) ;
-    }
-
+    read_image(reader, *task) ;
     tasksMutex.lock() ;
-    thisTask.done = true ;
-    numTasksCompleted ++ ;
+    task->done = true ;
+    Batch & batch = *task->batch ;
+    batch.numTasksCompleted ++ ;
+    if (!batch.collecting && !batch.pack && task->resizedImage.isMemoryOwner) {
+      ImageBuffer const & image = task->resizedImage ;
+      batch.numBytes += vl::getImageDataTypeSize(image.getDataType()) * image.getShape().getNumElements() ;
+    }
     completedCondition.notify_all() ;
   }
   tasksMutex.unlock() ;
@@ -233,41 +1141,80 @@ void create_readers(int num, int verbosity)
   if (verbosity > 1) { mexPrintf("vl_imreadjpeg: created %d reader threads\n", readers.size()) ; }
 }
 
-void delete_tasks() {
-  for (int t = 0 ; t < (int)tasks.size() ; ++t) {
-    if (tasks[t]) { delete tasks[t] ; }
+/* Called by the MATLAB thread with tasksMutex locked. The tasks that
+   have not started yet are dropped. */
+void delete_batch(Batch * batch)
+{
+  // wait until the tasks being read are complete
+  batch->cancelled = true ;
+  while (batch->numTasksCompleted < batch->nextTaskIndex) {
+    completedCondition.wait(tasksMutex);
   }
-  tasks.clear() ;
+  batches.remove(batch) ;
+  delete batch ;
 }
 
-void flush_tasks() {
-  // wait until all tasks in the current list are complete
-  tasksMutex.lock() ;
-  while (numTasksCompleted < (int)tasks.size()) {
-    completedCondition.wait(tasksMutex);
+/*
+ The prefetched batches are kept as long as the memory used by their
+ images does not exceed maxPrefetchSize, deleting the oldest ones
+ otherwise. If maxPrefetchSize is zero, only the newest one is kept.
+ Called by the MATLAB thread with tasksMutex locked.
+ */
+void limit_prefetched_batches(Batch * newest, int verbosity)
+{
+  size_t numBytes = 0 ;
+  for (Batches::iterator iter = batches.begin() ; iter != batches.end() ; ++iter) {
+    if (*iter != newest) { numBytes += (*iter)->numBytes ; }
+  }
+  while (batches.front() != newest && (maxPrefetchSize == 0 || numBytes > maxPrefetchSize)) {
+    Batch * oldest = batches.front() ;
+    if (verbosity > 1) {
+      mexPrintf("vl_imreadjpeg: discarding prefetched batch %d\n", oldest->handle) ;
+    }
+    numBytes -= oldest->numBytes ;
+    delete_batch(oldest) ;
   }
+}
 
-  // now delete them
-  delete_tasks() ;
-  numTasksCompleted = 0 ;
-  nextTaskIndex = 0 ;
-  tasksMutex.unlock() ;
+void delete_batches()
+{
+  while (batches.size() > 0) {
+    delete batches.front() ;
+    batches.pop_front() ;
+  }
 }
 
 void atExit()
 {
   delete_readers() ;
-  delete_tasks() ;
+  delete_batches() ;
+  delete_shards() ;
+  imageCache.setCapacity(0) ;
 }
 
 /* ---------------------------------------------------------------- */
 /*                                                            Cache */
 /* ---------------------------------------------------------------- */
 
+mxArray * get_cache_stats()
+{
+  char const * fieldNames [] = {
+    "numImages", "size", "capacity", "numHits", "numMisses", "numEvictions"} ;
+  size_t values [6] ;
+  imageCache.getStats(values[0], values[1], values[2], values[3], values[4], values[5]) ;
+  mxArray * stats = mxCreateStructMatrix(1, 1, 6, fieldNames) ;
+  for (int i = 0 ; i < 6 ; ++i) {
+    mxSetField(stats, 0, fieldNames[i], mxCreateDoubleScalar((double)values[i])) ;
+  }
+  return stats ;
+}
+
 void mexFunction(int nout, mxArray *out[],
                  int nin, mxArray const *in[])
 {
   bool prefetch = false ;
+  bool pack = false ;
+  vl::Type dataType = vl::vlTypeFloat ;
   int requestedNumThreads = -1 ;
   int verbosity = 0 ;
   int opt ;
@@ -277,6 +1224,8 @@ void mexFunction(int nout, mxArray *out[],
   ResizeMode resizeMode = kResizeNone ;
   int resizeWidth = 1 ;
   int resizeHeight = 1 ;
+  Augmentation augmentation ;
+  mxArray const * seedArray = NULL ;
 
   /* -------------------------------------------------------------- */
   /*                                            Check the arguments */
@@ -325,19 +1274,199 @@ void mexFunction(int nout, mxArray *out[],
       case opt_num_threads :
         requestedNumThreads = (int)mxGetScalar(optarg) ;
         break ;
+
+      case opt_crop_size :
+        if (!vlmxIsPlainVector(optarg, -1) ||
+            mxGetNumberOfElements(optarg) < 1 || mxGetNumberOfElements(optarg) > 2) {
+          mexErrMsgTxt("CROPSIZE is not a plain scalar or a [MIN MAX] vector.") ;
+        }
+        augmentation.crop = true ;
+        augmentation.minCropSize = (float)mxGetPr(optarg)[0] ;
+        augmentation.maxCropSize = (float)mxGetPr(optarg)[mxGetNumberOfElements(optarg) - 1] ;
+        if (augmentation.minCropSize <= 0 || augmentation.maxCropSize > 1 ||
+            augmentation.minCropSize > augmentation.maxCropSize) {
+          mexErrMsgTxt("CROPSIZE is not in the interval (0, 1] or MIN > MAX.") ;
+        }
+        break ;
+
+      case opt_crop_anisotropy :
+        if (!vlmxIsPlainVector(optarg, -1) ||
+            mxGetNumberOfElements(optarg) < 1 || mxGetNumberOfElements(optarg) > 2) {
+          mexErrMsgTxt("CROPANISOTROPY is not a plain scalar or a [MIN MAX] vector.") ;
+        }
+        augmentation.crop = true ;
+        augmentation.minCropAnisotropy = (float)mxGetPr(optarg)[0] ;
+        augmentation.maxCropAnisotropy = (float)mxGetPr(optarg)[mxGetNumberOfElements(optarg) - 1] ;
+        if (augmentation.minCropAnisotropy <= 0 ||
+            augmentation.minCropAnisotropy > augmentation.maxCropAnisotropy) {
+          mexErrMsgTxt("CROPANISOTROPY is not positive or MIN > MAX.") ;
+        }
+        break ;
+
+      case opt_crop_location :
+        if (vlmxIsEqualToStringI(optarg, "center")) {
+          augmentation.cropLocation = kCropCenter ;
+        } else if (vlmxIsEqualToStringI(optarg, "random")) {
+          augmentation.cropLocation = kCropRandom ;
+        } else {
+          mexErrMsgTxt("CROPLOCATION is neither 'center' nor 'random'.") ;
+        }
+        augmentation.crop = true ;
+        break ;
+
+      case opt_flip :
+        augmentation.flip = true ;
+        break ;
+
+      case opt_brightness :
+        if (!vlmxIsPlain(optarg)) {
+          mexErrMsgTxt("BRIGHTNESS is not a plain array.") ;
+        }
+        switch (mxGetNumberOfElements(optarg)) {
+          case 0 :
+            break ;
+          case 1 :
+          case 3 :
+            for (int i = 0 ; i < 3 ; ++i) {
+              augmentation.brightness[4*i] = (float)mxGetPr(optarg)[i % mxGetNumberOfElements(optarg)] ;
+            }
+            break ;
+          case 9 :
+            for (int i = 0 ; i < 9 ; ++i) {
+              augmentation.brightness[i] = (float)mxGetPr(optarg)[i] ;
+            }
+            break ;
+          default :
+            mexErrMsgTxt("BRIGHTNESS does not have 1, 3 or 9 elements.") ;
+        }
+        break ;
+
+      case opt_contrast :
+        if (!vlmxIsPlainScalar(optarg) || mxGetPr(optarg)[0] < 0 || mxGetPr(optarg)[0] > 1) {
+          mexErrMsgTxt("CONTRAST is not a scalar in the interval [0, 1].") ;
+        }
+        augmentation.contrast = (float)mxGetPr(optarg)[0] ;
+        break ;
+
+      case opt_saturation :
+        if (!vlmxIsPlainScalar(optarg) || mxGetPr(optarg)[0] < 0 || mxGetPr(optarg)[0] > 1) {
+          mexErrMsgTxt("SATURATION is not a scalar in the interval [0, 1].") ;
+        }
+        augmentation.saturation = (float)mxGetPr(optarg)[0] ;
+        break ;
+
+      case opt_subtract_average :
+        if (!vlmxIsPlain(optarg) ||
+            (mxGetNumberOfElements(optarg) != 1 && mxGetNumberOfElements(optarg) != 3)) {
+          mexErrMsgTxt("SUBTRACTAVERAGE does not have 1 or 3 elements.") ;
+        }
+        for (int i = 0 ; i < 3 ; ++i) {
+          augmentation.average[i] = (float)mxGetPr(optarg)[i % mxGetNumberOfElements(optarg)] ;
+        }
+        break ;
+
+      case opt_divide_std :
+        if (!vlmxIsPlain(optarg) ||
+            (mxGetNumberOfElements(optarg) != 1 && mxGetNumberOfElements(optarg) != 3)) {
+          mexErrMsgTxt("DIVIDESTD does not have 1 or 3 elements.") ;
+        }
+        for (int i = 0 ; i < 3 ; ++i) {
+          augmentation.std[i] = (float)mxGetPr(optarg)[i % mxGetNumberOfElements(optarg)] ;
+          if (!(augmentation.std[i] > 0)) {
+            mexErrMsgTxt("An element of DIVIDESTD is not positive.") ;
+          }
+        }
+        break ;
+
+      case opt_pack :
+        pack = true ;
+        break ;
+
+      case opt_uint8 :
+        dataType = vl::vlTypeChar ;
+        break ;
+
+      case opt_cache_size :
+        if (!vlmxIsPlainScalar(optarg) || !(mxGetPr(optarg)[0] >= 0)) {
+          mexErrMsgTxt("CACHESIZE is not a non-negative scalar.") ;
+        }
+        imageCache.setCapacity((mxGetPr(optarg)[0] < (double)(size_t)-1) ?
+                               (size_t)mxGetPr(optarg)[0] : (size_t)-1) ;
+        break ;
+
+      case opt_max_prefetch_size :
+        if (!vlmxIsPlainScalar(optarg) || !(mxGetPr(optarg)[0] >= 0)) {
+          mexErrMsgTxt("MAXPREFETCHSIZE is not a non-negative scalar.") ;
+        }
+        maxPrefetchSize = (mxGetPr(optarg)[0] < (double)(size_t)-1) ?
+          (size_t)mxGetPr(optarg)[0] : (size_t)-1 ;
+        break ;
+
+      case opt_seed :
+        if (!vlmxIsPlainVector(optarg, -1)) {
+          mexErrMsgTxt("SEED is not a plain vector.") ;
+        }
+        seedArray = optarg ;
+        break ;
     }
   }
 
-  if (!mxIsCell(in[IN_FILENAMES])) {
-    mexErrMsgTxt("FILENAMES is not a cell array of strings.") ;
+  // a crop has the aspect ratio of the target, so that both sides
+  // must be specified
+  if (augmentation.crop && resizeMode == kResizeIsotropic) {
+    resizeMode = kResizeAnisotropic ;
+    resizeWidth = resizeHeight ;
+  }
+  if (pack && resizeMode != kResizeAnisotropic) {
+    mexErrMsgTxt("PACK requires RESIZE to specify both the height and width of the images.") ;
+  }
+  if (dataType == vl::vlTypeChar && augmentation.hasColorTransform()) {
+    mexErrMsgTxt("UINT8 cannot be combined with BRIGHTNESS, CONTRAST, SATURATION, SUBTRACTAVERAGE or DIVIDESTD.") ;
+  }
+
+  // a prefetched batch can be returned by passing its handle
+  bool handleMode = !mxIsCell(in[IN_FILENAMES]) ;
+  if (handleMode && !vlmxIsPlainScalar(in[IN_FILENAMES])) {
+    mexErrMsgTxt("FILENAMES is neither a cell array of strings nor a HANDLE.") ;
+  }
+  if (handleMode && prefetch) {
+    mexErrMsgTxt("PREFETCH cannot be used with a HANDLE.") ;
+  }
+
+  // image t uses the seed SEED(t) or SEED + t - 1; without SEED, the
+  // latter is drawn from the MATLAB random generator
+  size_t numImages = handleMode ? 0 : mxGetNumberOfElements(in[IN_FILENAMES]) ;
+  std::vector<uint64_t> seeds(numImages, 0) ;
+  if (seedArray && !handleMode) {
+    size_t numSeeds = mxGetNumberOfElements(seedArray) ;
+    if (numSeeds != 1 && numSeeds != numImages) {
+      mexErrMsgTxt("SEED is neither a scalar nor a vector with one element per image.") ;
+    }
+    for (size_t t = 0 ; t < numImages ; ++t) {
+      seeds[t] = (numSeeds == 1) ?
+        (uint64_t)(int64_t)mxGetPr(seedArray)[0] + t :
+        (uint64_t)(int64_t)mxGetPr(seedArray)[t] ;
+    }
+  } else if (augmentation.isRandom() && !handleMode) {
+    mxArray * randomArray = NULL ;
+    if (mexCallMATLAB(1, &randomArray, 0, NULL, "rand") == 0) {
+      uint64_t seed = (uint64_t)(mxGetScalar(randomArray) * 4294967296.0) ;
+      mxDestroyArray(randomArray) ;
+      for (size_t t = 0 ; t < numImages ; ++t) { seeds[t] = seed + t ; }
+    }
   }
 
   // prepare reader tasks
   create_readers(requestedNumThreads, verbosity) ;
 
   if (verbosity) {
-    mexPrintf("vl_imreadjpeg: numThreads = %d, prefetch = %d\n",
-              readers.size(), prefetch) ;
+    mexPrintf("vl_imreadjpeg: numThreads = %d, prefetch = %d, pack = %d, class = %s\n",
+              readers.size(), prefetch, pack,
+              (dataType == vl::vlTypeChar) ? "uint8" : "single") ;
+    if (imageCache.getCapacity() > 0) {
+      mexPrintf("vl_imreadjpeg: cache capacity %.1f MB\n",
+                imageCache.getCapacity() / (1024.0 * 1024.0)) ;
+    }
     switch (resizeMode) {
       case kResizeIsotropic:
         mexPrintf("vl_imreadjpeg: isotropic resize to x %d\n", resizeHeight) ;
@@ -348,11 +1477,23 @@ void mexFunction(int nout, mxArray *out[],
       default:
         break ;
     }
+    if (augmentation.crop) {
+      mexPrintf("vl_imreadjpeg: %s crop, size [%g %g], anisotropy [%g %g]\n",
+                (augmentation.cropLocation == kCropRandom) ? "random" : "center",
+                augmentation.minCropSize, augmentation.maxCropSize,
+                augmentation.minCropAnisotropy, augmentation.maxCropAnisotropy) ;
+    }
+    if (augmentation.flip || augmentation.hasColorTransform()) {
+      mexPrintf("vl_imreadjpeg: flip %d, brightness %d, contrast %g, saturation %g, normalization %d\n",
+                augmentation.flip, augmentation.hasBrightness(),
+                augmentation.contrast, augmentation.saturation,
+                augmentation.hasNormalization()) ;
+    }
   }
 
   // extract filenames as strings
   std::vector<std::string> filenames ;
-  for (i = 0 ; i < (int)mxGetNumberOfElements(in[IN_FILENAMES]) ; ++i) {
+  for (i = 0 ; !handleMode && i < (int)mxGetNumberOfElements(in[IN_FILENAMES]) ; ++i) {
     mxArray* filename_array = mxGetCell(in[IN_FILENAMES], i) ;
     if (!vlmxIsString(filename_array,-1)) {
       mexErrMsgTxt("FILENAMES contains an entry that is not a string.") ;
@@ -362,106 +1503,178 @@ void mexFunction(int nout, mxArray *out[],
     filenames.push_back(std::string(filename)) ;
   }
 
-  // check if the cached tasks match the new ones
-  bool match = true ;
-  for (int t = 0 ; match & (t < (signed)filenames.size()) ; ++t) {
-    if (t >= (signed)tasks.size()) {
-      match = false ;
-      break ;
+  // find the batch to return or prefetch
+  Batch * batch = NULL ;
+  tasksMutex.lock() ;
+  if (handleMode) {
+    int handle = (int)mxGetScalar(in[IN_FILENAMES]) ;
+    for (Batches::iterator iter = batches.begin() ; iter != batches.end() ; ++iter) {
+      if ((*iter)->handle == handle) { batch = *iter ; break ; }
+    }
+    if (batch == NULL) {
+      tasksMutex.unlock() ;
+      mexErrMsgTxt("HANDLE does not refer to a prefetched batch (it was already returned or was discarded).") ;
+    }
+    pack = batch->pack ;
+    dataType = batch->dataType ;
+    resizeHeight = batch->resizeHeight ;
+    resizeWidth = batch->resizeWidth ;
+  } else {
+    // look for a batch with the same images; packing also requires
+    // the images to have been resized to the requested shape, and a
+    // prefetched batch is returned in the format requested by its
+    // handle
+    for (Batches::iterator iter = batches.begin() ; iter != batches.end() ; ++iter) {
+      Tasks const & tasks = (*iter)->tasks ;
+      bool match = (tasks.size() == filenames.size()) ;
+      match &= (!prefetch || (*iter)->pack == pack) ;
+      for (int t = 0 ; match & (t < (signed)filenames.size()) ; ++t) {
+        match &= (tasks[t]->name == filenames[t]) ;
+        match &= (tasks[t]->dataType == dataType) ;
+        if (pack) {
+          match &= (tasks[t]->resizeMode == kResizeAnisotropic &&
+                    tasks[t]->resizeHeight == resizeHeight &&
+                    tasks[t]->resizeWidth == resizeWidth) ;
+        }
+      }
+      if (match) { batch = *iter ; break ; }
     }
-    match &= (tasks[t]->name == filenames[t]) ;
   }
 
-  // if there is no match, then flush tasks and start over
-  if (!match) {
+  size_t slotSize = vl::getImageDataTypeSize(dataType) * resizeHeight * resizeWidth * 3 ;
+  mxClassID classID = (dataType == vl::vlTypeChar) ? mxUINT8_CLASS : mxSINGLE_CLASS ;
+
+  // if there is no match, then create a new batch
+  if (batch == NULL) {
+    batch = new Batch() ;
+    batch->handle = nextBatchHandle++ ;
+    batch->pack = pack ;
+    batch->dataType = dataType ;
+    batch->resizeHeight = resizeHeight ;
+    batch->resizeWidth = resizeWidth ;
+    batch->dimensions.assign(mxGetDimensions(in[IN_FILENAMES]),
+                             mxGetDimensions(in[IN_FILENAMES]) + mxGetNumberOfDimensions(in[IN_FILENAMES])) ;
     if (verbosity > 1) {
-      mexPrintf("vl_imreadjpeg: flushing tasks\n") ;
+      mexPrintf("vl_imreadjpeg: creating batch %d\n", batch->handle) ;
+    }
+    if (pack) {
+      batch->packedMemory = mxMalloc(slotSize * filenames.size()) ;
+      mexMakeMemoryPersistent(batch->packedMemory) ;
+      batch->numBytes = slotSize * filenames.size() ;
     }
-    flush_tasks() ;
-    tasksMutex.lock() ;
     for (int t = 0 ; t < (signed)filenames.size() ; ++t) {
       Task* newTask(new Task()) ;
       newTask->name = filenames[t] ;
+      newTask->batch = batch ;
       newTask->done = false ;
-      ImageBuffer & inputImage = newTask->inputImage ;
-      ImageBuffer & resizedImage = newTask->resizedImage ;
-
-      vl::ImageShape shape ;
-      newTask->error = readers[0].second->readShape(shape, filenames[t].c_str()) ;
-      if (newTask->error == vl::vlSuccess) {
-        vl::ImageShape resizedShape = shape ;
-        switch (resizeMode) {
-          case kResizeAnisotropic:
-            resizedShape.height = resizeHeight ;
-            resizedShape.width = resizeWidth ;
-            break ;
-          case kResizeIsotropic:
-          {
-            float scale = (std::max)((float)resizeWidth / shape.width,
-                                     (float)resizeHeight / shape.height);
-            resizedShape.height = roundf(resizedShape.height * scale) ;
-            resizedShape.width = roundf(resizedShape.width * scale) ;
-            break ;
-          }
-          default:
-            break ;
-        }
-        newTask->requireResize = ! (resizedShape == shape) ;
-        if (newTask->requireResize) {
-          newTask->error = inputImage.init(shape, false) ;
-          if (newTask->error == vl::vlSuccess) {
-            newTask->error = resizedImage.init(resizedShape, true) ;
-          }
-        } else {
-          newTask->error = resizedImage.init(shape, true) ;
-          // alias: remark: resized image will be asked to release memory so it *must* be the owner
-          inputImage  = resizedImage ;
-        }
-      } else {
-        strncpy(newTask->errorMessage, readers[0].second->getLastErrorMessage(), TASK_ERROR_MSG_MAX_LEN) ;
-        char message [1024*2] ;
-        int offset = snprintf(message, sizeof(message)/sizeof(char),
-                              "could not read the header of image '%s'", newTask->name.c_str()) ;
-        if (strlen(newTask->errorMessage) > 0) {
-          snprintf(message + offset, sizeof(message)/sizeof(char) - offset,
-                   " [%s]", newTask->errorMessage) ;
-        }
-        mexWarnMsgTxt(message) ;
-      }
-      tasks.push_back(newTask) ;
+      newTask->error = vl::vlSuccess ;
+      newTask->resizeMode = resizeMode ;
+      newTask->resizeHeight = resizeHeight ;
+      newTask->resizeWidth = resizeWidth ;
+      newTask->augmentation = augmentation ;
+      newTask->seed = seeds[t] ;
+      newTask->dataType = dataType ;
+      newTask->pack = pack ;
+      newTask->packedMemory = pack ? (char*)batch->packedMemory + t * slotSize : NULL ;
+      batch->tasks.push_back(newTask) ;
     }
+    batches.push_back(batch) ;
+  }
+
+  // done if prefetching only
+  if (prefetch) {
+    limit_prefetched_batches(batch, verbosity) ;
     tasksMutex.unlock() ;
     tasksCondition.notify_all() ;
+    if (nout > OUT_IMAGES) {
+      out[OUT_IMAGES] = mxCreateDoubleScalar(batch->handle) ;
+    }
+    if (nout > OUT_CACHE_STATS) {
+      out[OUT_CACHE_STATS] = get_cache_stats() ;
+    }
+    return ;
   }
 
-  // done if prefetching only
-  if (prefetch) { return ; }
+  // the readers give the priority to the batch being collected, and
+  // ask the MATLAB thread for the memory of its images
+  batch->collecting = true ;
+  tasksMutex.unlock() ;
+  tasksCondition.notify_all() ;
 
   // return
-  out[OUT_IMAGES] = mxCreateCellArray(mxGetNumberOfDimensions(in[IN_FILENAMES]),
-                                      mxGetDimensions(in[IN_FILENAMES])) ;
+  Tasks const & tasks = batch->tasks ;
+  char * packed = NULL ;
+  if (pack) {
+    mwSize dimensions [4] = {
+      (mwSize)resizeHeight,
+      (mwSize)resizeWidth,
+      3,
+      (mwSize)tasks.size()} ;
+    mwSize dimensions_ [4] = {0} ;
+    tasksMutex.lock() ;
+    if (batch->packedMemory) {
+      packed = (char*)batch->packedMemory ;
+      batch->packedMemory = NULL ;
+    } else {
+      // the tasks were created without packing
+      packed = (char*)mxMalloc(slotSize * tasks.size()) ;
+    }
+    tasksMutex.unlock() ;
+    out[OUT_IMAGES] = mxCreateNumericArray(4, dimensions_, classID, mxREAL) ;
+    mxSetDimensions(out[OUT_IMAGES], dimensions, 4) ;
+    mxSetData(out[OUT_IMAGES], packed) ;
+  } else {
+    out[OUT_IMAGES] = mxCreateCellArray(batch->dimensions.size(),
+                                        &batch->dimensions[0]) ;
+  }
 
+  // wait for the images, allocating their memory for the readers
   for (int t = 0 ; t < tasks.size() ; ++t) {
     tasksMutex.lock() ;
-    while (!tasks[t]->done) {
+    while (true) {
+      serve_memory_requests(*batch) ;
+      if (tasks[t]->done) { break ; }
       completedCondition.wait(tasksMutex);
     }
     ImageBuffer & image = tasks[t]->resizedImage ;
     tasksMutex.unlock() ;
 
-    if (tasks[t]->error == vl::vlSuccess) {
+    if (tasks[t]->error == vl::vlSuccess && pack) {
+      // copy the images that were not packed by the reader,
+      // replicating the channels of grayscale images
+      vl::ImageShape const & shape = image.getShape() ;
+      char * slot = packed + t * slotSize ;
+      if (image.getData() != slot) {
+        size_t planeSize = slotSize / 3 ;
+        for (int d = 0 ; d < 3 ; ++d) {
+          memcpy(slot + d * planeSize,
+                 (char const*)image.getData() + (d % shape.depth) * planeSize,
+                 planeSize) ;
+        }
+      }
+      image.clear() ;
+    } else if (tasks[t]->error == vl::vlSuccess) {
       vl::ImageShape const & shape = image.getShape() ;
       mwSize dimensions [3] = {
         (mwSize)shape.height,
         (mwSize)shape.width,
         (mwSize)shape.depth} ;
       mwSize dimensions_ [3] = {0} ;
-      mxArray * image_array = mxCreateNumericArray(3, dimensions_, mxSINGLE_CLASS, mxREAL) ;
+      void * pixels ;
+      if (image.hasMatlabMemory) {
+        pixels = image.relinquishMemory() ;
+      } else {
+        // decoded while prefetching
+        size_t numBytes = vl::getImageDataTypeSize(image.getDataType()) * shape.getNumElements() ;
+        pixels = mxMalloc(numBytes) ;
+        memcpy(pixels, image.getData(), numBytes) ;
+        image.clear() ;
+      }
+      mxArray * image_array = mxCreateNumericArray(3, dimensions_, classID, mxREAL) ;
       mxSetDimensions(image_array, dimensions, 3) ;
-      mxSetData(image_array, image.relinquishMemory()) ;
+      mxSetData(image_array, pixels) ;
       mxSetCell(out[OUT_IMAGES], t, image_array) ;
     } else {
-      strncpy(tasks[t]->errorMessage, readers[0].second->getLastErrorMessage(), TASK_ERROR_MSG_MAX_LEN) ;
       char message [1024*2] ;
       int offset = snprintf(message, sizeof(message)/sizeof(char),
                             "could not read image '%s'", tasks[t]->name.c_str()) ;
@@ -470,7 +1683,17 @@ void mexFunction(int nout, mxArray *out[],
                  " [%s]", tasks[t]->errorMessage) ;
       }
       mexWarnMsgTxt(message) ;
+      if (pack) {
+        memset(packed + t * slotSize, 0, slotSize) ;
+      }
     }
   }
-  flush_tasks() ;
+
+  tasksMutex.lock() ;
+  delete_batch(batch) ;
+  tasksMutex.unlock() ;
+
+  if (nout > OUT_CACHE_STATS) {
+    out[OUT_CACHE_STATS] = get_cache_stats() ;
+  }
 }
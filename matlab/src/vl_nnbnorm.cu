@@ -26,6 +26,8 @@ enum {
   opt_verbose = 0,
   opt_epsilon,
   opt_moments,
+  opt_relu,
+  opt_mask,
 } ;
 
 /* options */
@@ -33,6 +35,8 @@ vlmxOption  options [] = {
   {"Verbose",          0,   opt_verbose           },
   {"Epsilon",	         1,   opt_epsilon           },
   {"Moments",          1,   opt_moments           },
+  {"ReLU",             0,   opt_relu              },
+  {"Mask",             1,   opt_mask              },
   {0,                  0,   0                     }
 } ;
 
@@ -79,6 +83,9 @@ void mexFunction(int nout, mxArray *out[],
   bool givenMomentsMode = false ;
   bool returnMomentsMode = false ;
   mxArray const* momentsArray ;
+  bool rectify = false ;
+  bool returnMaskMode = false ;
+  mxArray const* maskArray = NULL ;
 
   int verbosity = 0 ;
   int opt ;
@@ -99,6 +106,7 @@ void mexFunction(int nout, mxArray *out[],
     backMode = (nin >= 4) ;
   }
   returnMomentsMode = backMode ? (nout > 3) : (nout > 1) ;
+  returnMaskMode = !backMode && (nout > 2) ;
 
   while ((opt = vlmxNextOption (in, nin, options, &next, &optarg)) >= 0) {
     switch (opt) {
@@ -115,6 +123,12 @@ void mexFunction(int nout, mxArray *out[],
         momentsArray = optarg ;
         givenMomentsMode = true ;
         break ;
+      case opt_relu:
+        rectify = true ;
+        break ;
+      case opt_mask:
+        maskArray = optarg ;
+        break ;
       default:
         break ;
     }
@@ -163,6 +177,19 @@ void mexFunction(int nout, mxArray *out[],
     mexErrMsgTxt("DATA and MOMENTS do not have compatible formats.") ;
   }
 
+  if (returnMaskMode && !rectify) {
+    mexErrMsgTxt("MASK can only be returned with the ReLU option.") ;
+  }
+  if (maskArray && !(backMode && rectify)) {
+    mexErrMsgTxt("MASK can only be given with the ReLU option in backward mode.") ;
+  }
+  if (maskArray) {
+    if (mxGetClassID(maskArray) != mxUINT8_CLASS ||
+        mxGetNumberOfElements(maskArray) != vl::nnbnorm_get_mask_size(data.getShape())) {
+      mexErrMsgTxt("MASK is not a UINT8 array of the size returned by the forward mode.") ;
+    }
+  }
+
   /* Get the filter geometry */
   vl::TensorShape multipliersGeom(multipliers) ;
   if (multipliersGeom.getHeight() != data.getDepth()) {
@@ -192,8 +219,15 @@ void mexFunction(int nout, mxArray *out[],
     moments.init(deviceType, dataType, momentsGeom) ;
   }
 
+  mxArray * maskOut = NULL ;
+  uint8_t * mask = NULL ;
   if (!backMode) {
     output.init(deviceType, dataType, data.getShape()) ;
+    if (returnMaskMode) {
+      maskOut = mxCreateNumericMatrix(vl::nnbnorm_get_mask_size(data.getShape()), 1,
+                                      mxUINT8_CLASS, mxREAL) ;
+      mask = (uint8_t*)mxGetData(maskOut) ;
+    }
   } else {
     if (computeDerData) {
       derData.init(deviceType, dataType, data.getShape()) ;
@@ -207,11 +241,13 @@ void mexFunction(int nout, mxArray *out[],
   }
 
   if (verbosity > 0) {
-    mexPrintf("vl_nnbnorm: mode %s; %s; moments %s/%s\n",
+    mexPrintf("vl_nnbnorm: mode %s; %s; moments %s/%s; relu %d; mask %s\n",
               (data.getDeviceType()==vl::GPU)?"gpu":"cpu",
               backMode?"backward":"forward",
               givenMomentsMode?"given":"computed",
-              returnMomentsMode?"returned":"discared") ;
+              returnMomentsMode?"returned":"discared",
+              rectify,
+              backMode ? (maskArray?"given":"none") : (returnMaskMode?"returned":"none")) ;
     vl::print("vl_nnbnorm: data: ", data) ;
     vl::print("vl_nnbnorm: multipliers: ", multipliers) ;
     vl::print("vl_nnbnorm: biases: ", biases) ;
@@ -226,6 +262,12 @@ void mexFunction(int nout, mxArray *out[],
     if (moments) { vl::print("vl_nnbnorm: moments: ", moments) ; }
   }
 
+  /* The CPU code splits the channels among as many threads as MATLAB
+     gives to BLAS. */
+  if (deviceType == vl::CPU) {
+    context.updateNumCpuThreads() ;
+  }
+
   /* -------------------------------------------------------------- */
   /*                                                    Do the work */
   /* -------------------------------------------------------------- */
@@ -240,14 +282,18 @@ void mexFunction(int nout, mxArray *out[],
                                   data,
                                   multipliers,
                                   biases,
-                                  epsilon) ;
+                                  epsilon,
+                                  rectify,
+                                  mask) ;
     } else {
       error = vl::nnbnorm_forward_given_moments(context,
                                                 output,
                                                 moments,
                                                 data,
                                                 multipliers,
-                                                biases) ;
+                                                biases,
+                                                rectify,
+                                                mask) ;
     }
   } else {
     if (!givenMomentsMode) {
@@ -260,7 +306,9 @@ void mexFunction(int nout, mxArray *out[],
                                    multipliers,
                                    biases,
                                    derOutput,
-                                   epsilon);
+                                   epsilon,
+                                   rectify,
+                                   maskArray ? (uint8_t const*)mxGetData(maskArray) : NULL) ;
     } else {
       error = vl::nnbnorm_backward_given_moments(context,
                                                  derData,
@@ -271,7 +319,9 @@ void mexFunction(int nout, mxArray *out[],
                                                  multipliers,
                                                  biases,
                                                  derOutput,
-                                                 epsilon) ;
+                                                 epsilon,
+                                                 rectify,
+                                                 maskArray ? (uint8_t const*)mxGetData(maskArray) : NULL) ;
     }
   }
 
@@ -280,6 +330,7 @@ void mexFunction(int nout, mxArray *out[],
   /* -------------------------------------------------------------- */
 
   if (error != vl::vlSuccess) {
+    if (maskOut) { mxDestroyArray(maskOut) ; }
     mexErrMsgTxt(context.getLastErrorMessage().c_str()) ;
   }
   if (!backMode) {
@@ -292,4 +343,7 @@ void mexFunction(int nout, mxArray *out[],
   if (moments) {
     out[backMode ? 3 : 1] = moments.relinquish() ;
   }
+  if (maskOut) {
+    out[2] = maskOut ;
+  }
 }
@@ -18,6 +18,8 @@ the terms of the BSD license (see the COPYING file).
 #include "bits/nnconv.hpp"
 #include "bits/nnfullyconnected.hpp"
 #include "bits/nnsubsample.hpp"
+#include "bits/convtuner.hpp"
+#include "bits/filtercache.hpp"
 
 #if ENABLE_GPU
 #include "bits/datacu.hpp"
@@ -31,6 +33,7 @@ the terms of the BSD license (see the COPYING file).
 enum {
   opt_stride = 0,
   opt_pad,
+  opt_dilate,
   opt_verbose,
   opt_no_der_data,
   opt_no_der_filters,
@@ -38,13 +41,21 @@ enum {
   opt_cudnn,
   opt_no_cudnn,
   opt_cudnn_workspace_limit,
-  opt_transpose
+  opt_transpose,
+  opt_cpu_conv_algo,
+  opt_cpu_conv_algo_cache,
+  opt_filter_cache,
+  opt_relu,
+  opt_int8,
+  opt_input_scale,
+  opt_filter_scales
 } ;
 
 /* options */
 vlmxOption  options [] = {
   {"Stride",                1,   opt_stride                },
   {"Pad",                   1,   opt_pad                   },
+  {"Dilate",                1,   opt_dilate                },
   {"Verbose",               0,   opt_verbose               },
   {"NoDerData",             0,   opt_no_der_data           },
   {"NoDerFilters",          0,   opt_no_der_filters        },
@@ -52,6 +63,13 @@ vlmxOption  options [] = {
   {"Cudnn",                 0,   opt_cudnn                 },
   {"NoCudnn",               0,   opt_no_cudnn              },
   {"CudnnWorkSpaceLimit",   1,   opt_cudnn_workspace_limit },
+  {"CpuConvAlgo",           1,   opt_cpu_conv_algo         },
+  {"CpuConvAlgoCache",      1,   opt_cpu_conv_algo_cache   },
+  {"FilterCache",           1,   opt_filter_cache          },
+  {"ReLU",                  0,   opt_relu                  },
+  {"Int8",                  0,   opt_int8                  },
+  {"InputScale",            1,   opt_input_scale           },
+  {"FilterScales",          1,   opt_filter_scales         },
   {0,                       0,   0                         }
 } ;
 
@@ -87,6 +105,8 @@ void mexFunction(int nout, mxArray *out[],
 {
   int strideX = 1 ;
   int strideY = 1 ;
+  int dilateX = 1 ;
+  int dilateY = 1 ;
   int padLeft = 0 ;
   int padRight = 0 ;
   int padTop = 0 ;
@@ -100,6 +120,12 @@ void mexFunction(int nout, mxArray *out[],
   bool computeDerData = true ;
   bool computeDerFilters = true ;
   bool computederBiases = true ;
+  bool rectify = false ;
+  bool int8 = false ;
+  bool sparseFilters = false ;
+  vl::SparseFilters sparse ;
+  float inputScale = 0 ;
+  mxArray const * filterScalesArray = NULL ;
 
   int verbosity = 0 ;
   int opt ;
@@ -147,6 +173,24 @@ void mexFunction(int nout, mxArray *out[],
         }
         break ;
 
+      case opt_dilate :
+        if (!vlmxIsPlainMatrix(optarg,-1,-1)) {
+          mexErrMsgTxt("DILATE is not a plain matrix.") ;
+        }
+        switch (mxGetNumberOfElements(optarg)) {
+          case 1:
+            dilateY = (int)mxGetPr(optarg)[0] ;
+            dilateX = dilateY ;
+            break ;
+          case 2:
+            dilateY = (int)mxGetPr(optarg)[0] ;
+            dilateX = (int)mxGetPr(optarg)[1] ;
+            break ;
+          default:
+            mexErrMsgTxt("DILATE has neither one nor two elements.") ;
+        }
+        break ;
+
       case opt_pad :
         if (!vlmxIsPlainMatrix(optarg,-1,-1)) {
           mexErrMsgTxt("PAD is not a plain matrix.") ;
@@ -215,10 +259,73 @@ void mexFunction(int nout, mxArray *out[],
           CUDNN_CONVOLUTION_BWD_DATA_PREFER_FASTEST :
           CUDNN_CONVOLUTION_BWD_DATA_SPECIFY_WORKSPACE_LIMIT),
          (size_t)x) ;
-        break ;
 #endif
+        break ;
       }
 
+      case opt_cpu_conv_algo :
+        if (!vlmxIsString(optarg,-1)) {
+          vlmxError(vlmxErrInvalidArgument, "CPUCONVALGO is not a string.") ;
+        }
+        if (vlmxIsEqualToStringI(optarg, "im2row")) {
+          context.getConvolutionTuner().setAlgo(vl::vlConvolutionAlgoIm2row) ;
+        } else if (vlmxIsEqualToStringI(optarg, "direct1x1")) {
+          context.getConvolutionTuner().setAlgo(vl::vlConvolutionAlgoDirect1x1) ;
+        } else if (vlmxIsEqualToStringI(optarg, "auto")) {
+          context.getConvolutionTuner().setAlgo(vl::vlConvolutionAlgoAuto) ;
+        } else {
+          vlmxError(vlmxErrInvalidArgument, "CPUCONVALGO is not a supported algorithm.") ;
+        }
+        break ;
+
+      case opt_cpu_conv_algo_cache :
+      {
+        if (!vlmxIsString(optarg,-1)) {
+          vlmxError(vlmxErrInvalidArgument, "CPUCONVALGOCACHE is not a string.") ;
+        }
+        char * path = mxArrayToString(optarg) ;
+        context.getConvolutionTuner().setCachePath(path) ;
+        mxFree(path) ;
+        break ;
+      }
+
+      case opt_filter_cache :
+      {
+        double x ;
+        if (!vlmxIsScalar(optarg) || (x = mxGetScalar(optarg)) < 0) {
+          vlmxError(vlmxErrInvalidArgument, "FILTERCACHE is not a non-negative scalar.") ;
+        }
+        /* true enables the cache with the default budget, larger
+           values are taken as the budget in bytes */
+        context.getFilterCache().setEnabled(x > 0) ;
+        if (x > 1) {
+          context.getFilterCache().setMaxSize((size_t)x) ;
+        }
+        break ;
+      }
+
+      case opt_relu :
+        rectify = true ;
+        break ;
+
+      case opt_int8 :
+        int8 = true ;
+        break ;
+
+      case opt_input_scale :
+      {
+        double x ;
+        if (!vlmxIsScalar(optarg) || (x = mxGetScalar(optarg)) < 0) {
+          vlmxError(vlmxErrInvalidArgument, "INPUTSCALE is not a non-negative scalar.") ;
+        }
+        inputScale = (float)x ;
+        break ;
+      }
+
+      case opt_filter_scales :
+        filterScalesArray = optarg ;
+        break ;
+
       default: break ;
     }
   }
@@ -227,12 +334,29 @@ void mexFunction(int nout, mxArray *out[],
   vl::MexTensor filters(context) ;
   vl::MexTensor biases(context) ;
   vl::MexTensor derOutput(context) ;
+  vl::MexTensor filterScales(context) ;
 
   data.init(in[IN_DATA]) ;
   data.reshape(4) ;
 
-  filters.init(in[IN_FILTERS]) ;
-  filters.reshape(4) ;
+  /*
+   Sparse filters are a MATLAB sparse matrix with one column per
+   filter, used in place (mwIndex is size_t with -largeArrayDims).
+   */
+  sparseFilters = mxIsSparse(in[IN_FILTERS]) ;
+  if (sparseFilters) {
+    if (!mxIsDouble(in[IN_FILTERS]) || mxIsComplex(in[IN_FILTERS])) {
+      mexErrMsgTxt("Sparse FILTERS must be a real double matrix.") ;
+    }
+    sparse.volume = mxGetM(in[IN_FILTERS]) ;
+    sparse.numFilters = mxGetN(in[IN_FILTERS]) ;
+    sparse.columnOffsets = (size_t const*)mxGetJc(in[IN_FILTERS]) ;
+    sparse.rowIndices = (size_t const*)mxGetIr(in[IN_FILTERS]) ;
+    sparse.values = mxGetPr(in[IN_FILTERS]) ;
+  } else {
+    filters.init(in[IN_FILTERS]) ;
+    filters.reshape(4) ;
+  }
 
   biases.init(in[IN_BIASES]) ;
 
@@ -241,11 +365,11 @@ void mexFunction(int nout, mxArray *out[],
     derOutput.reshape(4) ;
   }
 
-  hasFilters = !filters.isEmpty() ;
+  hasFilters = sparseFilters || !filters.isEmpty() ;
   hasBiases = !biases.isEmpty() ;
 
   /* check for GPU/data class consistency */
-  if (hasFilters && ! vl::areCompatible(data, filters)) {
+  if (hasFilters && !sparseFilters && ! vl::areCompatible(data, filters)) {
     mexErrMsgTxt("DATA and FILTERS do not have compatible formats.") ;
   }
   if (hasBiases && ! vl::areCompatible(data, biases)) {
@@ -254,11 +378,46 @@ void mexFunction(int nout, mxArray *out[],
   if (backMode && ! vl::areCompatible(data, derOutput)) {
     mexErrMsgTxt("DATA and DEROUTPUT do not have compatible formats.") ;
   }
+  if (rectify && backMode) {
+    mexErrMsgTxt("RELU can only be used in forward mode.") ;
+  }
+  if (rectify && !hasFilters) {
+    mexErrMsgTxt("RELU requires FILTERS.") ;
+  }
+  if (int8 && backMode) {
+    mexErrMsgTxt("INT8 can only be used in forward mode.") ;
+  }
+  if (int8 && !hasFilters) {
+    mexErrMsgTxt("INT8 requires FILTERS.") ;
+  }
+  if (sparseFilters) {
+    if (backMode) {
+      mexErrMsgTxt("Sparse FILTERS can only be used in forward mode.") ;
+    }
+    if (int8) {
+      mexErrMsgTxt("INT8 cannot be used with sparse FILTERS.") ;
+    }
+    if (data.getDeviceType() != vl::CPU) {
+      mexErrMsgTxt("Sparse FILTERS can only be used with CPU arrays.") ;
+    }
+    if (sparse.volume != data.getHeight() * data.getWidth() * data.getDepth()) {
+      mexErrMsgTxt("The number of rows of the sparse FILTERS is not the number of elements of a DATA image.") ;
+    }
+  }
+  if (filterScalesArray) {
+    filterScales.init(filterScalesArray) ;
+    if (!filterScales.isEmpty() && !vl::areCompatible(data, filterScales)) {
+      mexErrMsgTxt("DATA and FILTERSCALES do not have compatible formats.") ;
+    }
+  }
 
   /* basic argument checks */
   if (strideX < 1 || strideY < 1) {
     mexErrMsgTxt("At least one element of STRIDE is smaller than one.") ;
   }
+  if (dilateX < 1 || dilateY < 1) {
+    mexErrMsgTxt("At least one element of DILATE is smaller than one.") ;
+  }
   if (padLeft < 0 ||
       padRight < 0 ||
       padTop < 0 ||
@@ -266,26 +425,29 @@ void mexFunction(int nout, mxArray *out[],
     mexErrMsgTxt("An element of PAD is negative.") ;
   }
 
-  /* Get the filter shape */
+  /* Get the filter shape (sparse filters span the whole DATA image) */
   vl::TensorShape filtersShape(filters) ;
   int equivalentNumFilters ;
+  if (sparseFilters) {
+    filtersShape = vl::TensorShape(data.getHeight(), data.getWidth(), data.getDepth(), sparse.numFilters) ;
+  }
   if (hasFilters) {
     if (filtersShape.getHeight() == 0 || filtersShape.getWidth() == 0 || filtersShape.getDepth() == 0) {
       mexErrMsgTxt("A dimension of FILTERS is void.") ;
     }
-    if (data.getHeight() + (padTop+padBottom) < filters.getHeight() ||
-        data.getWidth() + (padLeft+padRight) < filters.getWidth()) {
+    if (data.getHeight() + (padTop+padBottom) < (filtersShape.getHeight()-1)*dilateY + 1 ||
+        data.getWidth() + (padLeft+padRight) < (filtersShape.getWidth()-1)*dilateX + 1) {
       mexErrMsgTxt("FILTERS are larger than the DATA (including padding).") ;
     }
     /* grouped filters */
-    numFilterGroups = data.getDepth() / filters.getDepth() ;
-    if (numFilterGroups * filters.getDepth() != data.getDepth()) {
+    numFilterGroups = data.getDepth() / filtersShape.getDepth() ;
+    if (numFilterGroups * filtersShape.getDepth() != data.getDepth()) {
       mexErrMsgTxt("The FILTERS depth does not divide the DATA depth.") ;
     }
-    if (filters.getSize() % numFilterGroups != 0) {
+    if (filtersShape.getSize() % numFilterGroups != 0) {
       mexErrMsgTxt("The number of filter groups does not divide the number of filters.") ;
     }
-    equivalentNumFilters = filters.getSize() ;
+    equivalentNumFilters = filtersShape.getSize() ;
   } else {
     /* empty filters -> pretend the identity filter bank */
     filtersShape = vl::TensorShape(1, 1, data.getDepth(), data.getDepth()) ;
@@ -293,9 +455,11 @@ void mexFunction(int nout, mxArray *out[],
     equivalentNumFilters = data.getDepth() ;
   }
 
-  /* Get the output shape */
-  vl::TensorShape outputShape((data.getHeight() + (padTop+padBottom) - filtersShape.getHeight())/strideY + 1,
-                                (data.getWidth()  + (padLeft+padRight) - filtersShape.getWidth())/strideX + 1,
+  /* Get the output shape (dilated filters span a larger window) */
+  int filterExtentY = (filtersShape.getHeight() - 1) * dilateY + 1 ;
+  int filterExtentX = (filtersShape.getWidth() - 1) * dilateX + 1 ;
+  vl::TensorShape outputShape((data.getHeight() + (padTop+padBottom) - filterExtentY)/strideY + 1,
+                                (data.getWidth()  + (padLeft+padRight) - filterExtentX)/strideX + 1,
                                 equivalentNumFilters,
                                 data.getSize()) ;
 
@@ -309,24 +473,35 @@ void mexFunction(int nout, mxArray *out[],
       mexErrMsgTxt("The number of elements of BIASES is not the same as the number of filters.") ;
     }
   }
+  if (!filterScales.isEmpty() &&
+      filterScales.getNumElements() != filtersShape.getSize()) {
+    mexErrMsgTxt("The number of elements of FILTERSCALES is not the same as the number of filters.") ;
+  }
 
   /*
    Detect fully connected mode (further optimisations):
    the output is 1 x 1 pixels,
    no padding,
    one filter group,
-   stride of one pixel
+   stride of one pixel,
+   no dilation
    */
   fullyConnectedMode = (outputShape.getHeight() == 1 &&
                         outputShape.getWidth() == 1 &&
                         strideY == 1 &&
                         strideX == 1 &&
+                        dilateY == 1 &&
+                        dilateX == 1 &&
                         padTop == 0 &&
                         padBottom == 0 &&
                         padLeft == 0 &&
                         padRight == 0 &&
                         numFilterGroups == 1) ;
 
+  if (sparseFilters && !fullyConnectedMode) {
+    mexErrMsgTxt("Sparse FILTERS can only be used without PAD, STRIDE and DILATE.") ;
+  }
+
   /* create output buffers */
   vl::Device deviceType = data.getDeviceType() ;
   vl::Type dataType = data.getDataType() ;
@@ -358,15 +533,27 @@ void mexFunction(int nout, mxArray *out[],
       mexPrintf("; cuBLAS\n") ;
 #endif
     } else {
-      mexPrintf("; BLAS\n") ;
+      mexPrintf("; BLAS (%s)\n",
+                vl::getConvolutionAlgoName(context.getConvolutionTuner().getAlgo())) ;
     }
-    mexPrintf("vl_nnconv: stride: [%d %d], pad: [%d %d %d %d]\n"
-              "vl_nnconv: num filter groups: %d, has bias: %d, has filters: %d, is fully connected: %d\n",
+    mexPrintf("vl_nnconv: stride: [%d %d], dilate: [%d %d], pad: [%d %d %d %d]\n"
+              "vl_nnconv: num filter groups: %d, has bias: %d, has filters: %d, is fully connected: %d, relu: %d\n",
               strideY, strideX,
+              dilateY, dilateX,
               padTop, padBottom, padLeft, padRight,
-              numFilterGroups, hasBiases, hasFilters, fullyConnectedMode) ;
+              numFilterGroups, hasBiases, hasFilters, fullyConnectedMode, rectify) ;
+    if (int8) {
+      mexPrintf("vl_nnconv: int8, input scale: %g%s\n", inputScale,
+                (inputScale == 0) ? " (dynamic)" : "") ;
+    }
     vl::print("vl_nnconv: data: ", data) ;
-    if (hasFilters) { vl::print("vl_nnconv: filters: ", filters) ; }
+    if (sparseFilters) {
+      mexPrintf("vl_nnconv: filters: sparse %d x %d, %d nonzeros\n",
+                (int)sparse.volume, (int)sparse.numFilters,
+                (int)sparse.columnOffsets[sparse.numFilters]) ;
+    } else if (hasFilters) {
+      vl::print("vl_nnconv: filters: ", filters) ;
+    }
     if (hasBiases) { vl::print("vl_nnconv: biases: ", biases) ; }
     if (backMode) {
       vl::print("vl_nnconv: derOutput: ", derOutput) ;
@@ -378,6 +565,15 @@ void mexFunction(int nout, mxArray *out[],
     }
   }
 
+  /*
+   The CPU code uses as many threads as MATLAB gives to BLAS. The best
+   CPU algorithm depends on this number too, so it is also part of the
+   tuning signature.
+   */
+  if (deviceType == vl::CPU) {
+    context.updateNumCpuThreads() ;
+  }
+
   /* -------------------------------------------------------------- */
   /*                                                    Do the work */
   /* -------------------------------------------------------------- */
@@ -389,12 +585,29 @@ void mexFunction(int nout, mxArray *out[],
    (could be done as a regular case, but it is faster this way)
    */
   if (fullyConnectedMode) {
-    if (!backMode) {
+    if (sparseFilters) {
+      error = vl::nnfullyconnected_forward_sparse(context,
+                                                  output,
+                                                  data,
+                                                  sparse,
+                                                  biases,
+                                                  rectify) ;
+    } else if (int8) {
+      error = vl::nnfullyconnected_forward_int8(context,
+                                                output,
+                                                data,
+                                                filters,
+                                                biases,
+                                                inputScale,
+                                                filterScales,
+                                                rectify) ;
+    } else if (!backMode) {
       error = vl::nnfullyconnected_forward(context,
                                            output,
                                            data,
                                            filters,
-                                           biases) ;
+                                           biases,
+                                           rectify) ;
     } else {
       error = vl::nnfullyconnected_backward(context,
                                             derData,
@@ -428,14 +641,28 @@ void mexFunction(int nout, mxArray *out[],
   }
 
   /* regular case */
-  if (!backMode) {
+  if (int8) {
+    error = vl::nnconv_forward_int8(context,
+                                    output,
+                                    data,
+                                    filters,
+                                    biases,
+                                    inputScale,
+                                    filterScales,
+                                    strideY, strideX,
+                                    dilateY, dilateX,
+                                    padTop, padBottom, padLeft, padRight,
+                                    rectify) ;
+  } else if (!backMode) {
     error = vl::nnconv_forward(context,
                                output, 0,
                                data, 1,
                                filters,
                                biases,
                                strideY, strideX,
-                               padTop, padBottom, padLeft, padRight) ;
+                               dilateY, dilateX,
+                               padTop, padBottom, padLeft, padRight,
+                               rectify) ;
   } else {
     error = vl::nnconv_backward(context,
                                 derData,
@@ -445,6 +672,7 @@ void mexFunction(int nout, mxArray *out[],
                                 filters,
                                 derOutput,
                                 strideY, strideX,
+                                dilateY, dilateX,
                                 padTop, padBottom, padLeft, padRight) ;
   }
 
@@ -475,6 +703,7 @@ doneok:
     switch (derOutput.getDataType()) {
       case vl::vlTypeFloat: classID = mxSINGLE_CLASS ; break ;
       case vl::vlTypeDouble: classID = mxDOUBLE_CLASS ; break ;
+      case vl::vlTypeHalf: classID = mxUINT16_CLASS ; break ;
       default: abort() ;
     }
     out[OUT_RESULT] = (computeDerData) ? derData.relinquish() : mxCreateNumericMatrix(0,0,classID,mxREAL) ;
@@ -36,6 +36,8 @@ enum {
   opt_cudnn,
   opt_no_cudnn,
   opt_cudnn_workspace_limit,
+  opt_separable,
+  opt_no_separable,
 } ;
 
 /* options */
@@ -50,6 +52,8 @@ vlmxOption  options [] = {
   {"CUDNN",                 0,   opt_cudnn                 },
   {"NoCUDNN",               0,   opt_no_cudnn              },
   {"CudnnWorkSpaceLimit",   1,   opt_cudnn_workspace_limit },
+  {"Separable",             0,   opt_separable             },
+  {"NoSeparable",           0,   opt_no_separable          },
   {0,                       0,   0                         }
 } ;
 
@@ -90,6 +94,7 @@ void mexFunction(int nout, mxArray *out[],
   int cropTop = 0 ;
   int cropBottom = 0 ;
   int numFilterGroups = 1 ;
+  vl::ConvTransposeMethod method = vl::vlConvTransposeAuto ;
 
   bool backMode = false ;
   bool hasBiases = false ;
@@ -223,6 +228,14 @@ void mexFunction(int nout, mxArray *out[],
 #endif
       }
 
+      case opt_separable :
+        method = vl::vlConvTransposeSeparable ;
+        break ;
+
+      case opt_no_separable :
+        method = vl::vlConvTransposeGeneric ;
+        break ;
+
       default: break ;
     }
   }
@@ -342,10 +355,13 @@ void mexFunction(int nout, mxArray *out[],
       mexPrintf("; BLAS\n") ;
     }
     mexPrintf("vl_nnconvt: upsample: [%d %d], crop: [%d %d %d %d]\n"
-              "vl_nnconvt: num filter groups: %d, has bias: %d, is fully connected: %d\n",
+              "vl_nnconvt: num filter groups: %d, has bias: %d, is fully connected: %d\n"
+              "vl_nnconvt: separable filters: %s\n",
               upsampleY, upsampleX,
               cropTop, cropBottom, cropLeft, cropRight,
-              numFilterGroups, hasBiases, fullyConnectedMode) ;
+              numFilterGroups, hasBiases, fullyConnectedMode,
+              (method == vl::vlConvTransposeAuto) ? "detect" :
+              ((method == vl::vlConvTransposeSeparable) ? "yes" : "no")) ;
     vl::print("vl_nnconvt: data: ", data) ;
     vl::print("vl_nnconvt: filters: ", filters) ;
     if (hasBiases) { vl::print("vl_nnconvt: biases: ", biases) ; }
@@ -359,6 +375,11 @@ void mexFunction(int nout, mxArray *out[],
     }
   }
 
+  /* the CPU code uses as many threads as MATLAB gives to BLAS */
+  if (deviceType == vl::CPU) {
+    context.updateNumCpuThreads() ;
+  }
+
   /* -------------------------------------------------------------- */
   /*                                                    Do the work */
   /* -------------------------------------------------------------- */
@@ -373,7 +394,8 @@ void mexFunction(int nout, mxArray *out[],
                                 filters,
                                 biases,
                                 upsampleY, upsampleX,
-                                cropTop, cropBottom, cropLeft, cropRight) ;
+                                cropTop, cropBottom, cropLeft, cropRight,
+                                method) ;
   } else {
     error = vl::nnconvt_backward(context,
                                  derData,
@@ -383,7 +405,8 @@ void mexFunction(int nout, mxArray *out[],
                                  filters,
                                  derOutput,
                                  upsampleY, upsampleX,
-                                 cropTop, cropBottom, cropLeft, cropRight) ;
+                                 cropTop, cropBottom, cropLeft, cropRight,
+                                 method) ;
   }
 
   if (verbosity > 0) {
@@ -412,6 +435,7 @@ void mexFunction(int nout, mxArray *out[],
     switch (derOutput.getDataType()) {
       case vl::vlTypeFloat: classID = mxSINGLE_CLASS ; break ;
       case vl::vlTypeDouble: classID = mxDOUBLE_CLASS ; break ;
+      case vl::vlTypeHalf: classID = mxUINT16_CLASS ; break ;
       default: abort() ;
     }
     out[OUT_RESULT] = (computeDerData) ? derData.relinquish() : mxCreateNumericMatrix(0,0,classID,mxREAL) ;
@@ -153,6 +153,12 @@ void mexFunction(int nout, mxArray *out[],
     }
   }
 
+  /* The CPU code splits the images and bands of pixels among as many
+     threads as MATLAB gives to BLAS. */
+  if (deviceType == vl::CPU) {
+    context.updateNumCpuThreads() ;
+  }
+
   /* -------------------------------------------------------------- */
   /*                                                    Do the work */
   /* -------------------------------------------------------------- */
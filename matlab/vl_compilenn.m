@@ -213,7 +213,15 @@ lib_src{end+1} = fullfile(root,'matlab','src','bits','impl','copy_cpu.cpp') ;
 lib_src{end+1} = fullfile(root,'matlab','src','bits','impl','pooling_cpu.cpp') ;
 lib_src{end+1} = fullfile(root,'matlab','src','bits','impl','normalize_cpu.cpp') ;
 lib_src{end+1} = fullfile(root,'matlab','src','bits','impl','bnorm_cpu.cpp') ;
+lib_src{end+1} = fullfile(root,'matlab','src','bits','impl','nnconv_direct_cpu.cpp') ;
+lib_src{end+1} = fullfile(root,'matlab','src','bits','impl','upsample_cpu.cpp') ;
+lib_src{end+1} = fullfile(root,'matlab','src','bits','impl','cpufeatures.cpp') ;
+lib_src{end+1} = fullfile(root,'matlab','src','bits','impl','half_cpu.cpp') ;
+lib_src{end+1} = fullfile(root,'matlab','src','bits','impl','nnconv_int8_cpu.cpp') ;
+lib_src{end+1} = fullfile(root,'matlab','src','bits','impl','nnfullyconnected_sparse_cpu.cpp') ;
 lib_src{end+1} = fullfile(root,'matlab','src','bits','impl','tinythread.cpp') ;
+lib_src{end+1} = fullfile(root,'matlab','src','bits','convtuner.cpp') ;
+lib_src{end+1} = fullfile(root,'matlab','src','bits','filtercache.cpp') ;
 lib_src{end+1} = fullfile(root,'matlab','src','bits','imread.cpp') ;
 
 % GPU-specific files
@@ -224,6 +232,7 @@ if opts.enableGpu
   lib_src{end+1} = fullfile(root,'matlab','src','bits','impl','pooling_gpu.cu') ;
   lib_src{end+1} = fullfile(root,'matlab','src','bits','impl','normalize_gpu.cu') ;
   lib_src{end+1} = fullfile(root,'matlab','src','bits','impl','bnorm_gpu.cu') ;
+  lib_src{end+1} = fullfile(root,'matlab','src','bits','impl','upsample_gpu.cu') ;
   lib_src{end+1} = fullfile(root,'matlab','src','bits','datacu.cu') ;
 end
 
@@ -0,0 +1,25 @@
+function x = vl_fromhalf(h)
+%VL_FROMHALF Convert half precision numbers to single precision.
+%   X = VL_FROMHALF(H) converts the UINT16 array H, containing the bit
+%   patterns of IEEE half precision numbers as returned by
+%   VL_TOHALF(), to a SINGLE array of the same size. The conversion is
+%   exact.
+%
+%   See also: VL_TOHALF().
+
+% Copyright (C) 2016 Andrea Vedaldi.
+% All rights reserved.
+%
+% This file is part of the VLFeat library and is made available under
+% the terms of the BSD license (see the COPYING file).
+
+h = double(h) ;
+e = floor(mod(h, 32768) / 1024) ;
+m = mod(h, 1024) ;
+
+x = (1 + m / 1024) .* 2.^(e - 15) ;
+x(e == 0) = m(e == 0) * 2^-24 ;
+x(e == 31 & m == 0) = inf ;
+x(e == 31 & m ~= 0) = nan ;
+x(h >= 32768) = - x(h >= 32768) ;
+x = single(x) ;
@@ -2,6 +2,14 @@
 %   IMAGES = VL_IMREADJPEG(FILES) reads the specified cell array
 %   FILES of JPEG files into the cell array of images IMAGES.
 %
+%   An element of FILES can also be a reference 'SHARD#ID' to the
+%   ID-th image packed in the file SHARD by VL_IMSHARD(). The shard is
+%   memory mapped the first time it is used, and its images are
+%   decoded directly from memory, without opening a file for each of
+%   them (this is only supported by the LibJPEG reader). A file name
+%   ending with # followed by digits is always interpreted in this
+%   manner.
+%
 %   IMAGES = VL_IMREADJPEG(FILES, 'NumThreads', T) uses T parallel
 %   threads to accelerate the operation. Note that this is
 %   independent of the number of computational threads used by
@@ -15,6 +23,27 @@
 %   images. This can be sued to quickly load a batch of JPEG images
 %   as MATLAB is busy doing something else.
 %
+%   H = VL_IMREADJPEG(FILES, 'Prefetch') also returns a handle H to
+%   the prefetched batch, and IMAGES = VL_IMREADJPEG(H) returns its
+%   images, in the format specified when prefetching them (the other
+%   options are then ignored). Several batches can be prefetched at
+%   the same time (see `MaxPrefetchSize`), for example the next
+%   training and validation batches. They are read in the order in
+%   which they are requested, except that the batch being returned is
+%   read first. A batch can be returned only once.
+%
+%   The files are opened only by the reading threads, each of which
+%   reads the header and the pixels of an image in a single pass, so
+%   that prefetching returns without accessing the disk. Files that
+%   cannot be read produce a warning when the images are returned.
+%
+%   [IMAGES, STATS] = VL_IMREADJPEG(...) also returns a structure
+%   with the statistics of the image cache (see `CacheSize` below):
+%   the number of cached images NUMIMAGES, their SIZE in bytes, the
+%   CAPACITY of the cache, and the total number of hits NUMHITS,
+%   misses NUMMISSES and evictions NUMEVICTIONS since the MEX file was
+%   loaded.
+%
 %   The function takes the following options:
 %
 %   `Prefetch`:: not specified
@@ -41,6 +70,119 @@
 %     over several input pixels to average them. The method is the
 %     same as MATLAB IMRESIZE() function (the two functions are
 %     numerically equivalent).
+%
+%     When the target is at most half as large as the image, the
+%     JPEG decoder (LibJPEG only) first downscales it by a factor of
+%     2, 4 or 8 in the DCT domain, choosing the largest factor that
+%     does not make the image smaller than the target, and the result
+%     is then resized as above. This is several times faster for
+%     large images, but the result differs slightly from IMRESIZE().
+%
+%   `Pack`:: not specified
+%     If specified, return a single SINGLE array of size HEIGHT x WIDTH
+%     x 3 x numel(FILES) instead of a cell array. This requires
+%     `Resize` to specify both HEIGHT and WIDTH (or cropping, see
+%     below). The array is allocated when the images are requested
+%     (also with `Prefetch`) and the reading threads resize each image
+%     directly into its slot, so that the batch is assembled without
+%     copying it as CAT(4, IMAGES{:}) does. Grayscale images are
+%     replicated into three channels (before the colour
+%     transformations below) and the slots of the images that cannot
+%     be read are set to zero.
+%
+%   `Uint8`:: not specified
+%     If specified, return UINT8 images (or a UINT8 array with `Pack`)
+%     instead of SINGLE ones. The pixels are decoded and resized
+%     directly in this format (resizing rounds the interpolated
+%     values), so that the images, including those being prefetched,
+%     take a quarter of the memory. The conversion to SINGLE and the
+%     normalization are then left to the caller, for example after
+%     transferring the batch to the GPU. This option is only supported
+%     by the LibJPEG reader and cannot be combined with the colour
+%     transformations below, while cropping and flipping are allowed.
+%
+%   `MaxPrefetchSize`:: `0`
+%     Keep the prefetched batches as long as the memory used by their
+%     images (in bytes) does not exceed this value. Otherwise, when a
+%     new batch is prefetched, the oldest ones are discarded and their
+%     handles become invalid (passing their FILES still reads them).
+%     If zero, prefetching discards all the other prefetched batches.
+%     The value is retained by the subsequent calls.
+%
+%   `CacheSize`:: `0`
+%     Set the capacity in bytes of a cache of decoded images, which
+%     persists across calls (until CLEAR MEX) so that the images are
+%     decoded only once when they are read again, for example in the
+%     following epochs. When the cache is full, the least recently
+%     used images are evicted. The capacity is retained by the
+%     subsequent calls, and setting it to zero empties the cache. An
+%     image is cached for the given file name and `Resize`, `Pack`,
+%     `Uint8` and crop options. It is stored after being cropped and
+%     resized, unless the crop is random, in which case it is stored
+%     after decoding it, at a resolution sufficient for the smallest
+%     crop, and then cropped and resized in each call (hence the result
+%     differs slightly from the one without the cache). Flipping and
+%     the colour transformations are always applied after the cache.
+%
+%   The following options perform data augmentation in the reading
+%   threads, so that, together with `Prefetch`, it runs concurrently
+%   with MATLAB. They are applied in the order in which they are
+%   listed.
+%
+%   `CropSize`:: not specified
+%     If specified, crop the image before resizing it. The crop has
+%     the aspect ratio of the `Resize` target (a scalar SIZE is then
+%     interpreted as [SIZE SIZE]) or, without resizing, of the image,
+%     and it is the largest such window that fits in the image, scaled
+%     by a factor CROPSIZE in (0, 1]. Passing [MIN MAX] draws the
+%     factor uniformly at random in this interval for each image.
+%
+%   `CropAnisotropy`:: `1`
+%     Multiply the aspect ratio (width over height) of the crop by this
+%     factor. Passing [MIN MAX] draws it uniformly at random.
+%
+%   `CropLocation`:: `'center'`
+%     Either `'center'` or `'random'` to place the crop in the center
+%     of the image or uniformly at random. Specifying either of the
+%     crop options turns on cropping.
+%
+%   `Flip`:: not specified
+%     If specified, flip each image horizontally with probability 1/2.
+%
+%   `Brightness`:: `[]`
+%     A 3 x 3 matrix B. A colour offset B * RANDN(3,1) is added to all
+%     the pixels of each image, as in the "PCA colour augmentation" of
+%     AlexNet. A 3-vector or scalar specifies a diagonal matrix.
+%
+%   `Contrast`:: `0`
+%     Scale the difference between the pixels and the average colour
+%     of the image by a factor drawn uniformly in [1-CONTRAST,
+%     1+CONTRAST].
+%
+%   `Saturation`:: `0`
+%     Blend the colour of the pixels with their gray level, amplifying
+%     them by a factor drawn uniformly in [1-SATURATION,
+%     1+SATURATION].
+%
+%   `SubtractAverage`:: `[0 0 0]`
+%     Subtract this colour from all the pixels.
+%
+%   `DivideStd`:: `[1 1 1]`
+%     Then divide each colour channel by the corresponding element.
+%
+%   The colour transformations are combined into a single affine map
+%   of the pixel colours, so that they cost a single pass over the
+%   image. For grayscale images, the three components of the colour
+%   offset, average and standard deviation are averaged, except
+%   with `Pack`.
+%
+%   `Seed`:: drawn from RAND()
+%     The random choices for the image FILES{T} are made by a
+%     generator seeded with SEED + T - 1 or, if SEED is a vector, by
+%     SEED(T), so that they do not depend on the number of threads and
+%     are reproducible. If not specified, SEED is drawn from the MATLAB
+%     random number generator (see RNG()) when the images are
+%     requested (by the call with `Prefetch`, if any).
 
 % Copyright (C) 2014-16 Andrea Vedaldi.
 % All rights reserved.
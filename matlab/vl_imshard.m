@@ -0,0 +1,59 @@
+function refs = vl_imshard(shardFile, files)
+%VL_IMSHARD Pack JPEG images into a shard file.
+%   REFS = VL_IMSHARD(SHARDFILE, FILES) concatenates the JPEG files in
+%   the cell array FILES into the single file SHARDFILE. REFS is a
+%   cell array of the same size as FILES with the references
+%   'SHARDFILE#ID' to the packed images, which can be passed to
+%   VL_IMREADJPEG() in place of the file names.
+%
+%   Reading images from a shard avoids opening a file for each of
+%   them, which dominates the reading time for large collections of
+%   small images, particularly on network file systems. The shard is
+%   memory mapped by VL_IMREADJPEG() and the images are decoded
+%   directly from memory (this requires the LibJPEG reader).
+%
+%   The shard starts with the 8 characters 'VLIMSHRD', followed by the
+%   number N of images and by N+1 byte offsets from the beginning of
+%   the file, all stored as 64-bit little endian integers. The bytes
+%   of the image ID (one-based) go from offset ID to offset ID+1
+%   (excluded). The files are copied verbatim and are not checked to
+%   be valid JPEG images.
+%
+%   See also: VL_IMREADJPEG().
+
+% Copyright (C) 2016 Andrea Vedaldi.
+% All rights reserved.
+%
+% This file is part of the VLFeat library and is made available under
+% the terms of the BSD license (see the COPYING file).
+
+if ~iscellstr(files)
+  error('FILES is not a cell array of strings.') ;
+end
+
+n = numel(files) ;
+offsets = zeros(1, n + 1) ;
+offsets(1) = 16 + 8 * (n + 1) ;
+
+out = fopen(shardFile, 'w', 'l') ;
+if out < 0, error('Could not open ''%s'' for writing.', shardFile) ; end
+cleanup = onCleanup(@() fclose(out)) ;
+
+% the header is written first with null offsets and fixed at the end
+fwrite(out, 'VLIMSHRD', 'char') ;
+fwrite(out, [n offsets], 'uint64') ;
+for i = 1:n
+  in = fopen(files{i}, 'r') ;
+  if in < 0, error('Could not open ''%s''.', files{i}) ; end
+  bytes = fread(in, inf, '*uint8') ;
+  fclose(in) ;
+  fwrite(out, bytes, 'uint8') ;
+  offsets(i+1) = offsets(i) + numel(bytes) ;
+end
+fseek(out, 16, 'bof') ;
+fwrite(out, offsets, 'uint64') ;
+
+refs = cell(size(files)) ;
+for i = 1:n
+  refs{i} = sprintf('%s#%d', shardFile, i) ;
+end
@@ -40,6 +40,28 @@
 %       above. This is useful to disable batch normalization during
 %       testing.
 %
+%   `ReLU`:: not set
+%       Apply the rectified linear unit max(0, Y) to the output, or, in
+%       the backward mode, compute the derivatives of the composition
+%       of the two blocks. This is faster than calling VL_NNRELU() on
+%       the result, as the CPU code rectifies each block of the output
+%       while it is still in cache, and does not require storing the
+%       output of batch normalization for the backward pass.
+%
+%   `Mask`:: unspecified
+%       With `ReLU`, a UINT8 array MASK returned by the forward mode
+%       as [Y,MOMENTS,MASK] = VL_NNBNORM(X,G,B,'ReLU'). MASK stores one
+%       bit per element of Y, set where Y is positive (the bits of each
+%       feature channel start at a new byte), and costs 1/32 of the
+%       memory of Y in single precision. Passing it to the backward
+%       mode, as in VL_NNBNORM(X,G,B,DZDY,'ReLU','Mask',MASK), selects
+%       the derivatives DZDY that go through the ReLU. Without it, the
+%       backward mode recomputes the moments of X first to find the
+%       positive outputs, which costs an additional pass over the data.
+%
+%   On the GPU, `ReLU` is only supported in the forward mode without
+%   returning MASK.
+%
 %   See also: VL_NNNORMALIZE().
 
 % Copyright (C) 2015 Sébastien Ehrhardt, Karel Lenc and Andrea Vedaldi.
@@ -46,6 +46,25 @@
 %     sides respectively. Passing a single scalar applies the same
 %     padding to all borders.
 %
+%   `Dilate`:: 1
+%     The filter dilation factor. A dilated (atrous) filter reads the
+%     input at pixels DILATE apart, so that a FH x FW filter spans a
+%     (FH-1)*DILATEY+1 x (FW-1)*DILATEX+1 window with the same number
+%     of parameters. Passing [DILATEY DILATEX] allows specifying
+%     different factors for each direction. Dilated convolutions do not
+%     use cuDNN.
+%
+%   `Int8`:: not set
+%     Compute the convolution on 8-bit quantized data and filters
+%     (see INT8 INFERENCE below).
+%
+%   `ReLU`:: not set
+%     Apply the rectified linear unit max(0, Y) to the output. This is
+%     the same as calling VL_NNRELU() on the result, but it is faster
+%     as the CPU code adds the biases and rectifies each block of the
+%     output while it is still in cache. It is only available in the
+%     forward mode and requires non-empty FILTERS.
+%
 %   The filter size must be not larger than the padded image, i.e.
 %
 %     1 <= FH <= H + 2*(PADTOP+PADBOTTOM),
@@ -57,6 +76,92 @@
 %     YH = floor((H + (PADTOP+PADBOTTOM) - FH)/STRIDEY) + 1,
 %     YW = floor((W + (PADLEFT+PADRIGHT) - FW)/STRIDEX) + 1.
 %
+%   With dilation, FH and FW in these formulas are replaced by the
+%   size of the dilated window, (FH-1)*DILATEY+1 and (FW-1)*DILATEX+1.
+%
+%   ## CPU ALGORITHMS
+%
+%   On the CPU, convolutions are computed by stacking image patches
+%   (im2row) and calling BLAS. For 1x1 filters with unit stride and
+%   no padding, the patch stacking can be skipped (`direct1x1`). The
+%   `CpuConvAlgo` option selects the algorithm: `im2row` (default),
+%   `direct1x1` (falls back to `im2row` when not applicable), or
+%   `auto`. With `auto`, the first time a given combination of data
+%   and filter size, stride, padding and number of computational
+%   threads (see `maxNumCompThreads`) is seen, all the applicable
+%   algorithms are timed and the fastest one is used from then on.
+%   `CpuConvAlgoCache` specifies a text file where these choices are
+%   stored, so that they persist across MATLAB sessions. As for cuDNN,
+%   the choice sticks until MATLAB purges the MEX files.
+%
+%   In the backward pass, the patch derivatives are accumulated back
+%   into DZDX (row2im) in bands that fit in the cache, using up to
+%   `maxNumCompThreads` threads. The same applies to the forward pass
+%   of VL_NNCONVT(). To keep small calls cheap, the MEX files ask
+%   MATLAB for `maxNumCompThreads` at most once a second.
+%
+%   Grouped convolutions where each filter has at most four channels,
+%   including depthwise ones (FC = 1), are instead always computed on
+%   the CPU by a direct method, both forward and backward, which is
+%   much faster than running a small matrix product for each group.
+%
+%   When the same filters are applied over and over, as at inference
+%   time, setting `FilterCache` to `true` makes the CPU code keep a
+%   transformed copy of each filter bank in the Int8 and sparse modes
+%   (see below), saving quantizing or compacting the filters at every
+%   call (VL_BENCH_FILTERCACHE() measures the gain). The ordinary
+%   single precision convolution does not use the cache. Cached
+%   filters are identified by the memory address and size of F and B
+%   and by a hash of all their values, so that an array changed in any
+%   way, even in place, is transformed again. Passing a number larger
+%   than one instead of `true` sets the memory budget in bytes
+%   (default 256MB); `false` disables the cache and frees its memory.
+%
+%   ## HALF PRECISION
+%
+%   On the CPU, X, F, B and DZDY can also be UINT16 arrays containing
+%   IEEE half precision numbers (see VL_TOHALF()), and the results
+%   are then returned in the same format. This halves the memory used
+%   to store the data. The computations are carried out in single
+%   precision, so the results differ from the ones obtained in single
+%   precision only by the rounding of the inputs and outputs. The data
+%   is converted to single precision one image at a time, so that the
+%   temporary single precision copies are not larger than the buffers
+%   that the convolution of an image needs anyway.
+%
+%   ## INT8 INFERENCE
+%
+%   With the `Int8` option, the forward convolution of SINGLE CPU
+%   arrays is computed on 8-bit integers: each filter is quantized as
+%   FILTERSCALES(K) * round(F(:,:,:,K) / FILTERSCALES(K)) and X as
+%   INPUTSCALE * round(X / INPUTSCALE), both clamped to [-127, 127].
+%   The products are accumulated exactly in 32-bit integers, and the
+%   result is converted back to SINGLE, adding B and, with `ReLU`,
+%   rectifying. The output is therefore an approximation of the one
+%   in single precision, with a relative error around 1e-2.
+%
+%   `InputScale` (default 0) gives INPUTSCALE; 0 uses max(abs(X(:)))/127
+%   for each call. `FilterScales` (default max(abs(F(:,:,:,K)))/127) is
+%   a SINGLE vector with one scale per filter. Fixed scales obtained
+%   from a sample of data, for example by DagNN.calibrateInt8(), avoid
+%   the dynamic quantization pass and are more robust to outliers.
+%   The quantized filters are kept by the `FilterCache` if enabled.
+%   Int8 is only available in the forward mode.
+%
+%   ## SPARSE FILTERS
+%
+%   For fully connected layers (F as large as X and no padding,
+%   stride or dilation), F can also be a sparse DOUBLE matrix of size
+%   FH*FW*FC x K, with the K filters as columns, e.g. obtained by
+%   pruning the small weights of a dense filter bank (see
+%   DagNN.sparsifyConv()). The output is then computed by a sparse
+%   matrix product on the CPU, which reads the nonzero weights once
+%   for a group of columns of X and is faster than the dense product
+%   when most of the weights are zero. The computation is carried out
+%   in the class of X; with `FilterCache`, the weights are kept in
+%   this class with 32-bit indices, halving the memory they use.
+%   Sparse filters are only available in the forward mode.
+%
 %   ## CUDNN SUPPORT
 %
 %   If compiled in, the function will use cuDNN convolution routines
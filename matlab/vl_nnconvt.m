@@ -45,6 +45,23 @@
 %     then interpreted as containing K * NUMGROUPS different filters,
 %     each of depth FD / NUMGROUPS.
 %
+%   `Separable`:: not set
+%     Assert that each filter is separable, skipping the check
+%     described below. `NoSeparable` disables the specialized code
+%     instead.
+%
+%   ## Bilinear upsampling
+%
+%   A common use of this operator is to upsample each feature channel
+%   by bilinear interpolation, as in fully-convolutional networks. In
+%   this case NUMGROUPS is equal to the number of channels D, K = 1,
+%   and each filter F(:,:,1,d) is the outer product of two vectors
+%   (i.e. it is separable) of length at most twice the upsampling
+%   factor. The function detects such filters and computes the result
+%   with a specialized kernel whose cost is proportional to the number
+%   of output pixels, rather than running a matrix product for each
+%   image. The derivative DZDF is still computed by the general code.
+%
 %   ## About the convolution transpose operator
 %
 %   The convolution transpose operator is defined as follows. Let U =
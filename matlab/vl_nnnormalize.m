@@ -31,6 +31,11 @@
 %     PARAM_CAFFE = [N KAPPA N*ALPHA BETA]
 %
 %   i.e. the ALPHA paramter is multiplied by N.
+%
+%   On the CPU, the images (or, for small batches, bands of pixels) are
+%   processed in parallel using up to `maxNumCompThreads` threads, and
+%   the power L^(-BETA) is computed by a fast polynomial approximation
+%   with a relative error around 1e-3.
 
 % Copyright (C) 2014 Andrea Vedaldi.
 % All rights reserved.
@@ -45,6 +45,11 @@
 %   The derivative DZDY has the same dimension of the output Y and
 %   the derivative DZDX has the same dimension as the input X.
 %
+%   On the CPU, X and DZDY can also be UINT16 arrays containing IEEE
+%   half precision numbers (see VL_TOHALF()). Y and DZDX are then
+%   returned in the same format, and the averages and derivatives are
+%   accumulated in single precision.
+%
 %   ## CUDNN SUPPORT
 %
 %   If compiled in, the function will use cuDNN convolution routines
@@ -0,0 +1,57 @@
+function h = vl_tohalf(x)
+%VL_TOHALF Convert an array to half precision.
+%   H = VL_TOHALF(X) converts the SINGLE or DOUBLE array X to IEEE
+%   half precision, rounding to the nearest value (ties to even).
+%   MATLAB has no half precision type, so H is an UINT16 array with
+%   the same size as X containing the bit patterns of the half
+%   precision numbers. Values too large are converted to infinity and
+%   values too small to zero.
+%
+%   UINT16 arrays in this format can be passed to the CPU versions of
+%   VL_NNCONV(), VL_NNCONVT(), VL_NNPOOL() and the ROI pooling block
+%   DAGNN.ROIPOOLING, which then store the data in half precision and
+%   accumulate in single precision. Pooling has half precision
+%   kernels. VL_NNCONV() and VL_NNCONVT() have none, and convert the
+%   data to single precision one image at a time, so that the
+%   temporary copies are no larger than their im2row buffers. The
+%   exceptions are the fully connected and the filterless (bias only)
+%   cases of VL_NNCONV(), which convert whole arrays: while these run,
+%   the memory used is higher than in single precision.
+%
+%   See also: VL_FROMHALF().
+
+% Copyright (C) 2016 Andrea Vedaldi.
+% All rights reserved.
+%
+% This file is part of the VLFeat library and is made available under
+% the terms of the BSD license (see the COPYING file).
+
+x = double(single(x)) ;
+a = abs(x) ;
+h = zeros(size(x)) ;
+
+% normal numbers: a = (1 + m/1024) 2^e
+[f,e] = log2(a) ;
+e = e - 1 ;
+normal = (a >= 2^-14) & isfinite(a) ;
+m = roundeven((2*f(normal) - 1) * 1024) ;
+h(normal) = (e(normal) + 15) * 1024 + m ; % rounding up may carry into e
+h(normal) = min(h(normal), 31 * 1024) ;   % overflow to infinity
+
+% subnormal numbers: a = m 2^-24
+subnormal = (a < 2^-14) ;
+h(subnormal) = roundeven(a(subnormal) * 2^24) ;
+
+h(isinf(a)) = 31 * 1024 ;
+h(isnan(a)) = 31 * 1024 + 512 ;
+
+negative = (x < 0) | (x == 0 & 1./x < 0) ;
+h(negative) = h(negative) + 32768 ;
+h = uint16(h) ;
+
+% --------------------------------------------------------------------
+function y = roundeven(x)
+% --------------------------------------------------------------------
+y = round(x) ;
+tie = (abs(x - fix(x)) == 0.5) ;
+y(tie) = 2 * round(x(tie) / 2) ;
@@ -0,0 +1,53 @@
+classdef cpuisa < nntest
+  % Compares the CPU kernels compiled for the different instruction
+  % sets, which are selected by the MATCONVNET_CPU_ISA environment
+  % variable when the MEX files are loaded.
+  properties (TestParameter)
+    cpuIsa = {'ssse3', 'avx2', 'avx512'}
+  end
+
+  methods (Test)
+    function compare_to_base(test, cpuIsa)
+      if ~strcmp(test.currentDevice, 'cpu'), return ; end
+      x = test.randn(15,14,16,4) ;
+      w = test.randn(3,3,16,8) / 100 ;
+      g = test.rand(16,1) ;
+      b = test.randn(16,1) ;
+      dzdx = test.randn(15,14,16,4) ;
+      dzdp = test.randn(7,7,16,4) ;
+      dzdy = test.randn(15,14,8,4) ;
+      y = cpuisa.run('base', x, w, g, b, dzdx, dzdp, dzdy) ;
+      y_ = cpuisa.run(cpuIsa, x, w, g, b, dzdx, dzdp, dzdy) ;
+      for i = 1:numel(y)
+        test.eq(y{i}, y_{i}) ;
+      end
+    end
+  end
+
+  methods (Static)
+    function y = run(cpuIsa, x, w, g, b, dzdx, dzdp, dzdy)
+      mexFiles = {'vl_nnnormalize', 'vl_nnpool', 'vl_nnbnorm', 'vl_nnconv'} ;
+      prev = getenv('MATCONVNET_CPU_ISA') ;
+      setenv('MATCONVNET_CPU_ISA', cpuIsa) ;
+      clear(mexFiles{:}) ;
+      cleanup = onCleanup(@() cpuisa.restore(prev, mexFiles)) ;
+      param = [5, 1, 1e-4, .75] ;
+      y = {...
+        vl_nnnormalize(x, param), ...
+        vl_nnnormalize(x, param, dzdx), ...
+        vl_nnpool(x, 2, 'stride', 2, 'method', 'max'), ...
+        vl_nnpool(x, 2, dzdp, 'stride', 2, 'method', 'max'), ...
+        vl_nnpool(x, 2, 'stride', 2, 'method', 'avg'), ...
+        vl_nnpool(x, 2, dzdp, 'stride', 2, 'method', 'avg'), ...
+        vl_nnbnorm(x, g, b), ...
+        vl_nnconv(x, w, [], 'pad', 1, 'cpuconvalgo', 'im2row'), ...
+        vl_nnconv(x, w, [], dzdy, 'pad', 1, 'cpuconvalgo', 'im2row')} ;
+      [y{end+1}, y{end+2}, y{end+3}] = vl_nnbnorm(x, g, b, dzdx) ;
+    end
+
+    function restore(prev, mexFiles)
+      setenv('MATCONVNET_CPU_ISA', prev) ;
+      clear(mexFiles{:}) ;
+    end
+  end
+end
@@ -25,5 +25,61 @@ classdef nnbnorm < nntest
       test.der(@(g) vl_nnbnorm(x,g,b), g, dzdy, dzdg, test.range * 1e-2, -1e-3) ;
       test.der(@(b) vl_nnbnorm(x,g,b), b, dzdy, dzdb, test.range * 1e-2, -1e-3) ;
     end
+
+    function givenMoments(test)
+      x = test.randn(13, 17, 4, 7) ;
+      g = test.randn(4, 1) ;
+      b = test.randn(4, 1) ;
+      [y,m] = vl_nnbnorm(x,g,b) ;
+      test.eq(y, vl_nnbnorm(x,g,b,'moments',m)) ;
+      dzdy = test.randn(size(y)) ;
+      [dzdx,dzdg,dzdb] = vl_nnbnorm(x,g,b,dzdy) ;
+      [dzdx_,dzdg_,dzdb_] = vl_nnbnorm(x,g,b,dzdy,'moments',m) ;
+      test.eq(dzdx, dzdx_) ;
+      test.eq(dzdg, dzdg_) ;
+      test.eq(dzdb, dzdb_) ;
+    end
+
+    function largeMean(test)
+      % the variance must not be lost to cancellation when the mean is
+      % much larger than the standard deviation (CPU code only)
+      if ~strcmp(test.currentDevice,'cpu'), return ; end
+      x = test.randn(13, 17, 4, 7) / test.range + 1000 ;
+      g = test.randn(4, 1) ;
+      b = test.randn(4, 1) ;
+      [~,m] = vl_nnbnorm(x,g,b,'epsilon',1e-4) ;
+      x_ = reshape(permute(gather(double(x)), [1 2 4 3]), [], 4) ;
+      sigma = sqrt(var(x_,1,1)' + 1e-4) ;
+      test.eq(m(:,2), cast(sigma, 'like', gather(m))) ;
+    end
+
+    function relu(test)
+      x = test.randn(13, 17, 4, 7) ;
+      g = test.randn(4, 1) ;
+      b = test.randn(4, 1) ;
+      [y,m] = vl_nnbnorm(x,g,b) ;
+      test.eq(max(y,0), vl_nnbnorm(x,g,b,'relu')) ;
+      test.eq(max(y,0), vl_nnbnorm(x,g,b,'moments',m,'relu')) ;
+      % the ReLU derivatives and the mask are only supported on the CPU
+      if ~strcmp(test.currentDevice,'cpu'), return ; end
+      [y_,~,mask] = vl_nnbnorm(x,g,b,'relu') ;
+      test.verifyClass(mask, 'uint8') ;
+      test.verifyEqual(numel(mask), 4 * ceil(13*17*7/8)) ;
+      dzdy = test.randn(size(y)) ;
+      [dzdx,dzdg,dzdb] = vl_nnbnorm(x,g,b,dzdy .* (y > 0)) ;
+      [dzdx_,dzdg_,dzdb_] = vl_nnbnorm(x,g,b,dzdy,'relu') ;
+      test.eq(dzdx, dzdx_) ;
+      test.eq(dzdg, dzdg_) ;
+      test.eq(dzdb, dzdb_) ;
+      [dzdx_,dzdg_,dzdb_] = vl_nnbnorm(x,g,b,dzdy,'relu','mask',mask) ;
+      test.eq(dzdx, dzdx_) ;
+      test.eq(dzdg, dzdg_) ;
+      test.eq(dzdb, dzdb_) ;
+      [dzdx_,dzdg_,dzdb_] = vl_nnbnorm(x,g,b,dzdy,'moments',m,'relu','mask',mask) ;
+      test.eq(dzdx, dzdx_) ;
+      test.eq(dzdg, dzdg_) ;
+      test.eq(dzdb, dzdb_) ;
+      test.der(@(x) vl_nnbnorm(x,g,b,'relu'), x, dzdy, dzdx_, test.range * 1e-2, -1e-3) ;
+    end
   end
 end
\ No newline at end of file
@@ -127,6 +127,46 @@ classdef nnconv < nntest
       test.der(@(w) vl_nnconv(x,w,[]), w, dzdy, dzdw, test.range * 1e-2) ;
     end
 
+    function depthwise(test,fh,fw,stride)
+      if fh == 0 | fw == 0, return ; end
+      n = 3 ;
+      x = test.randn(13,9,4,n) ;
+      w = test.randn(fh,fw,1,8) ;
+      b = test.randn(1,8) ;
+      w_ = test.zeros(fh,fw,4,8) ;
+      for k = 1:8
+        w_(:,:,ceil(k/2),k) = w(:,:,1,k) ;
+      end
+      opts = {'stride', stride, 'pad', [1 0 2 1]} ;
+      y = vl_nnconv(x,w,b,opts{:}) ;
+      y_ = vl_nnconv(x,w_,b,opts{:}) ;
+      test.eq(y,y_) ;
+      dzdy = test.randn(size(y)) ;
+      [dzdx,dzdw,dzdb] = vl_nnconv(x,w,b,dzdy,opts{:}) ;
+      test.der(@(x) vl_nnconv(x,w,b,opts{:}), x, dzdy, dzdx, test.range * 1e-2) ;
+      test.der(@(w) vl_nnconv(x,w,b,opts{:}), w, dzdy, dzdw, test.range * 1e-2) ;
+      test.der(@(b) vl_nnconv(x,w,b,opts{:}), b, dzdy, dzdb, test.range * 1e-2) ;
+    end
+
+    function dilate(test,stridex,stridey)
+      x = test.randn(16,15,4,2) ;
+      w = test.randn(3,2,4,5) ;
+      b = test.randn(1,5) ;
+      dilate = [2 3] ;
+      w_ = test.zeros(5,4,4,5) ;
+      w_(1:2:end,1:3:end,:,:) = w ;
+      opts = {'stride', [stridey stridex], 'pad', [2 1 0 3]} ;
+      y = vl_nnconv(x,w,b,opts{:},'dilate',dilate) ;
+      y_ = vl_nnconv(x,w_,b,opts{:}) ;
+      test.eq(y,y_) ;
+      dzdy = test.randn(size(y)) ;
+      [dzdx,dzdw,dzdb] = vl_nnconv(x,w,b,dzdy,opts{:},'dilate',dilate) ;
+      [dzdx_,dzdw_,dzdb_] = vl_nnconv(x,w_,b,dzdy,opts{:}) ;
+      test.eq(dzdx,dzdx_) ;
+      test.eq(dzdw,dzdw_(1:2:end,1:3:end,:,:)) ;
+      test.eq(dzdb,dzdb_) ;
+    end
+
     function test_gpu_correctnes(test)
       if ~strcmp(test.currentDevice, 'gpu'), return ; end
       opts = {...
@@ -167,5 +207,143 @@ classdef nnconv < nntest
         end
       end
     end
+
+    function test_cpu_conv_algo(test)
+      if ~strcmp(test.currentDevice, 'cpu'), return ; end
+      opts = {...
+        {'pad', [0 0 0 0], 'stride', [1 1]}, ...
+        {'pad', [1 1 2 2], 'stride', [2 1]}} ;
+      cache = [tempname '.txt'] ;
+      x = test.randn(15,12,8,3) ;
+      b = test.randn(1,6) ;
+      for fs = [1 3]
+        w = test.randn(fs,fs,4,6) ;
+        for o = 1:numel(opts)
+          y = vl_nnconv(x,w,b,opts{o}{:},'cpuconvalgo','im2row') ;
+          y_ = vl_nnconv(x,w,b,opts{o}{:},'cpuconvalgo','direct1x1') ;
+          test.eq(y, y_) ;
+          y_ = vl_nnconv(x,w,b,opts{o}{:},'cpuconvalgo','auto', ...
+                         'cpuconvalgocache',cache) ;
+          test.eq(y, y_) ;
+          y_ = vl_nnconv(x,w,b,opts{o}{:},'cpuconvalgo','auto', ...
+                         'cpuconvalgocache',cache) ;
+          test.eq(y, y_) ;
+        end
+      end
+      vl_nnconv(x,w,b,'cpuconvalgo','im2row') ;
+      delete(cache) ;
+    end
+
+    function test_filter_cache(test)
+      if ~strcmp(test.currentDevice, 'cpu') || ...
+          ~strcmp(test.currentDataType, 'single'), return ; end
+      x = test.randn(15,12,8,3) ;
+      w = test.randn(3,2,4,6) ;
+      b = test.randn(1,6) ;
+      opts = {'pad', [1 0 2 1], 'stride', [2 1], 'int8'} ;
+      y = vl_nnconv(x,w,b,opts{:}) ;
+      y_ = vl_nnconv(x,w,b,opts{:},'filtercache',true) ;
+      test.eq(y, y_) ;
+      y_ = vl_nnconv(x,w,b,opts{:}) ;
+      test.eq(y, y_) ;
+      w = 2 * w ;
+      b = 2 * b ;
+      y_ = vl_nnconv(x,w,b,opts{:}) ;
+      test.eq(2 * y, y_) ;
+      % edit a single weight of a single filter in place
+      y0 = y_ ;
+      w(2,1,3,5) = w(2,1,3,5) + 1 ;
+      y_ = vl_nnconv(x,w,b,opts{:}) ;
+      test.verifyTrue(any(y_(:) ~= y0(:))) ;
+      vl_nnconv(x,w,b,'filtercache',false) ;
+      y = vl_nnconv(x,w,b,opts{:}) ;
+      test.eq(y, y_) ;
+    end
+
+    function test_relu(test)
+      x = test.randn(15,12,8,3) ;
+      w = test.randn(3,2,4,6) ;
+      b = test.randn(1,6) ;
+      opts = {'pad', [1 0 2 1], 'stride', [2 1]} ;
+      y = vl_nnconv(x,w,b,opts{:}) ;
+      y_ = vl_nnconv(x,w,b,opts{:},'relu') ;
+      test.eq(max(y,0), y_) ;
+      w = test.randn(15,12,8,5) ;
+      b = test.randn(1,5) ;
+      y = vl_nnconv(x,w,b) ;
+      y_ = vl_nnconv(x,w,b,'relu') ;
+      test.eq(max(y,0), y_) ;
+    end
+
+    function test_half(test)
+      if ~strcmp(test.currentDevice, 'cpu'), return ; end
+      % round the data to half precision first, so that the only
+      % difference is in the rounding of the results
+      x = vl_fromhalf(vl_tohalf(test.randn(15,12,8,3))) ;
+      % convolution, fully connected (filters as large as the input)
+      % and subsampling (empty filters)
+      cases = {{test.randn(3,2,4,6) / 100, test.randn(1,6), ...
+                {'pad', [1 0 2 1], 'stride', [2 1]}}, ...
+               {test.randn(15,12,8,5) / 100, test.randn(1,5), {}}, ...
+               {[], test.randn(1,8), {'stride', [2 3]}}} ;
+      for i = 1:numel(cases)
+        w = vl_fromhalf(vl_tohalf(cases{i}{1})) ;
+        b = vl_fromhalf(vl_tohalf(cases{i}{2})) ;
+        opts = cases{i}{3} ;
+        y = vl_nnconv(x,w,b,opts{:}) ;
+        y_ = vl_nnconv(vl_tohalf(x),vl_tohalf(w),vl_tohalf(b),opts{:}) ;
+        test.verifyClass(y_, 'uint16') ;
+        test.eq(y, vl_fromhalf(y_)) ;
+        dzdy = vl_fromhalf(vl_tohalf(test.randn(size(y)))) ;
+        [dzdx,dzdw,dzdb] = vl_nnconv(x,w,b,dzdy,opts{:}) ;
+        [dzdx_,dzdw_,dzdb_] = vl_nnconv(vl_tohalf(x),vl_tohalf(w),vl_tohalf(b),...
+                                        vl_tohalf(dzdy),opts{:}) ;
+        test.eq(dzdx, vl_fromhalf(dzdx_)) ;
+        test.eq(dzdw, vl_fromhalf(dzdw_)) ;
+        test.eq(dzdb, vl_fromhalf(dzdb_)) ;
+      end
+    end
+
+    function test_int8(test)
+      if ~strcmp(test.currentDevice, 'cpu') || ...
+          ~strcmp(test.currentDataType, 'single'), return ; end
+      x = test.randn(15,12,8,3) ;
+      w = test.randn(3,2,4,19) ;
+      b = test.randn(1,19) ;
+      opts = {'pad', [1 0 2 1], 'stride', [2 1]} ;
+      y = vl_nnconv(x,w,b,opts{:}) ;
+      y_ = vl_nnconv(x,w,b,opts{:},'int8') ;
+      test.eq(y, y_) ;
+      % fixed scales, fused ReLU
+      s = single(squeeze(max(max(max(abs(w),[],1),[],2),[],3)) / 127) ;
+      y_ = vl_nnconv(x,w,b,opts{:},'int8','relu',...
+                     'inputscale',max(abs(x(:)))/127,'filterscales',s) ;
+      test.eq(max(y,0), y_) ;
+      % fully connected
+      w = test.randn(15,12,8,5) ;
+      b = test.randn(1,5) ;
+      y = vl_nnconv(x,w,b) ;
+      y_ = vl_nnconv(x,w,b,'int8') ;
+      test.eq(y, y_) ;
+    end
+
+    function test_sparse(test)
+      if ~strcmp(test.currentDevice, 'cpu'), return ; end
+      x = test.randn(6,5,8,40) ;
+      w = test.randn(6,5,8,7) ;
+      w(abs(w) < 0.1) = 0 ;
+      b = test.randn(1,7) ;
+      ws = sparse(double(reshape(w,[],7))) ;
+      y = vl_nnconv(x,w,b) ;
+      test.eq(y, vl_nnconv(x,ws,b)) ;
+      test.eq(max(y,0), vl_nnconv(x,ws,b,'relu')) ;
+      test.eq(vl_nnconv(x,w,[]), vl_nnconv(x,ws,[])) ;
+      test.eq(y(:,:,:,1), vl_nnconv(x(:,:,:,1),ws,b)) ;
+      y_ = vl_nnconv(x,ws,b,'filtercache',true) ;
+      test.eq(y, y_) ;
+      y_ = vl_nnconv(x,2*ws,2*b) ;
+      test.eq(2 * y, y_) ;
+      vl_nnconv(x,w,b,'filtercache',false) ;
+    end
   end
 end
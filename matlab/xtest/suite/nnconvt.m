@@ -82,6 +82,30 @@ classdef nnconvt < nntest
       test.der(@(b) vl_nnconvt(x,f,b,opts{:}), b, dzdy, dzdb, test.range * 1e-1) ;
     end
 
+    function separable_upsampling(test,upx,upy)
+      % bilinear interpolation filters, one per channel
+      m = 3 ; n = 2 ;
+      fsy = 2*upy - mod(upy,2) ;
+      fsx = 2*upx - mod(upx,2) ;
+      fy = 1 - abs((1:fsy) - (fsy+1)/2) / upy ;
+      fx = 1 - abs((1:fsx) - (fsx+1)/2) / upx ;
+      f = test.toDevice(test.toDataType(bsxfun(@times, fy' * fx, reshape(1:m,1,1,1,m)))) ;
+      b = test.randn(1,m) ;
+      opts = {'upsample',[upy upx],'crop',[floor(upy/2) floor(upy/2) floor(upx/2) floor(upx/2)],'numgroups',m} ;
+      x = test.randn(5,6,m,n) ;
+      y = vl_nnconvt(x,f,b,opts{:}) ;
+      y_ = vl_nnconvt(x,f,b,opts{:},'noseparable') ;
+      test.eq(y,y_) ;
+      test.eq(y,vl_nnconvt(x,f,b,opts{:},'separable')) ;
+      dzdy = test.randn(size(y)) ;
+      [dzdx,dzdf,dzdb] = vl_nnconvt(x,f,b,dzdy,opts{:}) ;
+      [dzdx_,dzdf_,dzdb_] = vl_nnconvt(x,f,b,dzdy,opts{:},'noseparable') ;
+      test.eq(dzdx,dzdx_) ;
+      test.eq(dzdf,dzdf_) ;
+      test.eq(dzdb,dzdb_) ;
+      test.der(@(x) vl_nnconvt(x,f,b,opts{:}), x, dzdy, dzdx, test.range * 1e-2) ;
+    end
+
     function test_gpu_correctnes(test)
       if ~strcmp(test.currentDevice, 'gpu'), return ; end
       opts = {...
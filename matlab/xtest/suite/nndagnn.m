@@ -110,6 +110,107 @@ classdef nndagnn < nntest
       end
       test.net.vars(outputIdx).precious = false;
     end
+
+    function fusedConvReLU(test)
+      % Verify that fusing conv and ReLU in test mode does not
+      % change the result
+      v = test.net.getVarIndex('x7') ;
+      test.net.vars(v).precious = true;
+      test.net.conserveMemory = true;
+      test.forward();
+      y = test.net.vars(v).value ;
+      test.net.mode = 'test' ;
+      test.forward();
+      test.eq(y, test.net.vars(v).value) ;
+      test.net.mode = 'normal' ;
+      test.net.vars(v).precious = false;
+    end
+
+    function factorizeConv(test)
+      % Verify that a full rank factorization of a layer followed by a
+      % ReLU does not change the result, in both modes
+      net = dagnn.DagNN.loadobj(test.net.saveobj()) ;
+      net.move(test.currentDevice) ;
+      v = net.getVarIndex('x7') ;
+      net.vars(v).precious = true ;
+      net.eval({'x0', test.x, 'label', test.class}) ;
+      y = net.vars(v).value ;
+      energy = net.factorizeConv('layer5', 500) ;
+      test.verifyEqual(energy, 1, 'AbsTol', 1e-6) ;
+      test.verifyTrue(isnan(net.getLayerIndex('layer5'))) ;
+      v = net.getVarIndex('x7') ;
+      net.vars(v).precious = true ;
+      for mode = {'normal', 'test'}
+        net.mode = char(mode) ;
+        net.eval({'x0', test.x, 'label', test.class}) ;
+        test.eq(y, net.vars(v).value) ;
+      end
+      % a lower rank keeps less energy
+      energy = net.factorizeConv('layer7', 5) ;
+      test.verifyLessThan(energy, 1) ;
+    end
+
+    function foldBatchNorm(test)
+      % Verify that folding batch normalization into the preceding
+      % convolutions does not change the result in test mode, with and
+      % without convolution biases
+      net = dagnn.DagNN.loadobj(test.net.saveobj()) ;
+      net.move(test.currentDevice) ;
+      net.layers(net.getLayerIndex('layer1')).block.hasBias = false ;
+      for l = [1 3]
+        n = size(net.params(net.layers(l).paramIndexes(1)).value, 4) ;
+        x = sprintf('x%d', l) ;
+        bn = sprintf('bn%d', l) ;
+        net.addLayer(bn, dagnn.BatchNorm('numChannels', n), {x}, {[bn 'x']}, ...
+                     {[bn 'g'], [bn 'b'], [bn 'm']}) ;
+        net.setLayerInputs(sprintf('layer%d', l+1), {[bn 'x']}) ;
+        net.params(net.getParamIndex([bn 'g'])).value = test.randn(n,1) ;
+        net.params(net.getParamIndex([bn 'b'])).value = test.randn(n,1) ;
+        net.params(net.getParamIndex([bn 'm'])).value = ...
+          [test.randn(n,1), test.range + test.rand(n,1)] ;
+      end
+      net.mode = 'test' ;
+      v = net.getVarIndex('x7') ;
+      net.vars(v).precious = true ;
+      net.eval({'x0', test.x, 'label', test.class}) ;
+      y = net.vars(v).value ;
+      folded = net.foldBatchNorm() ;
+      test.verifyEqual(sort(folded), {'bn1', 'bn3'}) ;
+      test.verifyFalse(any(arrayfun(@(l) isa(l.block, 'dagnn.BatchNorm'), net.layers))) ;
+      v = net.getVarIndex('x7') ;
+      net.vars(v).precious = true ;
+      net.eval({'x0', test.x, 'label', test.class}) ;
+      test.eq(y, net.vars(v).value) ;
+    end
+
+    function fuseBatchNormReLU(test)
+      % Verify that merging a ReLU into the preceding batch
+      % normalization does not change the result and the derivatives
+      net = dagnn.DagNN.loadobj(test.net.saveobj()) ;
+      net.move(test.currentDevice) ;
+      net.addLayer('bn5', dagnn.BatchNorm('numChannels', 500), {'x5'}, {'bn5x'}, ...
+                   {'bn5g', 'bn5b', 'bn5m'}) ;
+      net.setLayerInputs('layer6', {'bn5x'}) ;
+      net.params(net.getParamIndex('bn5g')).value = test.randn(500,1) ;
+      net.params(net.getParamIndex('bn5b')).value = test.randn(500,1) ;
+      net.params(net.getParamIndex('bn5m')).value = test.zeros(500,2) ;
+      v = net.getVarIndex('x6') ;
+      net.vars(v).precious = true ;
+      net.eval({'x0', test.x, 'label', test.class}, {'x8', 1}) ;
+      y = net.vars(v).value ;
+      ders = {net.params.der} ;
+      fused = net.fuseBatchNormReLU() ;
+      test.verifyEqual(fused, {'layer6'}) ;
+      test.verifyTrue(net.layers(net.getLayerIndex('bn5')).block.relu) ;
+      test.verifyEqual(net.layers(net.getLayerIndex('bn5')).outputs, {'x6'}) ;
+      v = net.getVarIndex('x6') ;
+      net.vars(v).precious = true ;
+      net.eval({'x0', test.x, 'label', test.class}, {'x8', 1}) ;
+      test.eq(y, net.vars(v).value) ;
+      for p = 1:numel(ders)
+        test.eq(ders{p}, net.params(p).der) ;
+      end
+    end
   end
 
   methods
@@ -110,5 +110,19 @@ classdef nnpool < nntest
       test.der(@(x) vl_nnpool(x,pool,args{:}), ...
                x, dzdy, dzdx, test.range * 1e-2) ;
     end
+
+    function half(test, type)
+      if ~strcmp(test.currentDevice, 'cpu'), return ; end
+      x = vl_fromhalf(vl_tohalf(test.x)) ;
+      args = {'stride',[2 1],'pad',[1 0 2 1],'method',type} ;
+      y = vl_nnpool(x,[3 4],args{:}) ;
+      y_ = vl_nnpool(vl_tohalf(x),[3 4],args{:}) ;
+      test.verifyClass(y_, 'uint16') ;
+      test.eq(y, vl_fromhalf(y_)) ;
+      dzdy = vl_fromhalf(vl_tohalf(test.randn(size(y)))) ;
+      dzdx = vl_nnpool(x,[3 4],dzdy,args{:}) ;
+      dzdx_ = vl_nnpool(vl_tohalf(x),[3 4],vl_tohalf(dzdy),args{:}) ;
+      test.eq(dzdx, vl_fromhalf(dzdx_)) ;
+    end
   end
 end
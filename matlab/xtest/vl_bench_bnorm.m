@@ -51,4 +51,32 @@ function vl_bench_bnorm(gpu)
   vl_testsim(a,a_);
   vl_testsim(b,b_);
   vl_testsim(c,c_);
+
+  if gpu, return ; end
+
+  % the CPU code splits the channels among maxNumCompThreads threads
+  n = maxNumCompThreads ;
+  for numThreads = unique([1 n])
+    maxNumCompThreads(numThreads) ;
+    clear vl_nnbnorm ; % the MEX file reads maxNumCompThreads once a second
+    tic
+    for t=1:T
+      y = vl_nnbnorm(x,g,b) ;
+    end
+    fprintf('new, %d threads: %f\n', numThreads, toc);
+    tic
+    for t=1:T
+      [dx,dg,db] = vl_nnbnorm(x,g,b,dzdy) ;
+    end
+    fprintf('new deriv, %d threads: %f\n', numThreads, toc);
+  end
+  maxNumCompThreads(n) ;
+
+  % the moments are computed in a single pass, but without the
+  % cancellation of E[x^2] - E[x]^2 when the mean is large
+  x = x + 1000 ;
+  [~,m] = vl_nnbnorm(x,g,b) ;
+  [~,m_] = vl_nnbnorm(double(x),double(g),double(b)) ;
+  fprintf('relative error of sigma with mean 1000: %g\n', ...
+          max(abs(m(:,2) - m_(:,2)) ./ m_(:,2))) ;
 end
@@ -0,0 +1,51 @@
+function vl_bench_filtercache()
+% VL_BENCH_FILTERCACHE  Evaluates the speed of the CPU filter cache
+%   With the `FilterCache` option, the CPU code keeps the quantized
+%   filters of the `Int8` mode and the compacted weights of the
+%   sparse mode, instead of recomputing them at every call. This
+%   compares the two on a few layer shapes.
+
+  T = 20 ;
+  layers = {...
+    {[56 56 64 1], [3 3 64 64]}, ...
+    {[28 28 128 8], [3 3 128 128]}, ...
+    {[14 14 256 8], [3 3 256 256]}, ...
+    {[7 7 512 8], [3 3 512 512]}, ...
+    {[7 7 512 8], [7 7 512 4096]}} ;
+
+  for l = 1:numel(layers)
+    x = randn(layers{l}{1},'single') ;
+    w = randn(layers{l}{2},'single') ;
+    b = randn(1,size(w,4),'single') ;
+    if size(w,1) == size(x,1), pad = 0 ; else pad = floor(size(w,1)/2) ; end
+    time = run(T, x, w, b, 'pad', pad, 'int8') ;
+    report('int8', x, w, time) ;
+  end
+
+  x = randn(6,6,256,128,'single') ;
+  w = randn(6,6,256,4096,'single') ;
+  w(abs(w) < 1.5) = 0 ;
+  b = randn(1,size(w,4),'single') ;
+  ws = sparse(double(reshape(w,[],size(w,4)))) ;
+  time = run(T, x, ws, b) ;
+  report('sparse', x, w, time) ;
+end
+
+function time = run(T, x, w, b, varargin)
+  time = zeros(1,2) ;
+  for cache = [false true]
+    vl_nnconv(x,w,b,varargin{:},'filtercache',cache) ;
+    tic
+    for t=1:T
+      y = vl_nnconv(x,w,b,varargin{:}) ;
+    end
+    time(cache+1) = toc / T ;
+  end
+  vl_nnconv(x,w,b,varargin{:},'filtercache',false) ;
+end
+
+function report(mode, x, w, time)
+  fprintf('%s x %s w %s: uncached %.2f ms, cached %.2f ms (%.2fx)\n', ...
+          mode, mat2str(size(x)), mat2str(size(w)), ...
+          time(1) * 1e3, time(2) * 1e3, time(1) / time(2)) ;
+end
@@ -0,0 +1,28 @@
+function vl_bench_im2row()
+% VL_BENCH_IM2ROW  Evaluates the speed of the CPU im2row variants
+%   The CPU convolution stacks image patches (im2row) before calling
+%   BLAS. Square windows of size 1, 3, 5 and 7 with stride 1 or 2 use
+%   specialized code; the other sizes are shown for comparison. A
+%   single filter is used so that the time is dominated by im2row.
+
+  T = 20 ;
+  x = randn(56,56,64,4,'single') ;
+  opts = {'cpuconvalgo', 'im2row'} ;
+
+  for stride = [1 2]
+    for k = 1:7
+      w = randn(k,k,64,1,'single') ;
+      pad = floor(k/2) ;
+      y = vl_nnconv(x,w,[],'stride',stride,'pad',pad,opts{:}) ;
+      tic
+      for t=1:T
+        y = vl_nnconv(x,w,[],'stride',stride,'pad',pad,opts{:}) ;
+      end
+      time = toc / T ;
+      patchBytes = 4 * numel(w) * size(y,1) * size(y,2) * size(x,4) ;
+      if mod(k,2) == 1, variant = 'fixed' ; else, variant = 'generic' ; end
+      fprintf('window %dx%d stride %d (%s): %.2f ms, %.2f GB/s of patches\n', ...
+              k, k, stride, variant, time * 1e3, patchBytes / time / 1e9) ;
+    end
+  end
+end
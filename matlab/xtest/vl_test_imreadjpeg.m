@@ -35,3 +35,79 @@ for n = 1:4
   ims___ = vl_imreadjpeg(files, 'numThreads', n) ;
   assert(isequal(ims,ims___)) ;
 end
+
+% Test reading from a shard
+shard = [tempname '.shard'] ;
+refs = vl_imshard(shard, files) ;
+ims____ = vl_imreadjpeg(refs, 'numThreads', 2) ;
+assert(isequal(ims,ims____)) ;
+ims____ = vl_imreadjpeg([refs(2:end) files(1)], 'resize', [64 48]) ;
+assert(isequal(size(ims____{1}), [64 48 3])) ;
+clear mex ;
+delete(shard) ;
+
+% Test data augmentation
+aug = {'resize', [64 48], 'cropSize', [.5 1], 'cropAnisotropy', [.8 1.25], ...
+       'cropLocation', 'random', 'flip', 'brightness', 10*eye(3), ...
+       'contrast', .3, 'saturation', .3, 'subtractAverage', [120 115 100], ...
+       'seed', 1} ;
+ims_ = vl_imreadjpeg(files, aug{:}) ;
+vl_imreadjpeg(files, aug{:}, 'prefetch', 'numThreads', 3) ;
+ims__ = vl_imreadjpeg(files, aug{:}) ;
+assert(isequal(ims_, ims__)) ;
+assert(isequal(size(ims_{1}), [64 48 3])) ;
+ims_ = vl_imreadjpeg(files, 'subtractAverage', [120 115 100], 'divideStd', 2) ;
+ims__ = vl_imreadjpeg(files, 'flip', 'seed', 1:6) ;
+for t=1:6
+  assert(max(abs(ims_{t}(:) - ...
+    reshape(bsxfun(@minus, ims{t}, reshape([120 115 100],1,1,3))/2, [], 1))) < 1e-4) ;
+  assert(isequal(ims__{t}, ims{t}) || isequal(ims__{t}, fliplr(ims{t}))) ;
+end
+
+% Test packing the images in a single array
+ims_ = vl_imreadjpeg(files, aug{:}) ;
+vl_imreadjpeg(files, aug{:}, 'pack', 'prefetch') ;
+ims__ = vl_imreadjpeg(files, aug{:}, 'pack') ;
+assert(isequal(size(ims__), [64 48 3 6])) ;
+assert(isequal(cat(4, ims_{:}), ims__)) ;
+ims__ = vl_imreadjpeg(files_, 'resize', [64 48], 'pack') ;
+assert(all(all(all(ims__(:,:,:,3) == 0)))) ;
+
+% Test returning UINT8 images
+ims_ = vl_imreadjpeg(files, 'uint8') ;
+assert(isa(ims_{1}, 'uint8')) ;
+assert(isequal(ims_, cellfun(@uint8, ims, 'uniformoutput', false))) ;
+vl_imreadjpeg(files, 'resize', [64 48], 'uint8', 'pack', 'prefetch') ;
+ims_ = vl_imreadjpeg(files, 'resize', [64 48], 'uint8', 'pack') ;
+ims__ = vl_imreadjpeg(files, 'resize', [64 48], 'pack') ;
+assert(isa(ims_, 'uint8')) ;
+assert(max(abs(single(ims_(:)) - ims__(:))) <= 0.5 + 1e-3) ;
+
+% Test the image cache
+[ims_, stats] = vl_imreadjpeg(files, 'cacheSize', 1e9) ;
+[ims__, stats_] = vl_imreadjpeg(files) ;
+assert(isequal(ims, ims_, ims__)) ;
+assert(stats_.numHits - stats.numHits == numel(files)) ;
+assert(stats_.numImages == numel(files) && stats_.size <= stats_.capacity) ;
+ims_ = vl_imreadjpeg(files, aug{:}) ;
+ims__ = vl_imreadjpeg(files, aug{:}) ;
+assert(isequal(ims_, ims__)) ;
+[~, stats] = vl_imreadjpeg({}, 'cacheSize', 0) ;
+assert(stats.numImages == 0 && stats.size == 0) ;
+
+% Test prefetching several batches with handles
+ims_ = vl_imreadjpeg(files, 'resize', [64 48], 'pack') ;
+h1 = vl_imreadjpeg(files, 'prefetch', 'maxPrefetchSize', 1e9) ;
+h2 = vl_imreadjpeg(files, 'resize', [64 48], 'pack', 'prefetch') ;
+assert(isequal(vl_imreadjpeg(h2), ims_)) ;
+assert(isequal(vl_imreadjpeg(h1), ims)) ;
+h1 = vl_imreadjpeg(files, 'prefetch', 'maxPrefetchSize', 0) ;
+h2 = vl_imreadjpeg(files(1:2), 'prefetch') ;
+assert(isequal(vl_imreadjpeg(h2), ims(1:2))) ;
+discarded = false ;
+try
+  vl_imreadjpeg(h1) ;
+catch
+  discarded = true ;
+end
+assert(discarded) ;